@@ -22,7 +22,9 @@
 #include <algorithm>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 using std::string;
 
 #define __STDC_FORMAT_MACROS
@@ -41,6 +43,7 @@ using std::string;
 #include "lean/id-tuple.h"
 #include "lean/formats/cctdb.h"
 #include "lean/formats/metadb.h"
+#include "lean/formats/packed.h"
 #include "lean/formats/primitive.h"
 #include "lean/formats/profiledb.h"
 #include "lean/formats/tracedb.h"
@@ -179,7 +182,8 @@ Analysis::Raw::writeAsText_profiledb(const char* filenm, bool easygrep)
             " (pCtxIndices: 0x" << pi.valueBlock.pCtxIndices << ")\n"
           "    ]\n"
           "    (pIdTuple: 0x" << pi.pIdTuple << ")\n"
-          "    (isSummary: " << (pi.isSummary ? 1 : 0) << ")\n"
+          "    (isSummary: " << (pi.isSummary ? 1 : 0) << ")"
+            " (isPacked: " << (pi.isPacked ? 1 : 0) << ")\n"
           "  ]\n";
       }
       std::cout << "]\n" << std::dec;
@@ -248,38 +252,50 @@ Analysis::Raw::writeAsText_profiledb(const char* filenm, bool easygrep)
       if(fread(buf.data(), 1, buf.size(), fs) < buf.size())
         DIAG_Throw("eof reading profile.db profile data segment");
 
+      // Decode the values and context indices. For packed blocks, each
+      // startIndex is a byte offset to a packed array, convert to value indices
+      std::vector<fmt_profiledb_mVal_t> vals;
+      std::vector<fmt_profiledb_cIdx_t> idxs(psvb.nCtxs);
+      vals.reserve(psvb.nValues);
+      for(uint32_t i = 0; i < psvb.nCtxs; i++) {
+        fmt_profiledb_cIdx_read(&idxs[i], &buf[psvb.pCtxIndices - psvb.pValues + i * FMT_PROFILEDB_SZ_CIdx]);
+        if(!pi.isPacked) continue;
+        const char* cur = &buf[idxs[i].startIndex];
+        idxs[i].startIndex = vals.size();
+        uint64_t n;
+        cur += fmt_packed_count_read(&n, cur);
+        uint32_t prevId = 0;
+        for(uint64_t j = 0; j < n; j++) {
+          uint32_t id;
+          fmt_profiledb_mVal_t val;
+          cur += fmt_packed_entry_read(&id, &val.value, &prevId, cur);
+          val.metricId = id;
+          vals.push_back(val);
+        }
+      }
+      if(!pi.isPacked) {
+        vals.resize(psvb.nValues);
+        for(uint64_t i = 0; i < psvb.nValues; i++)
+          fmt_profiledb_mVal_read(&vals[i], &buf[i * FMT_PROFILEDB_SZ_MVal]);
+      }
+
       std::cout << std::hex << "(0x" << psvb.pValues << ") [profile data:\n" << std::dec;
       if(!easygrep) {
         std::cout << "  [metric-value pairs:\n";
-        for(uint64_t i = 0; i < psvb.nValues; i++) {
-          fmt_profiledb_mVal_t val;
-          fmt_profiledb_mVal_read(&val, &buf[i * FMT_PROFILEDB_SZ_MVal]);
-          std::cout << "    [" << i << "] (metric id: " << val.metricId << ", value: " << val.value << ")\n";
+        for(uint64_t i = 0; i < vals.size(); i++) {
+          std::cout << "    [" << i << "] (metric id: " << vals[i].metricId << ", value: " << vals[i].value << ")\n";
         }
         std::cout << "  ]\n  [context-index pairs:\n";
-        for(uint32_t i = 0; i < psvb.nCtxs; i++) {
-          fmt_profiledb_cIdx_t idx;
-          fmt_profiledb_cIdx_read(&idx, &buf[psvb.pCtxIndices - psvb.pValues + i * FMT_PROFILEDB_SZ_CIdx]);
+        for(const auto& idx: idxs) {
           std::cout << "    (ctx id: " << idx.ctxId << ", index: " << idx.startIndex << ")\n";
         }
         std::cout << "  ]\n";
-      } else if(psvb.nCtxs > 0) {
-        fmt_profiledb_cIdx_t idx;
-        fmt_profiledb_cIdx_read(&idx, &buf[psvb.pCtxIndices - psvb.pValues]);
-        for(uint32_t i = 1; i <= psvb.nCtxs; i++) {
-          std::cout << "  (ctx id: " << idx.ctxId << ")";
-
-          uint64_t startIndex = idx.startIndex;
-          uint64_t endIndex = psvb.nValues;
-          if(i < psvb.nCtxs) {
-            fmt_profiledb_cIdx_read(&idx, &buf[psvb.pCtxIndices - psvb.pValues + i * FMT_PROFILEDB_SZ_CIdx]);
-            endIndex = idx.startIndex;
-          }
-
-          for(uint64_t j = startIndex; j < endIndex; j++) {
-            fmt_profiledb_mVal_t val;
-            fmt_profiledb_mVal_read(&val, &buf[j * FMT_PROFILEDB_SZ_MVal]);
-            std::cout << " (metric id: " << val.metricId << ", value: " << val.value << ")";
+      } else {
+        for(size_t i = 0; i < idxs.size(); i++) {
+          std::cout << "  (ctx id: " << idxs[i].ctxId << ")";
+          uint64_t endIndex = i + 1 < idxs.size() ? idxs[i+1].startIndex : vals.size();
+          for(uint64_t j = idxs[i].startIndex; j < endIndex; j++) {
+            std::cout << " (metric id: " << vals[j].metricId << ", value: " << vals[j].value << ")";
           }
           std::cout << "\n";
         }
@@ -386,6 +402,7 @@ Analysis::Raw::writeAsText_cctdb(const char* filenm, bool easygrep)
             " (pValues: 0x" << ci.valueBlock.pValues << ")\n"
           "      (nMetrics: " << std::dec << ci.valueBlock.nMetrics << std::hex << ")"
             " (pMetricIndices: 0x" << ci.valueBlock.pMetricIndices << ")\n"
+          "      (isPacked: " << (ci.valueBlock.isPacked ? 1 : 0) << ")\n"
           "    ]\n"
           "  ]\n";
       }
@@ -411,38 +428,48 @@ Analysis::Raw::writeAsText_cctdb(const char* filenm, bool easygrep)
       if(fread(buf.data(), 1, buf.size(), fs) < buf.size())
         DIAG_Throw("eof reading cct.db context data segment");
 
+      // Decode the values and metric indices. For packed blocks, each
+      // startIndex is a byte offset to a packed array, convert to value indices
+      std::vector<fmt_cctdb_pVal_t> vals;
+      std::vector<fmt_cctdb_mIdx_t> idxs(csvb.nMetrics);
+      vals.reserve(csvb.nValues);
+      for(uint16_t i = 0; i < csvb.nMetrics; i++) {
+        fmt_cctdb_mIdx_read(&idxs[i], &buf[csvb.pMetricIndices - csvb.pValues + i * FMT_CCTDB_SZ_MIdx]);
+        if(!csvb.isPacked) continue;
+        const char* cur = &buf[idxs[i].startIndex];
+        idxs[i].startIndex = vals.size();
+        uint64_t n;
+        cur += fmt_packed_count_read(&n, cur);
+        uint32_t prevId = 0;
+        for(uint64_t j = 0; j < n; j++) {
+          fmt_cctdb_pVal_t val;
+          cur += fmt_packed_entry_read(&val.profIndex, &val.value, &prevId, cur);
+          vals.push_back(val);
+        }
+      }
+      if(!csvb.isPacked) {
+        vals.resize(csvb.nValues);
+        for(uint64_t i = 0; i < csvb.nValues; i++)
+          fmt_cctdb_pVal_read(&vals[i], &buf[i * FMT_CCTDB_SZ_PVal]);
+      }
+
       std::cout << std::hex << "(0x" << csvb.pValues << ") [context data:\n" << std::dec;
       if(!easygrep) {
         std::cout << "  [profile-value pairs:\n";
-        for(uint64_t i = 0; i < csvb.nValues; i++) {
-          fmt_cctdb_pVal_t val;
-          fmt_cctdb_pVal_read(&val, &buf[i * FMT_CCTDB_SZ_PVal]);
-          std::cout << "    [" << i << "] (profile index: " << val.profIndex << ", value: " << val.value << ")\n";
+        for(uint64_t i = 0; i < vals.size(); i++) {
+          std::cout << "    [" << i << "] (profile index: " << vals[i].profIndex << ", value: " << vals[i].value << ")\n";
         }
         std::cout << "  ]\n  [metric-index pairs:\n";
-        for(uint16_t i = 0; i < csvb.nMetrics; i++) {
-          fmt_cctdb_mIdx_t idx;
-          fmt_cctdb_mIdx_read(&idx, &buf[csvb.pMetricIndices - csvb.pValues + i * FMT_CCTDB_SZ_MIdx]);
+        for(const auto& idx: idxs) {
           std::cout << "    (metric id: " << idx.metricId << ", index: " << idx.startIndex << ")\n";
         }
         std::cout << "  ]\n";
-      } else if(csvb.nMetrics > 0) {
-        fmt_cctdb_mIdx_t idx;
-        fmt_cctdb_mIdx_read(&idx, &buf[csvb.pMetricIndices - csvb.pValues]);
-        for(uint16_t i = 1; i <= csvb.nMetrics; i++) {
-          std::cout << "  (metric id: " << idx.metricId << ")";
-
-          uint64_t startIndex = idx.startIndex;
-          uint64_t endIndex = csvb.nValues;
-          if(i < csvb.nMetrics) {
-            fmt_cctdb_mIdx_read(&idx, &buf[csvb.pMetricIndices - csvb.pValues + i * FMT_CCTDB_SZ_MIdx]);
-            endIndex = idx.startIndex;
-          }
-
-          for(uint64_t j = startIndex; j < endIndex; j++) {
-            fmt_cctdb_pVal_t val;
-            fmt_cctdb_pVal_read(&val, &buf[j * FMT_CCTDB_SZ_PVal]);
-            std::cout << " (profile index: " << val.profIndex << ", value: " << val.value << ")";
+      } else {
+        for(size_t i = 0; i < idxs.size(); i++) {
+          std::cout << "  (metric id: " << idxs[i].metricId << ")";
+          uint64_t endIndex = i + 1 < idxs.size() ? idxs[i+1].startIndex : vals.size();
+          for(uint64_t j = idxs[i].startIndex; j < endIndex; j++) {
+            std::cout << " (profile index: " << vals[j].profIndex << ", value: " << vals[j].value << ")";
           }
           std::cout << "\n";
         }
@@ -483,11 +510,11 @@ Analysis::Raw::writeAsText_tracedb(const char* filenm)
       DIAG_Throw("error opening trace.db file '" << filenm << "'");
     }
 
+    uint8_t minor;
     {
       char buf[16];
       if(fread(buf, 1, sizeof buf, fs) < sizeof buf)
         DIAG_Throw("eof/error reading trace.db format header");
-      uint8_t minor;
       auto ver = fmt_tracedb_check(buf, &minor);
       switch(ver) {
       case fmt_version_invalid:
@@ -513,13 +540,19 @@ Analysis::Raw::writeAsText_tracedb(const char* filenm)
     fmt_tracedb_fHdr_t fhdr;
     { // trace.db file header
       rewind(fs);
-      char buf[FMT_CCTDB_SZ_FHdr];
+      char buf[FMT_TRACEDB_SZ_FHdr];
       if(fread(buf, 1, sizeof buf, fs) < sizeof buf)
-        DIAG_Throw("eof reading cct.db file header");
+        DIAG_Throw("eof reading trace.db file header");
       fmt_tracedb_fHdr_read(&fhdr, buf);
+      if(minor < 1) {
+        // The Context Trace Levels section was added in v4.1
+        fhdr.szCtxTraceLevels = 0;
+        fhdr.pCtxTraceLevels = 0;
+      }
       std::cout << std::hex <<
         "[file header:\n"
         "  (szCtxTraces: 0x" << fhdr.szCtxTraces << ") (pCtxTraces: 0x" << fhdr.pCtxTraces << ")\n"
+        "  (szCtxTraceLevels: 0x" << fhdr.szCtxTraceLevels << ") (pCtxTraceLevels: 0x" << fhdr.pCtxTraceLevels << ")\n"
         "]\n" << std::dec;
     }
 
@@ -551,7 +584,51 @@ Analysis::Raw::writeAsText_tracedb(const char* filenm)
       std::cout << "]\n" << std::dec;
     }
 
-    // Rest of the file is context traces. Output is in file order.
+    std::vector<std::vector<fmt_tracedb_ctxLevel_t>> ctxLevels;
+    if(fhdr.szCtxTraceLevels > 0) { // Context Trace Levels section
+      if(fseeko(fs, fhdr.pCtxTraceLevels, SEEK_SET) < 0)
+        DIAG_Throw("error seeking to trace.db Context Trace Levels section");
+      std::vector<char> buf(fhdr.szCtxTraceLevels);
+      if(fread(buf.data(), 1, buf.size(), fs) < buf.size())
+        DIAG_Throw("eof reading trace.db Context Trace Levels section");
+
+      fmt_tracedb_ctxLevelsSHdr_t shdr;
+      fmt_tracedb_ctxLevelsSHdr_read(&shdr, buf.data());
+      std::cout << std::hex <<
+        "[context trace levels:\n"
+        "  (pTraces: 0x" << shdr.pTraces << ") (nTraces: " << std::dec << shdr.nTraces << std::hex << ")\n"
+        "  (szTrace: 0x" << (unsigned int)shdr.szTrace << " >= 0x" << FMT_TRACEDB_SZ_CtxLevels << ")\n"
+        "  (log2Fanout: " << std::dec << (unsigned int)shdr.log2Fanout << ")\n";
+      for(uint32_t i = 0; i < shdr.nTraces; i++) {
+        fmt_tracedb_ctxLevels_t ctl;
+        fmt_tracedb_ctxLevels_read(&ctl, &buf[shdr.pTraces + i * shdr.szTrace - fhdr.pCtxTraceLevels]);
+        std::cout << "  [pTraces[" << std::dec << i << "]:\n" << std::hex <<
+          "    (pLevels: 0x" << ctl.pLevels << ") (nLevels: " << std::dec << (unsigned int)ctl.nLevels << ")\n";
+        std::vector<fmt_tracedb_ctxLevel_t> levels(ctl.nLevels);
+        if(ctl.nLevels > 0) {
+          std::vector<char> lbuf(ctl.nLevels * FMT_TRACEDB_SZ_CtxLevel);
+          if(fseeko(fs, ctl.pLevels, SEEK_SET) < 0)
+            DIAG_Throw("error seeking to trace.db context trace levels");
+          if(fread(lbuf.data(), 1, lbuf.size(), fs) < lbuf.size())
+            DIAG_Throw("eof reading trace.db context trace levels");
+          for(unsigned int l = 0; l < ctl.nLevels; l++) {
+            fmt_tracedb_ctxLevel_read(&levels[l], &lbuf[l * FMT_TRACEDB_SZ_CtxLevel]);
+            std::cout << "    [pLevels[" << std::dec << l << "]: " << std::hex <<
+              "(pStart: 0x" << levels[l].pStart << ") (pEnd: 0x" << levels[l].pEnd << ")]\n";
+          }
+        }
+        ctxLevels.push_back(std::move(levels));
+        std::cout << "  ]\n";
+      }
+      std::cout << "]\n" << std::dec;
+    }
+
+    // Rest of the file is context traces and their summary levels. Output is
+    // in file order.
+    for(const auto& levels: ctxLevels) {
+      for(const auto& tl: levels)
+        ctxTraces.push_back({0, tl.pStart, tl.pEnd});
+    }
     std::sort(ctxTraces.begin(), ctxTraces.end(), [](const auto& a, const auto& b){
       return a.pStart < b.pStart;
     });
@@ -1051,10 +1128,16 @@ Analysis::Raw::writeAsText_callpathTrace(const char* filenm)
 
     hpctrace_fmt_hdr_fprint(&hdr, stdout);
 
-    // Read trace records and exit on EOF
-    while ( !feof(fs) ) {
+    bool packed = HPCTRACE_HDR_FLAGS_GET_BIT(hdr.flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS);
+    std::unique_ptr<hpctrace_fmt_packed_t> pstate(new hpctrace_fmt_packed_t);
+    hpctrace_fmt_packed_init(pstate.get());
+
+    // Read trace records and exit on EOF. Packed records may still be
+    // buffered after the end of the file has been reached.
+    while ( pstate->nSamples > 0 || !feof(fs) ) {
       hpctrace_fmt_datum_t datum;
-      ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, fs);
+      ret = packed ? hpctrace_fmt_packed_datum_fread(&datum, hdr.flags, pstate.get(), fs)
+                   : hpctrace_fmt_datum_fread(&datum, hdr.flags, fs);
       if (ret == HPCFMT_EOF) {
         break;
       }
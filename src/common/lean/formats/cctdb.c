@@ -65,6 +65,7 @@ void fmt_cctdb_ctxInfo_read(fmt_cctdb_ctxInfo_t* ci, const char d[FMT_CCTDB_SZ_C
   ci->valueBlock.nValues = fmt_u64_read(d+0x00);
   ci->valueBlock.pValues = fmt_u64_read(d+0x08);
   ci->valueBlock.nMetrics = fmt_u16_read(d+0x10);
+  ci->valueBlock.isPacked = (d[0x12] & 0x1) != 0;
   ci->valueBlock.pMetricIndices = fmt_u64_read(d+0x18);
 }
 void fmt_cctdb_ctxInfo_write(char d[FMT_CCTDB_SZ_CtxInfo], const fmt_cctdb_ctxInfo_t* ci) {
@@ -72,6 +73,7 @@ void fmt_cctdb_ctxInfo_write(char d[FMT_CCTDB_SZ_CtxInfo], const fmt_cctdb_ctxIn
   fmt_u64_write(d+0x08, ci->valueBlock.pValues);
   fmt_u16_write(d+0x10, ci->valueBlock.nMetrics);
   memset(d+0x12, 0, 6);
+  d[0x12] = ci->valueBlock.isPacked ? 0x1 : 0;
   fmt_u64_write(d+0x18, ci->valueBlock.pMetricIndices);
   memset(d+0x20, 0, FMT_CCTDB_SZ_CtxInfo - 0x20);
 }
@@ -24,7 +24,7 @@ extern "C" {
 #endif
 
 /// Minor version of the cct.db format implemented here
-enum { FMT_CCTDB_MinorVersion = 0 };
+enum { FMT_CCTDB_MinorVersion = 1 };
 
 /// Check the given file start bytes for the cct.db format.
 /// If minorVer != NULL, also returns the exact minor version.
@@ -76,6 +76,9 @@ typedef struct fmt_cctdb_ctxInfo_t {
     uint64_t nValues;
     uint64_t pValues;
     uint16_t nMetrics;
+    // If set, pValues is a series of packed arrays (see packed.h), one per
+    // metric, and {Idx} startIndex is a byte offset from pValues.
+    bool isPacked : 1;
     uint64_t pMetricIndices;
   } valueBlock;
 } fmt_cctdb_ctxInfo_t;
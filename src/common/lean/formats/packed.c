@@ -0,0 +1,117 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+//***************************************************************************
+//
+// Purpose:
+//   Low-level functions for the packed encoding of sparse value arrays
+//
+//   See packed.h.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "packed.h"
+
+#include "primitive.h"
+
+#include <string.h>
+
+// Value kinds, stored in the low 2 bits of an entry's header
+enum {
+  tag_zero = 0,    // +0.0, no payload
+  tag_posint = 1,  // Non-negative integer, payload is the varint value
+  tag_negint = 2,  // Negative integer, payload is the varint negated value
+  tag_raw = 3,     // Anything else, payload is the f64
+};
+
+// Largest integer magnitude that is stored as a varint. Every integer below
+// this is exactly representable as a double, and encodes in at most 8 bytes.
+static const double int_limit = 9007199254740992.0;  // 2^53
+
+static size_t varint_write(char* d, uint64_t v) {
+  size_t n = 0;
+  while(v >= 0x80) {
+    d[n++] = (char)(v | 0x80);
+    v >>= 7;
+  }
+  d[n++] = (char)v;
+  return n;
+}
+
+static size_t varint_read(uint64_t* v, const char* d) {
+  uint64_t out = 0;
+  size_t n = 0;
+  unsigned int shift = 0;
+  uint8_t b;
+  do {
+    b = (uint8_t)d[n++];
+    out |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while((b & 0x80) && shift < 64);
+  *v = out;
+  return n;
+}
+
+size_t fmt_packed_count_write(char d[FMT_PACKED_SZ_MaxCount], uint64_t count) {
+  return varint_write(d, count);
+}
+size_t fmt_packed_count_read(uint64_t* count, const char* d) {
+  return varint_read(count, d);
+}
+
+size_t fmt_packed_entry_write(char d[FMT_PACKED_SZ_MaxEntry], uint32_t* prevId,
+                              uint32_t id, double value) {
+  // Ids are stored as zigzagged deltas from the previous entry
+  int64_t delta = (int64_t)id - (int64_t)*prevId;
+  uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  *prevId = id;
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof bits);
+  if(bits == 0)
+    return varint_write(d, zz << 2 | tag_zero);
+  if(value > 0 && value < int_limit && (double)(uint64_t)value == value) {
+    size_t n = varint_write(d, zz << 2 | tag_posint);
+    return n + varint_write(d + n, (uint64_t)value);
+  }
+  if(value < 0 && -value < int_limit && (double)(uint64_t)-value == -value) {
+    size_t n = varint_write(d, zz << 2 | tag_negint);
+    return n + varint_write(d + n, (uint64_t)-value);
+  }
+  size_t n = varint_write(d, zz << 2 | tag_raw);
+  fmt_f64_write(d + n, value);
+  return n + 8;
+}
+
+size_t fmt_packed_entry_read(uint32_t* id, double* value, uint32_t* prevId,
+                             const char* d) {
+  uint64_t hdr;
+  size_t n = varint_read(&hdr, d);
+  uint64_t zz = hdr >> 2;
+  int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+  *id = *prevId = (uint32_t)((int64_t)*prevId + delta);
+
+  uint64_t v;
+  switch(hdr & 0x3) {
+  case tag_zero:
+    *value = 0;
+    return n;
+  case tag_posint:
+    n += varint_read(&v, d + n);
+    *value = (double)v;
+    return n;
+  case tag_negint:
+    n += varint_read(&v, d + n);
+    *value = -(double)v;
+    return n;
+  default:
+    *value = fmt_f64_read(d + n);
+    return n + 8;
+  }
+}
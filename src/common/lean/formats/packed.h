@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+//***************************************************************************
+//
+// Purpose:
+//   Low-level functions for the packed encoding of sparse value arrays
+//
+//   Packed arrays are an optional, more compact replacement for the fixed-width
+//   {Val} arrays in profile.db and cct.db. See doc/FORMATS.md.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef FORMATS_PACKED_H
+#define FORMATS_PACKED_H
+
+#include "common.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/// Maximum size of a packed entry count in serialized form
+enum { FMT_PACKED_SZ_MaxCount = 10 };
+
+/// Maximum size of a single packed id-value entry in serialized form
+enum { FMT_PACKED_SZ_MaxEntry = 13 };
+
+/// Maximum size of a packed array of n entries, including the leading count
+#define FMT_PACKED_SZ_Max(n) (FMT_PACKED_SZ_MaxCount + (n) * FMT_PACKED_SZ_MaxEntry)
+
+/// Write the number of entries that start a packed array. Returns the number
+/// of bytes written.
+size_t fmt_packed_count_write(char[FMT_PACKED_SZ_MaxCount], uint64_t count);
+
+/// Read the number of entries that start a packed array. Returns the number
+/// of bytes read.
+size_t fmt_packed_count_read(uint64_t* count, const char*);
+
+/// Write a single id-value entry. `*prevId` is the id of the previous entry
+/// in the array (0 for the first) and is updated to `id`. Returns the number
+/// of bytes written.
+size_t fmt_packed_entry_write(char[FMT_PACKED_SZ_MaxEntry], uint32_t* prevId,
+                              uint32_t id, double value);
+
+/// Read a single id-value entry. `*prevId` is handled as for
+/// fmt_packed_entry_write. Returns the number of bytes read.
+size_t fmt_packed_entry_read(uint32_t* id, double* value, uint32_t* prevId,
+                             const char*);
+
+#if defined(__cplusplus)
+}  // extern "C"
+#endif
+
+#endif  // FORMATS_PACKED_H
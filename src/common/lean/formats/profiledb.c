@@ -73,6 +73,7 @@ void fmt_profiledb_profInfo_read(fmt_profiledb_profInfo_t* pi, const char d[FMT_
   pi->pIdTuple = fmt_u64_read(d+0x20);
   uint32_t flags = fmt_u32_read(d+0x28);
   pi->isSummary = (flags & 0x1) != 0;
+  pi->isPacked = (flags & 0x2) != 0;
 }
 void fmt_profiledb_profInfo_write(char d[FMT_PROFILEDB_SZ_ProfInfo], const fmt_profiledb_profInfo_t* pi) {
   fmt_u64_write(d+0x00, pi->valueBlock.nValues);
@@ -82,6 +83,7 @@ void fmt_profiledb_profInfo_write(char d[FMT_PROFILEDB_SZ_ProfInfo], const fmt_p
   fmt_u64_write(d+0x18, pi->valueBlock.pCtxIndices);
   fmt_u64_write(d+0x20, pi->pIdTuple);
   fmt_u32_write(d+0x28, (pi->isSummary ? 0x1 : 0) |
+                        (pi->isPacked ? 0x2 : 0) |
                         0);
   memset(d+0x2c, 0, FMT_PROFILEDB_SZ_ProfInfo - 0x2c);
 }
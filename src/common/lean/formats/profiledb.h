@@ -24,7 +24,7 @@ extern "C" {
 #endif
 
 /// Minor version of the profile.db format implemented here
-enum { FMT_PROFILEDB_MinorVersion = 0 };
+enum { FMT_PROFILEDB_MinorVersion = 1 };
 
 /// Check the given file start bytes for the profile.db format.
 /// If minorVer != NULL, also returns the exact minor version.
@@ -83,6 +83,9 @@ typedef struct fmt_profiledb_profInfo_t {
   } valueBlock;
   uint64_t pIdTuple;
   bool isSummary : 1;
+  // If set, pValues is a series of packed arrays (see packed.h), one per
+  // context, and {Idx} startIndex is a byte offset from pValues.
+  bool isPacked : 1;
 } fmt_profiledb_profInfo_t;
 
 void fmt_profiledb_profInfo_read(fmt_profiledb_profInfo_t*, const char[FMT_PROFILEDB_SZ_ProfInfo]);
@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+//***************************************************************************
+//
+// Purpose:
+//   Low-level types and functions for reading/writing Structfile indices
+//
+//   See structidx.h.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "structidx.h"
+
+#include "primitive.h"
+
+#include <string.h>
+
+static_assert('a' == 0x61, "Byte encoding isn't ASCII?");
+static const char fmt_structidx_magic[14] = "HPCTOOLKITstix";
+const char fmt_structidx_footer[8] = "_stix.db";
+
+enum fmt_version_t fmt_structidx_check(const char hdr[16], uint8_t* minorVer) {
+  if(memcmp(hdr, fmt_structidx_magic, sizeof fmt_structidx_magic) != 0)
+    return fmt_version_invalid;
+  if(hdr[0xe] != FMT_DB_MajorVersion)
+    return fmt_version_major;
+  if(minorVer != NULL) *minorVer = hdr[0xf];
+  if(hdr[0xf] < FMT_STRUCTIDX_MinorVersion)
+    return fmt_version_backward;
+  return hdr[0xf] > FMT_STRUCTIDX_MinorVersion
+         ? fmt_version_forward : fmt_version_exact;
+}
+
+void fmt_structidx_fHdr_read(fmt_structidx_fHdr_t* hdr, const char d[FMT_STRUCTIDX_SZ_FHdr]) {
+  hdr->pModules = fmt_u64_read(d+0x10);
+  hdr->nModules = fmt_u32_read(d+0x18);
+  hdr->szModule = fmt_u16_read(d+0x1c);
+}
+void fmt_structidx_fHdr_write(char d[FMT_STRUCTIDX_SZ_FHdr], const fmt_structidx_fHdr_t* hdr) {
+  memcpy(d, fmt_structidx_magic, sizeof fmt_structidx_magic);
+  d[0x0e] = FMT_DB_MajorVersion;
+  d[0x0f] = FMT_STRUCTIDX_MinorVersion;
+  fmt_u64_write(d+0x10, hdr->pModules);
+  fmt_u32_write(d+0x18, hdr->nModules);
+  fmt_u16_write(d+0x1c, FMT_STRUCTIDX_SZ_Module);
+  memset(d+0x1e, 0, 2);
+}
+
+void fmt_structidx_module_read(fmt_structidx_module_t* lm, const char d[FMT_STRUCTIDX_SZ_Module]) {
+  lm->pPath      = fmt_u64_read(d+0x00);
+  lm->pFunctions = fmt_u64_read(d+0x08);
+  lm->pScopes    = fmt_u64_read(d+0x10);
+  lm->pLeaves    = fmt_u64_read(d+0x18);
+  lm->pCalls     = fmt_u64_read(d+0x20);
+  lm->nFunctions = fmt_u32_read(d+0x28);
+  lm->nScopes    = fmt_u32_read(d+0x2c);
+  lm->nLeaves    = fmt_u32_read(d+0x30);
+  lm->nCalls     = fmt_u32_read(d+0x34);
+  lm->hasCalls = d[0x38] & 0x1;
+}
+void fmt_structidx_module_write(char d[FMT_STRUCTIDX_SZ_Module], const fmt_structidx_module_t* lm) {
+  fmt_u64_write(d+0x00, lm->pPath);
+  fmt_u64_write(d+0x08, lm->pFunctions);
+  fmt_u64_write(d+0x10, lm->pScopes);
+  fmt_u64_write(d+0x18, lm->pLeaves);
+  fmt_u64_write(d+0x20, lm->pCalls);
+  fmt_u32_write(d+0x28, lm->nFunctions);
+  fmt_u32_write(d+0x2c, lm->nScopes);
+  fmt_u32_write(d+0x30, lm->nLeaves);
+  fmt_u32_write(d+0x34, lm->nCalls);
+  memset(d+0x38, 0, 8);
+  d[0x38] = lm->hasCalls ? 0x1 : 0;
+}
+
+void fmt_structidx_function_read(fmt_structidx_function_t* fn, const char d[FMT_STRUCTIDX_SZ_Function]) {
+  fn->pName = fmt_u64_read(d+0x00);
+  fn->entry = fmt_u64_read(d+0x08);
+  fn->pFile = fmt_u64_read(d+0x10);
+  fn->line  = fmt_u32_read(d+0x18);
+  fn->hasEntry = d[0x1c] & 0x1;
+}
+void fmt_structidx_function_write(char d[FMT_STRUCTIDX_SZ_Function], const fmt_structidx_function_t* fn) {
+  fmt_u64_write(d+0x00, fn->pName);
+  fmt_u64_write(d+0x08, fn->entry);
+  fmt_u64_write(d+0x10, fn->pFile);
+  fmt_u32_write(d+0x18, fn->line);
+  memset(d+0x1c, 0, 4);
+  d[0x1c] = fn->hasEntry ? 0x1 : 0;
+}
+
+void fmt_structidx_scope_read(fmt_structidx_scope_t* sc, const char d[FMT_STRUCTIDX_SZ_Scope]) {
+  sc->addr     = fmt_u64_read(d+0x00);
+  sc->pFile    = fmt_u64_read(d+0x08);
+  sc->parent   = fmt_u32_read(d+0x10);
+  sc->function = fmt_u32_read(d+0x14);
+  sc->line     = fmt_u32_read(d+0x18);
+  sc->kind     = d[0x1c];
+  sc->relation = d[0x1d];
+}
+void fmt_structidx_scope_write(char d[FMT_STRUCTIDX_SZ_Scope], const fmt_structidx_scope_t* sc) {
+  fmt_u64_write(d+0x00, sc->addr);
+  fmt_u64_write(d+0x08, sc->pFile);
+  fmt_u32_write(d+0x10, sc->parent);
+  fmt_u32_write(d+0x14, sc->function);
+  fmt_u32_write(d+0x18, sc->line);
+  d[0x1c] = sc->kind;
+  d[0x1d] = sc->relation;
+  memset(d+0x1e, 0, 2);
+}
+
+void fmt_structidx_leaf_read(fmt_structidx_leaf_t* lf, const char d[FMT_STRUCTIDX_SZ_Leaf]) {
+  lf->begin    = fmt_u64_read(d+0x00);
+  lf->end      = fmt_u64_read(d+0x08);
+  lf->scope    = fmt_u32_read(d+0x10);
+  lf->function = fmt_u32_read(d+0x14);
+}
+void fmt_structidx_leaf_write(char d[FMT_STRUCTIDX_SZ_Leaf], const fmt_structidx_leaf_t* lf) {
+  fmt_u64_write(d+0x00, lf->begin);
+  fmt_u64_write(d+0x08, lf->end);
+  fmt_u32_write(d+0x10, lf->scope);
+  fmt_u32_write(d+0x14, lf->function);
+}
+
+void fmt_structidx_call_read(fmt_structidx_call_t* c, const char d[FMT_STRUCTIDX_SZ_Call]) {
+  c->callee     = fmt_u64_read(d+0x00);
+  c->callerInst = fmt_u64_read(d+0x08);
+  c->caller     = fmt_u32_read(d+0x10);
+}
+void fmt_structidx_call_write(char d[FMT_STRUCTIDX_SZ_Call], const fmt_structidx_call_t* c) {
+  fmt_u64_write(d+0x00, c->callee);
+  fmt_u64_write(d+0x08, c->callerInst);
+  fmt_u32_write(d+0x10, c->caller);
+}
+
+int64_t fmt_structidx_leaf_find(const char* leaves, uint32_t nLeaves, uint64_t addr) {
+  // Find the last Leaf starting at or before addr, then check that it covers addr
+  uint32_t lo = 0, hi = nLeaves;
+  while(lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if(fmt_u64_read(leaves + (size_t)mid * FMT_STRUCTIDX_SZ_Leaf) <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(lo == 0) return -1;
+  if(addr >= fmt_u64_read(leaves + (size_t)(lo-1) * FMT_STRUCTIDX_SZ_Leaf + 0x08))
+    return -1;
+  return lo - 1;
+}
@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+//***************************************************************************
+//
+// Purpose:
+//   Low-level types and functions for reading/writing Structfile indices
+//
+//   A Structfile index (*.hpcstruct.idx) is an optional binary companion to
+//   an hpcstruct XML file, containing the same data pre-digested for
+//   hpcprof's StructFile finalizer. All pointers (p*) are absolute offsets
+//   from the start of the file, strings are NUL-terminated. For each Load
+//   Module the file contains:
+//    - A table of Functions ({SF}), referenced by index,
+//    - A table of nested Scopes ({SS}), where each Scope references its
+//      parent (index+1, or 0 for top-level Scopes) which always precedes it,
+//    - A table of Leaves ({SL}) mapping address ranges to the innermost Scope
+//      and enclosing top-level Function. These are sorted by start address
+//      and do not overlap, so they can be binary-searched in-place.
+//    - A table of call edges ({SC}), from caller instruction to callee entry.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef FORMATS_STRUCTIDX_H
+#define FORMATS_STRUCTIDX_H
+
+#include "common.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/// Minor version of the Structfile index format implemented here
+enum { FMT_STRUCTIDX_MinorVersion = 0 };
+
+/// Check the given file start bytes for the Structfile index format.
+/// If minorVer != NULL, also returns the exact minor version.
+enum fmt_version_t fmt_structidx_check(const char[16], uint8_t* minorVer);
+
+/// Footer byte sequence for Structfile index files.
+extern const char fmt_structidx_footer[8];
+
+//
+// Structfile index file
+//
+
+/// Size of the Structfile index file header in serialized form
+enum { FMT_STRUCTIDX_SZ_FHdr = 0x20 };
+
+/// Structfile index file header
+typedef struct fmt_structidx_fHdr_t {
+  // NOTE: magic and versions are constant and cannot be adjusted
+  uint64_t pModules;
+  uint32_t nModules;
+  // NOTE: The following member is ignored on write
+  uint16_t szModule;
+} fmt_structidx_fHdr_t;
+
+void fmt_structidx_fHdr_read(fmt_structidx_fHdr_t*, const char[FMT_STRUCTIDX_SZ_FHdr]);
+void fmt_structidx_fHdr_write(char[FMT_STRUCTIDX_SZ_FHdr], const fmt_structidx_fHdr_t*);
+
+// Load Module structure {SM}
+enum { FMT_STRUCTIDX_SZ_Module = 0x40 };
+typedef struct fmt_structidx_module_t {
+  uint64_t pPath;
+  uint64_t pFunctions;
+  uint64_t pScopes;
+  uint64_t pLeaves;
+  uint64_t pCalls;
+  uint32_t nFunctions;
+  uint32_t nScopes;
+  uint32_t nLeaves;
+  uint32_t nCalls;
+  bool hasCalls;
+} fmt_structidx_module_t;
+
+void fmt_structidx_module_read(fmt_structidx_module_t*, const char[FMT_STRUCTIDX_SZ_Module]);
+void fmt_structidx_module_write(char[FMT_STRUCTIDX_SZ_Module], const fmt_structidx_module_t*);
+
+// Function structure {SF}
+enum { FMT_STRUCTIDX_SZ_Function = 0x20 };
+typedef struct fmt_structidx_function_t {
+  uint64_t pName;
+  uint64_t entry;
+  uint64_t pFile;  // 0 if no File is known
+  uint32_t line;
+  bool hasEntry;
+} fmt_structidx_function_t;
+
+void fmt_structidx_function_read(fmt_structidx_function_t*, const char[FMT_STRUCTIDX_SZ_Function]);
+void fmt_structidx_function_write(char[FMT_STRUCTIDX_SZ_Function], const fmt_structidx_function_t*);
+
+/// Types of nested Scopes in a Structfile index
+enum fmt_structidx_scope_kind_t {
+  /// Function body, references a {SF}
+  fmt_structidx_scope_function = 0,
+  /// Binary loop, with a header address, file and line
+  fmt_structidx_scope_loop = 1,
+  /// Source line, with a file and line
+  fmt_structidx_scope_line = 2,
+};
+
+/// Relations between a Scope and its parent in a Structfile index
+enum fmt_structidx_relation_t {
+  fmt_structidx_relation_enclosure = 0,
+  fmt_structidx_relation_inlined_call = 1,
+};
+
+// Scope structure {SS}
+enum { FMT_STRUCTIDX_SZ_Scope = 0x20 };
+typedef struct fmt_structidx_scope_t {
+  uint64_t addr;  // Loop header address, for loops only
+  uint64_t pFile;  // For loops and lines only
+  uint32_t parent;  // Index+1 of the parent Scope, 0 for top-level Scopes
+  uint32_t function;  // Index of the Function, for functions only
+  uint32_t line;  // For loops and lines only
+  uint8_t kind;  // enum fmt_structidx_scope_kind_t
+  uint8_t relation;  // enum fmt_structidx_relation_t
+} fmt_structidx_scope_t;
+
+void fmt_structidx_scope_read(fmt_structidx_scope_t*, const char[FMT_STRUCTIDX_SZ_Scope]);
+void fmt_structidx_scope_write(char[FMT_STRUCTIDX_SZ_Scope], const fmt_structidx_scope_t*);
+
+// Leaf structure {SL}
+enum { FMT_STRUCTIDX_SZ_Leaf = 0x18 };
+typedef struct fmt_structidx_leaf_t {
+  uint64_t begin;
+  uint64_t end;
+  uint32_t scope;  // Index of the innermost Scope
+  uint32_t function;  // Index of the enclosing top-level Function
+} fmt_structidx_leaf_t;
+
+void fmt_structidx_leaf_read(fmt_structidx_leaf_t*, const char[FMT_STRUCTIDX_SZ_Leaf]);
+void fmt_structidx_leaf_write(char[FMT_STRUCTIDX_SZ_Leaf], const fmt_structidx_leaf_t*);
+
+// Call edge structure {SC}
+enum { FMT_STRUCTIDX_SZ_Call = 0x14 };
+typedef struct fmt_structidx_call_t {
+  uint64_t callee;  // Entry address of the callee Function
+  uint64_t callerInst;
+  uint32_t caller;  // Index of the caller's top-level Function
+} fmt_structidx_call_t;
+
+void fmt_structidx_call_read(fmt_structidx_call_t*, const char[FMT_STRUCTIDX_SZ_Call]);
+void fmt_structidx_call_write(char[FMT_STRUCTIDX_SZ_Call], const fmt_structidx_call_t*);
+
+/// Binary-search a sorted table of nLeaves {SL} for the one containing addr.
+/// Returns the index of the Leaf, or -1 if no Leaf contains addr.
+int64_t fmt_structidx_leaf_find(const char* leaves, uint32_t nLeaves, uint64_t addr);
+
+#if defined(__cplusplus)
+}  // extern "C"
+#endif
+
+#endif // FORMATS_STRUCTIDX_H
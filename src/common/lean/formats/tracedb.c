@@ -41,6 +41,8 @@ enum fmt_version_t fmt_tracedb_check(const char hdr[16], uint8_t* minorVer) {
 void fmt_tracedb_fHdr_read(fmt_tracedb_fHdr_t* hdr, const char d[FMT_TRACEDB_SZ_FHdr]) {
   hdr->szCtxTraces = fmt_u64_read(d+0x10);
   hdr->pCtxTraces = fmt_u64_read(d+0x18);
+  hdr->szCtxTraceLevels = fmt_u64_read(d+0x20);
+  hdr->pCtxTraceLevels = fmt_u64_read(d+0x28);
 }
 void fmt_tracedb_fHdr_write(char d[FMT_TRACEDB_SZ_FHdr], const fmt_tracedb_fHdr_t* hdr) {
   memcpy(d, fmt_tracedb_magic, sizeof fmt_tracedb_magic);
@@ -48,6 +50,8 @@ void fmt_tracedb_fHdr_write(char d[FMT_TRACEDB_SZ_FHdr], const fmt_tracedb_fHdr_
   d[0x0f] = FMT_TRACEDB_MinorVersion;
   fmt_u64_write(d+0x10, hdr->szCtxTraces);
   fmt_u64_write(d+0x18, hdr->pCtxTraces);
+  fmt_u64_write(d+0x20, hdr->szCtxTraceLevels);
+  fmt_u64_write(d+0x28, hdr->pCtxTraceLevels);
 }
 
 void fmt_tracedb_ctxTraceSHdr_read(fmt_tracedb_ctxTraceSHdr_t* hdr, const char d[FMT_TRACEDB_SZ_CtxTraceSHdr]) {
@@ -87,3 +91,36 @@ void fmt_tracedb_ctxSample_write(char d[FMT_TRACEDB_SZ_CtxSample], const fmt_tra
   fmt_u64_write(d+0x00, elem->timestamp);
   fmt_u32_write(d+0x08, elem->ctxId);
 }
+
+void fmt_tracedb_ctxLevelsSHdr_read(fmt_tracedb_ctxLevelsSHdr_t* hdr, const char d[FMT_TRACEDB_SZ_CtxLevelsSHdr]) {
+  hdr->pTraces = fmt_u64_read(d+0x00);
+  hdr->nTraces = fmt_u32_read(d+0x08);
+  hdr->szTrace = d[0x0c];
+  hdr->log2Fanout = d[0x0d];
+}
+void fmt_tracedb_ctxLevelsSHdr_write(char d[FMT_TRACEDB_SZ_CtxLevelsSHdr], const fmt_tracedb_ctxLevelsSHdr_t* hdr) {
+  fmt_u64_write(d+0x00, hdr->pTraces);
+  fmt_u32_write(d+0x08, hdr->nTraces);
+  d[0x0c] = FMT_TRACEDB_SZ_CtxLevels;
+  d[0x0d] = hdr->log2Fanout;
+  memset(d+0x0e, 0, 2);
+}
+
+void fmt_tracedb_ctxLevels_read(fmt_tracedb_ctxLevels_t* ctl, const char d[FMT_TRACEDB_SZ_CtxLevels]) {
+  ctl->pLevels = fmt_u64_read(d+0x00);
+  ctl->nLevels = d[0x08];
+}
+void fmt_tracedb_ctxLevels_write(char d[FMT_TRACEDB_SZ_CtxLevels], const fmt_tracedb_ctxLevels_t* ctl) {
+  fmt_u64_write(d+0x00, ctl->pLevels);
+  d[0x08] = ctl->nLevels;
+  memset(d+0x09, 0, FMT_TRACEDB_SZ_CtxLevels - 0x09);
+}
+
+void fmt_tracedb_ctxLevel_read(fmt_tracedb_ctxLevel_t* tl, const char d[FMT_TRACEDB_SZ_CtxLevel]) {
+  tl->pStart = fmt_u64_read(d+0x00);
+  tl->pEnd = fmt_u64_read(d+0x08);
+}
+void fmt_tracedb_ctxLevel_write(char d[FMT_TRACEDB_SZ_CtxLevel], const fmt_tracedb_ctxLevel_t* tl) {
+  fmt_u64_write(d+0x00, tl->pStart);
+  fmt_u64_write(d+0x08, tl->pEnd);
+}
@@ -24,7 +24,7 @@ extern "C" {
 #endif
 
 /// Minor version of the trace.db format implemented here
-enum { FMT_TRACEDB_MinorVersion = 0 };
+enum { FMT_TRACEDB_MinorVersion = 1 };
 
 /// Check the given file start bytes for the trace.db format.
 /// If minorVer != NULL, also returns the exact minor version.
@@ -38,13 +38,16 @@ extern const char fmt_tracedb_footer[8];
 //
 
 /// Size of the trace.db file header in serialized form
-enum { FMT_TRACEDB_SZ_FHdr = 0x20 };
+enum { FMT_TRACEDB_SZ_FHdr = 0x30 };
 
 /// trace.db file header, names match FORMATS.md
 typedef struct fmt_tracedb_fHdr_t {
   // NOTE: magic and versions are constant and cannot be adjusted
   uint64_t szCtxTraces;
   uint64_t pCtxTraces;
+  // Since v4.1, only valid for files with a later minor version
+  uint64_t szCtxTraceLevels;
+  uint64_t pCtxTraceLevels;
 } fmt_tracedb_fHdr_t;
 
 /// Read a trace.db file header from a byte array
@@ -91,6 +94,42 @@ typedef struct fmt_tracedb_ctxSample_t {
 void fmt_tracedb_ctxSample_read(fmt_tracedb_ctxSample_t*, const char[FMT_TRACEDB_SZ_CtxSample]);
 void fmt_tracedb_ctxSample_write(char[FMT_TRACEDB_SZ_CtxSample], const fmt_tracedb_ctxSample_t*);
 
+//
+// Context Trace Levels section (since v4.1)
+//
+
+// Context Trace Levels section header
+enum { FMT_TRACEDB_SZ_CtxLevelsSHdr = 0x10 };
+typedef struct fmt_tracedb_ctxLevelsSHdr_t {
+  uint64_t pTraces;
+  uint32_t nTraces;
+  uint8_t szTrace;
+  uint8_t log2Fanout;
+} fmt_tracedb_ctxLevelsSHdr_t;
+
+void fmt_tracedb_ctxLevelsSHdr_read(fmt_tracedb_ctxLevelsSHdr_t*, const char[FMT_TRACEDB_SZ_CtxLevelsSHdr]);
+void fmt_tracedb_ctxLevelsSHdr_write(char[FMT_TRACEDB_SZ_CtxLevelsSHdr], const fmt_tracedb_ctxLevelsSHdr_t*);
+
+// Context Trace Levels structure {CTL}
+enum { FMT_TRACEDB_SZ_CtxLevels = 0x10 };
+typedef struct fmt_tracedb_ctxLevels_t {
+  uint64_t pLevels;
+  uint8_t nLevels;
+} fmt_tracedb_ctxLevels_t;
+
+void fmt_tracedb_ctxLevels_read(fmt_tracedb_ctxLevels_t*, const char[FMT_TRACEDB_SZ_CtxLevels]);
+void fmt_tracedb_ctxLevels_write(char[FMT_TRACEDB_SZ_CtxLevels], const fmt_tracedb_ctxLevels_t*);
+
+// Context Trace Level {TL}
+enum { FMT_TRACEDB_SZ_CtxLevel = 0x10 };
+typedef struct fmt_tracedb_ctxLevel_t {
+  uint64_t pStart;
+  uint64_t pEnd;
+} fmt_tracedb_ctxLevel_t;
+
+void fmt_tracedb_ctxLevel_read(fmt_tracedb_ctxLevel_t*, const char[FMT_TRACEDB_SZ_CtxLevel]);
+void fmt_tracedb_ctxLevel_write(char[FMT_TRACEDB_SZ_CtxLevel], const fmt_tracedb_ctxLevel_t*);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
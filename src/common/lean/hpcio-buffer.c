@@ -31,6 +31,15 @@
 //
 // Deserves further study: the best way to handle errors from write().
 //
+// Buffers attached with HPCIO_OUTBUF_ASYNC are split in two halves.
+// When one half fills up it is queued for a background I/O thread and
+// the client continues in the other half, so the (possibly slow) write()
+// happens off the client thread. If the I/O thread is still writing the
+// previous half when the current one fills, the client writes the
+// current half itself instead of waiting, since it may be in a signal
+// handler. Every half is written with pwrite() at the file offset it
+// was assigned when it filled, so it doesn't matter which lands first.
+//
 //***************************************************************************
 
 //************************* System Include Files ****************************
@@ -39,6 +48,12 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -49,6 +64,7 @@
 #include "hpcio-buffer.h"
 #include "spinlock.h"
 #include "min-max.h"
+#include "collections/mpsc-queue-entry-data.h"
 
 #define HPCIO_OUTBUF_MAGIC  0x494F4246
 
@@ -59,7 +75,8 @@
 //***************************************************************************
 
 typedef struct hpcio_outbuf_s {
-  struct hpcio_outbuf_s *next;
+  MPSC_QUEUE_ENTRY_DATA(struct hpcio_outbuf_s);  // async I/O queue
+  struct hpcio_outbuf_s *free_next;
   uint32_t magic;
   void  *buf_start;
   size_t buf_size;
@@ -68,9 +85,25 @@ typedef struct hpcio_outbuf_s {
   int  flags;
   char use_lock;
   spinlock_t lock;
+
+  // async mode: the half not being filled, and the part of it that is
+  // queued for the I/O thread while `pending` is set. `file_off` is the
+  // file offset for the start of the half being filled.
+  char async;
+  void  *other_half;
+  size_t pending_len;
+  off_t  pending_off;
+  off_t  file_off;
+  atomic_bool pending;
+  atomic_bool pending_err;
 } hpcio_outbuf_t;
 
 
+#define MPSC_QUEUE_PREFIX         outbufq
+#define MPSC_QUEUE_ENTRY_TYPE     hpcio_outbuf_t
+#include "collections/mpsc-queue.h"
+
+
 
 //***************************************************************************
 // variables
@@ -79,6 +112,14 @@ typedef struct hpcio_outbuf_s {
 static spinlock_t freelist_lock = SPINLOCK_UNLOCKED;
 static hpcio_outbuf_t *freelist = 0;
 
+// background I/O thread for async buffers
+static outbufq_t async_queue = MPSC_QUEUE_INITIALIZER;
+static sem_t async_sem;
+static pthread_t async_thread;
+static pid_t async_pid = -1;
+static atomic_bool async_running = false;
+static atomic_bool async_stop = false;
+
 
 
 //*************************** Private Functions *****************************
@@ -93,7 +134,7 @@ freelist_dequeue
    spinlock_lock(&freelist_lock);
    if (freelist) {
      ob = freelist;
-     freelist = ob->next;
+     freelist = ob->free_next;
    }
    spinlock_unlock(&freelist_lock);
    return ob;
@@ -121,27 +162,25 @@ outbuf_free
 )
 {
    spinlock_lock(&freelist_lock);
-   ob->next = freelist;
+   ob->free_next = freelist;
    freelist = ob;
    spinlock_unlock(&freelist_lock);
 }
 
 
-// Try to write() the entire outbuf.
+// Try to write() all of buf to fd.
 //
-// Returns: HPCFMT_OK if the entire buffer was successfully written,
-// else HPCFMT_ERR.
+// Returns: the number of bytes written, less than len on a hard failure.
 //
-static int
-outbuf_flush_buffer(hpcio_outbuf_t *outbuf)
+static size_t
+write_all(int fd, const void *buf, size_t len)
 {
-  ssize_t amt_done, ret;
+  ssize_t ret;
+  size_t amt_done = 0;
 
-  amt_done = 0;
-  while (amt_done < outbuf->in_use) {
+  while (amt_done < len) {
     errno = 0;
-    ret = write(outbuf->fd, outbuf->buf_start + amt_done,
-                outbuf->in_use - amt_done);
+    ret = write(fd, buf + amt_done, len - amt_done);
 
     // Check for short writes.  Note: EINTR is not failure.
     if (ret > 0 || (ret == 0 && errno == EINTR)) {
@@ -149,19 +188,63 @@ outbuf_flush_buffer(hpcio_outbuf_t *outbuf)
       amt_done += ret;
     }
     else {
-      // hard failure
-      // FIXME: should do better than copy to begin of buffer.
-      // However, this case is rare, it probably will continue to fail
-      // and I want to rethink this case anyway.  So, this will do for
-      // now. (krentel)
-      if (amt_done > 0) {
-        memmove(outbuf->buf_start, outbuf->buf_start + amt_done,
-                outbuf->in_use - amt_done);
-        outbuf->in_use = amt_done;
-      }
-      return HPCFMT_ERR;
+      break;
+    }
+  }
+  return amt_done;
+}
+
+
+// Try to pwrite() all of buf to fd, starting at file offset off.
+//
+// Returns: the number of bytes written, less than len on a hard failure.
+//
+static size_t
+pwrite_all(int fd, const void *buf, size_t len, off_t off)
+{
+  ssize_t ret;
+  size_t amt_done = 0;
+
+  while (amt_done < len) {
+    errno = 0;
+    ret = pwrite(fd, buf + amt_done, len - amt_done, off + amt_done);
+
+    // Check for short writes.  Note: EINTR is not failure.
+    if (ret > 0 || (ret == 0 && errno == EINTR)) {
+      // progress, continue
+      amt_done += ret;
+    }
+    else {
+      break;
     }
   }
+  return amt_done;
+}
+
+
+// Try to write() the entire outbuf.
+//
+// Returns: HPCFMT_OK if the entire buffer was successfully written,
+// else HPCFMT_ERR.
+//
+static int
+outbuf_flush_buffer(hpcio_outbuf_t *outbuf)
+{
+  size_t amt_done = write_all(outbuf->fd, outbuf->buf_start, outbuf->in_use);
+
+  if (amt_done < outbuf->in_use) {
+    // hard failure
+    // FIXME: should do better than copy to begin of buffer.
+    // However, this case is rare, it probably will continue to fail
+    // and I want to rethink this case anyway.  So, this will do for
+    // now. (krentel)
+    if (amt_done > 0) {
+      memmove(outbuf->buf_start, outbuf->buf_start + amt_done,
+              outbuf->in_use - amt_done);
+      outbuf->in_use = amt_done;
+    }
+    return HPCFMT_ERR;
+  }
 
   // entire buffer was successfully written
   outbuf->in_use = 0;
@@ -169,6 +252,140 @@ outbuf_flush_buffer(hpcio_outbuf_t *outbuf)
 }
 
 
+// Try to pwrite() the half being filled of an async outbuf, at its
+// place in the file.
+//
+// Returns: HPCFMT_OK if the entire half was successfully written,
+// else HPCFMT_ERR.
+//
+static int
+outbuf_flush_half(hpcio_outbuf_t *outbuf)
+{
+  size_t amt_done = pwrite_all(outbuf->fd, outbuf->buf_start,
+                               outbuf->in_use, outbuf->file_off);
+  outbuf->file_off += amt_done;
+
+  if (amt_done < outbuf->in_use) {
+    // hard failure, keep the rest for the next attempt
+    memmove(outbuf->buf_start, outbuf->buf_start + amt_done,
+            outbuf->in_use - amt_done);
+    outbuf->in_use -= amt_done;
+    return HPCFMT_ERR;
+  }
+
+  outbuf->in_use = 0;
+  return HPCFMT_OK;
+}
+
+
+// True if the I/O thread is running in this process. It does not
+// survive a fork(), so in the child nothing consumes the queue.
+//
+static bool
+async_live(void)
+{
+  return atomic_load_explicit(&async_running, memory_order_acquire)
+         && async_pid == getpid();
+}
+
+
+// Wait for the I/O thread to finish writing the other half of an async
+// outbuf. Only used when closing, never on the sample path.
+//
+static void
+outbuf_wait_pending(hpcio_outbuf_t *outbuf)
+{
+  while (atomic_load_explicit(&outbuf->pending, memory_order_acquire)) {
+    if (!async_live()) {
+      // Queued before a fork(), the parent's I/O thread owns that write
+      atomic_store_explicit(&outbuf->pending, false, memory_order_relaxed);
+      break;
+    }
+    sched_yield();
+  }
+}
+
+
+// Make room in the outbuf: queue the filled half of an async outbuf
+// for the I/O thread and switch to the other half. If the I/O thread
+// is busy with the other half, or there is no I/O thread in this
+// process, pwrite() the filled half out directly instead of waiting.
+//
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+//
+static int
+outbuf_make_room(hpcio_outbuf_t *outbuf)
+{
+  if (!outbuf->async) {
+    return outbuf_flush_buffer(outbuf);
+  }
+  if (outbuf->in_use == 0) {
+    return HPCFMT_OK;
+  }
+  if (atomic_load_explicit(&outbuf->pending, memory_order_acquire)
+      || !async_live()) {
+    return outbuf_flush_half(outbuf);
+  }
+
+  void *full = outbuf->buf_start;
+  outbuf->pending_len = outbuf->in_use;
+  outbuf->pending_off = outbuf->file_off;
+  outbuf->file_off += outbuf->in_use;
+  outbuf->buf_start = outbuf->other_half;
+  outbuf->other_half = full;
+  outbuf->in_use = 0;
+
+  atomic_store_explicit(&outbuf->pending, true, memory_order_release);
+  outbufq_enqueue(&async_queue, outbuf);
+  sem_post(&async_sem);  // async-signal-safe
+
+  return HPCFMT_OK;
+}
+
+
+// Write out every queued half-buffer. Only called by the one consumer
+// of the queue, the I/O thread (or the stopping thread once it exits).
+//
+static void
+async_drain(void)
+{
+  hpcio_outbuf_t *ob;
+
+  while ((ob = outbufq_dequeue(&async_queue)) != NULL) {
+    if (pwrite_all(ob->fd, ob->other_half, ob->pending_len, ob->pending_off)
+        != ob->pending_len) {
+      atomic_store_explicit(&ob->pending_err, true, memory_order_relaxed);
+    }
+    // N.B. this must be the last access, the client may reuse the buffer
+    // or close the outbuf as soon as it sees this
+    atomic_store_explicit(&ob->pending, false, memory_order_release);
+  }
+}
+
+
+static void *
+async_main(void *arg)
+{
+  // Samples are never taken in this thread
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+  for (;;) {
+    while (sem_wait(&async_sem) != 0 && errno == EINTR) {
+      // retry
+    }
+    async_drain();
+    if (atomic_load(&async_stop)) {
+      break;
+    }
+  }
+
+  async_drain();
+  return NULL;
+}
+
+
 //*************************** Interface Functions ***************************
 
 // Attach the file descriptor to the buffer, initialize and fill in
@@ -205,6 +422,25 @@ hpcio_outbuf_attach
   outbuf->use_lock = (flags & HPCIO_OUTBUF_LOCKED);
   spinlock_unlock(&outbuf->lock);
 
+  // Split the buffer in two for async mode, if there is an I/O thread.
+  // The halves are written by offset, so the file must be seekable.
+  outbuf->async = (flags & HPCIO_OUTBUF_ASYNC) && buf_size >= 2
+                  && async_live();
+  outbuf->other_half = NULL;
+  outbuf->file_off = 0;
+  if (outbuf->async) {
+    outbuf->file_off = lseek(fd, 0, SEEK_CUR);
+    outbuf->async = outbuf->file_off >= 0;
+  }
+  if (outbuf->async) {
+    outbuf->buf_size = buf_size / 2;
+    outbuf->other_half = buf_start + outbuf->buf_size;
+  }
+  outbuf->pending_len = 0;
+  outbuf->pending_off = 0;
+  atomic_init(&outbuf->pending, false);
+  atomic_init(&outbuf->pending_err, false);
+
   *outbuf_ptr = outbuf;
 
   return HPCFMT_OK;
@@ -231,7 +467,7 @@ hpcio_outbuf_write(hpcio_outbuf_t *outbuf, const void *data, size_t size)
   while (amt_done < size) {
     // flush if needed
     if (size > outbuf->buf_size - outbuf->in_use) {
-      outbuf_flush_buffer(outbuf);
+      outbuf_make_room(outbuf);
       if (outbuf->in_use == outbuf->buf_size) {
         // flush failed, no space
         break;
@@ -266,7 +502,8 @@ hpcio_outbuf_flush(hpcio_outbuf_t *outbuf)
     spinlock_lock(&outbuf->lock);
   }
 
-  int ret = outbuf_flush_buffer(outbuf);
+  int ret = outbuf->async ? outbuf_flush_half(outbuf)
+                          : outbuf_flush_buffer(outbuf);
 
   if (outbuf->use_lock) {
     spinlock_unlock(&outbuf->lock);
@@ -295,7 +532,16 @@ hpcio_outbuf_close(hpcio_outbuf_t **outbuf_ptr)
     spinlock_lock(&outbuf->lock);
   }
 
-  if (outbuf_flush_buffer(outbuf) == HPCFMT_OK
+  int flushed;
+  if (outbuf->async) {
+    flushed = outbuf_flush_half(outbuf);
+    outbuf_wait_pending(outbuf);
+  }
+  else {
+    flushed = outbuf_flush_buffer(outbuf);
+  }
+  if (flushed == HPCFMT_OK
+      && !atomic_load(&outbuf->pending_err)
       && close(outbuf->fd) == 0) {
     // flush and close both succeed
     outbuf->magic = 0;
@@ -315,3 +561,52 @@ hpcio_outbuf_close(hpcio_outbuf_t **outbuf_ptr)
 
   return ret;
 }
+
+
+// Start the background I/O thread for outbufs attached with
+// HPCIO_OUTBUF_ASYNC. Until it is started (or after it is stopped), such
+// outbufs are written synchronously. After a fork() the thread must be
+// started again in the child.
+//
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+//
+int
+hpcio_outbuf_async_start(void)
+{
+  if (atomic_load(&async_running) && async_pid == getpid()) {
+    return HPCFMT_OK;
+  }
+
+  outbufq_init(&async_queue);
+  atomic_store(&async_stop, false);
+  if (sem_init(&async_sem, 0, 0) != 0) {
+    return HPCFMT_ERR;
+  }
+  if (pthread_create(&async_thread, NULL, async_main, NULL) != 0) {
+    sem_destroy(&async_sem);
+    atomic_store(&async_running, false);
+    return HPCFMT_ERR;
+  }
+
+  async_pid = getpid();
+  atomic_store(&async_running, true);
+  return HPCFMT_OK;
+}
+
+
+// Write out every queued buffer and stop the background I/O thread.
+// Must only be called once no more async outbufs are being written.
+//
+void
+hpcio_outbuf_async_stop(void)
+{
+  if (!atomic_load(&async_running) || async_pid != getpid()) {
+    return;
+  }
+
+  atomic_store(&async_running, false);
+  atomic_store(&async_stop, true);
+  sem_post(&async_sem);
+  pthread_join(async_thread, NULL);
+  sem_destroy(&async_sem);
+}
@@ -24,6 +24,10 @@ typedef struct hpcio_outbuf_s hpcio_outbuf_t;
 #define HPCIO_OUTBUF_LOCKED    0x1
 #define HPCIO_OUTBUF_UNLOCKED  0x2
 
+// Double-buffer and hand full buffers to the background I/O thread,
+// see hpcio_outbuf_async_start().
+#define HPCIO_OUTBUF_ASYNC     0x4
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -63,6 +67,20 @@ hpcio_outbuf_close
 );
 
 
+int
+hpcio_outbuf_async_start
+(
+  void
+);
+
+
+void
+hpcio_outbuf_async_stop
+(
+  void
+);
+
+
 #if defined(__cplusplus)
 }
 #endif
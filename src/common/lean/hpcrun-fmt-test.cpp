@@ -0,0 +1,449 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "hpcrun-fmt.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// Sparse metric blocks, as (cct node id, [(metric id, value)...]) pairs
+using Blocks = std::vector<std::pair<uint32_t, std::vector<std::pair<uint16_t, uint64_t>>>>;
+
+// Generate an in-memory image of a profile containing only the sparse metrics
+// section and footer. Metric ids are in the file's (0-based) convention.
+std::vector<char> makeImage(const Blocks& blocks) {
+  std::vector<hpcrun_metricVal_t> values;
+  std::vector<uint16_t> mids;
+  std::vector<uint32_t> ids;
+  std::vector<uint64_t> idxs;
+  for (const auto& [id, entries] : blocks) {
+    ids.push_back(id);
+    idxs.push_back(values.size());
+    for (const auto& [mid, bits] : entries) {
+      hpcrun_metricVal_t v;
+      v.bits = bits;
+      values.push_back(v);
+      mids.push_back(mid);
+    }
+  }
+  ids.push_back(LastNodeEnd);
+  idxs.push_back(values.size());
+
+  pms_id_t tuple_ids[1];
+  hpcrun_fmt_sparse_metrics_t sm = {};
+  id_tuple_constructor(&sm.id_tuple, tuple_ids, 1);
+  id_tuple_push_back(&sm.id_tuple, IDTUPLE_RANK, 3, 3);
+  sm.num_vals = values.size();
+  sm.values = values.data();
+  sm.mids = mids.data();
+  sm.cct_node_ids = ids.data();
+  sm.cct_node_idxs = idxs.data();
+  sm.num_nz_cct_nodes = blocks.size();
+
+  char* buf = nullptr;
+  size_t size = 0;
+  FILE* fs = open_memstream(&buf, &size);
+  EXPECT_EQ(hpcrun_fmt_sparse_metrics_fwrite(&sm, fs), HPCFMT_OK);
+  fflush(fs);
+  hpcrun_fmt_footer_t footer = {};
+  footer.sm_start = 0;
+  footer.sm_end = footer.footer_start = size;
+  footer.HPCRUNsm = HPCRUNsm;
+  EXPECT_EQ(hpcrun_fmt_footer_fwrite(&footer, fs), HPCFMT_OK);
+  fclose(fs);
+
+  std::vector<char> image(buf, buf + size);
+  free(buf);
+  return image;
+}
+
+const Blocks testBlocks = {
+    {2, {{0, 10}, {3, 11}}},
+    {5, {}},
+    {7, {{1, 12}}},
+    {9, {{0, 13}, {1, 14}, {2, 15}}},
+};
+
+}  // namespace
+
+TEST(HpcrunSparseTest, BlockEntries) {
+  auto image = makeImage(testBlocks);
+  hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(image.data(), image.size(), 0, 0);
+  ASSERT_NE(sf, nullptr);
+
+  const hpcrun_metricVal_t* vals;
+  const uint16_t* mids;
+  size_t n;
+  for (const auto& [id, entries] : testBlocks) {
+    ASSERT_EQ(hpcrun_sparse_next_block_entries(sf, &vals, &mids, &n), (int)id);
+    ASSERT_EQ(n, entries.size());
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_EQ(mids[i], entries[i].first + 1);
+      EXPECT_EQ(vals[i].bits, entries[i].second);
+    }
+  }
+  EXPECT_EQ(hpcrun_sparse_next_block_entries(sf, &vals, &mids, &n), SF_END);
+  hpcrun_sparse_close(sf);
+}
+
+TEST(HpcrunSparseTest, MatchesPerEntryReader) {
+  auto image = makeImage(testBlocks);
+  hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(image.data(), image.size(), 0, 0);
+  ASSERT_NE(sf, nullptr);
+
+  std::vector<std::tuple<int, int, uint64_t>> expected;
+  int cid;
+  while ((cid = hpcrun_sparse_next_block(sf)) > 0) {
+    hpcrun_metricVal_t val;
+    int mid;
+    while ((mid = hpcrun_sparse_next_entry(sf, &val)) > 0)
+      expected.emplace_back(cid, mid, val.bits);
+  }
+  ASSERT_EQ(cid, SF_END);
+  hpcrun_sparse_close(sf);
+
+  sf = hpcrun_sparse_open_image(image.data(), image.size(), 0, 0);
+  ASSERT_NE(sf, nullptr);
+  std::vector<std::tuple<int, int, uint64_t>> got;
+  const hpcrun_metricVal_t* vals;
+  const uint16_t* mids;
+  size_t n;
+  while ((cid = hpcrun_sparse_next_block_entries(sf, &vals, &mids, &n)) > 0) {
+    for (size_t i = 0; i < n; i++)
+      got.emplace_back(cid, mids[i], vals[i].bits);
+  }
+  ASSERT_EQ(cid, SF_END);
+  hpcrun_sparse_close(sf);
+
+  EXPECT_EQ(got, expected);
+}
+
+TEST(HpcrunSparseTest, RandomAccessBlocks) {
+  auto image = makeImage(testBlocks);
+  hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(image.data(), image.size(), 0, 0);
+  ASSERT_NE(sf, nullptr);
+
+  uint32_t nblocks;
+  uint64_t nvals;
+  ASSERT_EQ(hpcrun_sparse_load_blocks(sf, &nblocks, &nvals), SF_SUCCEED);
+  EXPECT_EQ(nblocks, testBlocks.size());
+  EXPECT_EQ(nvals, 6u);
+  EXPECT_EQ(hpcrun_sparse_block_at(sf, 0), 0u);
+  EXPECT_EQ(hpcrun_sparse_block_at(sf, 1), 1u);
+  EXPECT_EQ(hpcrun_sparse_block_at(sf, 3), 3u);
+  EXPECT_EQ(hpcrun_sparse_block_at(sf, 4), nblocks);
+
+  // Blocks are decoded on request, so any order must work
+  const hpcrun_metricVal_t* vals;
+  const uint16_t* mids;
+  size_t n;
+  for (uint32_t b = nblocks; b-- > 0;) {
+    const auto& [id, entries] = testBlocks[b];
+    ASSERT_EQ(hpcrun_sparse_block_entries(sf, b, &vals, &mids, &n), (int)id);
+    ASSERT_EQ(n, entries.size());
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_EQ(mids[i], entries[i].first + 1);
+      EXPECT_EQ(vals[i].bits, entries[i].second);
+    }
+  }
+  EXPECT_EQ(hpcrun_sparse_block_entries(sf, nblocks, &vals, &mids, &n), SF_ERR);
+  hpcrun_sparse_close(sf);
+}
+
+TEST(HpcrunSparseTest, TruncatedSection) {
+  auto image = makeImage(testBlocks);
+  // Claim the sparse metrics section ends in the middle of the value pairs
+  hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(image.data(), image.size(), 0, 0);
+  ASSERT_NE(sf, nullptr);
+  sf->footer.sm_end = 20;
+
+  const hpcrun_metricVal_t* vals;
+  const uint16_t* mids;
+  size_t n;
+  EXPECT_EQ(hpcrun_sparse_next_block_entries(sf, &vals, &mids, &n), SF_ERR);
+  hpcrun_sparse_close(sf);
+}
+
+namespace {
+
+// Concatenate profile images into a container, with the given trace names
+std::vector<char> makeContainer(const std::vector<std::pair<std::vector<char>, const char*>>& sections) {
+  std::vector<char> out(HPCRUN_CONTAINER_Magic, HPCRUN_CONTAINER_Magic + HPCRUN_CONTAINER_MagicLen);
+  for (const auto& [image, trace] : sections) {
+    std::vector<char> hdr(hpcrun_fmt_container_section_hdr_size(trace));
+    char* end = hpcrun_fmt_container_section_hdr_swrite(image.size(), trace, hdr.data());
+    EXPECT_EQ(end, hdr.data() + hdr.size());
+    out.insert(out.end(), hdr.begin(), hdr.end());
+    out.insert(out.end(), image.begin(), image.end());
+  }
+  return out;
+}
+
+std::vector<hpcrun_fmt_container_section_t> readSections(std::vector<char>& container) {
+  FILE* fs = fmemopen(container.data(), container.size(), "r");
+  EXPECT_EQ(hpcrun_fmt_container_hdr_fread(fs), HPCFMT_OK);
+  std::vector<hpcrun_fmt_container_section_t> sections;
+  hpcrun_fmt_container_section_t sec;
+  int ret;
+  while ((ret = hpcrun_fmt_container_section_fread(&sec, fs, malloc)) == HPCFMT_OK)
+    sections.push_back(sec);
+  EXPECT_EQ(ret, HPCFMT_EOF);
+  fclose(fs);
+  return sections;
+}
+
+// Read all the blocks from a sparse file, as in testBlocks
+Blocks readBlocks(hpcrun_sparse_file_t* sf) {
+  Blocks blocks;
+  const hpcrun_metricVal_t* vals;
+  const uint16_t* mids;
+  size_t n;
+  int cid;
+  while ((cid = hpcrun_sparse_next_block_entries(sf, &vals, &mids, &n)) > 0) {
+    auto& [id, entries] = blocks.emplace_back();
+    id = cid;
+    for (size_t i = 0; i < n; i++)
+      entries.emplace_back(mids[i] - 1, vals[i].bits);
+  }
+  EXPECT_EQ(cid, SF_END);
+  return blocks;
+}
+
+const Blocks otherBlocks = {
+    {1, {{4, 20}}},
+    {3, {{0, 21}, {1, 22}}},
+};
+
+}  // namespace
+
+TEST(HpcrunContainerTest, Sections) {
+  auto container = makeContainer({{makeImage(testBlocks), "a.hpctrace"},
+                                  {makeImage(otherBlocks), nullptr}});
+  auto sections = readSections(container);
+  ASSERT_EQ(sections.size(), 2u);
+  EXPECT_STREQ(sections[0].trace_name, "a.hpctrace");
+  EXPECT_STREQ(sections[1].trace_name, "");
+  EXPECT_EQ(sections[1].end, container.size());
+
+  const Blocks* expected[] = {&testBlocks, &otherBlocks};
+  for (size_t i = 0; i < sections.size(); i++) {
+    hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(container.data(), container.size(),
+                                                        sections[i].start, sections[i].end);
+    ASSERT_NE(sf, nullptr);
+    EXPECT_EQ(readBlocks(sf), *expected[i]);
+    hpcrun_sparse_close(sf);
+    hpcrun_fmt_container_section_free(&sections[i], free);
+  }
+}
+
+TEST(HpcrunContainerTest, Truncated) {
+  auto container = makeContainer({{makeImage(testBlocks), "a"}, {makeImage(otherBlocks), "b"}});
+  // A writer that reserved space but never filled it leaves zeros behind
+  container.resize(container.size() + 64, 0);
+  auto sections = readSections(container);
+  EXPECT_EQ(sections.size(), 2u);
+  for (auto& sec : sections)
+    hpcrun_fmt_container_section_free(&sec, free);
+}
+
+TEST(HpcrunContainerTest, SectionImage) {
+  auto first = makeImage(otherBlocks);
+  auto second = makeImage(testBlocks);
+  auto container = makeContainer({{first, "a"}, {second, "b"}});
+  auto sections = readSections(container);
+  ASSERT_EQ(sections.size(), 2u);
+
+  // Open the second section from the container, then switch to an image
+  // holding only that section
+  hpcrun_sparse_file_t* sf = hpcrun_sparse_open_image(container.data(), container.size(),
+                                                      sections[1].start, sections[1].end);
+  ASSERT_NE(sf, nullptr);
+  ASSERT_EQ(hpcrun_sparse_pause(sf), SF_SUCCEED);
+  ASSERT_EQ(hpcrun_sparse_use_image(sf, second.data(), second.size()), SF_SUCCEED);
+  ASSERT_EQ(hpcrun_sparse_resume(sf, nullptr), SF_SUCCEED);
+  EXPECT_EQ(readBlocks(sf), testBlocks);
+  hpcrun_sparse_close(sf);
+
+  for (auto& sec : sections)
+    hpcrun_fmt_container_section_free(&sec, free);
+}
+
+namespace {
+
+// Write the trace records to a temporary file with the given encoding, and
+// return the file rewound to the start
+FILE* writeTrace(const std::vector<hpctrace_fmt_datum_t>& data, hpctrace_hdr_flags_t flags) {
+  FILE* fs = tmpfile();
+  EXPECT_NE(fs, nullptr);
+  static char buf[1 << 16];
+  hpcio_outbuf_t* outbuf = nullptr;
+  EXPECT_EQ(hpcio_outbuf_attach(&outbuf, dup(fileno(fs)), buf, sizeof buf, HPCIO_OUTBUF_UNLOCKED,
+                                malloc),
+            HPCFMT_OK);
+  const bool packed = HPCTRACE_HDR_FLAGS_GET_BIT(flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS);
+  hpctrace_fmt_packed_t p;
+  hpctrace_fmt_packed_init(&p);
+  for (auto x : data) {
+    EXPECT_EQ(packed ? hpctrace_fmt_packed_datum_outbuf(&x, flags, &p, outbuf)
+                     : hpctrace_fmt_datum_outbuf(&x, flags, outbuf),
+              HPCFMT_OK);
+  }
+  if (packed) {
+    EXPECT_EQ(hpctrace_fmt_packed_flush(&p, outbuf), HPCFMT_OK);
+  }
+  EXPECT_EQ(hpcio_outbuf_close(&outbuf), HPCFMT_OK);
+  rewind(fs);
+  return fs;
+}
+
+// Read all the packed trace records back, and the number of blocks
+std::vector<hpctrace_fmt_datum_t> readPacked(FILE* fs, hpctrace_hdr_flags_t flags,
+                                             std::size_t* blocks = nullptr) {
+  std::vector<hpctrace_fmt_datum_t> data;
+  hpctrace_fmt_packed_t p;
+  hpctrace_fmt_packed_init(&p);
+  std::size_t nblocks = 0;
+  while (true) {
+    if (p.nSamples == 0)
+      nblocks++;
+    hpctrace_fmt_datum_t x;
+    int ret = hpctrace_fmt_packed_datum_fread(&x, flags, &p, fs);
+    if (ret == HPCFMT_EOF)
+      break;
+    EXPECT_EQ(ret, HPCFMT_OK);
+    if (ret != HPCFMT_OK)
+      break;
+    data.push_back(x);
+  }
+  if (blocks)
+    *blocks = nblocks - 1;
+  return data;
+}
+
+long fileSize(FILE* fs) {
+  fseek(fs, 0, SEEK_END);
+  long size = ftell(fs);
+  rewind(fs);
+  return size;
+}
+
+// A trace sampled every ~5ms (in ns), where 1 in 4 samples changes call path
+std::vector<hpctrace_fmt_datum_t> syntheticTrace(std::size_t n, bool metrics) {
+  std::mt19937_64 rng(42);
+  std::vector<hpctrace_fmt_datum_t> data;
+  uint64_t time = 1700000000000000000ULL;
+  uint32_t cpId = 1000;
+  for (std::size_t i = 0; i < n; i++) {
+    time += 5000000 + rng() % 100000;
+    if (rng() % 4 == 0)
+      cpId = 100 + rng() % 5000;
+    hpctrace_fmt_datum_t x = {};
+    HPCTRACE_FMT_SET_TIME(x.comp, time);
+    x.cpId = cpId;
+    x.metricId = metrics ? rng() % 8 : HPCTRACE_FMT_MetricId_NULL;
+    data.push_back(x);
+  }
+  return data;
+}
+
+// Trace records as comparable (time, cpId, metricId) tuples
+using Records = std::vector<std::tuple<uint64_t, uint32_t, uint32_t>>;
+Records records(const std::vector<hpctrace_fmt_datum_t>& data) {
+  Records out;
+  for (const auto& x : data)
+    out.emplace_back(x.comp, x.cpId, x.metricId);
+  return out;
+}
+
+hpctrace_hdr_flags_t packedFlags(bool metrics) {
+  hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS, true);
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, metrics);
+  return flags;
+}
+
+}  // namespace
+
+TEST(HpctracePackedTest, NegativeDeltas) {
+  // Time and call path ids both go backwards, and a delta is too large for
+  // the repeat bit, which forces a new block
+  std::vector<hpctrace_fmt_datum_t> data = {
+      {1000, 50, HPCTRACE_FMT_MetricId_NULL}, {900, 50, HPCTRACE_FMT_MetricId_NULL},
+      {901, 7, HPCTRACE_FMT_MetricId_NULL},   {0, 4000000000u, HPCTRACE_FMT_MetricId_NULL},
+      {1ULL << 62, 0, HPCTRACE_FMT_MetricId_NULL}, {5, 1, HPCTRACE_FMT_MetricId_NULL},
+  };
+  const auto flags = packedFlags(false);
+  FILE* fs = writeTrace(data, flags);
+  std::size_t blocks;
+  EXPECT_EQ(records(readPacked(fs, flags, &blocks)), records(data));
+  EXPECT_EQ(blocks, 3u);
+  fclose(fs);
+}
+
+TEST(HpctracePackedTest, BlockRollover) {
+  const auto data = syntheticTrace(20000, false);
+  const auto flags = packedFlags(false);
+  FILE* fs = writeTrace(data, flags);
+
+  // Every block but the last is full up to the worst-case record size
+  std::size_t blocks = 0;
+  uint32_t nSamples, nBytes;
+  uint64_t baseTime;
+  std::size_t total = 0;
+  while (hpctrace_fmt_packed_blockhdr_fread(&nSamples, &nBytes, &baseTime, fs) == HPCFMT_OK) {
+    EXPECT_LE(nBytes, (uint32_t)HPCTRACE_FMT_PackedBlockSz);
+    EXPECT_EQ(baseTime, HPCTRACE_FMT_GET_TIME(data[total].comp));
+    total += nSamples;
+    if (total < data.size()) {
+      EXPECT_GT(nBytes + HPCTRACE_FMT_PackedDatumMaxSz, (uint32_t)HPCTRACE_FMT_PackedBlockSz);
+    }
+    ASSERT_EQ(fseek(fs, nBytes, SEEK_CUR), 0);
+    blocks++;
+  }
+  EXPECT_EQ(total, data.size());
+  EXPECT_GT(blocks, 1u);
+
+  rewind(fs);
+  EXPECT_EQ(records(readPacked(fs, flags)), records(data));
+  fclose(fs);
+}
+
+TEST(HpctracePackedTest, DataCentric) {
+  const auto data = syntheticTrace(5000, true);
+  const auto flags = packedFlags(true);
+  FILE* fs = writeTrace(data, flags);
+  EXPECT_EQ(records(readPacked(fs, flags)), records(data));
+  fclose(fs);
+
+  // Without the flag the metric ids are not stored
+  auto plain = data;
+  for (auto& x : plain)
+    x.metricId = HPCTRACE_FMT_MetricId_NULL;
+  fs = writeTrace(data, packedFlags(false));
+  EXPECT_EQ(records(readPacked(fs, packedFlags(false))), records(plain));
+  fclose(fs);
+}
+
+TEST(HpctracePackedTest, Size) {
+  // Regularly sampled timestamps need 4 bytes as deltas and the call path
+  // rarely changes, so records shrink to about 4.5 bytes from 12
+  const auto data = syntheticTrace(100000, false);
+  FILE* packed = writeTrace(data, packedFlags(false));
+  FILE* fixed = writeTrace(data, hpctrace_hdr_flags_NULL);
+  const long packedSize = fileSize(packed);
+  const long fixedSize = fileSize(fixed);
+  EXPECT_EQ(fixedSize, (long)data.size() * 12);
+  EXPECT_LT(packedSize * 5, fixedSize * 2) << packedSize << " vs " << fixedSize;
+  fclose(packed);
+  fclose(fixed);
+}
@@ -25,6 +25,8 @@
 
 //************************* System Include Files ****************************
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -1002,6 +1004,75 @@ hpcrun_fmt_footer_fprint(hpcrun_fmt_footer_t* x, FILE* fs, const char* pre)
   return HPCFMT_OK;
 }
 
+//***************************************************************************
+// hpcrun_fmt_container
+//***************************************************************************
+
+int
+hpcrun_fmt_container_hdr_fread(FILE* infs)
+{
+  char tag[HPCRUN_CONTAINER_MagicLen];
+
+  if (fread(tag, 1, HPCRUN_CONTAINER_MagicLen, infs) != HPCRUN_CONTAINER_MagicLen) {
+    return HPCFMT_ERR;
+  }
+  if (memcmp(tag, HPCRUN_CONTAINER_Magic, HPCRUN_CONTAINER_MagicLen) != 0) {
+    return HPCFMT_ERR;
+  }
+  return HPCFMT_OK;
+}
+
+int
+hpcrun_fmt_container_section_fread(hpcrun_fmt_container_section_t* x,
+                                   FILE* infs, hpcfmt_alloc_fn alloc)
+{
+  uint64_t image_size;
+  int ret = hpcfmt_int8_fread(&image_size, infs);
+  if (ret != HPCFMT_OK) {
+    return ret;
+  }
+  // A zero-filled tail is left behind by a writer that never finished
+  if (image_size == 0) {
+    return HPCFMT_EOF;
+  }
+
+  HPCFMT_ThrowIfError(hpcfmt_str_fread(&x->trace_name, infs, alloc));
+  long start = ftell(infs);
+  if (start < 0 || fseek(infs, image_size, SEEK_CUR) != 0) {
+    return HPCFMT_ERR;
+  }
+  x->start = start;
+  x->end = start + image_size;
+  return HPCFMT_OK;
+}
+
+void
+hpcrun_fmt_container_section_free(hpcrun_fmt_container_section_t* x,
+                                  hpcfmt_free_fn dealloc)
+{
+  hpcfmt_str_free(x->trace_name, dealloc);
+  x->trace_name = NULL;
+}
+
+size_t
+hpcrun_fmt_container_section_hdr_size(const char* trace_name)
+{
+  return sizeof(uint64_t) + sizeof(uint32_t) + (trace_name ? strlen(trace_name) : 0);
+}
+
+char*
+hpcrun_fmt_container_section_hdr_swrite(uint64_t image_size,
+                                        const char* trace_name, char* buf)
+{
+  uint32_t len = trace_name ? strlen(trace_name) : 0;
+  buf = hpcfmt_int8_swrite(image_size, buf);
+  buf = hpcfmt_int4_swrite(len, buf);
+  if (len > 0) {
+    memcpy(buf, trace_name, len);
+  }
+  return buf + len;
+}
+
 
 //***************************************************************************
 // hpcrun_sparse_file - YUMENG
@@ -1009,17 +1080,24 @@ hpcrun_fmt_footer_fprint(hpcrun_fmt_footer_t* x, FILE* fs, const char* pre)
 // File sections in order:
 // hdr, loadmap, ccts, metric-tbl, sparse metrics, footer
 //***************************************************************************
-hpcrun_sparse_file_t* hpcrun_sparse_open(const char* path, size_t start_pos, size_t end_pos)
+static hpcrun_sparse_file_t* sparse_open_stream(FILE* fs, size_t start_pos, size_t end_pos)
 {
-  FILE* fs = hpcio_fopen_r(path);
-  if(!fs) return NULL;
-
   hpcrun_sparse_file_t* sparse_fs = (hpcrun_sparse_file_t*) malloc(sizeof(hpcrun_sparse_file_t));
   sparse_fs->file = fs;
   sparse_fs->mode = OPENED;
   sparse_fs->cur_pos = start_pos;
   sparse_fs->start_pos = start_pos;
   sparse_fs->end_pos = end_pos;
+  sparse_fs->image = NULL;
+  sparse_fs->image_size = 0;
+  sparse_fs->image_base = 0;
+  sparse_fs->sm_loaded = false;
+  sparse_fs->sm_vals = NULL;
+  sparse_fs->sm_mids = NULL;
+  sparse_fs->sm_cct_ids = NULL;
+  sparse_fs->sm_cct_idxs = NULL;
+  sparse_fs->sm_val_mid = NULL;
+  sparse_fs->sm_raw = NULL;
 
   sparse_fs->cct_nodes_read    = 0;    //number of cct nodes that have been read
   sparse_fs->metric_bytes_read = 0;    //number of bytes for metric-tbl section that have been read
@@ -1047,6 +1125,104 @@ hpcrun_sparse_file_t* hpcrun_sparse_open(const char* path, size_t start_pos, siz
   return sparse_fs;
 }
 
+// Stream over an in-memory image that starts at file offset `base`, so that
+// all the (absolute) offsets in the footer can be used unchanged
+typedef struct sparse_image_stream {
+  const char* image;
+  size_t size;
+  size_t base;
+  off64_t pos;
+} sparse_image_stream_t;
+
+static ssize_t sparse_image_read(void* cookie, char* buf, size_t size)
+{
+  sparse_image_stream_t* s = cookie;
+  size_t pos = s->pos;
+  if(pos < s->base || pos >= s->base + s->size) return 0;
+  size_t off = pos - s->base;
+  size_t n = s->size - off < size ? s->size - off : size;
+  memcpy(buf, s->image + off, n);
+  s->pos += n;
+  return n;
+}
+
+static int sparse_image_seek(void* cookie, off64_t* offset, int whence)
+{
+  sparse_image_stream_t* s = cookie;
+  off64_t pos;
+  switch(whence) {
+  case SEEK_SET: pos = *offset; break;
+  case SEEK_CUR: pos = s->pos + *offset; break;
+  case SEEK_END: pos = s->base + s->size + *offset; break;
+  default: return -1;
+  }
+  if(pos < 0) return -1;
+  s->pos = *offset = pos;
+  return 0;
+}
+
+static int sparse_image_close(void* cookie)
+{
+  free(cookie);
+  return 0;
+}
+
+static FILE* sparse_fopen_image(const char* image, size_t image_size, size_t base)
+{
+  sparse_image_stream_t* s = malloc(sizeof *s);
+  if(!s) return NULL;
+  s->image = image;
+  s->size = image_size;
+  s->base = base;
+  s->pos = 0;
+  cookie_io_functions_t fns = {
+    .read = sparse_image_read,
+    .write = NULL,
+    .seek = sparse_image_seek,
+    .close = sparse_image_close,
+  };
+  FILE* fs = fopencookie(s, "r", fns);
+  if(!fs) free(s);
+  return fs;
+}
+
+hpcrun_sparse_file_t* hpcrun_sparse_open(const char* path, size_t start_pos, size_t end_pos)
+{
+  FILE* fs = hpcio_fopen_r(path);
+  if(!fs) return NULL;
+  return sparse_open_stream(fs, start_pos, end_pos);
+}
+
+/* Same as hpcrun_sparse_open, but reads from an in-memory image of the file.
+   The image must outlive the returned object. */
+hpcrun_sparse_file_t* hpcrun_sparse_open_image(const char* image, size_t image_size, size_t start_pos, size_t end_pos)
+{
+  FILE* fs = sparse_fopen_image(image, image_size, 0);
+  if(!fs) return NULL;
+  hpcrun_sparse_file_t* sparse_fs = sparse_open_stream(fs, start_pos, end_pos);
+  if(sparse_fs) {
+    sparse_fs->image = image;
+    sparse_fs->image_size = image_size;
+  }
+  return sparse_fs;
+}
+
+/* Redirect all future reads of a paused file to an in-memory image of the
+   same file, starting from the start_pos given when it was opened. The image
+   must outlive the object.
+   succeed: return 0; not paused or image too small: return -1 */
+int hpcrun_sparse_use_image(hpcrun_sparse_file_t* sparse_fs, const char* image, size_t image_size)
+{
+  int ret = hpcrun_sparse_check_mode(sparse_fs, PAUSED, __func__);
+  if(ret != SF_SUCCEED) return SF_ERR;
+  if(image_size < sparse_fs->end_pos - sparse_fs->start_pos) return SF_ERR;
+
+  sparse_fs->image = image;
+  sparse_fs->image_size = image_size;
+  sparse_fs->image_base = sparse_fs->start_pos;
+  return SF_SUCCEED;
+}
+
 //TEMPORARY function: we concatenate hpcrun files into one giant file for experiments
 // so we need to update the footer
 // TODO in the future: if hpcrun output is one file at the beginning,
@@ -1087,7 +1263,9 @@ int hpcrun_sparse_resume(hpcrun_sparse_file_t* sparse_fs, const char* path)
   int ret = hpcrun_sparse_check_mode(sparse_fs, PAUSED, __func__);
   if(ret != SF_SUCCEED) return SF_ERR;
 
-  FILE* fs = hpcio_fopen_r(path);
+  FILE* fs = sparse_fs->image != NULL
+             ? sparse_fopen_image(sparse_fs->image, sparse_fs->image_size, sparse_fs->image_base)
+             : hpcio_fopen_r(path);
   if(!fs) return SF_FAIL;
   if((sparse_fs->cur_pos < sparse_fs->start_pos)
     ||(sparse_fs->cur_pos >= sparse_fs->end_pos))
@@ -1101,6 +1279,11 @@ int hpcrun_sparse_resume(hpcrun_sparse_file_t* sparse_fs, const char* path)
 void hpcrun_sparse_close(hpcrun_sparse_file_t* sparse_fs)
 {
   if(sparse_fs->mode == OPENED) hpcio_fclose(sparse_fs->file);
+  free(sparse_fs->sm_vals);
+  free(sparse_fs->sm_mids);
+  free(sparse_fs->sm_cct_ids);
+  free(sparse_fs->sm_cct_idxs);
+  free(sparse_fs->sm_raw);
   free(sparse_fs);
 }
 
@@ -1290,6 +1473,177 @@ int hpcrun_sparse_next_entry(hpcrun_sparse_file_t* sparse_fs, hpcrun_metricVal_t
 }
 
 
+static inline uint16_t sparse_be2(const unsigned char* p)
+{
+  return ((uint16_t)p[0] << 8) | (uint16_t)p[1];
+}
+
+static inline uint32_t sparse_be4(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+         | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t sparse_be8(const unsigned char* p)
+{
+  return ((uint64_t)sparse_be4(p) << 32) | (uint64_t)sparse_be4(p + 4);
+}
+
+/* Read the whole sparse metrics section in one go and decode its block index.
+   The values themselves are left raw, see sparse_decode_block.
+   succeed: returns 0; error: returns -1 */
+static int sparse_load_blocks(hpcrun_sparse_file_t* sparse_fs)
+{
+  size_t sm_start = sparse_fs->footer.sm_start;
+  size_t sm_end   = sparse_fs->footer.sm_end;
+  if(sm_end < sm_start) return SF_ERR;
+  size_t size = sm_end - sm_start;
+
+  const unsigned char* buf;
+  unsigned char* owned = NULL;
+  if(sparse_fs->image != NULL) {
+    if(sm_start < sparse_fs->image_base
+       || sm_end - sparse_fs->image_base > sparse_fs->image_size) return SF_ERR;
+    buf = (const unsigned char*)sparse_fs->image + (sm_start - sparse_fs->image_base);
+  } else {
+    owned = malloc(size > 0 ? size : 1);
+    if(owned == NULL) return SF_ERR;
+    if(fseek(sparse_fs->file, sm_start, SEEK_SET) != 0
+       || fread(owned, 1, size, sparse_fs->file) != size) {
+      free(owned);
+      return SF_ERR;
+    }
+    buf = owned;
+  }
+
+  size_t off = PMS_id_tuple_len_SIZE;
+  if(size < off) goto fail;
+  off += PMS_id_SIZE * (size_t)sparse_be2(buf);
+  if(size < off + SF_num_val_SIZE + SF_num_nz_cct_node_SIZE) goto fail;
+  uint64_t num_nzval = sparse_be8(buf + off);
+  uint32_t num_nz_cct_nodes = sparse_be4(buf + off + SF_num_val_SIZE);
+  off += SF_num_val_SIZE + SF_num_nz_cct_node_SIZE;
+
+  const size_t pair_size = SF_val_SIZE + SF_mid_SIZE;
+  const size_t idx_size = SF_cct_node_id_SIZE + SF_cct_node_idx_SIZE;
+  if(num_nzval > (size - off) / pair_size) goto fail;
+  const unsigned char* val_mid = buf + off;
+  off += pair_size * num_nzval;
+  if((uint64_t)num_nz_cct_nodes + 1 > (size - off) / idx_size) goto fail;
+  const unsigned char* id_idx = buf + off;
+
+  sparse_fs->sm_vals = malloc(sizeof(hpcrun_metricVal_t) * (num_nzval + 1));
+  sparse_fs->sm_mids = malloc(sizeof(uint16_t) * (num_nzval + 1));
+  sparse_fs->sm_cct_ids = malloc(sizeof(uint32_t) * ((size_t)num_nz_cct_nodes + 1));
+  sparse_fs->sm_cct_idxs = malloc(sizeof(uint64_t) * ((size_t)num_nz_cct_nodes + 1));
+  if(!sparse_fs->sm_vals || !sparse_fs->sm_mids || !sparse_fs->sm_cct_ids
+     || !sparse_fs->sm_cct_idxs)
+    goto fail;
+
+  for(uint32_t i = 0; i <= num_nz_cct_nodes; i++, id_idx += idx_size) {
+    sparse_fs->sm_cct_ids[i] = sparse_be4(id_idx);
+    sparse_fs->sm_cct_idxs[i] = sparse_be8(id_idx + SF_cct_node_id_SIZE);
+  }
+
+  sparse_fs->num_nzval = num_nzval;
+  sparse_fs->num_nz_cct_nodes = num_nz_cct_nodes;
+  sparse_fs->sm_val_mid = val_mid;
+  sparse_fs->sm_raw = owned;
+  sparse_fs->sm_loaded = true;
+  return SF_SUCCEED;
+
+fail:
+  free(owned);
+  return SF_ERR;
+}
+
+/* Decode the values and metric ids of one block into sm_vals and sm_mids.
+   Blocks cover disjoint ranges, so different blocks may be decoded at once.
+   succeed: returns a cct ID; error: returns -1 */
+static int sparse_decode_block(const hpcrun_sparse_file_t* sparse_fs, uint32_t block,
+                               const hpcrun_metricVal_t** vals, const uint16_t** mids, size_t* num_entries)
+{
+  uint64_t start = sparse_fs->sm_cct_idxs[block];
+  uint64_t end   = sparse_fs->sm_cct_idxs[block + 1];
+  if(start > end || end > sparse_fs->num_nzval) return SF_ERR;
+
+  const size_t pair_size = SF_val_SIZE + SF_mid_SIZE;
+  const unsigned char* val_mid = sparse_fs->sm_val_mid + pair_size * start;
+  for(uint64_t i = start; i < end; i++, val_mid += pair_size) {
+    sparse_fs->sm_vals[i].bits = sparse_be8(val_mid);
+    //match the metric id in metricTbl(starting as 1), it was recorded starting as 0
+    sparse_fs->sm_mids[i] = sparse_be2(val_mid + SF_val_SIZE) + 1;
+  }
+
+  *vals = &sparse_fs->sm_vals[start];
+  *mids = &sparse_fs->sm_mids[start];
+  *num_entries = end - start;
+  return sparse_fs->sm_cct_ids[block];
+}
+
+/* Batched alternative to hpcrun_sparse_next_block + hpcrun_sparse_next_entry,
+   do not mix the two. The first call reads and decodes the whole sparse metrics
+   section, later calls do no I/O at all. *vals and *mids (matching metricTbl,
+   start from 1) are set to the *num_entries pairs for the block, which remain
+   valid until the file is closed.
+   succeed: returns a cct ID; end of list: returns 0; error: returns -1 */
+int hpcrun_sparse_next_block_entries(hpcrun_sparse_file_t* sparse_fs, const hpcrun_metricVal_t** vals,
+                                     const uint16_t** mids, size_t* num_entries)
+{
+  int ret = hpcrun_sparse_check_mode(sparse_fs, OPENED, __func__);
+  if(ret != SF_SUCCEED) return SF_ERR;
+
+  if(!sparse_fs->sm_loaded && sparse_load_blocks(sparse_fs) != SF_SUCCEED) return SF_ERR;
+  if(sparse_fs->sm_block_touched == sparse_fs->num_nz_cct_nodes) return SF_END; //no more cct block
+
+  return sparse_decode_block(sparse_fs, sparse_fs->sm_block_touched++, vals, mids, num_entries);
+}
+
+/* Random-access alternative to hpcrun_sparse_next_block_entries, allowing the
+   blocks to be processed by several threads at once. Reads the whole sparse
+   metrics section and decodes its block index, *num_blocks and *num_entries are
+   set to the number of cct blocks and the total number of nonzero values in it.
+   succeed: returns 0; error: returns -1 */
+int hpcrun_sparse_load_blocks(hpcrun_sparse_file_t* sparse_fs, uint32_t* num_blocks, uint64_t* num_entries)
+{
+  int ret = hpcrun_sparse_check_mode(sparse_fs, OPENED, __func__);
+  if(ret != SF_SUCCEED) return SF_ERR;
+
+  if(!sparse_fs->sm_loaded && sparse_load_blocks(sparse_fs) != SF_SUCCEED) return SF_ERR;
+  *num_blocks = sparse_fs->num_nz_cct_nodes;
+  *num_entries = sparse_fs->num_nzval;
+  return SF_SUCCEED;
+}
+
+/* Decode and get the entries of the given block (< *num_blocks) after a
+   successful hpcrun_sparse_load_blocks, as for hpcrun_sparse_next_block_entries.
+   May be called from multiple threads at once, as long as each block is only
+   requested by one thread at a time.
+   succeed: returns a cct ID; error: returns -1 */
+int hpcrun_sparse_block_entries(const hpcrun_sparse_file_t* sparse_fs, uint32_t block,
+                                const hpcrun_metricVal_t** vals, const uint16_t** mids, size_t* num_entries)
+{
+  if(!sparse_fs->sm_loaded || block >= sparse_fs->num_nz_cct_nodes) return SF_ERR;
+
+  return sparse_decode_block(sparse_fs, block, vals, mids, num_entries);
+}
+
+/* Find the first block whose values start at or after the given nonzero value
+   index, for splitting the section into blocks of roughly equal size. Returns
+   the number of blocks if there is no such block. */
+uint32_t hpcrun_sparse_block_at(const hpcrun_sparse_file_t* sparse_fs, uint64_t entry)
+{
+  if(!sparse_fs->sm_loaded) return 0;
+  uint32_t lo = 0, hi = sparse_fs->num_nz_cct_nodes;
+  while(lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if(sparse_fs->sm_cct_idxs[mid] < entry) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+
 
 //***************************************************************************
 // hpctrace (located here for now)
@@ -1514,6 +1868,206 @@ hpctrace_fmt_datum_fprint(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 }
 
 
+//***************************************************************************
+// [hpctrace] packed trace records
+//***************************************************************************
+
+static inline uint64_t
+hpctrace_zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+hpctrace_unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline unsigned int
+hpctrace_varint_write(unsigned char* buf, uint64_t v)
+{
+  unsigned int n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (unsigned char)v;
+  return n;
+}
+
+// Returns the number of bytes read, or 0 if the varint runs past `len`
+static inline unsigned int
+hpctrace_varint_read(uint64_t* v, const unsigned char* buf, unsigned int len)
+{
+  uint64_t out = 0;
+  unsigned int shift = 0;
+  for (unsigned int n = 0; n < len && shift < 64; n++, shift += 7) {
+    out |= (uint64_t)(buf[n] & 0x7f) << shift;
+    if (!(buf[n] & 0x80)) {
+      *v = out;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+
+void
+hpctrace_fmt_packed_init(hpctrace_fmt_packed_t* p)
+{
+  p->baseTime = 0;
+  p->prevTime = 0;
+  p->prevCpId = 0;
+  p->nSamples = 0;
+  p->nBytes = 0;
+  p->pos = 0;
+}
+
+
+int
+hpctrace_fmt_packed_datum_outbuf(hpctrace_fmt_datum_t* x,
+                                 hpctrace_hdr_flags_t flags,
+                                 hpctrace_fmt_packed_t* p,
+                                 hpcio_outbuf_t* outbuf)
+{
+  uint64_t time = HPCTRACE_FMT_GET_TIME(x->comp);
+
+  // Start a new block if this record may not fit, or if the time delta is too
+  // large to leave room for the repeat bit after zigzagging.
+  int64_t dt = (int64_t)(time - p->prevTime);
+  if (p->nSamples > 0
+      && (p->nBytes + HPCTRACE_FMT_PackedDatumMaxSz > HPCTRACE_FMT_PackedBlockSz
+          || dt >= ((int64_t)1 << 61) || dt < -((int64_t)1 << 61))) {
+    HPCFMT_ThrowIfError(hpctrace_fmt_packed_flush(p, outbuf));
+  }
+  if (p->nSamples == 0) {
+    p->baseTime = p->prevTime = time;
+    p->prevCpId = 0;
+    dt = 0;
+  }
+
+  unsigned char* d = &p->buf[p->nBytes];
+  unsigned int k = 0;
+  bool repeat = x->cpId == p->prevCpId;
+  k += hpctrace_varint_write(&d[k], (hpctrace_zigzag(dt) << 1) | repeat);
+  if (!repeat) {
+    k += hpctrace_varint_write(&d[k],
+        hpctrace_zigzag((int64_t)x->cpId - (int64_t)p->prevCpId));
+  }
+  if (HPCTRACE_HDR_FLAGS_GET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS)) {
+    k += hpctrace_varint_write(&d[k], x->metricId);
+  }
+
+  p->nBytes += k;
+  p->nSamples++;
+  p->prevTime = time;
+  p->prevCpId = x->cpId;
+  return HPCFMT_OK;
+}
+
+
+int
+hpctrace_fmt_packed_flush(hpctrace_fmt_packed_t* p, hpcio_outbuf_t* outbuf)
+{
+  if (p->nSamples == 0) {
+    return HPCFMT_OK;
+  }
+
+  unsigned char hdr[HPCTRACE_FMT_PackedBlockHdrSz];
+  int k = 0;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    hdr[k++] = (p->nSamples >> shift) & 0xff;
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    hdr[k++] = (p->nBytes >> shift) & 0xff;
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    hdr[k++] = (p->baseTime >> shift) & 0xff;
+  }
+
+  if (hpcio_outbuf_write(outbuf, hdr, k) != k
+      || hpcio_outbuf_write(outbuf, p->buf, p->nBytes) != (ssize_t)p->nBytes) {
+    return HPCFMT_ERR;
+  }
+
+  p->nSamples = 0;
+  p->nBytes = 0;
+  return HPCFMT_OK;
+}
+
+
+int
+hpctrace_fmt_packed_blockhdr_fread(uint32_t* nSamples, uint32_t* nBytes,
+                                   uint64_t* baseTime, FILE* fs)
+{
+  int ret = hpcfmt_int4_fread(nSamples, fs);
+  if (ret != HPCFMT_OK) {
+    return ret; // can be HPCFMT_EOF
+  }
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(nBytes, fs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fread(baseTime, fs));
+  if (*nBytes > HPCTRACE_FMT_PackedBlockSz) {
+    return HPCFMT_ERR;
+  }
+  return HPCFMT_OK;
+}
+
+
+int
+hpctrace_fmt_packed_datum_fread(hpctrace_fmt_datum_t* x,
+                                hpctrace_hdr_flags_t flags,
+                                hpctrace_fmt_packed_t* p, FILE* fs)
+{
+  if (p->nSamples == 0) {
+    int ret = hpctrace_fmt_packed_blockhdr_fread(&p->nSamples, &p->nBytes,
+                                                 &p->baseTime, fs);
+    if (ret != HPCFMT_OK) {
+      return ret; // can be HPCFMT_EOF
+    }
+    if (p->nSamples == 0 || fread(p->buf, 1, p->nBytes, fs) != p->nBytes) {
+      return HPCFMT_ERR;
+    }
+    p->prevTime = p->baseTime;
+    p->prevCpId = 0;
+    p->pos = 0;
+  }
+
+  const unsigned char* d = &p->buf[p->pos];
+  unsigned int len = p->nBytes - p->pos;
+  unsigned int k, n;
+  uint64_t v;
+
+  if ((k = hpctrace_varint_read(&v, d, len)) == 0) {
+    return HPCFMT_ERR;
+  }
+  p->prevTime += (uint64_t)hpctrace_unzigzag(v >> 1);
+  if (!(v & 1)) {
+    if ((n = hpctrace_varint_read(&v, d + k, len - k)) == 0) {
+      return HPCFMT_ERR;
+    }
+    k += n;
+    p->prevCpId = (uint32_t)((int64_t)p->prevCpId + hpctrace_unzigzag(v));
+  }
+  if (HPCTRACE_HDR_FLAGS_GET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS)) {
+    if ((n = hpctrace_varint_read(&v, d + k, len - k)) == 0) {
+      return HPCFMT_ERR;
+    }
+    k += n;
+    x->metricId = (uint32_t)v;
+  }
+  else {
+    x->metricId = HPCTRACE_FMT_MetricId_NULL;
+  }
+
+  x->comp = p->prevTime;
+  x->cpId = p->prevCpId;
+  p->pos += k;
+  p->nSamples--;
+  return HPCFMT_OK;
+}
+
+
 //***************************************************************************
 // hpcprof-metricdb (located here for now)
 //***************************************************************************
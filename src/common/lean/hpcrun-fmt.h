@@ -615,6 +615,54 @@ int
 hpcrun_fmt_footer_fprint(hpcrun_fmt_footer_t* x, FILE* fs, const char* pre);
 
 
+// --------------------------------------------------------------------------
+// hpcrun_fmt_container
+// --------------------------------------------------------------------------
+// A container file aggregates the profiles of all threads of a process. It
+// uses the same suffix as a single profile but starts with its own magic,
+// followed by any number of self-describing sections:
+//
+//   container = "HPCRUN-container" section*
+//   section   = image-size{8b} trace-name-str image{image-size b}
+//
+// Each image is a complete profile, with footer offsets relative to the
+// start of the image. The trace name is the basename of the thread's trace
+// file in the same directory, or empty if there is none. Sections are
+// appended as threads finish, so there is no global table; readers walk
+// the sections and stop at the first truncated one.
+
+static const char HPCRUN_CONTAINER_Magic[] = "HPCRUN-container"; // 16 bytes
+static const int HPCRUN_CONTAINER_MagicLen = (sizeof(HPCRUN_CONTAINER_Magic) - 1);
+
+typedef struct hpcrun_fmt_container_section_t {
+  uint64_t start;     // offset of the first byte of the image
+  uint64_t end;       // offset one past the last byte of the image
+  char* trace_name;
+} hpcrun_fmt_container_section_t;
+
+// Returns HPCFMT_OK if the stream is positioned at the start of a container
+int
+hpcrun_fmt_container_hdr_fread(FILE* infs);
+
+// Reads the section header at the current position and seeks past its
+// image. Returns HPCFMT_EOF at the end of the container.
+int
+hpcrun_fmt_container_section_fread(hpcrun_fmt_container_section_t* x,
+                                   FILE* infs, hpcfmt_alloc_fn alloc);
+
+void
+hpcrun_fmt_container_section_free(hpcrun_fmt_container_section_t* x,
+                                  hpcfmt_free_fn dealloc);
+
+// Size of the header preceding an image in a section
+size_t
+hpcrun_fmt_container_section_hdr_size(const char* trace_name);
+
+char*
+hpcrun_fmt_container_section_hdr_swrite(uint64_t image_size,
+                                        const char* trace_name, char* buf);
+
+
 // --------------------------------------------------------------------------
 // hpcrun_sparse_file
 // --------------------------------------------------------------------------
@@ -666,12 +714,28 @@ typedef struct hpcrun_sparse_file {
   size_t cct_node_id_idx_offset;
   size_t val_mid_offset;
 
+  //in-memory image of the file, if not NULL all reads are served from here
+  const char* image;
+  size_t image_size;
+  size_t image_base; //file offset of the first byte of the image
+
+  //whole sparse metrics section in memory, see hpcrun_sparse_next_block_entries.
+  //The block index is decoded on load, the values and metric ids per block on use.
+  bool sm_loaded;
+  hpcrun_metricVal_t* sm_vals;
+  uint16_t* sm_mids;        //already adjusted to match metricTbl (starting as 1)
+  uint32_t* sm_cct_ids;
+  uint64_t* sm_cct_idxs;    //num_nz_cct_nodes + 1 entries, last is the end of the last block
+  const unsigned char* sm_val_mid; //raw (value, metric id) pairs, in the image or sm_raw
+  unsigned char* sm_raw;    //copy of the section if not served from the image
 
 } hpcrun_sparse_file_t;
 
 void hpcrun_sparse_footer_update_w_start(hpcrun_fmt_footer_t *f, size_t start_pos);
 
 hpcrun_sparse_file_t* hpcrun_sparse_open(const char* path, size_t start_pos, size_t end_pos);
+hpcrun_sparse_file_t* hpcrun_sparse_open_image(const char* image, size_t image_size, size_t start_pos, size_t end_pos);
+int hpcrun_sparse_use_image(hpcrun_sparse_file_t* sparse_fs, const char* image, size_t image_size);
 int hpcrun_sparse_pause(hpcrun_sparse_file_t* sparse_fs);
 int hpcrun_sparse_resume(hpcrun_sparse_file_t* sparse_fs, const char* path);
 void hpcrun_sparse_close(hpcrun_sparse_file_t* sparse_fs);
@@ -685,6 +749,12 @@ int hpcrun_sparse_read_idtuple_dxnry(hpcrun_sparse_file_t* sparse_fs, hpcrun_fmt
 int hpcrun_sparse_read_id_tuple(hpcrun_sparse_file_t* sparse_fs, id_tuple_t* id_tuple);
 int hpcrun_sparse_next_block(hpcrun_sparse_file_t* sparse_fs);
 int hpcrun_sparse_next_entry(hpcrun_sparse_file_t* sparse_fs, hpcrun_metricVal_t* val);
+int hpcrun_sparse_next_block_entries(hpcrun_sparse_file_t* sparse_fs, const hpcrun_metricVal_t** vals,
+                                     const uint16_t** mids, size_t* num_entries);
+int hpcrun_sparse_load_blocks(hpcrun_sparse_file_t* sparse_fs, uint32_t* num_blocks, uint64_t* num_entries);
+int hpcrun_sparse_block_entries(const hpcrun_sparse_file_t* sparse_fs, uint32_t block,
+                                const hpcrun_metricVal_t** vals, const uint16_t** mids, size_t* num_entries);
+uint32_t hpcrun_sparse_block_at(const hpcrun_sparse_file_t* sparse_fs, uint64_t entry);
 
 
 //***************************************************************************
@@ -717,6 +787,7 @@ typedef struct hpctrace_hdr_flags_bitfield {
 #define HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS 0U
 #define HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS 1U
 #define HPCTRACE_HDR_FLAGS_CALL_TRACE_BIT_POS 2U
+#define HPCTRACE_HDR_FLAGS_PACKED_BIT_POS 3U
 
 #define HPCTRACE_HDR_FLAGS_GET_BIT(flag, pos) \
   ((flag >> pos) & 1U)
@@ -819,6 +890,71 @@ hpctrace_fmt_datum_fprint(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
                           FILE* fs);
 
 
+//***************************************************************************
+// [hpctrace] packed trace records
+//***************************************************************************
+
+// If HPCTRACE_HDR_FLAGS_PACKED_BIT_POS is set, trace records are not stored
+// as fixed-width datums but packed into blocks. Each block is:
+//   uint32_t nSamples   number of records in the block
+//   uint32_t nBytes     size of the packed records that follow
+//   uint64_t baseTime   time of the first record in the block
+//   nBytes of packed records, each of which is:
+//     varint  (zigzag(time - prevTime) << 1) | (cpId == prevCpId)
+//     varint  zigzag(cpId - prevCpId), only if the cpId changed
+//     varint  metricId, only if DATA_CENTRIC is set
+// Varints are LEB128 (low 7 bits first). For the first record of a block
+// prevTime is baseTime and prevCpId is 0. Blocks are self-contained, so
+// readers can count records and seek to any block without decoding.
+
+// Size of a block header
+#define HPCTRACE_FMT_PackedBlockHdrSz 16
+
+// Maximum size of the packed records in one block
+#define HPCTRACE_FMT_PackedBlockSz 8192
+
+// Maximum size of a single packed record
+#define HPCTRACE_FMT_PackedDatumMaxSz 20
+
+typedef struct hpctrace_fmt_packed_t {
+  uint64_t baseTime;
+  uint64_t prevTime;
+  uint32_t prevCpId;
+  uint32_t nSamples;  // records in the block (writer) or left to read (reader)
+  uint32_t nBytes;    // bytes of packed records in buf
+  uint32_t pos;       // read cursor in buf (reader only)
+  unsigned char buf[HPCTRACE_FMT_PackedBlockSz];
+} hpctrace_fmt_packed_t;
+
+
+void
+hpctrace_fmt_packed_init(hpctrace_fmt_packed_t* p);
+
+// Append the trace record to the current block, first writing the block out
+// to the outbuf if it is full.
+int
+hpctrace_fmt_packed_datum_outbuf(hpctrace_fmt_datum_t* x,
+                                 hpctrace_hdr_flags_t flags,
+                                 hpctrace_fmt_packed_t* p,
+                                 hpcio_outbuf_t* outbuf);
+
+// Write out the current block, if it is not empty.
+int
+hpctrace_fmt_packed_flush(hpctrace_fmt_packed_t* p, hpcio_outbuf_t* outbuf);
+
+// Read a block header. Returns HPCFMT_EOF at the end of the trace.
+int
+hpctrace_fmt_packed_blockhdr_fread(uint32_t* nSamples, uint32_t* nBytes,
+                                   uint64_t* baseTime, FILE* fs);
+
+// Read the next trace record, reading in the next block as needed.
+// Returns HPCFMT_EOF at the end of the trace.
+int
+hpctrace_fmt_packed_datum_fread(hpctrace_fmt_datum_t* x,
+                                hpctrace_hdr_flags_t flags,
+                                hpctrace_fmt_packed_t* p, FILE* fs);
+
+
 //***************************************************************************
 // hpcprof-metricdb (located here for now)
 //***************************************************************************
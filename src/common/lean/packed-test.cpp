@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "formats/packed.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Serialize a full packed array of the given entries
+std::vector<char> pack(const std::vector<std::pair<uint32_t, double>>& entries) {
+  std::vector<char> buf(FMT_PACKED_SZ_Max(entries.size()));
+  size_t n = fmt_packed_count_write(buf.data(), entries.size());
+  uint32_t prevId = 0;
+  for (const auto& [id, value] : entries)
+    n += fmt_packed_entry_write(&buf[n], &prevId, id, value);
+  buf.resize(n);
+  return buf;
+}
+
+// Deserialize a full packed array, checking that exactly `size` bytes are used
+std::vector<std::pair<uint32_t, double>> unpack(const std::vector<char>& buf) {
+  uint64_t count;
+  size_t n = fmt_packed_count_read(&count, buf.data());
+  std::vector<std::pair<uint32_t, double>> out;
+  uint32_t prevId = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint32_t id;
+    double value;
+    n += fmt_packed_entry_read(&id, &value, &prevId, &buf[n]);
+    out.emplace_back(id, value);
+  }
+  EXPECT_EQ(n, buf.size());
+  return out;
+}
+
+bool sameBits(double a, double b) { return std::memcmp(&a, &b, sizeof a) == 0; }
+
+}  // namespace
+
+TEST(PackedTest, Encoding) {
+  // Matches the example given in FORMATS.md and the Python reader's tests
+  const auto buf = pack({{2, 0.0}, {5, 300.0}, {4, -1.0}, {4, 0.5}});
+  const std::vector<char> expected = {
+      '\x04', '\x10', '\x19', '\xac', '\x02', '\x06', '\x01',
+      '\x03', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\xe0', '\x3f'};
+  EXPECT_EQ(buf, expected);
+}
+
+TEST(PackedTest, RoundTrip) {
+  const std::vector<std::pair<uint32_t, double>> entries = {
+      {0, 1.0},
+      {1, 0.0},
+      {2, -0.0},
+      {3, 3.25},
+      {7, -42.0},
+      {8, 9007199254740991.0},
+      {9, 9007199254740992.0},
+      {10, -9007199254740991.0},
+      {11, std::numeric_limits<double>::infinity()},
+      {12, std::numeric_limits<double>::quiet_NaN()},
+      {13, std::numeric_limits<double>::denorm_min()},
+      {std::numeric_limits<uint32_t>::max(), 1e300},
+      {0, 17.0},
+  };
+  const auto buf = pack(entries);
+  EXPECT_LE(buf.size(), FMT_PACKED_SZ_Max(entries.size()));
+
+  const auto got = unpack(buf);
+  ASSERT_EQ(got.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    EXPECT_EQ(got[i].first, entries[i].first) << "at entry " << i;
+    EXPECT_TRUE(sameBits(got[i].second, entries[i].second)) << "at entry " << i;
+  }
+}
+
+TEST(PackedTest, Compact) {
+  // Dense ids with small integer values should take 2 bytes per entry
+  std::vector<std::pair<uint32_t, double>> entries;
+  for (uint32_t i = 0; i < 1000; i++)
+    entries.emplace_back(i, (double)(i % 100));
+  const auto buf = pack(entries);
+  EXPECT_LE(buf.size(), 2 + entries.size() * 2);
+  EXPECT_EQ(unpack(buf), entries);
+}
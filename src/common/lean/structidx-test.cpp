@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "formats/structidx.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+// Serialize a sorted table of Leaves covering the given ranges
+std::vector<char> makeLeaves(const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+  std::vector<char> table(ranges.size() * FMT_STRUCTIDX_SZ_Leaf);
+  for (size_t i = 0; i < ranges.size(); i++) {
+    fmt_structidx_leaf_t lf = {ranges[i].first, ranges[i].second, (uint32_t)i, (uint32_t)(i * 2)};
+    fmt_structidx_leaf_write(table.data() + i * FMT_STRUCTIDX_SZ_Leaf, &lf);
+  }
+  return table;
+}
+
+}  // namespace
+
+TEST(StructIdxTest, Header) {
+  char d[FMT_STRUCTIDX_SZ_FHdr];
+  fmt_structidx_fHdr_t hdr = {};
+  hdr.pModules = 0x20;
+  hdr.nModules = 3;
+  fmt_structidx_fHdr_write(d, &hdr);
+
+  uint8_t minor;
+  EXPECT_EQ(fmt_structidx_check(d, &minor), fmt_version_exact);
+  EXPECT_EQ(minor, FMT_STRUCTIDX_MinorVersion);
+
+  fmt_structidx_fHdr_t got;
+  fmt_structidx_fHdr_read(&got, d);
+  EXPECT_EQ(got.pModules, 0x20u);
+  EXPECT_EQ(got.nModules, 3u);
+  EXPECT_EQ(got.szModule, FMT_STRUCTIDX_SZ_Module);
+
+  d[0] = 'X';
+  EXPECT_EQ(fmt_structidx_check(d, nullptr), fmt_version_invalid);
+}
+
+TEST(StructIdxTest, Records) {
+  char d[FMT_STRUCTIDX_SZ_Module];
+  fmt_structidx_module_t lm = {0x100, 0x200, 0x300, 0x400, 0x500, 1, 2, 3, 4, true};
+  fmt_structidx_module_write(d, &lm);
+  fmt_structidx_module_t lm2;
+  fmt_structidx_module_read(&lm2, d);
+  EXPECT_EQ(lm2.pPath, lm.pPath);
+  EXPECT_EQ(lm2.pCalls, lm.pCalls);
+  EXPECT_EQ(lm2.nCalls, lm.nCalls);
+  EXPECT_TRUE(lm2.hasCalls);
+
+  fmt_structidx_scope_t sc = {0x401000, 0x600, 7, 9, 42, fmt_structidx_scope_loop,
+                              fmt_structidx_relation_inlined_call};
+  fmt_structidx_scope_write(d, &sc);
+  fmt_structidx_scope_t sc2;
+  fmt_structidx_scope_read(&sc2, d);
+  EXPECT_EQ(sc2.addr, sc.addr);
+  EXPECT_EQ(sc2.parent, sc.parent);
+  EXPECT_EQ(sc2.line, sc.line);
+  EXPECT_EQ(sc2.kind, fmt_structidx_scope_loop);
+  EXPECT_EQ(sc2.relation, fmt_structidx_relation_inlined_call);
+
+  fmt_structidx_call_t c = {0x401000, 0x402010, 5};
+  fmt_structidx_call_write(d, &c);
+  fmt_structidx_call_t c2;
+  fmt_structidx_call_read(&c2, d);
+  EXPECT_EQ(c2.callee, c.callee);
+  EXPECT_EQ(c2.callerInst, c.callerInst);
+  EXPECT_EQ(c2.caller, c.caller);
+}
+
+TEST(StructIdxTest, LeafFind) {
+  auto table = makeLeaves({{0x10, 0x20}, {0x20, 0x28}, {0x40, 0x50}});
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x0f), -1);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x10), 0);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x1f), 0);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x20), 1);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x30), -1);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x4f), 2);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 3, 0x50), -1);
+  EXPECT_EQ(fmt_structidx_leaf_find(table.data(), 0, 0x10), -1);
+
+  fmt_structidx_leaf_t lf;
+  fmt_structidx_leaf_read(&lf, table.data() + 2 * FMT_STRUCTIDX_SZ_Leaf);
+  EXPECT_EQ(lf.scope, 2u);
+  EXPECT_EQ(lf.function, 4u);
+}
@@ -9,6 +9,9 @@
 #include "context.hpp"
 #include "metric.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
 #include <ostream>
 #include <stack>
 
@@ -80,6 +83,140 @@ void StatisticAccumulator::PartialRef::addRaw(const raw_t& v) noexcept {
     partial.isLoop.store(isLoop, std::memory_order_relaxed);
 }
 
+// Combine raw accumulator values, with the same semantics as atomic_op. The
+// loops run over whole tuples so they vectorize cleanly.
+static void combine(StatisticAccumulator::raw_t& a, const StatisticAccumulator::raw_t& v,
+                    Statistic::combination_t op) noexcept {
+  constexpr std::size_t n = std::tuple_size_v<StatisticAccumulator::raw_t> - 1;
+  switch(op) {
+  case Statistic::combination_t::sum:
+    for(std::size_t i = 0; i < n; i++) a[i] += v[i];
+    break;
+  case Statistic::combination_t::min:
+    for(std::size_t i = 0; i < n; i++) a[i] = v[i] < a[i] || a[i] == 0 ? v[i] : a[i];
+    break;
+  case Statistic::combination_t::max:
+    for(std::size_t i = 0; i < n; i++) a[i] = v[i] > a[i] || a[i] == 0 ? v[i] : a[i];
+    break;
+  }
+  a[n] = v[n];  // isLoop flag, not combined
+}
+
+// Partials are packed in arrays, so scramble the address to spread them out.
+// The table slot uses the high half of the hash and the shard the middle bits,
+// since the lowest bits are always zero for aligned addresses.
+static std::uint64_t partialHash(const void* p) noexcept {
+  return (std::uint64_t)reinterpret_cast<std::uintptr_t>(p) * UINT64_C(0x9E3779B97F4A7C15);
+}
+
+bool StatisticStaging::Table::add(Partial& p, const StatisticPartial& sp,
+                                  const raw_t& v, std::size_t limit) noexcept {
+  if(m_slots.empty()) rehash(16);
+  std::size_t mask = m_slots.size() - 1;
+  std::size_t i = (partialHash(&p) >> 32) & mask;
+  for(; m_slots[i].partial != nullptr; i = (i + 1) & mask) {
+    if(m_slots[i].partial == &p) {
+      combine(m_slots[i].value, v, sp.combinator());
+      return true;
+    }
+  }
+  if(m_used >= limit) return false;
+  if((m_used + 1) * 2 > m_slots.size()) {
+    // Keep the load factor at most 1/2, so probe sequences stay short
+    rehash(m_slots.size() * 2);
+    mask = m_slots.size() - 1;
+    for(i = (partialHash(&p) >> 32) & mask; m_slots[i].partial != nullptr; i = (i + 1) & mask);
+  }
+  m_slots[i] = {&p, &sp, v};
+  m_used++;
+  return true;
+}
+
+void StatisticStaging::Table::rehash(std::size_t slots) noexcept {
+  std::vector<Entry> old(slots);
+  std::swap(old, m_slots);
+  const std::size_t mask = m_slots.size() - 1;
+  for(const auto& e: old) {
+    if(e.partial == nullptr) continue;
+    std::size_t i = (partialHash(e.partial) >> 32) & mask;
+    for(; m_slots[i].partial != nullptr; i = (i + 1) & mask);
+    m_slots[i] = e;
+  }
+}
+
+void StatisticStaging::Table::clear() noexcept {
+  m_slots = {};
+  m_used = 0;
+}
+
+StatisticStaging::StatisticStaging(Shards& shards, std::size_t capacity)
+  : m_shards(shards), m_capacity(std::max<std::size_t>(capacity, 1)) {};
+
+StatisticStaging::~StatisticStaging() {
+  assert(m_table.size() == 0 && "StatisticStaging destroyed without being flushed!");
+}
+
+void StatisticStaging::add(Partial& p, const StatisticPartial& sp, const raw_t& v) noexcept {
+  if(!m_table.add(p, sp, v, m_capacity)) {
+    // Full, hand everything over and start afresh with this Partial
+    flush();
+    [[maybe_unused]] bool ok = m_table.add(p, sp, v, m_capacity);
+    assert(ok);
+  }
+}
+
+void StatisticStaging::flush() noexcept {
+  if(m_table.size() == 0) return;
+  const std::size_t n = m_shards.size();
+
+  // Bucket the Entries by shard, so each shard is only locked once
+  std::vector<std::size_t> offsets(n + 1, 0);
+  for(const auto& e: m_table.slots())
+    if(e.partial != nullptr) offsets[(partialHash(e.partial) >> 16) % n + 1]++;
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<const Entry*> order(m_table.size());
+  {
+    auto pos = offsets;
+    for(const auto& e: m_table.slots())
+      if(e.partial != nullptr) order[pos[(partialHash(e.partial) >> 16) % n]++] = &e;
+  }
+
+  // Start at a different shard for each worker, to spread out the locking
+  const std::size_t start = (partialHash(this) >> 16) % n;
+  for(std::size_t k = 0; k < n; k++) {
+    const std::size_t s = (start + k) % n;
+    if(offsets[s] == offsets[s + 1]) continue;
+    auto& shard = m_shards.m_shards[s];
+    std::unique_lock<std::mutex> l{shard.lock};
+    for(std::size_t j = offsets[s]; j < offsets[s + 1]; j++) {
+      const Entry& e = *order[j];
+      shard.table.add(*e.partial, *e.statpart, e.value,
+                      std::numeric_limits<std::size_t>::max());
+    }
+  }
+  m_table.clear();
+}
+
+StatisticStaging::Shards::Shards(std::size_t shards)
+  : m_shards(std::max<std::size_t>(shards, 1)) {};
+
+void StatisticStaging::Shards::reduce(std::size_t shard) noexcept {
+  auto& table = m_shards[shard].table;
+  for(const auto& e: table.slots()) {
+    if(e.partial == nullptr) continue;
+    // No other thread touches this Partial, so there is no need for atomic
+    // read-modify-write operations here.
+    raw_t v = e.partial->getRaw();
+    combine(v, e.value, e.statpart->combinator());
+    e.partial->point.store(v[0], std::memory_order_relaxed);
+    e.partial->function.store(v[1], std::memory_order_relaxed);
+    e.partial->function_noloops.store(v[2], std::memory_order_relaxed);
+    e.partial->execution.store(v[3], std::memory_order_relaxed);
+    e.partial->isLoop.store(v[4] == 1.0, std::memory_order_relaxed);
+  }
+  table.clear();  // Free up the memory early
+}
+
 StatisticAccumulator::PartialCRef StatisticAccumulator::get(const StatisticPartial& p) const noexcept {
   return {partials[p.m_idx]};
 }
@@ -129,6 +266,105 @@ MetricScopeSet MetricAccumulator::getNonZero() const noexcept {
   return out;
 }
 
+std::optional<double> ThreadAccumulators::Value::get(MetricScope s) const noexcept {
+  switch(s) {
+  case MetricScope::point: return opt0(point);
+  case MetricScope::function: return opt0(function);
+  case MetricScope::lex_aware: return opt0(isLoop ? function_noloops : function);
+  case MetricScope::execution: return opt0(execution);
+  }
+  assert(false && "Invalid MetricScope!");
+  std::abort();
+}
+
+MetricScopeSet ThreadAccumulators::Value::getNonZero() const noexcept {
+  MetricScopeSet out;
+  for(MetricScope ms: MetricScopeSet(MetricScopeSet::all))
+    if(get(ms)) out |= ms;
+  return out;
+}
+
+util::optional_ref<const ThreadAccumulators::Value>
+ThreadAccumulators::Row::find(const Metric& m) const noexcept {
+  auto it = std::lower_bound(m_begin, m_end, &m,
+    [](const Value& v, const Metric* m){
+      return std::less<const Metric*>{}(&v.metric(), m);
+    });
+  if(it == m_end || &it->metric() != &m) return std::nullopt;
+  return *it;
+}
+
+// Ordering for staged Points: by Context, then by Metric
+static bool pointLess(const Context* ac, const Metric* am,
+                      const Context* bc, const Metric* bm) noexcept {
+  if(ac != bc) return std::less<const Context*>{}(ac, bc);
+  return std::less<const Metric*>{}(am, bm);
+}
+
+void ThreadAccumulators::add(const Context& c, const Metric& m, double v) noexcept {
+  std::unique_lock<std::mutex> l(m_lock);
+  m_points.push_back({&c, &m, v});
+  // Compact once the unsorted tail outgrows the sorted prefix. This keeps the
+  // total work at O(n log n) and the memory overhead at a constant factor of
+  // the number of unique (Context, Metric) pairs.
+  const std::size_t tail = m_points.size() - m_sorted;
+  if(tail >= std::max<std::size_t>(m_sorted, 1 << 16)) compact();
+}
+
+void ThreadAccumulators::Batch::flush() noexcept {
+  if(m_points.empty()) return;
+  auto& t = *m_table;
+  {
+    std::unique_lock<std::mutex> l(t.m_lock);
+    t.m_points.insert(t.m_points.end(), m_points.cbegin(), m_points.cend());
+    const std::size_t tail = t.m_points.size() - t.m_sorted;
+    if(tail >= std::max<std::size_t>(t.m_sorted, 1 << 16)) t.compact();
+  }
+  m_points.clear();
+}
+
+void ThreadAccumulators::compact() noexcept {
+  const auto less = [](const Point& a, const Point& b) -> bool {
+    return pointLess(a.ctx, a.metric, b.ctx, b.metric);
+  };
+  auto mid = m_points.begin() + m_sorted;
+  std::sort(mid, m_points.end(), less);
+  std::inplace_merge(m_points.begin(), mid, m_points.end(), less);
+
+  // Merge Points with equal keys by summing their values
+  auto out = m_points.begin();
+  for(auto it = m_points.begin(); it != m_points.end(); ++it) {
+    if(out != m_points.begin() && (out-1)->ctx == it->ctx
+       && (out-1)->metric == it->metric)
+      (out-1)->value += it->value;
+    else
+      *out++ = *it;
+  }
+  m_points.erase(out, m_points.end());
+  m_sorted = m_points.size();
+}
+
+ThreadAccumulators::point_range
+ThreadAccumulators::points(const Context& c) const noexcept {
+  assert(m_sorted == m_points.size() && "Staged Points were not compacted!");
+  auto [b, e] = std::equal_range(m_points.begin(), m_points.end(),
+    Point{&c, nullptr, 0}, [](const Point& a, const Point& b){
+      return std::less<const Context*>{}(a.ctx, b.ctx);
+    });
+  return {m_points.data() + (b - m_points.begin()),
+          m_points.data() + (e - m_points.begin())};
+}
+
+std::optional<ThreadAccumulators::Row>
+ThreadAccumulators::find(const Context& c) const noexcept {
+  auto it = std::lower_bound(m_rows.begin(), m_rows.end(), &c,
+    [](const Row& r, const Context* c){
+      return std::less<const Context*>{}(r.m_ctx, c);
+    });
+  if(it == m_rows.end() || it->m_ctx != &c) return std::nullopt;
+  return *it;
+}
+
 StatisticAccumulator& PerContextAccumulators::statisticsFor(const Metric& m) noexcept {
   return m_statistics.emplace(std::piecewise_construct,
                               std::forward_as_tuple(m),
@@ -139,7 +375,7 @@ void PerContextAccumulators::markUsed(const Metric& m, MetricScopeSet ms) noexce
   m_metricUsage[m] |= ms & m.scopes();
 }
 
-void PerThreadTemporary::finalize() noexcept {
+void PerThreadTemporary::finalize(StatisticStaging& staging) noexcept {
   // Before doing anything else, we need to redistribute the metric values
   // attributed to Reconstructions and FlowGraphs within this Thread.
   {
@@ -152,6 +388,7 @@ void PerThreadTemporary::finalize() noexcept {
     };
 
     // First redistribute the Reconstructions, since those are a bit easier.
+    c_data.compact();
     for(const auto& [r, input]: r_data.citerate()) {
       auto [factors, hasEC] = r->rescalingFactors(c_data);
       {
@@ -180,13 +417,12 @@ void PerThreadTemporary::finalize() noexcept {
       std::unordered_map<util::reference_index<const Metric>, double>> r_sums;
     for(auto& [idx, group]: r_groups.iterate()) {
       for(const auto& [c, input]: group.c_data.citerate()) {
-        auto& data = c_data[c];
         for(const auto& [m, va]: input.citerate()) {
           if(auto v = va.get(MetricScope::point)) {
             auto [it, first] = r_sums[c].try_emplace(m, *v);
             if(!first) it->second += *v;
 
-            data[m].add(*v);
+            c_data.add(c, m, *v);
           }
         }
       }
@@ -252,12 +488,12 @@ void PerThreadTemporary::finalize() noexcept {
 
     // Fold the redistributed values back into the larger Context tree data
     for(const auto& cvs: outputs) {
-      auto& data = c_data[cvs.first];
       for(const auto& mv: cvs.second) {
-        data[mv.first].add(mv.second);
+        c_data.add(cvs.first, mv.first, mv.second);
       }
     }
   }
+  c_data.compact();
 
   // For each Context we need to know what its children are. But we only care
   // about ones that have descendants with actual data. So we construct a
@@ -265,8 +501,9 @@ void PerThreadTemporary::finalize() noexcept {
   util::optional_ref<const Context> global;
   std::unordered_map<util::reference_index<const Context>,
     std::unordered_set<util::reference_index<const Context>>> children;
-  for(const auto& cx: c_data.citerate()) {
-    std::reference_wrapper<const Context> c = cx.first;
+  for(auto it = c_data.m_points.cbegin(); it != c_data.m_points.cend(); ++it) {
+    if(it != c_data.m_points.cbegin() && (it-1)->ctx == it->ctx) continue;
+    std::reference_wrapper<const Context> c = *it->ctx;
     while(auto p = c.get().direct_parent()) {
       auto x = children.insert({*p, {}});
       x.first->second.emplace(c.get());
@@ -279,10 +516,27 @@ void PerThreadTemporary::finalize() noexcept {
       global = c.get();
     }
   }
-  if(!global) return;  // Apparently there's nothing to propagate
+  if(!global) {
+    // Apparently there's nothing to propagate
+    c_data.m_points = {};
+    c_data.m_sorted = 0;
+    return;
+  }
+
+  // Final Rows are built in post-order, as (Context, offset, size) into the
+  // final Values. The Row pointers are only filled in once the Values are
+  // stable.
+  struct row_t {
+    const Context* ctx;
+    std::size_t offset;
+    std::size_t size;
+  };
+  std::vector<row_t> rows;
+  rows.reserve(children.size() + 1);
+  auto& values = c_data.m_values;
+  values.reserve(c_data.m_points.size());
 
   // Now that the critical subtree is built, recursively propagate up.
-  using md_t = decltype(c_data)::mapped_type;
   struct frame_t {
     frame_t(const Context& c) : ctx(c) {};
     frame_t(const Context& c, const decltype(children)::mapped_type& v)
@@ -290,10 +544,14 @@ void PerThreadTemporary::finalize() noexcept {
     const Context& ctx;
     decltype(children)::mapped_type::const_iterator here;
     decltype(children)::mapped_type::const_iterator end;
-    std::vector<std::pair<std::reference_wrapper<const Context>,
-                          std::reference_wrapper<const md_t>>> submds;
+    std::vector<std::size_t> subrows;
   };
   std::stack<frame_t, std::vector<frame_t>> stack;
+  std::vector<ThreadAccumulators::Value> data;
+  std::vector<ThreadAccumulators::Value> merged;
+  const auto metricLess = [](const Metric* a, const Metric* b) -> bool {
+    return std::less<const Metric*>{}(a, b);
+  };
 
   // Post-order in-memory tree traversal
   {
@@ -313,56 +571,89 @@ void PerThreadTemporary::finalize() noexcept {
     }
 
     const Context& c = stack.top().ctx;
-    md_t& data = c_data[c];
 
     const bool isLoop = c.scope().flat().type() == Scope::Type::lexical_loop
         || c.scope().flat().type() == Scope::Type::binary_loop;
 
-    // Handle the internal propagation first, so we don't get mixed up.
-    for(auto& mx: data.iterate()) {
-      mx.second.isLoop = isLoop;
-      mx.second.execution = mx.second.function
-                          = mx.second.function_noloops
-                          = mx.second.point.load(std::memory_order_relaxed);
+    // Handle the internal propagation first, so we don't get mixed up. The
+    // staged Points are already sorted by Metric.
+    data.clear();
+    {
+      auto [b, e] = c_data.points(c);
+      for(; b != e; ++b) data.push_back(ThreadAccumulators::Value(*b->metric, b->value));
     }
 
-    // Go through our children and sum into our bits
-    for(std::size_t i = 0; i < stack.top().submds.size(); i++) {
-      const auto& sub = stack.top().submds[i];
-      const bool pullFunc = !isCall(sub.first.get().scope().relation());
-      const bool pullNoLoops = sub.first.get().scope().flat().type() != Scope::Type::lexical_loop
-          && sub.first.get().scope().flat().type() != Scope::Type::binary_loop;
-      for(const auto& mx: sub.second.get().citerate()) {
-        auto& accum = data[mx.first];
+    // Go through our children and sum into our bits. Both sides are sorted by
+    // Metric, so this is a linear merge.
+    for(std::size_t sr: stack.top().subrows) {
+      const auto& sub = rows[sr];
+      const bool pullFunc = !isCall(sub.ctx->scope().relation());
+      const bool pullNoLoops = sub.ctx->scope().flat().type() != Scope::Type::lexical_loop
+          && sub.ctx->scope().flat().type() != Scope::Type::binary_loop;
+      merged.clear();
+      merged.reserve(data.size() + sub.size);
+      auto dit = data.cbegin();
+      for(std::size_t i = 0; i < sub.size; i++) {
+        const auto& mx = values[sub.offset + i];
+        for(; dit != data.cend() && metricLess(dit->m_metric, mx.m_metric); ++dit)
+          merged.push_back(*dit);
+        if(dit != data.cend() && dit->m_metric == mx.m_metric)
+          merged.push_back(*dit++);
+        else
+          merged.push_back(ThreadAccumulators::Value(*mx.m_metric, 0));
+        auto& accum = merged.back();
         if(pullFunc) {
-          accum.function += mx.second.function;
+          accum.function += mx.function;
           if(pullNoLoops)
-            accum.function_noloops += mx.second.function_noloops;
+            accum.function_noloops += mx.function_noloops;
         }
-        accum.execution += mx.second.execution;
+        accum.execution += mx.execution;
       }
+      merged.insert(merged.end(), dit, data.cend());
+      std::swap(data, merged);
     }
+    for(auto& mx: data) mx.isLoop = isLoop;
 
     // Now that our bits are stable, accumulate back into the per-Context data
     auto& cdata = const_cast<Context&>(c).m_data.m_statistics;
     auto& musage = const_cast<Context&>(c).m_data.m_metricUsage;
-    for(const auto& mx: data.citerate()) {
-      musage[mx.first] |= mx.second.getNonZero() & mx.first->scopes();
+    for(const auto& mx: data) {
+      const Metric& m = *mx.m_metric;
+      musage[m] |= mx.getNonZero() & m.scopes();
       auto& accum = cdata.emplace(std::piecewise_construct,
-        std::forward_as_tuple(mx.first), std::forward_as_tuple(mx.first)).first;
-      for(size_t i = 0; i < mx.first->partials().size(); i++) {
-        auto& partial = mx.first->partials()[i];
-        auto& atomics = accum.partials[i];
-        if(atomics.isLoop.load(std::memory_order_relaxed) != isLoop)
-          atomics.isLoop.store(isLoop, std::memory_order_relaxed);
-        atomic_op(atomics.point, partial.m_accum.evaluate(mx.second.point.load(std::memory_order_relaxed)), partial.combinator());
-        atomic_op(atomics.function, partial.m_accum.evaluate(mx.second.function), partial.combinator());
-        atomic_op(atomics.function_noloops, partial.m_accum.evaluate(mx.second.function_noloops), partial.combinator());
-        atomic_op(atomics.execution, partial.m_accum.evaluate(mx.second.execution), partial.combinator());
+        std::forward_as_tuple(m), std::forward_as_tuple(m)).first;
+      for(size_t i = 0; i < m.partials().size(); i++) {
+        auto& partial = m.partials()[i];
+        staging.add(accum.partials[i], partial, {
+          partial.m_accum.evaluate(mx.point),
+          partial.m_accum.evaluate(mx.function),
+          partial.m_accum.evaluate(mx.function_noloops),
+          partial.m_accum.evaluate(mx.execution),
+          isLoop ? 1.0 : 0.0,
+        });
       }
     }
 
+    // Append our bits to the final Rows
+    rows.push_back({&c, values.size(), data.size()});
+    values.insert(values.end(), data.cbegin(), data.cend());
+
     stack.pop();
-    if(!stack.empty()) stack.top().submds.emplace_back(c, data);
+    if(!stack.empty()) stack.top().subrows.push_back(rows.size() - 1);
   }
+
+  // The staged Points are no longer needed, free up the memory
+  c_data.m_points = {};
+  c_data.m_sorted = 0;
+
+  // Values are stable now, so we can finally generate the Rows. These are
+  // sorted by Context for quick lookup later.
+  values.shrink_to_fit();
+  std::sort(rows.begin(), rows.end(), [](const row_t& a, const row_t& b){
+    return std::less<const Context*>{}(a.ctx, b.ctx);
+  });
+  c_data.m_rows.reserve(rows.size());
+  for(const auto& r: rows)
+    c_data.m_rows.push_back({*r.ctx, values.data() + r.offset,
+                             values.data() + r.offset + r.size});
 }
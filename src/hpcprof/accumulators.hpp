@@ -9,20 +9,25 @@
 
 #include "scope.hpp"
 
+#include "util/external_sort.hpp"
 #include "util/locked_unordered.hpp"
 #include "util/streaming_sort.hpp"
 
 #include <atomic>
 #include <bitset>
 #include <chrono>
+#include <deque>
 #include <iosfwd>
+#include <mutex>
 #include <optional>
+#include <utility>
 #include <vector>
 
 namespace hpctoolkit {
 
 class Metric;
 class StatisticPartial;
+class StatisticStaging;
 class Thread;
 class Context;
 class ContextReconstruction;
@@ -168,6 +173,162 @@ private:
   double execution = 0;
 };
 
+/// Flat storage for the Metric data attributed to the Contexts of a single
+/// Thread. Values are appended to a staging log as they arrive and periodically
+/// compacted in bulk into a run sorted by (Context, Metric), so no per-Context
+/// maps or locks are allocated while filling. During finalization the table is
+/// converted into CSR form: one Row per Context, each a contiguous run of
+/// Values sorted by Metric.
+class ThreadAccumulators final {
+  // Single staged point-Scope value
+  struct Point {
+    const Context* ctx;
+    const Metric* metric;
+    double value;
+  };
+
+public:
+  ThreadAccumulators() = default;
+  ~ThreadAccumulators() = default;
+
+  ThreadAccumulators(const ThreadAccumulators&) = delete;
+  ThreadAccumulators& operator=(const ThreadAccumulators&) = delete;
+  ThreadAccumulators(ThreadAccumulators&& o)
+    : m_points(std::move(o.m_points)), m_sorted(o.m_sorted),
+      m_values(std::move(o.m_values)), m_rows(std::move(o.m_rows)) {};
+  ThreadAccumulators& operator=(ThreadAccumulators&&) = delete;
+
+  /// Accumulation of a single Metric for a single Context, within a Row.
+  class Value final {
+  public:
+    /// Metric this Value is an accumulation of.
+    // MT: Safe (const)
+    const Metric& metric() const noexcept { return *m_metric; }
+
+    /// Get the Thread-local sum of Metric value, for a particular Metric Scope.
+    // MT: Safe (const), Unstable (before ThreadFinal wavefront)
+    std::optional<double> get(MetricScope) const noexcept;
+
+  private:
+    friend class PerThreadTemporary;
+    Value(const Metric& m, double v)
+      : m_metric(&m), point(v), function(v), function_noloops(v),
+        execution(v) {};
+
+    MetricScopeSet getNonZero() const noexcept;
+
+    const Metric* m_metric;
+    bool isLoop = false;
+    double point;
+    double function;
+    double function_noloops;
+    double execution;
+  };
+
+  /// Contiguous run of the Values attributed to a single Context.
+  class Row final {
+  public:
+    /// Context the Values in this Row are attributed to.
+    // MT: Safe (const)
+    const Context& context() const noexcept { return *m_ctx; }
+
+    // MT: Safe (const)
+    const Value* begin() const noexcept { return m_begin; }
+    const Value* end() const noexcept { return m_end; }
+    std::size_t size() const noexcept { return m_end - m_begin; }
+    bool empty() const noexcept { return m_begin == m_end; }
+
+    /// Get the Value for a particular Metric, if present.
+    // MT: Safe (const)
+    util::optional_ref<const Value> find(const Metric&) const noexcept;
+
+  private:
+    friend class ThreadAccumulators;
+    friend class PerThreadTemporary;
+    Row(const Context& c, const Value* b, const Value* e)
+      : m_ctx(&c), m_begin(b), m_end(e) {};
+
+    const Context* m_ctx;
+    const Value* m_begin;
+    const Value* m_end;
+  };
+
+  /// Add some point-Scope value for a Metric attributed to a Context.
+  // MT: Internally Synchronized
+  void add(const Context&, const Metric&, double) noexcept;
+
+  /// Local buffer of point-Scope values bound for a table, which are added in
+  /// bulk under a single acquisition of the table's lock. Flushed when
+  /// destroyed, or when a value is added for a different table.
+  class Batch final {
+  public:
+    Batch() = default;
+    ~Batch() { flush(); }
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+    Batch(Batch&&) = delete;
+    Batch& operator=(Batch&&) = delete;
+
+    /// Buffer some point-Scope value for a Metric attributed to a Context in
+    /// the given table.
+    // MT: Externally Synchronized
+    void add(ThreadAccumulators& t, const Context& c, const Metric& m, double v) {
+      if(m_table != &t) {
+        flush();
+        m_table = &t;
+      }
+      m_points.push_back({&c, &m, v});
+    }
+
+    /// Get the number of values currently buffered.
+    // MT: Safe (const)
+    std::size_t size() const noexcept { return m_points.size(); }
+
+    /// Add all the buffered values to their table, and clear the buffer.
+    // MT: Externally Synchronized (this), Internally Synchronized
+    void flush() noexcept;
+
+  private:
+    ThreadAccumulators* m_table = nullptr;
+    std::vector<Point> m_points;
+  };
+
+  /// Get the Row for a particular Context. Returns `std::nullopt` if none is
+  /// present.
+  // MT: Safe (const), Unstable (before ThreadFinal wavefront)
+  std::optional<Row> find(const Context&) const noexcept;
+
+  /// Get all the Rows in this table, in no particular order.
+  // MT: Safe (const), Unstable (before ThreadFinal wavefront)
+  const std::vector<Row>& rows() const noexcept { return m_rows; }
+
+private:
+  friend class PerThreadTemporary;
+  friend class ContextReconstruction;
+
+  using point_range = std::pair<const Point*, const Point*>;
+
+  // Sort and merge the staged Points, summing values with equal keys.
+  // MT: Externally Synchronized
+  void compact() noexcept;
+
+  // Get the (compacted) staged Points for a particular Context, sorted by
+  // Metric. Only valid directly after compact().
+  // MT: Safe (const)
+  point_range points(const Context&) const noexcept;
+
+  std::mutex m_lock;
+  // Staged Points. The first m_sorted are compacted, the remainder are in
+  // order of arrival.
+  std::vector<Point> m_points;
+  std::size_t m_sorted = 0;
+
+  // Final CSR form, filled during finalization
+  std::vector<Value> m_values;
+  std::vector<Row> m_rows;
+};
+
 /// Accumulators and other related fields local to a Thread.
 class PerThreadTemporary final {
 public:
@@ -186,13 +347,13 @@ public:
   /// Reference to the Metric data for a particular Context in this Thread.
   /// Returns `std::nullopt` if none is present.
   // MT: Safe (const), Unstable (before notifyThreadFinal)
-  auto accumulatorsFor(const Context& c) const noexcept {
+  std::optional<ThreadAccumulators::Row> accumulatorsFor(const Context& c) const noexcept {
     return c_data.find(c);
   }
 
   /// Reference to all of the Metric data on Thread.
   // MT: Safe (const), Unstable (before notifyThreadFinal)
-  const auto& accumulators() const noexcept { return c_data; }
+  const ThreadAccumulators& accumulators() const noexcept { return c_data; }
 
 private:
   Thread& m_thread;
@@ -200,9 +361,10 @@ private:
   friend class ProfilePipeline;
   PerThreadTemporary(Thread& t) : m_thread(t) {};
 
-  // Finalize the MetricAccumulators for a Thread.
+  // Finalize the MetricAccumulators for a Thread. Contributions to the
+  // Statistics are combined into the given staging buffer.
   // MT: Internally Synchronized
-  void finalize() noexcept;
+  void finalize(StatisticStaging&) noexcept;
 
   // Bits needed for handling timepoints
   std::chrono::nanoseconds minTime = std::chrono::nanoseconds::max();
@@ -212,6 +374,7 @@ private:
     bool unboundedDisorder = false;
     util::bounded_streaming_sort_buffer<Tp, util::compare_only_first<Tp>> sortBuf;
     std::vector<Tp> staging;
+    util::external_sort_buffer<Tp, util::compare_only_first<Tp>> spill;
   };
   TimepointsData<std::pair<std::chrono::nanoseconds,
     std::reference_wrapper<const Context>>> ctxTpData;
@@ -219,9 +382,7 @@ private:
     TimepointsData<std::pair<std::chrono::nanoseconds, double>>> metricTpData;
 
   friend class Metric;
-  util::locked_unordered_map<util::reference_index<const Context>,
-    util::locked_unordered_map<util::reference_index<const Metric>,
-      MetricAccumulator>> c_data;
+  ThreadAccumulators c_data;
   util::locked_unordered_map<util::reference_index<const ContextReconstruction>,
     util::locked_unordered_map<util::reference_index<const Metric>,
       MetricAccumulator>> r_data;
@@ -273,7 +434,7 @@ private:
     raw_t getRaw() const noexcept;
 
     friend class StatisticAccumulator;
-    friend class PerThreadTemporary;
+    friend class StatisticStaging;
     std::atomic<bool> isLoop = false;
     std::atomic<double> point = 0;
     std::atomic<double> function = 0;
@@ -367,9 +528,108 @@ public:
 
 private:
   friend class PerThreadTemporary;
+  friend class StatisticStaging;
   std::vector<Partial> partials;
 };
 
+/// Worker-local staging buffer for the Statistic values generated while
+/// finalizing Threads. Each worker combines the values from every Thread it
+/// finalizes into its own buffer, so hot Contexts see one update per flush
+/// instead of one per Thread. The buffer is a flat table of bounded size, and
+/// is handed over to a set of Shards whenever it fills up. The Shards are
+/// reduced into the StatisticAccumulators once all Threads are complete.
+class StatisticStaging final {
+public:
+  class Shards;
+
+  /// Number of distinct Partials staged before the buffer is flushed.
+  static constexpr std::size_t defaultCapacity = 1 << 15;
+
+  explicit StatisticStaging(Shards&, std::size_t capacity = defaultCapacity);
+  ~StatisticStaging();
+
+  StatisticStaging(const StatisticStaging&) = delete;
+  StatisticStaging& operator=(const StatisticStaging&) = delete;
+  StatisticStaging(StatisticStaging&&) = delete;
+  StatisticStaging& operator=(StatisticStaging&&) = delete;
+
+  /// Hand all the staged values over to the Shards, and release the memory
+  /// used by the buffer.
+  // MT: Externally Synchronized (this), Internally Synchronized (Shards)
+  void flush() noexcept;
+
+private:
+  friend class PerThreadTemporary;
+  using Partial = StatisticAccumulator::Partial;
+  using raw_t = StatisticAccumulator::raw_t;
+
+  struct Entry {
+    Partial* partial = nullptr;
+    const StatisticPartial* statpart = nullptr;
+    raw_t value;
+  };
+
+  // Open-addressed table of Entries keyed by Partial, with linear probing.
+  class Table final {
+  public:
+    std::size_t size() const noexcept { return m_used; }
+    const std::vector<Entry>& slots() const noexcept { return m_slots; }
+
+    // Combine some raw values into the Entry for a Partial. Returns false if
+    // that would need a new Entry beyond the given limit.
+    bool add(Partial&, const StatisticPartial&, const raw_t&, std::size_t limit) noexcept;
+
+    // Remove all Entries and release the memory.
+    void clear() noexcept;
+
+  private:
+    void rehash(std::size_t slots) noexcept;
+
+    std::size_t m_used = 0;
+    std::vector<Entry> m_slots;
+  };
+
+  // Combine some raw values into the staged values for a Partial.
+  // MT: Externally Synchronized
+  void add(Partial&, const StatisticPartial&, const raw_t&) noexcept;
+
+  Shards& m_shards;
+  std::size_t m_capacity;
+  Table m_table;
+};
+
+/// Statistic values handed over from the StatisticStaging buffers. Values are
+/// split into shards by target Partial, so the final reduction can be spread
+/// across workers without any synchronization on the accumulators themselves.
+/// Each shard holds at most one entry per Partial.
+class StatisticStaging::Shards final {
+public:
+  explicit Shards(std::size_t shards);
+  ~Shards() = default;
+
+  Shards(const Shards&) = delete;
+  Shards& operator=(const Shards&) = delete;
+  Shards(Shards&&) = delete;
+  Shards& operator=(Shards&&) = delete;
+
+  /// Get the number of shards.
+  // MT: Safe (const)
+  std::size_t size() const noexcept { return m_shards.size(); }
+
+  /// Reduce a single shard into the final accumulators, and release its memory.
+  // MT: Externally Synchronized (per shard, and with respect to any addRaw())
+  void reduce(std::size_t shard) noexcept;
+
+private:
+  friend class StatisticStaging;
+
+  struct Shard {
+    std::mutex lock;
+    Table table;
+  };
+  std::deque<Shard> m_shards;
+};
+
 /// Accumulators and related fields local to a Context. In particular, holds
 /// the statistics.
 class PerContextAccumulators final {
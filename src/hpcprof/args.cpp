@@ -22,6 +22,7 @@
 #include <getopt.h>
 #include <iostream>
 #include <iomanip>
+#include <numeric>
 #include <omp.h>
 #include <random>
 #include <sstream>
@@ -81,17 +82,47 @@ Output Options:
                                  normal: Linear mean and standard deviation
                                 extrema: Minimum and maximum
                                   stats: All of the above
+                                    pct: 50th, 90th and 99th percentiles,
+                                         estimated within a factor of
+                                         sqrt(2) from a fixed-size sketch.
+                                         Adds ~65 summary values per metric
+                                         and scope, so is not included in
+                                         `stats'. The database holds at most
+                                         65536 summary values in total, which
+                                         limits this to ~250 metrics.
                               `none' disables all global statistics.
       --no-thread-local       Disable generation of thread-local statistics.
       --no-traces             Disable generation of traces.
       --no-source             Disable embedded source output.
+      --pack-values           Write metric values in profile.db and cct.db
+                              in a compact variable-length encoding. Greatly
+                              reduces the size of large databases, but the
+                              result cannot be read by older viewers.
+      --trace-levels          Write downsampled summary levels for each trace
+                              in trace.db, so that zoomed-out views of large
+                              traces can be drawn without reading every
+                              sample. Increases trace.db size by up to 1/3.
 
 Processing options:
       --dwarf-max-size=<limit>[<unit>]
                               Specify a limit on the binary size to parse DWARF
-                              data from. Units are K,M,G,T (powers of 1024)
-                              If limit is "unlimited," always parses DWARF.
-                              Default limit is 100M.
+                              data from in full. Larger binaries only have the
+                              compilation units covering measured addresses
+                              parsed, as they are needed. Units are K,M,G,T
+                              (powers of 1024). If limit is "unlimited,"
+                              always parses DWARF in full. Default is 100M.
+      --profile-cache-size=<limit>[<unit>]
+                              (hpcprof-mpi only) Keep up to this many bytes of
+                              measurement profiles in memory per rank, so they
+                              are read from the filesystem only once instead
+                              of once per analysis pass. Units are as for
+                              --dwarf-max-size. Default is 0 (disabled).
+      --trace-sort-memory=<limit>[<unit>]
+                              Sort badly unordered traces using at most this
+                              much memory in total (per rank for hpcprof-mpi),
+                              spilling the rest to temporary files in $TMPDIR.
+                              Units are as for --dwarf-max-size. Default is
+                              256M.
       --ignore-structs
                               Ignore hpcstruct files in measurement directories
                               (the structs/ subdirectory). Used for testing.
@@ -122,14 +153,47 @@ const bool string_starts_with(const std::string& a, const std::string& n) {
   return it_n == n.end();
 }
 
+// Parse a size limit of the form <limit>[<unit>] or "unlimited"
+static uintmax_t parseSizeLimit(const char* opt, const char* arg) {
+  char* end;
+  double limit = std::strtod(arg, &end);
+  if(end == arg) {  // Failed conversion
+    std::string s(arg);
+    size_t start;
+    for(start = 0; start < s.size() && std::isspace(s[start]); start++);
+    s = std::move(s).substr(start);
+
+    if(s == "unlimited") return std::numeric_limits<uintmax_t>::max();
+    std::cerr << "Error: invalid limit for " << opt << ": `" << s << "'\n";
+    std::exit(2);
+  }
+  uintmax_t factor = 1024;
+  if(end[0] != '\0') {
+    switch(end[0]) {
+    case 'k': case 'K': factor = 1024; break;
+    case 'm': case 'M': factor = 1024 * 1024; break;
+    case 'g': case 'G': factor = 1024 * 1024 * 1024; break;
+    case 't': case 'T': factor = 1024UL * 1024 * 1024 * 1024; break;
+    }
+    if(end[1] != '\0') {
+      std::cerr << "Error: invalid suffix for " << opt << ": `" << arg << "'\n";
+      std::exit(2);
+    }
+  }
+  return std::floor(limit * factor);
+}
+
 ProfArgs::ProfArgs(int argc, char* const argv[])
   : title(), threads(0), output(),
     include_sources(true), include_traces(true), include_thread_local(true),
-    format(Format::metadb), dwarfMaxSize(100*1024*1024), valgrindUnclean(false) {
+    pack_values(false), trace_levels(false), format(Format::metadb), dwarfMaxSize(100*1024*1024),
+    profileCacheSize(0), traceSortMemory(256*1024*1024), valgrindUnclean(false) {
   int arg_includeSources = include_sources;
   int arg_includeTraces = include_traces;
   int arg_overwriteOutput = 0;
   int arg_valgrindUnclean = valgrindUnclean;
+  int arg_packValues = pack_values;
+  int arg_traceLevels = trace_levels;
   int arg_foreign = 0;
   int arg_ignore_structs = 0;
   struct option longopts[] = {
@@ -138,6 +202,8 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
     {"no-thread-local", no_argument, NULL, 0},
     {"dwarf-max-size", required_argument, NULL, 0},
     {"only-exe", required_argument, NULL, 0},
+    {"profile-cache-size", required_argument, NULL, 0},
+    {"trace-sort-memory", required_argument, NULL, 0},
     // The rest can be in any order
     {"version", no_argument, NULL, 'V'},
     {"help", no_argument, NULL, 'h'},
@@ -149,6 +215,8 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
     {"format", required_argument, NULL, 'f'},
     {"no-traces", no_argument, &arg_includeTraces, 0},
     {"no-source", no_argument, &arg_includeSources, 0},
+    {"pack-values", no_argument, &arg_packValues, 1},
+    {"trace-levels", no_argument, &arg_traceLevels, 1},
     {"name", required_argument, NULL, 'n'},
     {"force", no_argument, &arg_overwriteOutput, 1},
     {"valgrind-unclean", no_argument, &arg_valgrindUnclean, 1},
@@ -273,13 +341,13 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
     }
     case 'M': {
       const char* const options[] = {"none", "sum", "normal", "extrema",
-                                     "stats", nullptr};
+                                     "stats", "pct", nullptr};
       char* value;
       while(optarg[0] != '\0') {
         switch(getsubopt(&optarg, const_cast<char*const*>(options), &value)) {
         case 0:  // none
           stats.sum = stats.mean = stats.min = stats.max = stats.stddev
-                    = stats.cfvar = false;
+                    = stats.cfvar = stats.percentiles = false;
           break;
         case 1:  // sum
           stats.sum = true; break;
@@ -291,6 +359,8 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
           stats.sum = stats.mean = stats.min = stats.max = stats.stddev
                     = stats.cfvar = true;
           break;
+        case 5:  // pct
+          stats.percentiles = true; break;
         default:
           std::cout << "Unrecognized argument to -M: " << value << "\n"
                        "Usage: " << fs::path(argv[0]).filename().string()
@@ -325,40 +395,9 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
         include_thread_local = false;
         seenNoThreadLocal = true;
         break;
-      case 2: {  // --dwarf-max-size
-        char* end;
-        double limit = std::strtod(optarg, &end);
-        if(end == optarg) {  // Failed conversion
-          std::string s(optarg);
-          size_t start;
-          for(start = 0; start < s.size() && std::isspace(s[start]); start++);
-          s = std::move(s).substr(start);
-
-          if(s == "unlimited") dwarfMaxSize = std::numeric_limits<uintmax_t>::max();
-          else {
-            std::cerr << "Error: invalid limit for --dwarf-max-size: `"
-                      << s << "'\n";
-            std::exit(2);
-          }
-        } else {
-          uintmax_t factor = 1024;
-          if(end[0] != '\0') {
-            switch(end[0]) {
-            case 'k': case 'K': factor = 1024; break;
-            case 'm': case 'M': factor = 1024 * 1024; break;
-            case 'g': case 'G': factor = 1024 * 1024 * 1024; break;
-            case 't': case 'T': factor = 1024UL * 1024 * 1024 * 1024; break;
-            }
-            if(end[1] != '\0') {
-              std::cerr << "Error: invalid suffix for --dwarf-max-size: `"
-                        << optarg << "'\n";
-              std::exit(2);
-            }
-          }
-          dwarfMaxSize = std::floor(limit * factor);
-        }
+      case 2:  // --dwarf-max-size
+        dwarfMaxSize = parseSizeLimit("--dwarf-max-size", optarg);
         break;
-      }
       case 3: {  // --only-exe
         fs::path exe(optarg);
         if(!exe.has_filename()) {
@@ -371,6 +410,12 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
         only_exes.emplace(exe.filename().generic_string());
         break;
       }
+      case 4:  // --profile-cache-size
+        profileCacheSize = parseSizeLimit("--profile-cache-size", optarg);
+        break;
+      case 5:  // --trace-sort-memory
+        traceSortMemory = parseSizeLimit("--trace-sort-memory", optarg);
+        break;
       }
       break;
     default:
@@ -383,6 +428,8 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
   include_sources = arg_includeSources;
   include_traces = arg_includeTraces;
   valgrindUnclean = arg_valgrindUnclean;
+  pack_values = arg_packValues;
+  trace_levels = arg_traceLevels;
   foreign = arg_foreign;
 
   {
@@ -535,21 +582,64 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
   {
     std::vector<std::string> files_s;
     if(mpi::World::rank() == 0) {
-      std::vector<std::vector<std::string>> allfiles(mpi::World::size());
-      std::size_t peer = 0;
+      // Weigh every input by the bytes that will be read for it. Tracefiles
+      // are read along with their profiles, so they are weighed together.
+      const fs::path profileext = std::string(".")+HPCRUN_ProfileFnmSfx;
+      const fs::path traceext = std::string(".")+HPCRUN_TraceFnmSfx;
+      struct input_t {
+        fs::path path;
+        std::size_t group;
+        std::uintmax_t size;
+      };
+      std::vector<input_t> inputs;
       for(int idx = optind; idx < argc; idx++) {
         fs::path p(argv[idx]);
         if(fs::is_directory(p)) {
-          for(const auto& de: fs::directory_iterator(p)) {
-            allfiles[peer].emplace_back(de.path().string());
-            peer = (peer + 1) % allfiles.size();
-          }
-        } else {
-          allfiles[peer].emplace_back(p.string());
-          peer = (peer + 1) % allfiles.size();
+          for(const auto& de: fs::directory_iterator(p))
+            inputs.push_back({de.path(), (std::size_t)(idx - optind), 0});
+        } else inputs.push_back({std::move(p), (std::size_t)(idx - optind), 0});
+      }
+      #pragma omp parallel for num_threads(threads) schedule(dynamic, 64)
+      for(std::size_t i = 0; i < inputs.size(); i++) {
+        auto& in = inputs[i];
+        if(in.path.extension() == traceext) continue;
+        std::error_code ec;
+        auto size = fs::file_size(in.path, ec);
+        if(ec) continue;
+        if(in.path.extension() == profileext) {
+          auto tsize = fs::file_size(fs::path(in.path).replace_extension(traceext), ec);
+          if(!ec) size += tsize;
+        }
+        in.size = size;
+      }
+
+      // Hand out the inputs largest-first, each to the rank with the fewest
+      // bytes so far (LPT). Unknown sizes count as a byte, so those at least
+      // balance by count.
+      std::vector<std::size_t> order(inputs.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){
+        return inputs[a].size > inputs[b].size;
+      });
+      std::vector<std::pair<std::uintmax_t, std::size_t>> loads;
+      for(std::size_t r = 0; r < mpi::World::size(); r++) loads.emplace_back(0, r);
+      std::vector<std::vector<std::vector<std::string>>> assigned(mpi::World::size(),
+          std::vector<std::vector<std::string>>(argc - optind));
+      for(std::size_t i: order) {
+        std::pop_heap(loads.begin(), loads.end(), std::greater<>());
+        auto& [load, peer] = loads.back();
+        assigned[peer][inputs[i].group].emplace_back(inputs[i].path.string());
+        load += std::max<std::uintmax_t>(inputs[i].size, 1);
+        std::push_heap(loads.begin(), loads.end(), std::greater<>());
+      }
+
+      std::vector<std::vector<std::string>> allfiles(mpi::World::size());
+      for(std::size_t peer = 0; peer < allfiles.size(); peer++) {
+        for(auto& group: assigned[peer]) {
+          for(auto& f: group) allfiles[peer].emplace_back(std::move(f));
+          // We use an empty string to mark the boundaries between argument "groups"
+          allfiles[peer].emplace_back("");
         }
-        // We use an empty string to mark the boundaries between argument "groups"
-        for(auto& fs: allfiles) fs.emplace_back("");
       }
       files_s = mpi::scatter(std::move(allfiles), 0);
     } else {
@@ -590,21 +680,22 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
         auto arg = optind + pg.second;
         fs::path meas = argv[arg];
         if(!fs::is_directory(meas)) meas = "";
-        auto s = ProfileSource::create_for(pg.first, meas);
-        if(!only_exes.empty()) {
-          if(auto* r4 = dynamic_cast<hpctoolkit::sources::Hpcrun4*>(s.get()); r4 != nullptr) {
-            if(only_exes.count(r4->exe_basename()) == 0)
-              continue;
-          }
-        }
-        if(s) {
-          my_sources.emplace_back(std::move(s), std::move(pg.first));
-          my_source_args.emplace_back(std::move(arg));
-          cnts_a[pg.second].fetch_add(1, std::memory_order_relaxed);
-        } else if(pg.first.extension() == profileext) {
+        auto ss = ProfileSource::create_all_for(pg.first, meas);
+        if(ss.empty() && pg.first.extension() == profileext) {
           util::log::warning{} << pg.first.string() <<
             " does not contain a valid measurement profile";
         }
+        for(auto& [s, p]: ss) {
+          if(!only_exes.empty()) {
+            if(auto* r4 = dynamic_cast<hpctoolkit::sources::Hpcrun4*>(s.get()); r4 != nullptr) {
+              if(only_exes.count(r4->exe_basename()) == 0)
+                continue;
+            }
+          }
+          my_sources.emplace_back(std::move(s), std::move(p));
+          my_source_args.emplace_back(arg);
+          cnts_a[pg.second].fetch_add(1, std::memory_order_relaxed);
+        }
       }
       {
         std::unique_lock<std::mutex> l(sources_lock);
@@ -637,49 +728,79 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
     }
   }
 
-  // Every rank over the average workload ships its extra paths up to rank 0,
-  // every rank under the limit gives a report as to how many it can take.
-  std::size_t limit = totalcnt / mpi::World::size();
-  std::uint32_t avail = sources.size() < limit+1 ? limit+1 - sources.size() : 0;
+  // Order our Sources largest-first, by their estimated size. Unknown sizes
+  // count as a byte, so those at least balance by count.
+  std::vector<std::uint64_t> weights;
+  const auto sortBySize = [&]{
+    std::vector<std::uint64_t> ws;
+    for(const auto& sp: sources)
+      ws.push_back(std::max<std::uintmax_t>(sp.first->sizeHint(), 1));
+    std::vector<std::size_t> order(sources.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){
+      return ws[a] > ws[b];
+    });
+    decltype(sources) sorted;
+    decltype(source_args) sorted_args;
+    weights.clear();
+    for(std::size_t i: order) {
+      sorted.emplace_back(std::move(sources[i]));
+      sorted_args.emplace_back(source_args[i]);
+      weights.push_back(ws[i]);
+    }
+    sources = std::move(sorted);
+    source_args = std::move(sorted_args);
+  };
+  sortBySize();
+
+  // Every rank over its share of the total size ships its smallest extra
+  // paths up to rank 0, every rank under gives a report of how much it can
+  // take. Inputs that can't be moved without leaving a rank short are kept.
+  std::uint64_t mine = 0;
+  for(auto w: weights) mine += w;
+  const std::uint64_t total = mpi::allreduce(mine, mpi::Op::sum());
+  const std::uint64_t share = (total + mpi::World::size() - 1) / mpi::World::size();
   std::vector<std::string> extra;
   std::vector<std::size_t> extra_args;
-  if(sources.size() > 0) {
-    for(std::size_t i = sources.size()-1; i > limit; i--) {
-      assert(i == sources.size()-1);
-      assert(i == source_args.size()-1);
-      extra.emplace_back(std::move(sources.back().second).string());
-      extra_args.emplace_back(std::move(source_args.back()));
-      sources.pop_back();
-      source_args.pop_back();
-    }
+  std::vector<std::uint64_t> extra_weights;
+  while(!sources.empty() && mine - weights.back() >= share) {
+    assert(sources.size() == source_args.size());
+    extra.emplace_back(std::move(sources.back().second).string());
+    extra_args.emplace_back(std::move(source_args.back()));
+    extra_weights.emplace_back(weights.back());
+    mine -= weights.back();
+    sources.pop_back();
+    source_args.pop_back();
+    weights.pop_back();
   }
+  std::uint64_t avail = mine < share ? share - mine : 0;
   auto avails = mpi::gather(avail, 0);
   auto extras = mpi::gather(std::move(extra), 0);
   auto extras_args = mpi::gather(std::move(extra_args), 0);
+  auto extras_weights = mpi::gather(std::move(extra_weights), 0);
 
-  // Allocate extra strings to ranks with available slots.
+  // Allocate extra strings largest-first to the ranks with the most room.
   if(avails && extras) {
     std::vector<std::vector<std::string>> allocations(mpi::World::size());
     std::vector<std::vector<std::size_t>> allocations_args(mpi::World::size());
-    std::size_t next = 0;
-    bool nearfull = false;
-    for(uint32_t i = 0; i < (*extras).size(); i++) {
-      auto& ps = (*extras)[i];
-      for(uint32_t j = 0; j < ps.size(); j++) {
-        while(1) {
-          while(next < avails->size() && (*avails)[next] <= (nearfull ? 0 : 1)) {
-            next++;
-          }
-          if(next < avails->size()) break;
-          assert(!nearfull && "Ran out of slots trying to allocate inputs to ranks!");
-          // Try again, but allocate more aggressively
-          nearfull = true;
-          next = 0;
-        }
-        allocations[next].emplace_back(std::move(ps[j]));
-        allocations_args[next].emplace_back(std::move((*extras_args)[i][j]));
-        (*avails)[next] -= 1;
-      }
+    std::vector<std::pair<std::size_t, std::size_t>> order;
+    for(std::size_t i = 0; i < (*extras).size(); i++) {
+      for(std::size_t j = 0; j < (*extras)[i].size(); j++)
+        order.emplace_back(i, j);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const auto& a, const auto& b){
+      return (*extras_weights)[a.first][a.second] > (*extras_weights)[b.first][b.second];
+    });
+    std::vector<std::pair<std::uint64_t, std::size_t>> room;
+    for(std::size_t r = 0; r < avails->size(); r++) room.emplace_back((*avails)[r], r);
+    std::make_heap(room.begin(), room.end());
+    for(const auto& [i, j]: order) {
+      std::pop_heap(room.begin(), room.end());
+      auto& [left, next] = room.back();
+      allocations[next].emplace_back(std::move((*extras)[i][j]));
+      allocations_args[next].emplace_back(std::move((*extras_args)[i][j]));
+      left -= std::min(left, (*extras_weights)[i][j]);
+      std::push_heap(room.begin(), room.end());
     }
     extra = mpi::scatter(std::move(allocations), 0);
     extra_args = mpi::scatter(std::move(allocations_args), 0);
@@ -699,6 +820,7 @@ ProfArgs::ProfArgs(int argc, char* const argv[])
     sources.emplace_back(std::move(s), std::move(p));
     source_args.emplace_back(std::move(arg));
   }
+  if(!extra.empty()) sortBySize();
 }
 
 static std::pair<bool, fs::path> remove_prefix(const fs::path& path, const fs::path& pre) {
@@ -730,6 +852,7 @@ void ProfArgs::StatisticsExtender::appendStatistics(const Metric& m, Metric::Sta
   s.max = args.stats.max;
   s.stddev = args.stats.stddev;
   s.cfvar = args.stats.cfvar;
+  s.percentiles = args.stats.percentiles;
   mas.requestStatistics(std::move(s));
 }
 
@@ -100,9 +100,10 @@ public:
     bool max : 1;
     bool stddev : 1;
     bool cfvar : 1;
+    bool percentiles : 1;
 
     Stats() : sum(true), mean(false), min(false), max(false), stddev(false),
-              cfvar(false) {};
+              cfvar(false), percentiles(false) {};
   } stats;
 
   /// Path for the root database directory, or output file
@@ -117,6 +118,12 @@ public:
   /// Whether to include thread-local data in the output database
   bool include_thread_local;
 
+  /// Whether to write the values in the output database in the packed encoding
+  bool pack_values;
+
+  /// Whether to write downsampled summary levels for each trace in trace.db
+  bool trace_levels;
+
   /// Enum for possible output formats for profile data
   enum class Format {
     /// *.db + metrics.yaml, the current database format
@@ -128,6 +135,14 @@ public:
   /// Maximum size (in bytes) to use DWARF parsing for.
   uintmax_t dwarfMaxSize;
 
+  /// Maximum size (in bytes) of measurement profiles to keep in memory between
+  /// the passes of hpcprof-mpi.
+  uintmax_t profileCacheSize;
+
+  /// Maximum size (in bytes) of memory to use for sorting the timepoints of a
+  /// badly unordered trace, before spilling to disk.
+  uintmax_t traceSortMemory;
+
   /// Whether to enable "Valgrind-unclean" mode, which disables some deallocations.
   bool valgrindUnclean;
 
@@ -489,15 +489,20 @@ void ContextReconstruction::instantiate(
 
 std::pair<std::vector<double>, std::vector<bool>>
 ContextReconstruction::rescalingFactors(
-    const perctx_mvals_t<Context>& c_data) const {
-  return rescalingFactors_impl<mvals_t>(
-    [&](const Context& entry_c) -> util::optional_ref<const mvals_t> {
-      return c_data.find(entry_c);
-    }, [&](const mvals_t& mvs, const Metric& m) -> double {
-      return mvs.at(m).get(MetricScope::point).value_or(0);
-    }, [&](const mvals_t& mvs, const auto& f){
-      for(const auto& [m, v]: mvs.citerate())
-        f(m, v.get(MetricScope::point).value_or(0));
+    const ThreadAccumulators& c_data) const {
+  using mvs_t = ThreadAccumulators::point_range;
+  return rescalingFactors_impl<mvs_t>(
+    [&](const Context& entry_c) -> std::optional<mvs_t> {
+      auto mvs = c_data.points(entry_c);
+      if(mvs.first == mvs.second) return std::nullopt;
+      return mvs;
+    }, [&](const mvs_t& mvs, const Metric& m) -> double {
+      for(auto it = mvs.first; it != mvs.second; ++it)
+        if(it->metric == &m) return it->value;
+      return 0;
+    }, [&](const mvs_t& mvs, const auto& f){
+      for(auto it = mvs.first; it != mvs.second; ++it)
+        f(*it->metric, it->value);
     });
 }
 
@@ -534,7 +539,7 @@ ContextReconstruction::rescalingFactors_impl(
     bool exteriorLogicalIsAlsoExterior = false;
     std::unordered_set<util::reference_index<const Metric>> queried;
     for(const auto& [entry_s, entry_c]: m_entries) {
-      util::optional_ref<const T> mvs = find(entry_c);
+      auto mvs = find(entry_c);
       if(mvs) {
         // Find the metrics we need for the rescaling factor calculations.
         forall(*mvs, [&](const Metric& m, double){
@@ -178,9 +178,7 @@ private:
   /// Also determine which Templates have entry calls at all, for interiorFactors.
   // MT: Safe (const)
   std::pair<std::vector<double>, std::vector<bool>> rescalingFactors(
-    const util::locked_unordered_map<util::reference_index<const Context>,
-      util::locked_unordered_map<util::reference_index<const Metric>,
-        MetricAccumulator>>&) const;
+    const ThreadAccumulators&) const;
 
   /// Variant that allows for STL maps instead of the locked wrappers.
   // MT: Safe (const)
@@ -83,19 +83,23 @@ double Expression::evaluate(Kind op, const std::vector<double>& args) {
   case Kind::op_sum:
     return stdshim::accumulate(args.begin(), args.end(), (double)0.);
   case Kind::op_sub:
-    return stdshim::accumulate(args.begin(), args.end(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.begin() + 1, args.end(), args.front(),
                                [](double l, double r){ return l - r; });
   case Kind::op_neg:
     assert(args.size() == 1);
     return -args[0];
   case Kind::op_prod:
-    return stdshim::accumulate(args.begin(), args.end(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.begin() + 1, args.end(), args.front(),
                                [](double l, double r){ return l * r; });
   case Kind::op_div:
-    return stdshim::accumulate(args.begin(), args.end(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.begin() + 1, args.end(), args.front(),
                                [](double l, double r){ return l / r; });
   case Kind::op_pow:
-    return stdshim::accumulate(args.rbegin(), args.rend(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.rbegin() + 1, args.rend(), args.back(),
                                [](double r, double l){ return std::pow(l, r); });
   case Kind::op_sqrt:
     assert(args.size() == 1);
@@ -107,10 +111,12 @@ double Expression::evaluate(Kind op, const std::vector<double>& args) {
     assert(args.size() == 1);
     return std::log(args[0]);
   case Kind::op_min:
-    return stdshim::accumulate(args.begin(), args.end(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.begin() + 1, args.end(), args.front(),
         [](double l, double r){ return std::min<double>(l, r); });
   case Kind::op_max:
-    return stdshim::accumulate(args.begin(), args.end(), (double)0.,
+    assert(!args.empty());
+    return stdshim::accumulate(args.begin() + 1, args.end(), args.front(),
         [](double l, double r){ return std::max<double>(l, r); });
   case Kind::op_floor:
     assert(args.size() == 1);
@@ -6,6 +6,11 @@
 
 #include "denseids.hpp"
 
+#include "../util/log.hpp"
+
+#include <cstdint>
+#include <limits>
+
 using namespace hpctoolkit;
 using namespace finalizers;
 
@@ -20,7 +25,15 @@ std::optional<unsigned int> DenseIds::identify(const File&) noexcept {
 }
 std::optional<Metric::Identifier> DenseIds::identify(const Metric& m) noexcept {
   auto inc = std::max<size_t>(m.partials().size(), 1) * m.scopes().size();
-  return Metric::Identifier(m, met_id.fetch_add(inc, std::memory_order_relaxed));
+  auto id = met_id.fetch_add(inc, std::memory_order_relaxed);
+  // The database formats store metric identifiers as 16-bit integers
+  if(id + inc - 1 > std::numeric_limits<std::uint16_t>::max()) {
+    util::log::fatal{} << "Too many metric values to fit in the database: "
+      "metric " << m.name() << " needs identifiers up to " << (id + inc - 1)
+      << " but at most " << std::numeric_limits<std::uint16_t>::max()
+      << " are supported. Request fewer statistics (-M), especially `pct'.";
+  }
+  return Metric::Identifier(m, id);
 }
 std::optional<unsigned int> DenseIds::identify(const Context& c) noexcept {
   if(!c.direct_parent())
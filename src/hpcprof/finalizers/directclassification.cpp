@@ -8,12 +8,14 @@
 
 #include "../../common/lean/hpctoolkit_demangle.h"
 #include "../pipeline.hpp"
+#include "../util/once.hpp"
 
 #include <elfutils/libdw.h>
 #include <elfutils/libdwelf.h>
 #include <dwarf.h>
 #include <libelf.h>
 
+#include <mutex>
 #include <stdexcept>
 #include <unordered_map>
 #include <limits>
@@ -40,24 +42,116 @@ void DirectClassification::notifyPipeline() noexcept {
     });
 }
 
+#ifdef ELF_C_READ_MMAP
+#define HPC_ELF_C_READ ELF_C_READ_MMAP
+#else
+#define HPC_ELF_C_READ ELF_C_READ
+#endif
+
+// State for parsing the DWARF one CU at a time. libdw handles can't be shared
+// between threads, so each parse checks out its own from a pool of handles,
+// opening more as needed.
+struct DirectClassification::udModule::lazyDwarf final {
+  lazyDwarf(stdshim::filesystem::path p, bool a) : path(std::move(p)), alt(a) {};
+  ~lazyDwarf() {
+    for(auto& h: handles) end(h);
+  }
+
+  // File containing the DWARF. If alt, this is a separate debug file.
+  stdshim::filesystem::path path;
+  bool alt;
+
+  struct handle final {
+    int fd = -1;
+    Elf* elf = nullptr;
+    Dwarf* dbg = nullptr;
+  };
+  std::mutex handlesLock;
+  std::vector<handle> handles;
+
+  std::optional<handle> acquire() {
+    {
+      std::unique_lock<std::mutex> l(handlesLock);
+      if(!handles.empty()) {
+        handle h = handles.back();
+        handles.pop_back();
+        return h;
+      }
+    }
+    handle h;
+    h.fd = open(path.c_str(), O_RDONLY);
+    if(h.fd == -1) return std::nullopt;
+    if(alt) h.dbg = dwarf_begin(h.fd, DWARF_C_READ);
+    else {
+      h.elf = elf_begin(h.fd, HPC_ELF_C_READ, nullptr);
+      if(h.elf != nullptr) h.dbg = dwarf_begin_elf(h.elf, DWARF_C_READ, nullptr);
+    }
+    if(h.dbg == nullptr) {
+      end(h);
+      return std::nullopt;
+    }
+    return h;
+  }
+
+  void release(handle h) {
+    std::unique_lock<std::mutex> l(handlesLock);
+    handles.push_back(h);
+  }
+
+  static void end(handle& h) {
+    if(h.dbg != nullptr) dwarf_end(h.dbg);
+    if(h.elf != nullptr) elf_end(h.elf);
+    if(h.fd != -1) close(h.fd);
+  }
+
+  struct unit final {
+    unit(Dwarf_Off o) : offset(o) {};
+    Dwarf_Off offset;  // Offset of the CU DIE
+    util::OnceFlag once;
+    dwarfData data;
+  };
+  std::deque<unit> units;
+
+  // Address ranges covered by each CU, as indices into units
+  std::map<util::interval<uint64_t>, std::size_t> ranges;
+
+  // Functions are shared between all the units, same as when parsed eagerly.
+  // A concrete instance (often inlined) may refer to an abstract origin in
+  // another unit, e.g. with LTO or dwz partial units.
+  std::mutex functionsLock;
+  std::unordered_map<uint64_t, Function> functions;
+};
+
 std::optional<std::pair<util::optional_ref<Context>, Context&>>
 DirectClassification::classify(Context& c, NestedScope& ns) noexcept {
   if(ns.flat().type() == Scope::Type::point) {
     auto mo = ns.flat().point_data();
     const auto& udm = mo.first.userdata[ud];
 
+    // If the DWARF is being parsed lazily, find and parse the CU covering this
+    // address. Only that CU's data is needed to classify it.
+    const udModule::dwarfData* dw = &udm.dwarf;
+    if(udm.lazy) {
+      auto cuit = udm.lazy->ranges.find({mo.second, mo.second});
+      if(cuit != udm.lazy->ranges.end()) {
+        auto& unit = udm.lazy->units[cuit->second];
+        unit.once.call([&]{ lazyDwarfUnit(mo.first, *udm.lazy, cuit->second); });
+        dw = &unit.data;
+      }
+    }
+
     // First attempt: DWARF data
-    auto leafit = udm.leaves.find({mo.second, mo.second});
-    if(leafit != udm.leaves.end()) {
+    auto leafit = dw->leaves.find({mo.second, mo.second});
+    if(leafit != dw->leaves.end()) {
       util::optional_ref<Context> cr;
       std::reference_wrapper<Context> cc = c;
 
       // Create Contexts from the root of the trie to this node. Use a
       // mini-recursive algorithm since it shouldn't be very deep.
-      const std::function<void(const udModule::trienode&)> handle =
-        [&](const udModule::trienode& tn) {
+      const std::function<void(const trienode&)> handle =
+        [&](const trienode& tn) {
           if(tn.second != nullptr)
-            handle(*(const udModule::trienode*)tn.second);
+            handle(*(const trienode*)tn.second);
           cc = sink.context(cc, {ns.relation(), tn.first.first}).second;
           if(!cr) cr = cc;
           ns.relation() = tn.first.second;
@@ -65,8 +159,8 @@ DirectClassification::classify(Context& c, NestedScope& ns) noexcept {
       handle(leafit->second);
 
       // Add an inner (line) Scope if we can
-      auto lineit = udm.lines.find(mo.second);
-      if(lineit != udm.lines.end() && lineit->second) {
+      auto lineit = dw->lines.find(mo.second);
+      if(lineit != dw->lines.end() && lineit->second) {
         const auto& l = *lineit->second;
         cc = sink.context(cc, {ns.relation(), Scope(l.first, l.second)}).second;
         if(!cr) cr = cc;
@@ -136,12 +230,6 @@ static stdshim::filesystem::path altfile(const stdshim::filesystem::path& path,
   return "";
 }
 
-#ifdef ELF_C_READ_MMAP
-#define HPC_ELF_C_READ ELF_C_READ_MMAP
-#else
-#define HPC_ELF_C_READ ELF_C_READ
-#endif
-
 void DirectClassification::load(const Module& m, udModule& ud) noexcept {
   // Try to open the binary on the current filesystem. If we fail, give up.
   int fd = -1;
@@ -162,16 +250,17 @@ void DirectClassification::load(const Module& m, udModule& ud) noexcept {
     return;  // We only work with ELF files.
   }
 
-  // Process the DWARF, but only if its small enough
+  // Process the DWARF in full if its small enough. Otherwise only index the
+  // CUs, they are parsed later as addresses within them are classified.
   auto baseweight = stdshim::filesystem::file_size(mpath);
   Dwarf* dbg = dwarf_begin_elf(elf, DWARF_C_READ, nullptr);
   if(dbg != nullptr) {
     if(dwarfThreshold == std::numeric_limits<uintmax_t>::max()
        || baseweight < dwarfThreshold) {
-      if(!fullDwarf(dbg, m, ud))
+      if(!fullDwarf(dbg, m, ud.dwarf))
         util::log::error{} << "Error parsing DWARF for " << mpath.string();
-    } else util::log::warning{} << "Skipping DWARF for " << mpath.string() << ","
-        " over threshold (" << baseweight << " > " << dwarfThreshold << ")";
+    } else if(!indexDwarf(dbg, mpath, false, ud))
+      util::log::error{} << "Error indexing DWARF for " << mpath.string();
     dwarf_end(dbg);
   } else {
     auto altpath = altfile(mpath, elf);
@@ -184,10 +273,8 @@ void DirectClassification::load(const Module& m, udModule& ud) noexcept {
         if(altdbg != nullptr) {
           if(dwarfThreshold == std::numeric_limits<uintmax_t>::max()
              || baseweight + altweight < dwarfThreshold)
-            fullDwarf(altdbg, m, ud);
-          else util::log::warning{} << "Skipping DWARF for " << mpath.string()
-            << ", over threshold (" << baseweight << " + " << altweight << " ="
-            " " << (baseweight + altweight) << " > " << dwarfThreshold << ")";
+            fullDwarf(altdbg, m, ud.dwarf);
+          else indexDwarf(altdbg, altpath, true, ud);
           dwarf_end(altdbg);
         }
         close(altfd);
@@ -292,8 +379,130 @@ void dwarfwalk(Dwarf_Die die, const std::function<T(Dwarf_Die&, T)>& pre,
   } while(dwarf_siblingof(&die, &die) == 0);
 }
 
-bool DirectClassification::fullDwarf(void* dbg_vp, const Module& m, udModule& ud) try {
+bool DirectClassification::fullDwarf(void* dbg_vp, const Module& m, udModule::dwarfData& ud) try {
+  Dwarf* dbg = (Dwarf*)dbg_vp;
+
+  // Process the bits one CU at a time
+  Dwarf_CU* cu = nullptr;
+  Dwarf_Die root;
+  while(dwarf_get_units(dbg, cu, &cu, nullptr, nullptr, &root, nullptr) == 0)
+    dwarfUnit(&root, m, ud, ud.functions, nullptr);
+
+  // Make sure the linemap is consistent before returning, since we use it in
+  // const mode just about everywhere else.
+  ud.lines.make_consistent();
+  return true;
+} catch(std::exception& e) {
+  util::log::info{} << "Exception caught during DWARF parsing for "
+    << m.userdata[sink.resolvedPath()].filename().string() << "\n"
+       "  what(): " << e.what() << "\n"
+       "  Full path: " << m.userdata[sink.resolvedPath()].string();
+  return false;
+}
+
+bool DirectClassification::indexDwarf(void* dbg_vp, const stdshim::filesystem::path& path,
+                                      bool alt, udModule& ud) try {
   Dwarf* dbg = (Dwarf*)dbg_vp;
+  auto lazy = std::make_unique<udModule::lazyDwarf>(path, alt);
+
+  // List out the units that may cover code. Type units never do.
+  std::unordered_map<Dwarf_Off, std::size_t> unitIdx;
+  {
+    Dwarf_CU* cu = nullptr;
+    Dwarf_Die root;
+    uint8_t type;
+    while(dwarf_get_units(dbg, cu, &cu, nullptr, &type, &root, nullptr) == 0) {
+      if(type == DW_UT_type || type == DW_UT_split_type) continue;
+      Dwarf_Off off = dwarf_dieoffset(&root);
+      unitIdx.emplace(off, lazy->units.size());
+      lazy->units.emplace_back(off);
+    }
+  }
+  if(lazy->units.empty()) return true;
+
+  // Map address ranges to units. Overlaps shouldn't happen, but if they do the
+  // first unit to claim an address wins.
+  const auto addRange = [&](util::interval<uint64_t> mine, std::size_t idx) {
+    for(auto [it, end] = lazy->ranges.equal_range(mine); it != end; ++it) {
+      auto [before, after] = mine - it->first;
+      if(!before.empty()) lazy->ranges.try_emplace(before, idx);
+      mine = after;
+      if(mine.empty()) break;
+    }
+    if(!mine.empty()) lazy->ranges.try_emplace(mine, idx);
+  };
+
+  // .debug_aranges is the cheapest source for the ranges, when it's present.
+  std::vector<bool> covered(lazy->units.size(), false);
+  Dwarf_Aranges* aranges = nullptr;
+  std::size_t naranges = 0;
+  if(dwarf_getaranges(dbg, &aranges, &naranges) == 0) {
+    for(std::size_t i = 0; i < naranges; i++) {
+      Dwarf_Addr start;
+      Dwarf_Word length;
+      Dwarf_Off off;
+      if(dwarf_getarangeinfo(dwarf_onearange(aranges, i), &start, &length, &off) != 0
+         || length == 0)
+        continue;
+      auto it = unitIdx.find(off);
+      if(it == unitIdx.end()) continue;
+      covered[it->second] = true;
+      addRange({start, start + length}, it->second);
+    }
+  }
+
+  // Units missing from .debug_aranges (which is optional) list their own
+  // ranges on the CU DIE, via DW_AT_low/high_pc or .debug_rnglists.
+  for(std::size_t i = 0; i < lazy->units.size(); i++) {
+    if(covered[i]) continue;
+    Dwarf_Die root;
+    if(dwarf_offdie(dbg, lazy->units[i].offset, &root) == nullptr) continue;
+    ptrdiff_t offset = 0;
+    Dwarf_Addr base, start, end;
+    while((offset = dwarf_ranges(&root, offset, &base, &start, &end)) > 0) {
+      if(start < end) addRange({start, end}, i);
+    }
+  }
+
+  ud.lazy = std::move(lazy);
+  return true;
+} catch(std::exception& e) {
+  util::log::info{} << "Exception caught during DWARF indexing for "
+    << path.filename().string() << "\n"
+       "  what(): " << e.what() << "\n"
+       "  Full path: " << path.string();
+  return false;
+}
+
+void DirectClassification::lazyDwarfUnit(const Module& m, udModule::lazyDwarf& lazy,
+                                         std::size_t idx) noexcept {
+  auto& unit = lazy.units[idx];
+  auto h = lazy.acquire();
+  if(!h) {
+    util::log::error{} << "Error reopening DWARF for " << lazy.path.string();
+    return;
+  }
+
+  try {
+    Dwarf_Die root;
+    if(dwarf_offdie(h->dbg, unit.offset, &root) != nullptr)
+      dwarfUnit(&root, m, unit.data, lazy.functions, &lazy.functionsLock);
+  } catch(std::exception& e) {
+    util::log::info{} << "Exception caught during DWARF parsing for "
+      << m.userdata[sink.resolvedPath()].filename().string() << "\n"
+         "  what(): " << e.what() << "\n"
+         "  Full path: " << m.userdata[sink.resolvedPath()].string();
+  }
+  lazy.release(*h);
+
+  // Only this thread writes to the unit's data, but many will read it after.
+  unit.data.lines.make_consistent();
+}
+
+void DirectClassification::dwarfUnit(void* cudie_vp, const Module& m, udModule::dwarfData& ud,
+                                     std::unordered_map<uint64_t, Function>& functions,
+                                     std::mutex* functionsLock) {
+  Dwarf_Die& root = *(Dwarf_Die*)cudie_vp;
 
   // Cache Files so that we don't hammer the maps too much
   const File* unknownFile = nullptr;
@@ -332,154 +541,141 @@ bool DirectClassification::fullDwarf(void* dbg_vp, const Module& m, udModule& ud
     return getFile(nullptr, cudie, 0, allowUnknown);
   };
 
-  // Process the bits one CU at a time
-  Dwarf_CU* cu = nullptr;
-  Dwarf_Die root;
-  while(dwarf_get_units(dbg, cu, &cu, nullptr, nullptr, &root, nullptr) == 0) {
-    dwarfwalk<udModule::trienode*>(root,
-      [&](Dwarf_Die& die, udModule::trienode* par) -> udModule::trienode* {
-        // Check that the DIE is a function-like thing. Skip if not.
-        int tag = dwarf_tag(&die);
-        if(tag != DW_TAG_subprogram && tag != DW_TAG_inlined_subroutine)
-          return par;
-
-        // Skip declarations. They'll be added when we find them.
-        if(dwarf_hasattr(&die, DW_AT_declaration)) return par;
-
-        // Skip any abstract instances. We want only the concrete ones.
-        if(dwarf_func_inline(&die)) return par;
-
-        Dwarf_Attribute attr_mem;
-        Dwarf_Attribute* attr;
-
-        // Construct a Function based on the data we have in this DIE
-        Function myfunc(m);
-
-        // Name can either be the demangled symbol name or the better name.
-        attr = dwarf_attr_integrate(&die, DW_AT_linkage_name, &attr_mem);
-        if(attr == nullptr)
-          attr = dwarf_attr_integrate(&die, DW_AT_name, &attr_mem);
-        if(attr != nullptr) {
-          const char* str = dwarf_formstring(attr);
-          if(str != nullptr && str[0] != '\0') {
-            char* dn = hpctoolkit_demangle(str);
-            myfunc.name(dn == nullptr ? str : dn);
-            if(dn != nullptr) std::free(dn);
-          }
-        }
-
-        // Offset is always the entry pc
-        Dwarf_Addr offset;
-        if(dwarf_entrypc(&die, &offset) == 0) myfunc.offset(offset);
-
-        // Source location is based on the location of the declaration
-        Dwarf_Word idx = 0;
-        if(dwarf_formudata(dwarf_attr_integrate(&die, DW_AT_decl_file,
-                           &attr_mem), &idx) == 0 && idx > 0) {
-          Dwarf_Die cu_mem;
-          auto* file = getFileDie(dwarf_diecu(&die, &cu_mem, nullptr, nullptr),
-                                  idx, false);
-          if(file != nullptr) {
-            int linenum;
-            if(dwarf_decl_line(&die, &linenum) != 0) linenum = 0;
-            myfunc.sourceLocation(*file, linenum);
-          }
+  dwarfwalk<trienode*>(root,
+    [&](Dwarf_Die& die, trienode* par) -> trienode* {
+      // Check that the DIE is a function-like thing. Skip if not.
+      int tag = dwarf_tag(&die);
+      if(tag != DW_TAG_subprogram && tag != DW_TAG_inlined_subroutine)
+        return par;
+
+      // Skip declarations. They'll be added when we find them.
+      if(dwarf_hasattr(&die, DW_AT_declaration)) return par;
+
+      // Skip any abstract instances. We want only the concrete ones.
+      if(dwarf_func_inline(&die)) return par;
+
+      Dwarf_Attribute attr_mem;
+      Dwarf_Attribute* attr;
+
+      // Construct a Function based on the data we have in this DIE
+      Function myfunc(m);
+
+      // Name can either be the demangled symbol name or the better name.
+      attr = dwarf_attr_integrate(&die, DW_AT_linkage_name, &attr_mem);
+      if(attr == nullptr)
+        attr = dwarf_attr_integrate(&die, DW_AT_name, &attr_mem);
+      if(attr != nullptr) {
+        const char* str = dwarf_formstring(attr);
+        if(str != nullptr && str[0] != '\0') {
+          char* dn = hpctoolkit_demangle(str);
+          myfunc.name(dn == nullptr ? str : dn);
+          if(dn != nullptr) std::free(dn);
         }
+      }
 
-        // Merge the Function we gathered here into the full one.
-        // If this is an inlining, we work from that Function.
-        Dwarf_Off offsetid = dwarf_dieoffset(&die);
-        if((attr = dwarf_attr(&die, DW_AT_abstract_origin, &attr_mem)) != nullptr) {
-          Dwarf_Die fdie_mem;
-          Dwarf_Die* fdie = dwarf_formref_die(attr, &fdie_mem);
-          if(fdie != nullptr) offsetid = dwarf_dieoffset(fdie);
+      // Offset is always the entry pc
+      Dwarf_Addr offset;
+      if(dwarf_entrypc(&die, &offset) == 0) myfunc.offset(offset);
+
+      // Source location is based on the location of the declaration
+      Dwarf_Word idx = 0;
+      if(dwarf_formudata(dwarf_attr_integrate(&die, DW_AT_decl_file,
+                         &attr_mem), &idx) == 0 && idx > 0) {
+        Dwarf_Die cu_mem;
+        auto* file = getFileDie(dwarf_diecu(&die, &cu_mem, nullptr, nullptr),
+                                idx, false);
+        if(file != nullptr) {
+          int linenum;
+          if(dwarf_decl_line(&die, &linenum) != 0) linenum = 0;
+          myfunc.sourceLocation(*file, linenum);
         }
-        Function& func = ud.functions.try_emplace(offsetid, m).first->second;
-        func += std::move(myfunc);
+      }
 
-        // If this is not an inlined call, just emit as a normal Scope
-        if(tag != DW_TAG_inlined_subroutine) {
-          ud.trie.push_back({{Scope(func), Relation::enclosure}, par});
-          return &ud.trie.back();
-        }
+      // Merge the Function we gathered here into the full one.
+      // If this is an inlining, we work from that Function.
+      Dwarf_Off offsetid = dwarf_dieoffset(&die);
+      if((attr = dwarf_attr(&die, DW_AT_abstract_origin, &attr_mem)) != nullptr) {
+        Dwarf_Die fdie_mem;
+        Dwarf_Die* fdie = dwarf_formref_die(attr, &fdie_mem);
+        if(fdie != nullptr) offsetid = dwarf_dieoffset(fdie);
+      }
+      std::unique_lock<std::mutex> l;
+      if(functionsLock != nullptr) l = std::unique_lock<std::mutex>(*functionsLock);
+      Function& func = functions.try_emplace(offsetid, m).first->second;
+      func += std::move(myfunc);
+      if(l) l.unlock();
+
+      // If this is not an inlined call, just emit as a normal Scope
+      if(tag != DW_TAG_inlined_subroutine) {
+        ud.trie.push_back({{Scope(func), Relation::enclosure}, par});
+        return &ud.trie.back();
+      }
 
-        // Try to find the file for this inlined call.
-        const File* srcf = nullptr;
-        {
-          Dwarf_Word idx = 0;
-          if(dwarf_formudata(dwarf_attr_integrate(&die, DW_AT_call_file,
-                             &attr_mem), &idx) == 0 && idx > 0) {
-            srcf = getFileDie(&root, idx, true);
-          } else srcf = getFile(nullptr, &root, 0, true);
-        }
+      // Try to find the file for this inlined call.
+      const File* srcf = nullptr;
+      {
+        Dwarf_Word idx = 0;
+        if(dwarf_formudata(dwarf_attr_integrate(&die, DW_AT_call_file,
+                           &attr_mem), &idx) == 0 && idx > 0) {
+          srcf = getFileDie(&root, idx, true);
+        } else srcf = getFile(nullptr, &root, 0, true);
+      }
 
-        uint64_t linenum = 0;
-        if((attr = dwarf_attr(&die, DW_AT_call_line, &attr_mem)) != nullptr) {
-          Dwarf_Word word;
-          if(dwarf_formudata(attr, &word) == 0) linenum = word;
-        }
+      uint64_t linenum = 0;
+      if((attr = dwarf_attr(&die, DW_AT_call_line, &attr_mem)) != nullptr) {
+        Dwarf_Word word;
+        if(dwarf_formudata(attr, &word) == 0) linenum = word;
+      }
 
-        ud.trie.push_back({{Scope(*srcf, linenum), Relation::inlined_call}, par});
-        ud.trie.push_back({{Scope(func), Relation::enclosure}, &ud.trie.back()});
-        return &ud.trie.back();
-      }, [&](Dwarf_Die& die, udModule::trienode* here, udModule::trienode* par) {
-        // If we have no trienode, skip without doing anything
-        if(here == nullptr) return;
-
-        // Mark all remaining ranges as being from this tail
-        ptrdiff_t offset = 0;
-        Dwarf_Addr base, start, end;
-        while((offset = dwarf_ranges(&die, offset, &base, &start, &end)) > 0) {
-          // if(start != end) end -= 1;
-          util::interval<uint64_t> mine(start, end);
-          for(auto [it, end] = ud.leaves.equal_range(mine);
-              it != end; ++it) {
-            auto [before, after] = mine - it->first;
-            if(!before.empty()) {
-              [[maybe_unused]] bool first = ud.leaves.try_emplace(before, *here).second;
-              assert(first);
-            }
-            mine = after;
-            if(mine.empty()) break;
-          }
-          if(!mine.empty()) {
-            [[maybe_unused]] bool first = ud.leaves.try_emplace(mine, *here).second;
+      ud.trie.push_back({{Scope(*srcf, linenum), Relation::inlined_call}, par});
+      ud.trie.push_back({{Scope(func), Relation::enclosure}, &ud.trie.back()});
+      return &ud.trie.back();
+    }, [&](Dwarf_Die& die, trienode* here, trienode* par) {
+      // If we have no trienode, skip without doing anything
+      if(here == nullptr) return;
+
+      // Mark all remaining ranges as being from this tail
+      ptrdiff_t offset = 0;
+      Dwarf_Addr base, start, end;
+      while((offset = dwarf_ranges(&die, offset, &base, &start, &end)) > 0) {
+        // if(start != end) end -= 1;
+        util::interval<uint64_t> mine(start, end);
+        for(auto [it, end] = ud.leaves.equal_range(mine);
+            it != end; ++it) {
+          auto [before, after] = mine - it->first;
+          if(!before.empty()) {
+            [[maybe_unused]] bool first = ud.leaves.try_emplace(before, *here).second;
             assert(first);
           }
+          mine = after;
+          if(mine.empty()) break;
         }
-      }, nullptr);
-
-    // Now that the scopes are in place for this CU, load in the line info.
-    Dwarf_Lines* lines = nullptr;
-    std::size_t cnt = 0;
-    dwarf_getsrclines(&root, &lines, &cnt);
-    for(std::size_t i = 0; i < cnt; i++) {
-      Dwarf_Line* line = dwarf_onesrcline(lines, i);
-      Dwarf_Addr addr = 0;
-      dwarf_lineaddr(line, &addr);
-
-      Dwarf_Files* dfiles;
-      std::size_t fidx;
-      dwarf_line_file(line, &dfiles, &fidx);
-      const File* file = getFile(dfiles, &root, fidx, false);
-      if(file != nullptr) {
-        int lineno = 0;
-        dwarf_lineno(line, &lineno);
-
-        ud.lines.try_emplace(addr, udModule::line(*file, lineno));
-      } else
-        ud.lines.try_emplace(addr, std::nullopt);
-    }
+        if(!mine.empty()) {
+          [[maybe_unused]] bool first = ud.leaves.try_emplace(mine, *here).second;
+          assert(first);
+        }
+      }
+    }, nullptr);
+
+  // Now that the scopes are in place for this CU, load in the line info.
+  Dwarf_Lines* lines = nullptr;
+  std::size_t cnt = 0;
+  dwarf_getsrclines(&root, &lines, &cnt);
+  for(std::size_t i = 0; i < cnt; i++) {
+    Dwarf_Line* line = dwarf_onesrcline(lines, i);
+    Dwarf_Addr addr = 0;
+    dwarf_lineaddr(line, &addr);
+
+    Dwarf_Files* dfiles;
+    std::size_t fidx;
+    dwarf_line_file(line, &dfiles, &fidx);
+    const File* file = getFile(dfiles, &root, fidx, false);
+    if(file != nullptr) {
+      int lineno = 0;
+      dwarf_lineno(line, &lineno);
+
+      ud.lines.try_emplace(addr, udModule::dwarfData::line(*file, lineno));
+    } else
+      ud.lines.try_emplace(addr, std::nullopt);
   }
-
-  // Make sure the linemap is consistent before returning, since we use it in
-  // const mode just about everywhere else.
-  ud.lines.make_consistent();
-  return true;
-} catch(std::exception& e) {
-  util::log::info{} << "Exception caught during DWARF parsing for "
-    << m.userdata[sink.resolvedPath()].filename().string() << "\n"
-       "  what(): " << e.what() << "\n"
-       "  Full path: " << m.userdata[sink.resolvedPath()].string();
-  return false;
 }
@@ -12,6 +12,9 @@
 #include "../util/range_map.hpp"
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace hpctoolkit::finalizers {
 
@@ -19,7 +22,8 @@ namespace hpctoolkit::finalizers {
 // itself. This handles the little details.
 class DirectClassification final : public ProfileFinalizer {
 public:
-  // `dwarfThreshold` is in the units of bytes.
+  // `dwarfThreshold` is in the units of bytes. Binaries over the threshold
+  // have their DWARF parsed lazily, one CU at a time as addresses are seen.
   // If dwarfThreshold == std::numeric_limits<uintmax_t>::max(), no limit.
   DirectClassification(uintmax_t dwarfThreshold);
 
@@ -32,26 +36,43 @@ public:
 
 private:
   struct udModule final {
-    // Storage for DWARF function data
-    std::unordered_map<uint64_t, Function> functions;
-    using trienode = std::pair<std::pair<Scope, Relation>, const void* /* const trienode* */>;
-    std::deque<trienode> trie;
-    std::map<util::interval<uint64_t>, const trienode&> leaves;
-
-    // Storage for DWARF linemap data
-    using line = std::pair<util::reference_index<const File>, uint64_t>;
-    util::range_map<uint64_t, std::optional<line>,
-                    util::range_merge::truthy<void,
-                      util::range_merge::min<>>> lines;
+    struct dwarfData final {
+      // Storage for DWARF function data. Unused if parsed lazily, where the
+      // Functions are shared between all the units instead.
+      std::unordered_map<uint64_t, Function> functions;
+      using trienode = std::pair<std::pair<Scope, Relation>, const void* /* const trienode* */>;
+      std::deque<trienode> trie;
+      std::map<util::interval<uint64_t>, const trienode&> leaves;
+
+      // Storage for DWARF linemap data
+      using line = std::pair<util::reference_index<const File>, uint64_t>;
+      util::range_map<uint64_t, std::optional<line>,
+                      util::range_merge::truthy<void,
+                        util::range_merge::min<>>> lines;
+    };
+
+    // DWARF data for the whole binary, parsed eagerly
+    dwarfData dwarf;
+
+    // DWARF data for binaries over the threshold, parsed one CU at a time
+    // on first reference. nullptr if the DWARF was parsed eagerly (or absent).
+    struct lazyDwarf;
+    std::unique_ptr<lazyDwarf> lazy;
 
     // Storage for ELF symbols
     std::multimap<util::interval<uint64_t>, Function> symbols;
   };
+  using trienode = udModule::dwarfData::trienode;
 
   uintmax_t dwarfThreshold;
   Module::ud_t::typed_member_t<udModule> ud;
   void load(const Module&, udModule&) noexcept;
-  bool fullDwarf(void* dw, const Module&, udModule&);
+  bool fullDwarf(void* dw, const Module&, udModule::dwarfData&);
+  bool indexDwarf(void* dw, const stdshim::filesystem::path&, bool alt, udModule&);
+  void lazyDwarfUnit(const Module&, udModule::lazyDwarf&, std::size_t idx) noexcept;
+  void dwarfUnit(void* cudie, const Module&, udModule::dwarfData&,
+                 std::unordered_map<uint64_t, Function>& functions,
+                 std::mutex* functionsLock);
   bool symtab(void* elf, const Module&, udModule&);
 };
 
@@ -8,6 +8,8 @@
 
 #include "../util/log.hpp"
 
+#include "../../common/lean/formats/structidx.h"
+
 #include <limits>
 #include <xercesc/sax2/SAX2XMLReader.hpp>
 #include <xercesc/sax2/DefaultHandler.hpp>
@@ -16,10 +18,16 @@
 #include <xercesc/util/XMLString.hpp>
 
 #include <atomic>
+#include <cstring>
 #include <mutex>
 #include <functional>
 #include <stack>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace hpctoolkit;
 using namespace finalizers;
 using namespace xercesc;
@@ -79,6 +87,33 @@ namespace hpctoolkit::finalizers::detail {
 struct LMData {
   stdshim::filesystem::path path;
   bool has_calls;
+  // Module record in the Structfile index, if the data comes from there
+  std::optional<fmt_structidx_module_t> index;
+};
+
+/// Read-only mapping of a Structfile index (see formats/structidx.h).
+class StructIndex {
+public:
+  // Map the index for the given Structfile. Throws if the index is missing,
+  // older than the Structfile or otherwise unusable.
+  StructIndex(const stdshim::filesystem::path&);
+  ~StructIndex();
+
+  StructIndex(StructIndex&&) = delete;
+  StructIndex(const StructIndex&) = delete;
+  StructIndex& operator=(StructIndex&&) = delete;
+  StructIndex& operator=(const StructIndex&) = delete;
+
+  std::vector<fmt_structidx_module_t> modules() const;
+
+  /// Get a pointer to the given table, after checking it is within bounds
+  const char* table(uint64_t p, uint64_t n, uint64_t sz) const;
+  /// Get the string at the given pointer, after checking it is within bounds
+  std::string_view string(uint64_t p) const;
+
+private:
+  const char* data = nullptr;
+  std::size_t size = 0;
 };
 
 class StructFileParser {
@@ -96,6 +131,13 @@ public:
   std::optional<LMData> seekToNextLM(const stdshim::filesystem::path measDirPath) noexcept;
   bool parse(ProfilePipeline::Source&, const Module&, bool, StructFile::udModule&) noexcept;
 
+  /// Post-process the call edges from a Structfile (callee entry, caller
+  /// instruction and top Function) into the final reversed call graph.
+  static bool buildRCG(const Module&, bool has_calls,
+      const std::deque<std::pair<uint64_t, std::pair<uint64_t, std::reference_wrapper<const Function>>>>&,
+      const std::unordered_map<uint64_t, const Function&>&,
+      StructFile::udModule&);
+
 private:
   std::unique_ptr<SAX2XMLReader> parser;
   XMLPScanToken token;
@@ -105,9 +147,109 @@ private:
 
 using LMData = hpctoolkit::finalizers::detail::LMData;
 using StructFileParser = hpctoolkit::finalizers::detail::StructFileParser;
+using StructIndex = hpctoolkit::finalizers::detail::StructIndex;
+
+StructIndex::StructIndex(const stdshim::filesystem::path& sfpath) {
+  auto ipath = sfpath;
+  ipath += ".idx";
+  int fd = open(ipath.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) throw std::runtime_error("no index present");
+  struct stat ist, sst;
+  if(fstat(fd, &ist) != 0 || stat(sfpath.c_str(), &sst) != 0) {
+    close(fd);
+    throw std::runtime_error("unable to stat");
+  }
+  if(ist.st_mtime < sst.st_mtime) {
+    // The Structfile was regenerated since the index was made, don't trust it
+    close(fd);
+    throw std::runtime_error("index is out of date");
+  }
+  size = ist.st_size;
+  if(size < FMT_STRUCTIDX_SZ_FHdr + sizeof fmt_structidx_footer) {
+    close(fd);
+    throw std::runtime_error("index is truncated");
+  }
+  void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(m == MAP_FAILED) throw std::runtime_error("unable to mmap");
+  data = (const char*)m;
+
+  if(fmt_structidx_check(data, nullptr) < 0
+     || std::memcmp(data + size - sizeof fmt_structidx_footer, fmt_structidx_footer,
+                    sizeof fmt_structidx_footer) != 0) {
+    munmap((void*)data, size);
+    throw std::runtime_error("bad index header or footer");
+  }
+}
+
+StructIndex::~StructIndex() {
+  munmap((void*)data, size);
+}
+
+std::vector<fmt_structidx_module_t> StructIndex::modules() const {
+  fmt_structidx_fHdr_t hdr;
+  fmt_structidx_fHdr_read(&hdr, data);
+  if(hdr.szModule < FMT_STRUCTIDX_SZ_Module)
+    throw std::runtime_error("bad index module size");
+  const char* p = table(hdr.pModules, hdr.nModules, hdr.szModule);
+  std::vector<fmt_structidx_module_t> out(hdr.nModules);
+  for(auto& lm: out) {
+    fmt_structidx_module_read(&lm, p);
+    p += hdr.szModule;
+  }
+  return out;
+}
+
+const char* StructIndex::table(uint64_t p, uint64_t n, uint64_t sz) const {
+  if(p > size || n > (size - p) / sz)
+    throw std::out_of_range("index table out of bounds");
+  return data + p;
+}
+
+std::string_view StructIndex::string(uint64_t p) const {
+  if(p >= size) throw std::out_of_range("index string out of bounds");
+  const void* end = std::memchr(data + p, '\0', size - p);
+  if(end == nullptr) throw std::out_of_range("index string is unterminated");
+  return {data + p, (std::size_t)((const char*)end - (data + p))};
+}
+
+static stdshim::filesystem::path lmPath(stdshim::filesystem::path path,
+    const stdshim::filesystem::path& measDirPath) {
+  if(!path.has_root_path()){
+    if(measDirPath.empty()){
+      util::log::warning{} << "No measurement directory path provided for a load module with relative path "
+              << path << ", so we ignore this StructFile\n";
+      return "";
+    }
+    return measDirPath / path;
+  }
+  return path;
+}
 
 StructFile::StructFile(stdshim::filesystem::path p, stdshim::filesystem::path meas, std::shared_ptr<RecommendationStore> rs)
   : recstore(std::move(rs)), path(stdshim::filesystem::absolute(std::move(p))), measDirPath(stdshim::filesystem::weakly_canonical(meas)) {
+  // If hpcstruct left an index beside the Structfile, take the load modules
+  // from there and skip the XML entirely.
+  try {
+    index = std::make_shared<StructIndex>(path);
+    for(const auto& sm: index->modules()) {
+      auto lm = std::make_unique<LMData>();
+      lm->path = lmPath(std::string(index->string(sm.pPath)), measDirPath);
+      lm->has_calls = sm.hasCalls;
+      lm->index = sm;
+      if(lm->path.empty() || lms.find(lm->path) != lms.end()) continue;
+      auto path = lm->path;
+      lms.emplace(std::move(path), std::make_pair(std::move(lm), nullptr));
+    }
+    return;
+  } catch(std::exception& e) {
+    if(index)
+      util::log::info{} << "Ignoring corrupt Structfile index for "
+                        << path.filename().native() << ": " << e.what();
+    index.reset();
+    lms.clear();
+  }
+
   while(1) {  // Exit on EOF or error
     auto parser = std::make_unique<StructFileParser>(path);
     if(!parser->valid()) {
@@ -145,13 +287,13 @@ StructFile::classify(Context& c, NestedScope& ns) noexcept {
   if(ns.flat().type() == Scope::Type::point) {
     auto mo = ns.flat().point_data();
     const auto& udm = mo.first.userdata[ud];
-    if(udm.leaves.empty()) {
+    if(udm.empty()) {
       // We don't have any data for this Module, so pass it on
       return std::nullopt;
     }
 
-    auto leafit = udm.leaves.find(mo.second);
-    if(leafit == udm.leaves.end()) {
+    auto leaf = udm.find(mo.second);
+    if(!leaf) {
       // We have data for this module, but we don't have data for this specific
       // point (i.e. a gap in the Structfile). Assume we are better than any
       // other available Finalizer and report no information.
@@ -168,7 +310,7 @@ StructFile::classify(Context& c, NestedScope& ns) noexcept {
         if(!cr) cr = cc;
         ns.relation() = tn.first.second;
       };
-    handle(leafit->second.first);
+    handle(leaf->first);
     return std::make_pair(cr, cc);
   }
   return std::nullopt;
@@ -219,8 +361,8 @@ bool StructFile::resolve(ContextFlowGraph& fg) noexcept {
 
     // First move from the instruction to it's enclosing function's entry. That
     // makes things easier for the DFS later.
-    const auto leafit = udm.leaves.find(mo.second);
-    if(leafit == udm.leaves.end()) {
+    const auto leaf = udm.find(mo.second);
+    if(!leaf) {
       // Sample outside of our knowledge of function bounds. We know nothing.
       // TODO: Emit an error in this case?
       return false;
@@ -251,7 +393,7 @@ bool StructFile::resolve(ContextFlowGraph& fg) noexcept {
         fg.add({Scope(callee), std::move(fpath)});
       }
     };
-    dfs(leafit->second.second);
+    dfs(leaf->second);
 
     // If we made it here, we found at least one path. Set up the handler and
     // report it as the final answer.
@@ -297,10 +439,118 @@ void StructFile::load(const Module& m, udModule& ud) noexcept {
   // TODO: Check if this is the only StructFile for this Module.
 
   ud.cfgStatus = lm->has_calls ? CallGraphStatus::ERRORED : CallGraphStatus::NOT_PRESENT;
+  if(lm->index) {
+    if(!loadIndex(m, *lm, ud))
+      util::log::warning{} << "Error loading Structfile index " << path.filename().native() << ".idx";
+    return;
+  }
   if(!parser->parse(sink, m, lm->has_calls, ud))
     util::log::warning{} << "Error parsing Structfile " << path.filename().native();
 }
 
+bool StructFile::udModule::empty() const noexcept {
+  return leaves.empty() && index.nLeaves == 0;
+}
+
+std::optional<StructFile::udModule::leaf_t>
+StructFile::udModule::find(uint64_t addr) const noexcept {
+  if(index.leaves == nullptr) {
+    auto it = leaves.find(addr);
+    if(it == leaves.end()) return std::nullopt;
+    return it->second;
+  }
+  auto i = fmt_structidx_leaf_find(index.leaves, index.nLeaves, addr);
+  if(i < 0) return std::nullopt;
+  fmt_structidx_leaf_t lf;
+  fmt_structidx_leaf_read(&lf, index.leaves + i * FMT_STRUCTIDX_SZ_Leaf);
+  if(lf.scope >= index.nodes.size() || lf.function >= index.funcs.size())
+    return std::nullopt;
+  return leaf_t(index.nodes[lf.scope], index.funcs[lf.function]);
+}
+
+bool StructFile::loadIndex(const Module& m, const LMData& lm, udModule& ud) noexcept try {
+  const auto& sm = *lm.index;
+  ud.index.file = index;
+
+  // Files are referenced by their (unique) string pointer, so cache them
+  std::unordered_map<uint64_t, std::reference_wrapper<const File>> files;
+  auto file = [&](uint64_t p) -> const File& {
+    auto it = files.find(p);
+    if(it == files.end())
+      it = files.emplace(p, sink.file(std::string(index->string(p)))).first;
+    return it->second;
+  };
+
+  // Mapping of function entries to Functions
+  std::unordered_map<uint64_t, const Function&> funcs;
+  const char* fnp = index->table(sm.pFunctions, sm.nFunctions, FMT_STRUCTIDX_SZ_Function);
+  ud.index.funcs.reserve(sm.nFunctions);
+  for(uint32_t i = 0; i < sm.nFunctions; i++, fnp += FMT_STRUCTIDX_SZ_Function) {
+    fmt_structidx_function_t fn;
+    fmt_structidx_function_read(&fn, fnp);
+    std::optional<uint64_t> entry;
+    if(fn.hasEntry) entry = fn.entry;
+    std::string name(index->string(fn.pName));
+    auto& func = fn.pFile != 0
+        ? ud.funcs.emplace_back(m, entry, std::move(name), file(fn.pFile), fn.line)
+        : ud.funcs.emplace_back(m, entry, std::move(name));
+    if(entry && !funcs.emplace(*entry, func).second)
+      throw std::logic_error("Functions must have unique entries!");
+    ud.index.funcs.emplace_back(func);
+  }
+
+  const char* scp = index->table(sm.pScopes, sm.nScopes, FMT_STRUCTIDX_SZ_Scope);
+  ud.index.nodes.reserve(sm.nScopes);
+  for(uint32_t i = 0; i < sm.nScopes; i++, scp += FMT_STRUCTIDX_SZ_Scope) {
+    fmt_structidx_scope_t sc;
+    fmt_structidx_scope_read(&sc, scp);
+    // Parents always come before their children
+    if(sc.parent > i) throw std::logic_error("Scope parent is out of order");
+    const udModule::trienode* parent = sc.parent == 0 ? nullptr
+        : &ud.index.nodes[sc.parent - 1].get();
+    Scope scope;
+    switch(sc.kind) {
+    case fmt_structidx_scope_function:
+      scope = Scope(ud.index.funcs.at(sc.function).get());
+      break;
+    case fmt_structidx_scope_loop:
+      scope = Scope(Scope::loop, m, sc.addr, file(sc.pFile), sc.line);
+      break;
+    case fmt_structidx_scope_line:
+      scope = Scope(file(sc.pFile), sc.line);
+      break;
+    default:
+      throw std::logic_error("Unknown Scope kind");
+    }
+    Relation rel = sc.relation == fmt_structidx_relation_inlined_call
+        ? Relation::inlined_call : Relation::enclosure;
+    ud.trie.push_back({{scope, rel}, parent});
+    ud.index.nodes.emplace_back(ud.trie.back());
+  }
+
+  ud.index.leaves = index->table(sm.pLeaves, sm.nLeaves, FMT_STRUCTIDX_SZ_Leaf);
+  ud.index.nLeaves = sm.nLeaves;
+
+  // Reversed call graph, but with callee function entries instead of Functions
+  std::deque<std::pair<uint64_t, std::pair<uint64_t,
+      std::reference_wrapper<const Function>>>> tmp_rcg;
+  const char* cp = index->table(sm.pCalls, sm.nCalls, FMT_STRUCTIDX_SZ_Call);
+  for(uint32_t i = 0; i < sm.nCalls; i++, cp += FMT_STRUCTIDX_SZ_Call) {
+    fmt_structidx_call_t c;
+    fmt_structidx_call_read(&c, cp);
+    tmp_rcg.push_back({c.callee, {c.callerInst, ud.index.funcs.at(c.caller)}});
+  }
+
+  return StructFileParser::buildRCG(m, lm.has_calls, tmp_rcg, funcs, ud);
+} catch(std::exception& e) {
+  util::log::info{} << "Exception caught while loading Structfile index\n"
+       "  what(): " << e.what() << "\n"
+       "  for binary: " << m.path().string();
+  ud.index.leaves = nullptr;
+  ud.index.nLeaves = 0;
+  return false;
+}
+
 StructFileParser::StructFileParser(const stdshim::filesystem::path& path) noexcept
   : parser(XMLReaderFactory::createXMLReader()), ok(false) {
   try {
@@ -326,16 +576,7 @@ std::optional<LMData> StructFileParser::seekToNextLM(const stdshim::filesystem::
   bool eof = false;
   LHandler handler([&](const std::string& ename, const Attributes& attr){
     if(ename == "LM") {
-      lm.path = xmlstr(attr.getValue(XMLStr("n")));
-      if(!lm.path.has_root_path()){
-        if(measDirPath.empty()){
-          util::log::warning{} << "No measurement directory path provided for a load module with relative path "
-                  << lm.path << ", so we ignore this StructFile\n";
-          lm.path = "";
-        }else{
-          lm.path = measDirPath / lm.path;
-        }
-      }
+      lm.path = lmPath(xmlstr(attr.getValue(XMLStr("n"))), measDirPath);
       lm.has_calls = xmlstr(attr.getValue(XMLStr("has-calls"))) == "1";
     }
   }, [&](const std::string& ename){
@@ -522,6 +763,23 @@ bool StructFileParser::parse(ProfilePipeline::Source& sink, const Module& m,
   }
   assert(stack.size() == 0 && "Inconsistent stack handling!");
 
+  return buildRCG(m, has_calls, tmp_rcg, funcs, ud);
+} catch(std::exception& e) {
+  util::log::info{} << "Exception caught while parsing Structfile\n"
+       "  what(): " << e.what() << "\n"
+       "  for binary: " << m.path().string();
+  return false;
+} catch(xercesc::SAXException& e) {
+  util::log::info{} << "Exception caught while parsing Structfile\n"
+       "  msg: " << xmlstr(e.getMessage()) << "\n"
+       "  for binary: " << m.path().string();
+  return false;
+}
+
+bool StructFileParser::buildRCG(const Module& m, bool has_calls,
+    const std::deque<std::pair<uint64_t, std::pair<uint64_t, std::reference_wrapper<const Function>>>>& tmp_rcg,
+    const std::unordered_map<uint64_t, const Function&>& funcs,
+    StructFile::udModule& ud) {
   // If we have a call graph, do some processing on it to generate a final Reverse Call Graph (RCG).
   if(has_calls || !tmp_rcg.empty()) {
     ud.cfgStatus = StructFile::CallGraphStatus::VALID;
@@ -627,14 +885,4 @@ bool StructFileParser::parse(ProfilePipeline::Source& sink, const Module& m,
   }
 
   return true;
-} catch(std::exception& e) {
-  util::log::info{} << "Exception caught while parsing Structfile\n"
-       "  what(): " << e.what() << "\n"
-       "  for binary: " << m.path().string();
-  return false;
-} catch(xercesc::SAXException& e) {
-  util::log::info{} << "Exception caught while parsing Structfile\n"
-       "  msg: " << xmlstr(e.getMessage()) << "\n"
-       "  for binary: " << m.path().string();
-  return false;
 }
@@ -12,14 +12,17 @@
 #include "../util/range_map.hpp"
 
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <map>
+#include <vector>
 
 namespace hpctoolkit::finalizers {
 
 namespace detail {
 struct LMData;
 class StructFileParser;
+class StructIndex;
 }
 
 // When a struct file is around, this draws data from it to Classify a Module.
@@ -77,10 +80,26 @@ private:
     using trienode = std::pair<std::pair<Scope, Relation>, const void* /* const trienode* */>;
     // Trie of Scopes, for efficiently storing nested Scopes
     std::deque<trienode> trie;
+    using leaf_t = std::pair<std::reference_wrapper<const trienode>,
+                             std::reference_wrapper<const Function>>;
     // Bounds-map (instruction -> nested Scope and top Function)
-    std::map<util::interval<uint64_t>, std::pair<
-        std::reference_wrapper<const trienode>,
-        std::reference_wrapper<const Function>>> leaves;
+    std::map<util::interval<uint64_t>, leaf_t> leaves;
+
+    // When loaded from a Structfile index, the bounds are instead looked up
+    // directly in the (mapped) sorted Leaf table, whose entries refer to the
+    // trie nodes and Functions by index.
+    struct {
+      std::shared_ptr<const detail::StructIndex> file;
+      const char* leaves = nullptr;
+      uint32_t nLeaves = 0;
+      std::vector<std::reference_wrapper<const trienode>> nodes;
+      std::vector<std::reference_wrapper<const Function>> funcs;
+    } index;
+
+    // Returns true if there is no bounds data for this Module
+    bool empty() const noexcept;
+    // Look up the leaf Scope and top Function for the given instruction
+    std::optional<leaf_t> find(uint64_t) const noexcept;
 
     // Status of the call graph data for
     CallGraphStatus cfgStatus = CallGraphStatus::NONE;
@@ -94,6 +113,10 @@ private:
   stdshim::filesystem::path measDirPath;
   Module::ud_t::typed_member_t<udModule> ud;
   void load(const Module&, udModule&) noexcept;
+  bool loadIndex(const Module&, const detail::LMData&, udModule&) noexcept;
+
+  // Mapped Structfile index, if one was found alongside the Structfile
+  std::shared_ptr<const detail::StructIndex> index;
 
   // Structfiles can have data on multiple load modules (LM tags), this maps
   // each binary path with the properly initialized Parser for that tag.
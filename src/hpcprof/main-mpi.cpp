@@ -13,6 +13,7 @@
 #include "pipeline.hpp"
 #include "packedids.hpp"
 #include "source.hpp"
+#include "sources/hpcrun4.hpp"
 #include "sources/packed.hpp"
 #include "sinks/hpctracedb2.hpp"
 #include "sinks/metadb.hpp"
@@ -93,6 +94,20 @@ int main(int argc, char* const argv[]) {
   // Add the base Sources to the two Pipelines we'll be using.
   ProfilePipeline::Settings pipelineB1;
   ProfilePipeline::Settings pipelineB2;
+  pipelineB1.sortBudget(args.traceSortMemory);
+  pipelineB2.sortBudget(args.traceSortMemory);
+
+  // Sources that fit in the cache are read into memory once and replicated
+  // for the first Pipeline, the second Pipeline then reads the same image.
+  std::atomic<std::uintmax_t> cacheAvail(args.profileCacheSize);
+  const auto cacheReserve = [&](std::uintmax_t size) -> bool {
+    auto avail = cacheAvail.load(std::memory_order_relaxed);
+    do {
+      if(avail < size) return false;
+    } while(!cacheAvail.compare_exchange_weak(avail, avail - size,
+                                              std::memory_order_relaxed));
+    return true;
+  };
 #ifndef NVALGRIND
   char start_arc;
   char end_arc;
@@ -110,6 +125,18 @@ int main(int argc, char* const argv[]) {
       if(!stdshim::filesystem::is_directory(meas)) {
         meas = "";
       }
+      if(auto* r4 = dynamic_cast<sources::Hpcrun4*>(args.sources[i].first.get());
+         r4 != nullptr && args.profileCacheSize > 0) {
+        auto size = r4->imageSize();
+        if(size > 0 && cacheReserve(size)) {
+          if(r4->retainImage()) {
+            if(auto r = r4->replicate()) {
+              my_sources.emplace_back(std::move(r));
+              continue;
+            }
+          } else cacheAvail.fetch_add(size, std::memory_order_relaxed);
+        }
+      }
       my_sources.emplace_back(ProfileSource::create_for(args.sources[i].second, meas));
     }
     #pragma omp critical
@@ -243,9 +270,9 @@ int main(int argc, char* const argv[]) {
     // Finally, we get to write stuff out
     switch(args.format) {
     case ProfArgs::Format::metadb:
-      pipelineB2 << std::make_unique<sinks::SparseDB>(args.output);
+      pipelineB2 << std::make_unique<sinks::SparseDB>(args.output, args.pack_values);
       if(args.include_traces)
-        pipelineB2 << std::make_unique<sinks::HPCTraceDB2>(args.output);
+        pipelineB2 << std::make_unique<sinks::HPCTraceDB2>(args.output, args.trace_levels);
       break;
     }
 
@@ -30,6 +30,7 @@ int main(int argc, char* const argv[]) {
 
   // Get the main core of the Pipeline set up.
   ProfilePipeline::Settings pipelineB;
+  pipelineB.sortBudget(args.traceSortMemory);
   for(auto& sp : args.sources) pipelineB << std::move(sp.first);
   ProfArgs::StatisticsExtender se(args);
   pipelineB << se;
@@ -59,10 +60,10 @@ int main(int argc, char* const argv[]) {
   switch(args.format) {
   case ProfArgs::Format::metadb: {
     pipelineB << std::make_unique<sinks::MetaDB>(args.output, args.include_sources)
-              << std::make_unique<sinks::SparseDB>(args.output)
+              << std::make_unique<sinks::SparseDB>(args.output, args.pack_values)
               << std::make_unique<sinks::MetricsYAML>(args.output);
     if(args.include_traces)
-      pipelineB << std::make_unique<sinks::HPCTraceDB2>(args.output);
+      pipelineB << std::make_unique<sinks::HPCTraceDB2>(args.output, args.trace_levels);
     break;
   }
   }
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "metric.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace hpctoolkit;
+
+namespace {
+
+// Partials of a Metric with only the percentile sketch: the Thread count
+// followed by the bucket counts.
+constexpr std::size_t cntIdx = 0;
+constexpr std::size_t sketchIdx = 1;
+
+// Build the Partials by accumulating the given per-Thread values
+std::vector<double> sketch(const std::vector<double>& values) {
+  std::vector<double> partials(sketchIdx + Metric::percentileBuckets, 0);
+  for (double v : values) {
+    partials[cntIdx] += 1;
+    for (std::size_t k = 0; k < Metric::percentileBuckets; k++)
+      partials[sketchIdx + k] += Metric::percentileBucketFormula(k).evaluate(v);
+  }
+  return partials;
+}
+
+double percentile(unsigned int pct, const std::vector<double>& partials) {
+  return Metric::percentileFormula(pct, cntIdx, sketchIdx)
+      .evaluate([&](Expression::uservalue_t i) -> double { return partials.at(i); });
+}
+
+}  // namespace
+
+TEST(MetricPercentileTest, Buckets) {
+  // Boundaries are exclusive: a value on a boundary is not above it
+  const double b = std::ldexp(1.0, Metric::percentileMinExp + 3);
+  EXPECT_EQ(Metric::percentileBucketFormula(3).evaluate(b), 0);
+  EXPECT_EQ(Metric::percentileBucketFormula(3).evaluate(b * 1.5), 1);
+  EXPECT_EQ(Metric::percentileBucketFormula(3).evaluate(b / 2), 0);
+  EXPECT_EQ(Metric::percentileBucketFormula(2).evaluate(b), 1);
+}
+
+TEST(MetricPercentileTest, HandBuiltCounts) {
+  // 10 Threads: 5 above 2^-20 only, 4 above up to 2^2, 1 above up to 2^5
+  std::vector<double> partials(sketchIdx + Metric::percentileBuckets, 0);
+  partials[cntIdx] = 10;
+  for (std::size_t k = 0; k < Metric::percentileBuckets; k++) {
+    const int e = Metric::percentileMinExp + (int)k;
+    partials[sketchIdx + k] = e <= -20 ? 10 : e <= 2 ? 5 : e <= 5 ? 1 : 0;
+  }
+  // P50: exactly 5 Threads are above 2^-20..2^2, so the median is in (2^-20, 2^-19]
+  EXPECT_DOUBLE_EQ(percentile(50, partials), std::ldexp(1.0, -20) * std::sqrt(2.0));
+  // P90: exactly 1 Thread is above 2^3..2^5, so P90 is in (2^2, 2^3]
+  EXPECT_DOUBLE_EQ(percentile(90, partials), std::ldexp(1.0, 2) * std::sqrt(2.0));
+  // P99: 0.1 Threads, so the one Thread above 2^5 is the 99th percentile
+  EXPECT_DOUBLE_EQ(percentile(99, partials), std::ldexp(1.0, 5) * std::sqrt(2.0));
+}
+
+TEST(MetricPercentileTest, ExactlyTenPercentAbove) {
+  // When exactly 10% of the Threads lie above a boundary, P90 is the bucket
+  // holding the other 90% and not the one above it.
+  for (std::size_t n : {10, 20, 40, 80, 100, 1000}) {
+    std::vector<double> values(n, 1.5);
+    for (std::size_t i = 0; i < n / 10; i++)
+      values[i] = 100;
+    const auto partials = sketch(values);
+    EXPECT_DOUBLE_EQ(percentile(50, partials), std::sqrt(2.0)) << "n = " << n;
+    EXPECT_DOUBLE_EQ(percentile(90, partials), std::sqrt(2.0)) << "n = " << n;
+    EXPECT_DOUBLE_EQ(percentile(99, partials), 64 * std::sqrt(2.0)) << "n = " << n;
+  }
+}
+
+TEST(MetricPercentileTest, ExactlyOnePercentAbove) {
+  std::vector<double> values(100, 3);
+  values[0] = 1000;
+  const auto partials = sketch(values);
+  EXPECT_DOUBLE_EQ(percentile(99, partials), 2 * std::sqrt(2.0));
+  EXPECT_DOUBLE_EQ(percentile(50, partials), 2 * std::sqrt(2.0));
+}
+
+TEST(MetricPercentileTest, BelowRange) {
+  const auto partials = sketch({0, 0, 0, std::ldexp(1.0, -30)});
+  EXPECT_EQ(percentile(50, partials), 0);
+  EXPECT_EQ(percentile(99, partials), 0);
+}
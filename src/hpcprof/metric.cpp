@@ -11,6 +11,7 @@
 #include "context.hpp"
 #include "attributes.hpp"
 
+#include <cmath>
 #include <forward_list>
 #include <stack>
 #include <thread>
@@ -78,6 +79,7 @@ void Metric::StatsAccess::requestStatistics(Statistics ss) {
   // If the Metric is invisible, we don't actually need to do anything
   if(m.visibility() == Settings::visibility_t::invisible) {
     assert(!ss.sum && !ss.mean && !ss.min && !ss.max && !ss.stddev && !ss.cfvar
+           && !ss.percentiles
            && "Attempt to request Statistics from an invisible Metric!");
     return;
   }
@@ -91,6 +93,7 @@ void Metric::StatsAccess::requestStatistics(Statistics ss) {
     assert((!ss.max    || m.m_thawed_stats.max)    && "Attempt to request :Max from a frozen Metric!");
     assert((!ss.stddev || m.m_thawed_stats.stddev) && "Attempt to request :StdDev from a frozen Metric!");
     assert((!ss.cfvar  || m.m_thawed_stats.cfvar)  && "Attempt to request :CfVar from a frozen Metric!");
+    assert((!ss.percentiles || m.m_thawed_stats.percentiles) && "Attempt to request :P50/:P90/:P99 from a frozen Metric!");
     return;
   }
   m.m_thawed_stats.sum = m.m_thawed_stats.sum || ss.sum;
@@ -99,6 +102,7 @@ void Metric::StatsAccess::requestStatistics(Statistics ss) {
   m.m_thawed_stats.max = m.m_thawed_stats.max || ss.max;
   m.m_thawed_stats.stddev = m.m_thawed_stats.stddev || ss.stddev;
   m.m_thawed_stats.cfvar = m.m_thawed_stats.cfvar || ss.cfvar;
+  m.m_thawed_stats.percentiles = m.m_thawed_stats.percentiles || ss.percentiles;
 }
 
 std::size_t Metric::StatsAccess::requestSumPartial() {
@@ -113,6 +117,45 @@ std::size_t Metric::StatsAccess::requestSumPartial() {
   return m.m_thawed_sumPartial;
 }
 
+// The sketch is mergeable like any other sum, so it needs no special handling
+// across Threads or ranks. Estimates are within a factor of sqrt(2) of the true
+// percentile for values between the smallest and largest bucket boundaries.
+
+// Indicator for x > y, i.e. 1 if x > y and 0 otherwise
+static Expression above(Expression x, Expression y) {
+  return {Expression::Kind::op_min, {1., {Expression::Kind::op_max, {0.,
+    {Expression::Kind::op_ceil, {{Expression::Kind::op_sub, {std::move(x), std::move(y)}}}},
+  }}}};
+}
+
+Expression Metric::percentileBucketFormula(std::size_t k) {
+  assert(k < percentileBuckets);
+  return above(Expression::variable, std::ldexp(1.0, percentileMinExp + (int)k));
+}
+
+// The bucket counts are non-increasing, so the number of boundaries with more
+// than (100 - pct)% of the Threads above them locates the bucket the percentile
+// lies in. The estimate is the geometric midpoint of that bucket, or 0 if below
+// the smallest boundary. The threshold is built from integers so that it is
+// exact whenever (100 - pct)% of the Threads is a whole number of Threads.
+Expression Metric::percentileFormula(unsigned int pct, std::size_t cntIdx,
+                                     std::size_t sketchIdx) {
+  assert(pct <= 100);
+  const Expression thres = {Expression::Kind::op_div, {
+    {Expression::Kind::op_prod, {(double)(100 - pct), {Expression::variable, cntIdx}}},
+    100.,
+  }};
+  std::vector<Expression> exp;
+  exp.reserve(percentileBuckets + 1);
+  exp.push_back(percentileMinExp - 0.5);
+  for(std::size_t k = 0; k < percentileBuckets; k++)
+    exp.push_back(above({Expression::variable, sketchIdx + k}, thres));
+  return {Expression::Kind::op_prod, {
+    above({Expression::variable, sketchIdx}, thres),
+    {Expression::Kind::op_pow, {2., {Expression::Kind::op_sum, std::move(exp)}}},
+  }};
+}
+
 bool Metric::freeze() {
   if(m_frozen.load(std::memory_order_acquire)) {
     ANNOTATE_HAPPENS_AFTER(&m_frozen);
@@ -127,7 +170,7 @@ bool Metric::freeze() {
   const Statistics& ss = m_thawed_stats;
 
   size_t cntIdx = -1;
-  if(ss.mean || ss.stddev || ss.cfvar) {
+  if(ss.mean || ss.stddev || ss.cfvar || ss.percentiles) {
     cntIdx = m_partials.size();
     m_partials.push_back({1, Statistic::combination_t::sum, cntIdx});
   }
@@ -155,6 +198,15 @@ bool Metric::freeze() {
                           maxIdx});
   }
 
+  size_t pctIdx = -1;
+  if(ss.percentiles) {
+    pctIdx = m_partials.size();
+    for(std::size_t k = 0; k < percentileBuckets; k++) {
+      m_partials.push_back({percentileBucketFormula(k), Statistic::combination_t::sum,
+                            pctIdx + k});
+    }
+  }
+
   if(ss.sum)
     m_stats.push_back({"Sum", true, {Expression::variable, m_thawed_sumPartial},
                        u_settings().visibility == Settings::visibility_t::shownByDefault});
@@ -197,6 +249,12 @@ bool Metric::freeze() {
   if(ss.max)
     m_stats.push_back({"Max", false, {Expression::variable, maxIdx},
                        u_settings().visibility == Settings::visibility_t::shownByDefault});
+  if(ss.percentiles) {
+    for(const auto& [suffix, pct]: {std::pair{"P50", 50u}, {"P90", 90u}, {"P99", 99u}}) {
+      m_stats.push_back({suffix, false, percentileFormula(pct, cntIdx, pctIdx),
+                         u_settings().visibility == Settings::visibility_t::shownByDefault});
+    }
+  }
 
   ANNOTATE_HAPPENS_BEFORE(&m_frozen);
   m_frozen.store(true, std::memory_order_release);
@@ -212,7 +270,7 @@ const std::vector<Statistic>& Metric::statistics() const noexcept {
   return m_stats;
 }
 
-util::optional_ref<const MetricAccumulator> Metric::getFor(const PerThreadTemporary& t, const Context& c) const noexcept {
+util::optional_ref<const ThreadAccumulators::Value> Metric::getFor(const PerThreadTemporary& t, const Context& c) const noexcept {
   auto cd = t.c_data.find(c);
   if(!cd) return std::nullopt;
   return cd->find(*this);
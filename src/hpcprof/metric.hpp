@@ -225,7 +225,7 @@ public:
   struct Statistics final {
     Statistics()
       : sum(false), mean(false), min(false), max(false), stddev(false),
-        cfvar(false) {};
+        cfvar(false), percentiles(false) {};
 
     bool sum : 1;
     bool mean : 1;
@@ -233,6 +233,7 @@ public:
     bool max : 1;
     bool stddev : 1;
     bool cfvar : 1;
+    bool percentiles : 1;  // P50, P90 and P99
   };
 
   const std::string& name() const noexcept { return u_settings().name; }
@@ -259,7 +260,7 @@ public:
   /// Obtain a pointer to the Thread-local Accumulator for a particular Context.
   /// Returns `nullptr` if no metric data exists for the given Context.
   // MT: Safe (const), Unstable (before notifyThreadFinal)
-  util::optional_ref<const MetricAccumulator> getFor(const PerThreadTemporary&, const Context& c) const noexcept;
+  util::optional_ref<const ThreadAccumulators::Value> getFor(const PerThreadTemporary&, const Context& c) const noexcept;
 
   Metric(Metric&& m);
 
@@ -286,6 +287,22 @@ public:
   /// Convenience function to generate a StatsAccess handle.
   StatsAccess statsAccess() { return StatsAccess{*this}; }
 
+  /// Percentiles are estimated from a fixed-size sketch: a log2-scale
+  /// histogram in cumulative form, with one sum Partial per bucket boundary
+  /// counting the Threads with a value above 2^(percentileMinExp + k).
+  static constexpr int percentileMinExp = -20;
+  static constexpr std::size_t percentileBuckets = 64;
+
+  /// Accumulate formula for the `k`-th Partial of the percentile sketch.
+  // MT: Safe
+  static Expression percentileBucketFormula(std::size_t k);
+
+  /// Finalize formula estimating the `pct`-th percentile, given the index of
+  /// the Thread-count Partial and of the first Partial of the sketch.
+  // MT: Safe
+  static Expression percentileFormula(unsigned int pct, std::size_t cntIdx,
+                                      std::size_t sketchIdx);
+
 private:
   util::uniqable_key<Settings> u_settings;
   Statistics m_thawed_stats;
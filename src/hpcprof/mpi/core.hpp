@@ -59,7 +59,7 @@ enum class Tag : int {
   // 0 is skipped
   ThreadAttributes_1 = 1,  // For attributes.cpp
 
-  SparseDB_1, SparseDB_2,  // For sinks/sparsedb.cpp
+  SparseDB_1, SparseDB_2, SparseDB_3,  // For sinks/sparsedb.cpp
   RankTree_1, RankTree_2,  // For hpcprof2-mpi/tree.cpp
 };
 
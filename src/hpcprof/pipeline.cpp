@@ -13,7 +13,9 @@
 #include "sink.hpp"
 #include "finalizer.hpp"
 
+#include <algorithm>
 #include <iomanip>
+#include <numeric>
 #include <stdexcept>
 #include <limits>
 
@@ -95,6 +97,11 @@ Settings& Settings::operator<<(std::unique_ptr<ProfileFinalizer>&& fp) {
   return operator<<(*up_finalizers.back());
 }
 
+Settings& Settings::sortBudget(std::size_t bytes) noexcept {
+  timepointSortBudget = bytes;
+  return *this;
+}
+
 ProfilePipeline::ProfilePipeline(Settings&& b, std::size_t team_sz)
   : detail::ProfilePipelineBase(std::move(b)), team_size(team_sz),
     waves(sources.size()),
@@ -227,16 +234,31 @@ ProfilePipeline::ProfilePipeline(Settings&& b, std::size_t team_sz)
   scheduled &= all_requested;
   unscheduledWaves = scheduledWaves - scheduled;
   scheduledWaves &= scheduled;
+
+  // Schedule the Sources largest-first (LPT), otherwise a few huge Sources
+  // that happen to be last can leave the rest of the team idle.
+  std::vector<std::uintmax_t> sizes;
+  sizes.reserve(sources.size());
+  for(auto& ms: sources) sizes.push_back(ms().sizeHint());
+  sourceOrder.resize(sources.size());
+  std::iota(sourceOrder.begin(), sourceOrder.end(), 0);
+  std::stable_sort(sourceOrder.begin(), sourceOrder.end(),
+    [&](std::size_t a, std::size_t b){ return sizes[a] > sizes[b]; });
 }
 
-void ProfilePipeline::complete(PerThreadTemporary&& tt, std::optional<std::pair<std::chrono::nanoseconds, std::chrono::nanoseconds>>& localTimepointBounds) {
+void ProfilePipeline::complete(PerThreadTemporary&& tt, StatisticStaging& localStatistics, std::optional<std::pair<std::chrono::nanoseconds, std::chrono::nanoseconds>>& localTimepointBounds) {
   auto drain = [&](auto& tpd, auto type, auto notify) {
-    // Drain the remaining timepoints from the staging buffer first
+    // Timepoints with unbounded disorder are all in the external sort
+    if(!tpd.spill.empty()) {
+      tpd.spill.drain([&](const auto& tps){
+        for(auto& s: sinks) {
+          if(!s.dataLimit.has(type)) continue;
+          notify(s(), tps);
+        }
+      });
+    }
+    // Otherwise drain the remaining timepoints from the staging buffer first
     if(!tpd.staging.empty()) {
-      if(tpd.unboundedDisorder) {
-        std::sort(tpd.staging.begin(), tpd.staging.end(),
-            util::compare_only_first<typename decltype(tpd.staging)::value_type>());
-      }
       for(auto& s: sinks) {
         if(!s.dataLimit.has(type)) continue;
         notify(s(), tpd.staging);
@@ -272,7 +294,7 @@ void ProfilePipeline::complete(PerThreadTemporary&& tt, std::optional<std::pair<
   }
 
   // Finish off the Thread's metrics and let the Sinks know
-  tt.finalize();
+  tt.finalize(localStatistics);
   std::shared_ptr<PerThreadTemporary> ttptr = std::make_shared<PerThreadTemporary>(std::move(tt));
   for(auto& s: sinks)
     if(s.dataLimit.hasThreads()) s().notifyThreadFinal(ttptr);
@@ -284,14 +306,19 @@ void ProfilePipeline::run() {
   char barrier_arc;
   char single_arc;
   char barrier2_arc;
+  char barrier3_arc;
   char end_arc;
 #endif  // !NVALGRIND
 
   std::array<std::atomic<std::size_t>, 4> countdowns;
   for(auto& c: countdowns) c.store(sources.size(), std::memory_order_relaxed);
+  std::atomic<std::size_t> finishingSources(sources.size());
 
   std::deque<std::reference_wrapper<PerThreadTemporary>> allMergedThreads;
 
+  // Staged Statistics are reduced in bulk once all the Threads are complete
+  StatisticStaging::Shards statShards(team_size);
+
   ANNOTATE_HAPPENS_BEFORE(&start_arc);
   #pragma omp parallel num_threads(team_size)
   {
@@ -337,7 +364,8 @@ void ProfilePipeline::run() {
     auto wave = [&](DataClass d, std::size_t idx) {
       if(!(d & scheduledWaves).hasAny()) return;
       #pragma omp for schedule(dynamic) nowait
-      for(std::size_t i = 0; i < sources.size(); ++i) {
+      for(std::size_t k = 0; k < sources.size(); ++k) {
+        const std::size_t i = sourceOrder[k];
         {
           std::unique_lock<std::mutex> l(sources[i].lock);
           DataClass req = (sources[i]().finalizeRequest(d) - sources[i].read)
@@ -368,10 +396,14 @@ void ProfilePipeline::run() {
 
     std::optional<std::pair<std::chrono::nanoseconds, std::chrono::nanoseconds>>
       localTimepointBounds;
+    // Statistics from finalized Threads are staged per-worker, instead of
+    // contending on the accumulators of hot Contexts for every Thread.
+    StatisticStaging localStatistics(statShards);
 
     // Now for the finishing wave
     #pragma omp for schedule(dynamic) nowait
-    for(std::size_t i = 0; i < sources.size(); ++i) {
+    for(std::size_t k = 0; k < sources.size(); ++k) {
+      const std::size_t i = sourceOrder[k];
       auto& sl = sourceLocals[i];
       {
         sources[i].wavesComplete.wait();
@@ -385,9 +417,10 @@ void ProfilePipeline::run() {
         sl.disabled |= req;
 #endif
       }
+      finishingSources.fetch_sub(1, std::memory_order_release);
 
       // Complete the threads unit to this Source in particular
-      for(auto& tt: sl.threads) complete(std::move(tt), localTimepointBounds);
+      for(auto& tt: sl.threads) complete(std::move(tt), localStatistics, localTimepointBounds);
 
       // Clean up the Source-local data.
       sl.threads.clear();
@@ -395,6 +428,16 @@ void ProfilePipeline::run() {
       sl.thawedMetrics.clear();
     }
 
+    // Help out any Sources still reading in the finishing wave. Large Sources
+    // may split their reads into pieces that other threads can pick up.
+    for(bool didwork = true;
+        finishingSources.load(std::memory_order_acquire) > 0; ) {
+      // Same as for the Sinks below, don't contend if there's nothing to do.
+      if(!didwork) std::this_thread::yield();
+      didwork = false;
+      for(auto& s: sources) didwork = s().help().contributed || didwork;
+    }
+
     // Make sure everything has been read before we handle the merged threads
     ANNOTATE_HAPPENS_BEFORE(&barrier_arc);
     #pragma omp barrier
@@ -414,9 +457,12 @@ void ProfilePipeline::run() {
     // Handle all the Threads that were merged, same as for any other Thread
     #pragma omp for schedule(dynamic) nowait
     for(std::size_t i = 0; i < allMergedThreads.size(); ++i) {
-      complete(std::move(allMergedThreads[i].get()), localTimepointBounds);
+      complete(std::move(allMergedThreads[i].get()), localStatistics, localTimepointBounds);
     }
 
+    // Hand over the remaining staged Statistics for the reduction below
+    localStatistics.flush();
+
     // Update the main timepoint bounds with our thread-local data
     if(localTimepointBounds) {
       std::unique_lock<std::mutex> l(attrsLock);
@@ -432,6 +478,17 @@ void ProfilePipeline::run() {
     #pragma omp barrier
     ANNOTATE_HAPPENS_AFTER(&barrier2_arc);
 
+    // Reduce the staged Statistics into their final accumulators. Each shard
+    // is handled by a single thread, so this needs no further synchronization.
+    #pragma omp for schedule(dynamic) nowait
+    for(std::size_t i = 0; i < statShards.size(); ++i)
+      statShards.reduce(i);
+
+    // The Sinks may read the Statistics while writing, so wait for them
+    ANNOTATE_HAPPENS_BEFORE(&barrier3_arc);
+    #pragma omp barrier
+    ANNOTATE_HAPPENS_AFTER(&barrier3_arc);
+
     // Clean up the Sources early, to save some serialized time later
     #pragma omp for schedule(dynamic) nowait
     for(std::size_t i = 0; i < sources.size(); ++i)
@@ -691,7 +748,7 @@ void Source::addToReconstructionGroup(Context& r, const Scope& entry, PerThreadT
 Source::AccumulatorsRef Source::accumulateTo(PerThreadTemporary& t, Context& c) {
   SRC_ASSERT_LIMITS(metrics);
   assert(slocal->lastWave && "Attempt to emit metrics before requested!");
-  return AccumulatorsRef(t.c_data[c]);
+  return AccumulatorsRef(t.c_data, c);
 }
 
 Source::AccumulatorsRef Source::accumulateTo(PerThreadTemporary& t, ContextReconstruction& cr) {
@@ -721,7 +778,10 @@ Source::AccumulatorsRef Source::accumulateTo(PerThreadTemporary& t, uint64_t g,
 }
 
 void Source::AccumulatorsRef::add(Metric& m, double v) {
-  map.get()[m].add(v);
+  if(table) {
+    if(batch) batch->add(*table, *ctx, m, v);
+    else table->add(*ctx, m, v);
+  } else (*map)[m].add(v);
 }
 
 Thread& Source::newThread(ThreadAttributes o) {
@@ -778,8 +838,8 @@ Source::TimepointStatus Source::timepoint(PerThreadTemporary& tt, PerThreadTempo
   tt.maxTime = std::max(tt.maxTime, std::get<0>(tp));
 
   if(tpd.unboundedDisorder) {
-    // Stash in the staging buffer until we have 'em all to sort together
-    tpd.staging.push_back(std::move(tp));
+    // Stash in the external sort until we have 'em all to sort together
+    tpd.spill.push(std::move(tp));
     return TimepointStatus::next;
   }
 
@@ -802,13 +862,16 @@ Source::TimepointStatus Source::timepoint(PerThreadTemporary& tt, PerThreadTempo
         // with a significantly smaller bound. Rewinds are expensive.
         tpd.sortBuf = decltype(tpd.sortBuf)(1023);
       } else {
-        // Fall back to loading the whole thing in memory
+        // Fall back to sorting the whole thing, spilling to disk if needed
         util::log::warning{} << "Trace for a thread is unexpectedly extremely"
-             " unordered, falling back to an in-memory sort.\n"
+             " unordered, falling back to a full external sort.\n"
              "  This may indicate an issue during measurement, and WILL"
-             " significantly increase memory usage!\n"
+             " significantly increase processing time!\n"
              "  Affected thread: " << tt.thread().attributes;
         tpd.unboundedDisorder = true;
+        // Every thread of the team may be sorting at once, so each gets a
+        // share of the budget
+        tpd.spill = decltype(tpd.spill)(pipe->timepointSortBudget / pipe->team_size);
       }
 
       for(auto& s: pipe->sinks) {
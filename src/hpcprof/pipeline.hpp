@@ -99,6 +99,10 @@ protected:
   ExtensionClass available;  // Maximum available Extension set.
   ExtensionClass requested;  // Minimal requested Extension set.
 
+  // Memory budget (in bytes) for sorting badly disordered timepoints, shared
+  // between the threads of the team. Anything more than this is spilled to disk.
+  std::size_t timepointSortBudget = 256 * 1024 * 1024;
+
   // Storage for the unique_ptrs
   std::vector<std::unique_ptr<ProfileSink>> up_sinks;
   std::vector<std::unique_ptr<ProfileFinalizer>> up_finalizers;
@@ -134,6 +138,12 @@ public:
     // MT: Externally Synchronized
     Settings& operator<<(ProfileFinalizer&);
     Settings& operator<<(std::unique_ptr<ProfileFinalizer>&&);
+
+    /// Set the memory budget (in bytes) for sorting the timepoints of threads
+    /// with unbounded disorder, shared evenly between the threads of the team.
+    /// Timepoints past this budget are sorted on disk.
+    // MT: Externally Synchronized
+    Settings& sortBudget(std::size_t bytes) noexcept;
   };
 
   /// Compile the given Settings into a usable Pipeline. The teamSize determines
@@ -399,39 +409,55 @@ public:
       AccumulatorsRef& operator=(AccumulatorsRef&&) = default;
 
       /// Emit some Thread-local metric data into the Pipeline.
-      // MT: Externally Synchronized (this, Source), Internally Synchronized
+      // MT: Externally Synchronized (this), Internally Synchronized
       void add(Metric&, double);
 
+      /// Buffer any data bound for the Thread's Context table in the given
+      /// Batch instead, to be added in bulk when the Batch is flushed. Data
+      /// bound elsewhere is still emitted directly.
+      // MT: Externally Synchronized (this)
+      AccumulatorsRef& batchInto(ThreadAccumulators::Batch& b) noexcept {
+        batch = &b;
+        return *this;
+      }
+
     private:
       friend class ProfilePipeline::Source;
-      std::reference_wrapper<decltype(PerThreadTemporary::c_data)::mapped_type> map;
-      explicit AccumulatorsRef(decltype(map)::type& m) : map(m) {};
+      using map_t = decltype(PerThreadTemporary::r_data)::mapped_type;
+      // Either a Context within the Thread's flat table, or a separate map
+      ThreadAccumulators* table = nullptr;
+      const Context* ctx = nullptr;
+      map_t* map = nullptr;
+      ThreadAccumulators::Batch* batch = nullptr;
+      explicit AccumulatorsRef(map_t& m) : map(&m) {};
+      AccumulatorsRef(ThreadAccumulators& t, const Context& c)
+        : table(&t), ctx(&c) {};
     };
 
     /// Attribute metric values to the given Thread and Context, by proxy
     /// of the returned AccumulatorsRef.
     /// DataClass: `metrics`
-    // MT: Externally Synchronized (this), Internally Synchronized
+    // MT: Internally Synchronized
     AccumulatorsRef accumulateTo(PerThreadTemporary&, Context&);
 
     /// Attribute metric values to a ContextReconstruction. These values will be
     /// redistributed back to the base Contexts, see ContextReconstruction.
     /// DataClass: `metrics`
-    // MT: Externally Synchronized (this), Internally Synchronized
+    // MT: Internally Synchronized
     AccumulatorsRef accumulateTo(PerThreadTemporary&, ContextReconstruction&);
 
     /// Attribute metric values to a Context, as part of the given
     /// Reconstruction group. These will be summed with the non-group values
     /// but are more importantly used for FlowGraph redistribution.
     /// DataClass: `metrics`
-    // MT: Externally Synchronized (this), Internally Synchronized
+    // MT: Internally Synchronized
     AccumulatorsRef accumulateTo(PerThreadTemporary&, uint64_t group, Context&);
 
     /// Attribute metric values to a ContextFlowGraph. These values will be
     /// redistributed among the root Contexts included in the given
     /// Reconstruction group.
     /// DataClass: `metrics`
-    // MT: Externally Synchronized (this), Internally Synchronized
+    // MT: Internally Synchronized
     AccumulatorsRef accumulateTo(PerThreadTemporary&, uint64_t group,
                                  ContextFlowGraph&);
 
@@ -513,7 +539,7 @@ public:
 private:
   // Finalize the data in a PerThreadTemporary, and commit it to the Sinks
   // MT: Externally Synchronized (tt, localTimepointBounds), Internally Synchronized (this)
-  void complete(PerThreadTemporary&& tt, std::optional<std::pair<std::chrono::nanoseconds, std::chrono::nanoseconds>>& localTimepointBounds);
+  void complete(PerThreadTemporary&& tt, StatisticStaging& localStatistics, std::optional<std::pair<std::chrono::nanoseconds, std::chrono::nanoseconds>>& localTimepointBounds);
 
   // Scheduled data transfer. Minimal requested and available set.
   DataClass scheduled;
@@ -544,6 +570,10 @@ private:
   // Storage for the pointers to the SourceLocals.
   std::vector<SourceLocal> sourceLocals;
 
+  // Order in which the Sources are read, largest first so that the longest
+  // reads are not left to the end of a wave.
+  std::vector<std::size_t> sourceOrder;
+
   // Bits needed for ThreadAttributes to finalize
   ThreadAttributes::FinalizeState threadAttrFinalizeState;
 
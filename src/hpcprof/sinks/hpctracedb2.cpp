@@ -31,7 +31,37 @@ static constexpr uint64_t align(uint64_t v, uint8_t a) {
   return (v + a - 1) / a * a;
 }
 
-HPCTraceDB2::HPCTraceDB2(const stdshim::filesystem::path& dir) {
+// Each summary level summarizes 2^levelLog2Fanout elements of the level below
+static constexpr uint8_t levelLog2Fanout = 2;
+// Levels are only written while they have at least this many elements
+static constexpr uint64_t levelMinElements = 256;
+// Summary elements are written out in chunks of this many bytes
+static constexpr std::size_t levelBufferSize = FMT_TRACEDB_SZ_CtxSample * 1024;
+
+// Number of summary levels for a trace with the given number of timepoints
+static std::size_t numLevels(uint64_t count) {
+  std::size_t n = 0;
+  while((count >> (levelLog2Fanout * (n + 1))) >= levelMinElements) n++;
+  return n;
+}
+
+// Maximum number of elements in the given summary level (1-based)
+static uint64_t levelCapacity(uint64_t count, std::size_t level) {
+  const unsigned int shift = levelLog2Fanout * level;
+  return count == 0 ? 0 : ((count - 1) >> shift) + 1;
+}
+
+// Total size of the summary levels (including {TL} headers) for a trace
+static uint64_t levelsSize(uint64_t count) {
+  const std::size_t n = numLevels(count);
+  uint64_t sz = align(n * FMT_TRACEDB_SZ_CtxLevel, 8);
+  for(std::size_t l = 1; l <= n; l++)
+    sz += align(levelCapacity(count, l) * FMT_TRACEDB_SZ_CtxSample, 8);
+  return sz;
+}
+
+HPCTraceDB2::HPCTraceDB2(const stdshim::filesystem::path& dir, bool levels)
+  : levels(levels) {
   if(!dir.empty()) {
     stdshim::filesystem::create_directory(dir);
     tracefile = util::File(dir / "trace.db", true);
@@ -41,11 +71,22 @@ HPCTraceDB2::HPCTraceDB2(const stdshim::filesystem::path& dir) {
 }
 
 HPCTraceDB2::udThread::udThread(const Thread& t, HPCTraceDB2& tdb)
-  : uds(tdb.uds), hdr(t, tdb) {}
+  : uds(tdb.uds), hdr(t, tdb) {
+  if(tdb.levels)
+    levels.resize(numLevels(t.attributes.ctxTimepointMaxCount()));
+}
 
 static constexpr uint64_t pCtxTraces = align(FMT_TRACEDB_SZ_FHdr, 8);
 static constexpr uint64_t ctx_pTraces = align(pCtxTraces + FMT_TRACEDB_SZ_CtxTraceSHdr, 8);
 
+// The Context Trace Levels section follows the Context Trace Headers
+static uint64_t pCtxTraceLevels(uint64_t nTraces) {
+  return align(ctx_pTraces + nTraces * FMT_TRACEDB_SZ_CtxTrace, 8);
+}
+static uint64_t ctl_pTraces(uint64_t nTraces) {
+  return align(pCtxTraceLevels(nTraces) + FMT_TRACEDB_SZ_CtxLevelsSHdr, 8);
+}
+
 void HPCTraceDB2::notifyWavefront(DataClass d){
   if(!d.hasThreads()) return;
 
@@ -163,6 +204,8 @@ void HPCTraceDB2::notifyTimepoints(const Thread& t, const std::vector<
         }
       }
       ud.tmcntr++;
+      if(!ud.levels.empty())
+        levelsPush(ud, datum.timestamp, datum.ctxId, prebuffer_cursor == nullptr);
     }
   }
 
@@ -176,6 +219,7 @@ void HPCTraceDB2::notifyCtxTimepointRewindStart(const Thread& t) {
   ud.buffer_cursor = 0;
   ud.off = -1;
   ud.tmcntr = 0;
+  levelsReset(ud);
 
   std::unique_lock<std::shared_mutex> l(ud.prebuffer_lock);
   if(!ud.prebuffer_done)
@@ -198,6 +242,9 @@ void HPCTraceDB2::notifyThreadFinal(std::shared_ptr<const PerThreadTemporary> tt
   if(ud.buffer_cursor > 0)
     inst.writeat(ud.off, ud.buffer_cursor, ud.buffer.data());
 
+  // Summarize the last timepoint and any partial groups
+  levelsFinish(ud);
+
   // Check if the prebuffer is done. If it isn't, defer the header write until then
   {
     bool prebuffer_done;
@@ -232,6 +279,110 @@ void HPCTraceDB2::writeHdrFor(udThread& ud, util::File::Instance& inst) {
   fmt_tracedb_ctxTrace_write(buf, &hdr);
   inst.writeat(ctx_pTraces + (ud.hdr.prof_info_idx - 1) * FMT_TRACEDB_SZ_CtxTrace,
                sizeof buf, buf);
+
+  if(levels) levelsWrite(ud, inst);
+}
+
+void HPCTraceDB2::levelsPush(udThread& ud, uint64_t timestamp, uint32_t ctxId,
+                             bool canWrite) {
+  // The previous timepoint lasted until this one
+  if(ud.lastTimepoint) {
+    const auto& [lastTm, lastCtx] = *ud.lastTimepoint;
+    levelsFeed(ud, 0, lastTm, timestamp - lastTm, lastCtx, canWrite);
+  }
+  ud.lastTimepoint = {timestamp, ctxId};
+}
+
+void HPCTraceDB2::levelsFeed(udThread& ud, std::size_t l, uint64_t timestamp,
+                             uint64_t duration, uint32_t ctxId, bool canWrite) {
+  auto& lv = ud.levels[l];
+  if(lv.n == 0) {
+    lv.timestamp = timestamp;
+    lv.duration = duration;
+    lv.ctxId = ctxId;
+  } else if(duration > lv.duration) {
+    // The longest-running context in the group represents it
+    lv.duration = duration;
+    lv.ctxId = ctxId;
+  }
+  if(++lv.n == (1U << levelLog2Fanout))
+    levelsEmit(ud, l, canWrite);
+}
+
+void HPCTraceDB2::levelsEmit(udThread& ud, std::size_t l, bool canWrite) {
+  auto& lv = ud.levels[l];
+  fmt_tracedb_ctxSample_t datum = {
+    .timestamp = lv.timestamp,
+    .ctxId = lv.ctxId,
+  };
+  auto oldsz = lv.buffer.size();
+  lv.buffer.resize(oldsz + FMT_TRACEDB_SZ_CtxSample);
+  fmt_tracedb_ctxSample_write(&lv.buffer[oldsz], &datum);
+  lv.count++;
+  lv.n = 0;
+  if(canWrite && ud.inst && lv.buffer.size() >= levelBufferSize) {
+    ud.inst->writeat(lv.start + lv.written * FMT_TRACEDB_SZ_CtxSample, lv.buffer);
+    lv.written += lv.buffer.size() / FMT_TRACEDB_SZ_CtxSample;
+    lv.buffer.clear();
+  }
+
+  // Pass the summary up to the next level
+  if(l + 1 < ud.levels.size())
+    levelsFeed(ud, l + 1, datum.timestamp, lv.duration, datum.ctxId, canWrite);
+}
+
+void HPCTraceDB2::levelsFinish(udThread& ud) {
+  if(ud.levels.empty()) return;
+  if(ud.lastTimepoint) {
+    const auto& [lastTm, lastCtx] = *ud.lastTimepoint;
+    levelsFeed(ud, 0, lastTm, 0, lastCtx, false);
+    ud.lastTimepoint.reset();
+  }
+  // Emit the partial groups, from the bottom up
+  for(std::size_t l = 0; l < ud.levels.size(); l++) {
+    if(ud.levels[l].n > 0)
+      levelsEmit(ud, l, false);
+  }
+}
+
+void HPCTraceDB2::levelsWrite(udThread& ud, util::File::Instance& inst) {
+  std::vector<char> buf(ud.levels.size() * FMT_TRACEDB_SZ_CtxLevel);
+  for(std::size_t l = 0; l < ud.levels.size(); l++) {
+    auto& lv = ud.levels[l];
+    if(!lv.buffer.empty()) {
+      inst.writeat(lv.start + lv.written * FMT_TRACEDB_SZ_CtxSample, lv.buffer);
+      lv.written += lv.buffer.size() / FMT_TRACEDB_SZ_CtxSample;
+      lv.buffer.clear();
+    }
+    assert(lv.written == lv.count);
+    fmt_tracedb_ctxLevel_t tl = {
+      .pStart = lv.start,
+      .pEnd = lv.start + lv.count * FMT_TRACEDB_SZ_CtxSample,
+    };
+    fmt_tracedb_ctxLevel_write(&buf[l * FMT_TRACEDB_SZ_CtxLevel], &tl);
+  }
+  if(!buf.empty())
+    inst.writeat(ud.hdr.levels, buf);
+
+  fmt_tracedb_ctxLevels_t ctl = {
+    .pLevels = ud.levels.empty() ? 0 : ud.hdr.levels,
+    .nLevels = (uint8_t)ud.levels.size(),
+  };
+  char cbuf[FMT_TRACEDB_SZ_CtxLevels];
+  fmt_tracedb_ctxLevels_write(cbuf, &ctl);
+  inst.writeat(ctl_pTraces(totalNumTraces)
+               + (ud.hdr.prof_info_idx - 1) * FMT_TRACEDB_SZ_CtxLevels,
+               sizeof cbuf, cbuf);
+}
+
+void HPCTraceDB2::levelsReset(udThread& ud) {
+  for(auto& lv: ud.levels) {
+    lv.count = 0;
+    lv.written = 0;
+    lv.buffer.clear();
+    lv.n = 0;
+  }
+  ud.lastTimepoint.reset();
 }
 
 void HPCTraceDB2::notifyPipeline() noexcept {
@@ -266,6 +417,9 @@ void HPCTraceDB2::write() {
     fmt_tracedb_fHdr_t fhdr = {
       .szCtxTraces = ctx_pTraces + totalNumTraces * FMT_TRACEDB_SZ_CtxTrace - pCtxTraces,
       .pCtxTraces = pCtxTraces,
+      .szCtxTraceLevels = levels ? ctl_pTraces(totalNumTraces)
+          + totalNumTraces * FMT_TRACEDB_SZ_CtxLevels - pCtxTraceLevels(totalNumTraces) : 0,
+      .pCtxTraceLevels = levels ? pCtxTraceLevels(totalNumTraces) : 0,
     };
     char buf[FMT_TRACEDB_SZ_FHdr];
     fmt_tracedb_fHdr_write(buf, &fhdr);
@@ -282,6 +436,17 @@ void HPCTraceDB2::write() {
     fmt_tracedb_ctxTraceSHdr_write(buf, &shdr);
     traceinst.writeat(pCtxTraces, sizeof buf, buf);
   }
+  if(levels) {
+    fmt_tracedb_ctxLevelsSHdr_t shdr = {
+      .pTraces = ctl_pTraces(totalNumTraces),
+      .nTraces = (uint32_t)totalNumTraces,
+      .szTrace = 0,
+      .log2Fanout = levelLog2Fanout,
+    };
+    char buf[FMT_TRACEDB_SZ_CtxLevelsSHdr];
+    fmt_tracedb_ctxLevelsSHdr_write(buf, &shdr);
+    traceinst.writeat(pCtxTraceLevels(totalNumTraces), sizeof buf, buf);
+  }
 
 }
 
@@ -291,21 +456,24 @@ void HPCTraceDB2::write() {
 //***************************************************************************
 HPCTraceDB2::traceHdr::traceHdr(const Thread& t, HPCTraceDB2& tdb)
   : prof_info_idx(t.userdata[tdb.src.identifier()] + 1),
-   start(INVALID_HDR), end(INVALID_HDR) {}
+   start(INVALID_HDR), end(INVALID_HDR), levels(INVALID_HDR) {}
 
 std::vector<uint64_t> HPCTraceDB2::calcStartEnd() {
   //get the size of all traces
   std::vector<uint64_t> trace_sizes;
   uint64_t total_size = 0;
   for(const auto& t : src.threads().iterate()){
-    uint64_t trace_sz = align(t->attributes.ctxTimepointMaxCount() * FMT_TRACEDB_SZ_CtxSample, 8);
+    const auto cnt = t->attributes.ctxTimepointMaxCount();
+    uint64_t trace_sz = align(cnt * FMT_TRACEDB_SZ_CtxSample, 8);
+    if(levels) trace_sz += levelsSize(cnt);
     trace_sizes.emplace_back(trace_sz);
     total_size += trace_sz;
   }
 
   //get the offset of this rank's traces section
   uint64_t my_off = mpi::exscan(total_size, mpi::Op::sum()).value_or(0);
-  my_off += align(ctx_pTraces + totalNumTraces * FMT_TRACEDB_SZ_CtxTrace, 8);
+  my_off += levels ? align(ctl_pTraces(totalNumTraces) + totalNumTraces * FMT_TRACEDB_SZ_CtxLevels, 8)
+                   : pCtxTraceLevels(totalNumTraces);
 
   //get the individual offsets of this rank's traces
   std::vector<uint64_t> trace_offs(trace_sizes.size() + 1);
@@ -322,9 +490,18 @@ std::vector<uint64_t> HPCTraceDB2::calcStartEnd() {
 void HPCTraceDB2::assignHdrs(const std::vector<uint64_t>& trace_offs) {
   int i = 0;
   for(const auto& t : src.threads().iterate()){
-    auto& hdr = t->userdata[uds.thread].hdr;
-    hdr.start = trace_offs[i];
-    hdr.end = trace_offs[i] + t->attributes.ctxTimepointMaxCount() * FMT_TRACEDB_SZ_CtxSample;
+    auto& ud = t->userdata[uds.thread];
+    const auto cnt = t->attributes.ctxTimepointMaxCount();
+    ud.hdr.start = trace_offs[i];
+    ud.hdr.end = trace_offs[i] + cnt * FMT_TRACEDB_SZ_CtxSample;
+
+    // Summary levels follow the trace line, with their {TL} headers first
+    ud.hdr.levels = trace_offs[i] + align(cnt * FMT_TRACEDB_SZ_CtxSample, 8);
+    uint64_t off = ud.hdr.levels + align(ud.levels.size() * FMT_TRACEDB_SZ_CtxLevel, 8);
+    for(std::size_t l = 0; l < ud.levels.size(); l++) {
+      ud.levels[l].start = off;
+      off += align(levelCapacity(cnt, l + 1) * FMT_TRACEDB_SZ_CtxSample, 8);
+    }
     i++;
   }
   footerPos = trace_offs.back();
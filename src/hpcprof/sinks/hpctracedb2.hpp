@@ -20,8 +20,9 @@ class HPCTraceDB2 final : public ProfileSink {
 public:
   ~HPCTraceDB2() = default;
 
-  /// Constructor, with a reference to the output database directory.
-  HPCTraceDB2(const stdshim::filesystem::path&);
+  /// Constructor, with a reference to the output database directory. If
+  /// `levels` is true, downsampled summary levels are written for every trace.
+  HPCTraceDB2(const stdshim::filesystem::path&, bool levels = false);
 
   /// Write out as much data as possible. See ProfileSink::write.
   void write() override;
@@ -49,6 +50,7 @@ public:
 
 private:
   std::optional<hpctoolkit::util::File> tracefile;
+  bool levels;
   bool has_traces;
   size_t totalNumTraces;
   uint64_t footerPos;
@@ -63,6 +65,7 @@ private:
     uint32_t prof_info_idx;
     uint64_t start;
     uint64_t end;
+    uint64_t levels;
   };
 
   class udContext {
@@ -94,6 +97,23 @@ private:
     bool prebuffer_done = false;
     bool hdr_prebuffered = false;
     std::vector<char> prebuffer;
+
+    // Summary levels, each summarizing groups of elements of the one below.
+    // The last timepoint is held back until we know how long it lasted.
+    struct Level {
+      uint64_t start = -1;
+      uint64_t count = 0;
+      uint64_t written = 0;
+      std::vector<char> buffer;
+
+      // Group currently being summarized
+      unsigned int n = 0;
+      uint64_t timestamp;
+      uint64_t duration;
+      uint32_t ctxId;
+    };
+    std::vector<Level> levels;
+    std::optional<std::pair<uint64_t, uint32_t>> lastTimepoint;
   };
 
   struct uds {
@@ -103,6 +123,14 @@ private:
 
   void writeHdrFor(udThread&, util::File::Instance&);
 
+  void levelsPush(udThread&, uint64_t timestamp, uint32_t ctxId, bool canWrite);
+  void levelsFeed(udThread&, std::size_t level, uint64_t timestamp,
+                  uint64_t duration, uint32_t ctxId, bool canWrite);
+  void levelsEmit(udThread&, std::size_t level, bool canWrite);
+  void levelsFinish(udThread&);
+  void levelsWrite(udThread&, util::File::Instance&);
+  void levelsReset(udThread&);
+
 
   //***************************************************************************
   // trace_hdr
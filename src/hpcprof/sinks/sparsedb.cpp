@@ -16,12 +16,14 @@
 #include "../../common/lean/id-tuple.h"
 #include "../../common/lean/formats/profiledb.h"
 #include "../../common/lean/formats/cctdb.h"
+#include "../../common/lean/formats/packed.h"
 
 #include "../stdshim/numeric.hpp"
 #include "../stdshim/filesystem.hpp"
 #include <cassert>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <omp.h>
 #include <stdexcept>
 #include <sys/stat.h>
@@ -42,7 +44,8 @@ namespace hpctoolkit::staticdata {
 extern const char formats_md[];
 }
 
-SparseDB::SparseDB(stdshim::filesystem::path dir) {
+SparseDB::SparseDB(stdshim::filesystem::path dir, bool packValues)
+  : packValues(packValues) {
   if(dir.empty())
     util::log::fatal{} << "SparseDB doesn't allow for dry runs!";
   else
@@ -207,67 +210,96 @@ void SparseDB::notifyThreadFinal(std::shared_ptr<const PerThreadTemporary> tt) {
   prebuffer.emplace_back(std::move(tt));
 }
 
+// Append the metric/value pairs for a single context to a profile's blob of
+// values, and return the startIndex to list for the context. For packed blobs
+// the startIndex is a byte offset rather than an index.
+static uint64_t appendMVals(std::vector<char>& buf,
+    const std::vector<fmt_profiledb_mVal_t>& vals, bool packed) {
+  const auto oldsz = buf.size();
+  if(!packed) {
+    buf.resize(oldsz + vals.size() * FMT_PROFILEDB_SZ_MVal, 0);
+    char* cur = &buf[oldsz];
+    for(const auto& val: vals) {
+      fmt_profiledb_mVal_write(cur, &val);
+      cur += FMT_PROFILEDB_SZ_MVal;
+    }
+    return oldsz / FMT_PROFILEDB_SZ_MVal;
+  }
+
+  buf.resize(oldsz + FMT_PACKED_SZ_Max(vals.size()), 0);
+  size_t sz = fmt_packed_count_write(&buf[oldsz], vals.size());
+  uint32_t prevId = 0;
+  for(const auto& val: vals)
+    sz += fmt_packed_entry_write(&buf[oldsz + sz], &prevId, val.metricId, val.value);
+  buf.resize(oldsz + sz);
+  return oldsz;
+}
+
 void SparseDB::process(std::shared_ptr<const PerThreadTemporary> tt) {
   const auto& t = tt->thread();
 
+  // The Thread's accumulators are stored as Rows in no particular order, sort
+  // them to match the order of Contexts in the final output.
+  const auto& rows = tt->accumulators().rows();
+  std::vector<std::reference_wrapper<const ThreadAccumulators::Row>> sorted(
+      rows.begin(), rows.end());
+  std::sort(sorted.begin(), sorted.end(), [this](const auto& a, const auto& b){
+    return a.get().context().userdata[src.identifier()]
+           < b.get().context().userdata[src.identifier()];
+  });
+
   // Allocate the blobs needed for the final output
   std::vector<char> mvalsBuf;
   std::vector<char> cidxsBuf;
-  cidxsBuf.reserve(contexts.size() * FMT_PROFILEDB_SZ_CIdx);
+  cidxsBuf.reserve(sorted.size() * FMT_PROFILEDB_SZ_CIdx);
+  uint64_t nValues = 0;
 
-  // Helper functions to insert ctx_id/idx pairs and metric/value pairs
+  // Helper function to insert ctx_id/idx pairs
   const auto addCIdx = [&](const fmt_profiledb_cIdx_t idx) {
     auto oldsz = cidxsBuf.size();
     cidxsBuf.resize(oldsz + FMT_PROFILEDB_SZ_CIdx, 0);
     fmt_profiledb_cIdx_write(&cidxsBuf[oldsz], &idx);
   };
-  const auto addMVal = [&](const fmt_profiledb_mVal_t val) {
-    auto oldsz = mvalsBuf.size();
-    mvalsBuf.resize(oldsz + FMT_PROFILEDB_SZ_MVal, 0);
-    fmt_profiledb_mVal_write(&mvalsBuf[oldsz], &val);
-  };
 
   // Now stitch together each Context's results
-  for(const Context& c: contexts) {
-    if(auto accums = tt->accumulatorsFor(c)) {
-      // Add the ctx_id/idx pair for this Context
-      addCIdx({
-        .ctxId = c.userdata[src.identifier()],
-        .startIndex = mvalsBuf.size() / FMT_PROFILEDB_SZ_MVal,
-      });
-      size_t nValues = 0;
-
-      auto iter = accums->citerate();
-      std::vector<std::reference_wrapper<const
-          std::pair<const util::reference_index<const Metric>, MetricAccumulator>>> pairs;
-      pairs.reserve(accums->size());
-      for(const auto& mx: iter) pairs.push_back(std::cref(mx));
-      std::sort(pairs.begin(), pairs.end(), [=](const auto& a, const auto& b){
-        return a.get().first->userdata[src.identifier()].base()
-               < b.get().first->userdata[src.identifier()].base();
-      });
-      for(const auto& mx: pairs) {
-        const Metric& m = mx.get().first;
-        const auto& vv = mx.get().second;
-        const auto& id = m.userdata[src.identifier()];
-        for(MetricScope ms: m.scopes()) {
-          if(auto v = vv.get(ms)) {
-            addMVal({
-              .metricId = (uint16_t)id.getFor(ms),
-              .value = *v,
-            });
-            nValues++;
-          }
+  std::vector<std::reference_wrapper<const ThreadAccumulators::Value>> values;
+  std::vector<fmt_profiledb_mVal_t> mvals;
+  for(const ThreadAccumulators::Row& row: sorted) {
+    const Context& c = row.context();
+    mvals.clear();
+
+    values.assign(row.begin(), row.end());
+    std::sort(values.begin(), values.end(), [=](const auto& a, const auto& b){
+      return a.get().metric().userdata[src.identifier()].base()
+             < b.get().metric().userdata[src.identifier()].base();
+    });
+    for(const ThreadAccumulators::Value& vv: values) {
+      const Metric& m = vv.metric();
+      const auto& id = m.userdata[src.identifier()];
+      for(MetricScope ms: m.scopes()) {
+        if(auto v = vv.get(ms)) {
+          mvals.push_back({
+            .metricId = (uint16_t)id.getFor(ms),
+            .value = *v,
+          });
         }
       }
-      c.userdata[ud].nValues.fetch_add(nValues, std::memory_order_relaxed);
     }
+
+    // Add the ctx_id/idx pair and metric/value pairs for this Context
+    addCIdx({
+      .ctxId = c.userdata[src.identifier()],
+      .startIndex = appendMVals(mvalsBuf, mvals, packValues),
+    });
+    nValues += mvals.size();
+    c.userdata[ud].nValues.fetch_add(mvals.size(), std::memory_order_relaxed);
   }
 
   // Build prof_info
   auto& pi = t.userdata[ud].info;
   pi.isSummary = false;
-  pi.valueBlock.nValues = mvalsBuf.size() / FMT_PROFILEDB_SZ_MVal;
+  pi.isPacked = packValues;
+  pi.valueBlock.nValues = nValues;
   pi.valueBlock.nCtxs = cidxsBuf.size() / FMT_PROFILEDB_SZ_CIdx;
 
   profDataOut.write(std::move(mvalsBuf), pi.valueBlock.pValues,
@@ -280,6 +312,8 @@ SparseDB::DoubleBufferedOutput::DoubleBufferedOutput()
 void SparseDB::DoubleBufferedOutput::initialize(util::File& outfile,
                                                 uint64_t startOffset) {
   file = outfile;
+  // Keep a few full Buffers in flight while we fill the next ones
+  io = outfile.async(bufs.size());
   // We ensure all blobs are 4-aligned in the final output.
   pos.initialize(align(startOffset, 4));
 }
@@ -318,19 +352,19 @@ void SparseDB::DoubleBufferedOutput::write(
   buf.blob.resize(ciOffset, 0);
   buf.blob.insert(buf.blob.end(), ciBlob.begin(), ciBlob.end());
 
-  if(needsFlush) buf.flush(*file, allocate(buf.blob.size()));
+  if(needsFlush) buf.flush(io, allocate(buf.blob.size()));
 }
 
-void SparseDB::DoubleBufferedOutput::Buffer::flush(util::File& file,
+void SparseDB::DoubleBufferedOutput::Buffer::flush(util::File::Async& io,
                                                    uint64_t offset) {
-  if(!blob.empty())
-    file.open(true, true).writeat(offset, blob.size(), blob.data());
+  // Hand the blob off to be written in the background
+  io.writeat(offset, std::move(blob));
 
   // Update the saved offsets with the final answers
   for(uint64_t& target: toUpdate) target += offset;
 
   // Reset this Buffer for the next time around
-  blob.clear();
+  blob = std::vector<char>();
   blob.reserve(bufferSize);
   toUpdate.clear();
 }
@@ -339,33 +373,35 @@ void SparseDB::DoubleBufferedOutput::flush() {
   assert(file);
   for(Buffer& buf: bufs) {
     std::unique_lock<std::mutex> l(buf.lowlock);
-    buf.flush(*file, allocate(buf.blob.size()));
+    buf.flush(io, allocate(buf.blob.size()));
   }
+  io.wait();
 }
 
 
-// Read all the ctx_id/idx pairs for a profile from the profile.db
+// Read all the ctx_id/idx pairs for a profile from the (mapped) profile.db.
+// The indices are converted to byte offsets from the profile's pValues.
 static std::vector<std::pair<uint32_t, uint64_t>> readProfileCtxPairs(
-    const util::File& pmf, const fmt_profiledb_profInfo_t& pi) {
+    const util::File::Instance& pmfi, const fmt_profiledb_profInfo_t& pi) {
   if(pi.valueBlock.nCtxs == 0) {
     // No data in this profile, skip
     return {};
   }
 
-  // Read the whole chunk of ctx_id/idx pairs
-  auto pmfi = pmf.open(false, false);
-  std::vector<char> buf(pi.valueBlock.nCtxs * FMT_PROFILEDB_SZ_CIdx);
-  pmfi.readat(pi.valueBlock.pCtxIndices, buf.size(), buf.data());
-
-  // Parse and save in the output
+  // Parse the whole chunk of ctx_id/idx pairs in-place and save in the output
+  const char* buf = pmfi.view(pi.valueBlock.pCtxIndices,
+                              pi.valueBlock.nCtxs * FMT_PROFILEDB_SZ_CIdx);
   std::vector<std::pair<uint32_t, uint64_t>> prof_ctx_pairs;
   prof_ctx_pairs.reserve(pi.valueBlock.nCtxs + 1);
   for(uint32_t i = 0; i < pi.valueBlock.nCtxs; i++) {
     fmt_profiledb_cIdx_t idx;
     fmt_profiledb_cIdx_read(&idx, &buf[i * FMT_PROFILEDB_SZ_CIdx]);
-    prof_ctx_pairs.emplace_back(idx.ctxId, idx.startIndex);
+    prof_ctx_pairs.emplace_back(idx.ctxId, pi.isPacked ? idx.startIndex
+        : idx.startIndex * FMT_PROFILEDB_SZ_MVal);
   }
-  prof_ctx_pairs.push_back({std::numeric_limits<uint32_t>::max(), pi.valueBlock.nValues});
+  prof_ctx_pairs.push_back({std::numeric_limits<uint32_t>::max(), pi.isPacked
+      ? pi.valueBlock.pCtxIndices - pi.valueBlock.pValues
+      : pi.valueBlock.nValues * FMT_PROFILEDB_SZ_MVal});
   return prof_ctx_pairs;
 }
 
@@ -376,7 +412,9 @@ struct ProfileIndexData {
   uint64_t offset;
   // Absolute index of this profile
   uint32_t index;
-  // Preparsed ctx_id/idx pairs
+  // True if the values for this profile are packed
+  bool packed;
+  // Preparsed ctx_id/(byte offset) pairs
   std::vector<std::pair<uint32_t, uint64_t>> ctxPairs;
 };
 
@@ -389,22 +427,26 @@ struct ProfileMetricData {
   std::vector<std::pair<uint32_t,uint64_t>>::const_iterator last;
   // Absolute index of the profile
   uint32_t index;
-  // Loaded metric/value blob for the profile, in the [first, last) ctx range
-  std::vector<char> mvBlob;
+  // True if the metric/value blob is packed
+  bool packed = false;
+  // View of the metric/value blob for the profile, in the [first, last) ctx
+  // range. Points directly into the mapped profile.db.
+  const char* mvBlob = nullptr;
 
   ProfileMetricData() = default;
 
-  ProfileMetricData(uint32_t firstCtx, uint32_t lastCtx, const util::File& pmf,
-      uint64_t offset, uint32_t index,
+  ProfileMetricData(uint32_t firstCtx, uint32_t lastCtx, const util::File::Instance& pmfi,
+      uint64_t offset, uint32_t index, bool packed,
       const std::vector<std::pair<uint32_t, uint64_t>>& ctxPairs);
 };
 }
 
-// Load a profile's metric data from the given File and data
+// Locate a profile's metric data within the given mapped File and data
 ProfileMetricData::ProfileMetricData(uint32_t firstCtx, uint32_t lastCtx,
-    const util::File& pmf, const uint64_t offset, const uint32_t index,
-    const std::vector<std::pair<uint32_t, uint64_t>>& ctxPairs)
-  : first(ctxPairs.begin()), last(ctxPairs.begin()), index(index) {
+    const util::File::Instance& pmfi, const uint64_t offset, const uint32_t index,
+    const bool packed, const std::vector<std::pair<uint32_t, uint64_t>>& ctxPairs)
+  : first(ctxPairs.begin()), last(ctxPairs.begin()), index(index),
+    packed(packed) {
   if(ctxPairs.size() <= 1 || firstCtx >= lastCtx) {
     // Empty range, we don't have any data to add.
     return;
@@ -435,20 +477,31 @@ ProfileMetricData::ProfileMetricData(uint32_t firstCtx, uint32_t lastCtx,
     return;
   }
 
-  // Read the blob of data containing all our pairs
-  mvBlob.resize((last->second - first->second) * FMT_PROFILEDB_SZ_MVal);
-  assert(!mvBlob.empty());
+  // View the blob of data containing all our pairs
+  assert(last->second > first->second);
+  mvBlob = pmfi.view(offset + first->second, last->second - first->second);
+}
 
-  auto pmfi = pmf.open(false, false);
-  pmfi.readat(offset + first->second * FMT_PROFILEDB_SZ_MVal,
-              mvBlob.size(), mvBlob.data());
+namespace {
+// Layout of the packed cct.db context data. Packed blocks are only sized once
+// they have been generated, so they are placed in the file as they are written
+// rather than at precalculated offsets.
+struct PackedContextLayout {
+  // Offset of the Context Info array in the cct.db
+  uint64_t pCtxs;
+  // Allocate space in the cct.db for a blob of the given size
+  std::function<uint64_t(uint64_t)> allocate;
+};
 }
 
-// Transpose and write the metric data for a range of contexts
+// Transpose and write the metric data for a range of contexts. If `packed` is
+// given the context data is packed, and the Context Infos for the range are
+// written out here as well.
 static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
-    const util::File& cmf,
+    util::File::Async& cmfio,
     const std::deque<ProfileMetricData>& metricData,
-    const std::vector<uint64_t>& ctxOffsets) {
+    const std::vector<uint64_t>& ctxOffsets,
+    const PackedContextLayout* packed) {
   // Set up a heap with cursors into each profile's data blob
   std::vector<std::pair<
     std::vector<std::pair<uint32_t, uint64_t>>::const_iterator,  // ctx_id/idx pair in a profile
@@ -480,9 +533,11 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
   // our search so we can jump straight to the next context we want.
   const auto firstCtxId = heap.front().first->first;
   std::vector<char> buf;
+  // Context Infos for the packed blocks, with offsets relative to buf
+  std::vector<std::pair<uint32_t, fmt_cctdb_ctxInfo_t>> packedInfos;
   while(!heap.empty() && heap.front().first->first < lastCtx) {
     const uint32_t ctx_id = heap.front().first->first;
-    std::map<uint16_t, std::vector<char>> valuebufs;
+    std::map<uint16_t, std::vector<fmt_cctdb_pVal_t>> valuebufs;
     uint64_t allpvs = 0;
 
     // Pull the data out for one context and save it to cmb
@@ -493,22 +548,31 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
 
       // Fill cmb with metric/value pairs for this context, from the top profile
       const ProfileMetricData& profile = heap.back().second;
-      const char* cur = &profile.mvBlob[(curPair.second - profile.first->second) * FMT_PROFILEDB_SZ_MVal];
-      for(uint64_t i = 0, e = heap.back().first->second - curPair.second;
-          i < e; i++, cur += FMT_PROFILEDB_SZ_MVal) {
+      const auto addValue = [&](uint16_t metricId, double value) {
         allpvs++;
-        fmt_profiledb_mVal_t val;
-        fmt_profiledb_mVal_read(&val, cur);
-        auto& subbuf = valuebufs.try_emplace(val.metricId).first->second;
-        fmt_cctdb_pVal_t outval = {
+        valuebufs[metricId].push_back({
           .profIndex = profile.index,
-          .value = val.value,
-        };
-
-        // Write in this prof_idx/value pair, in bytes.
-        auto oldsz = subbuf.size();
-        subbuf.resize(oldsz + FMT_CCTDB_SZ_PVal, 0);
-        fmt_cctdb_pVal_write(&subbuf[oldsz], &outval);
+          .value = value,
+        });
+      };
+      const char* cur = &profile.mvBlob[curPair.second - profile.first->second];
+      if(profile.packed) {
+        uint64_t n;
+        cur += fmt_packed_count_read(&n, cur);
+        uint32_t prevId = 0;
+        for(uint64_t i = 0; i < n; i++) {
+          uint32_t metricId;
+          double value;
+          cur += fmt_packed_entry_read(&metricId, &value, &prevId, cur);
+          addValue(metricId, value);
+        }
+      } else {
+        for(uint64_t i = 0, e = (heap.back().first->second - curPair.second) / FMT_PROFILEDB_SZ_MVal;
+            i < e; i++, cur += FMT_PROFILEDB_SZ_MVal) {
+          fmt_profiledb_mVal_t val;
+          fmt_profiledb_mVal_read(&val, cur);
+          addValue(val.metricId, val.value);
+        }
       }
 
       // If the updated entry is still in range, push it back into the heap.
@@ -519,8 +583,45 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
         heap.pop_back();
     }
 
-    // Allocate enough space in buf for all the bits we want.
     buf.resize(align(buf.size(), 4));
+    if(packed) {
+      // Concatenate the packed prof_idx/value arrays, in metric order
+      const auto start = buf.size();
+      std::vector<fmt_cctdb_mIdx_t> idxs;
+      idxs.reserve(valuebufs.size());
+      for(const auto& [mid, pvs]: valuebufs) {
+        const auto oldsz = buf.size();
+        idxs.push_back({
+          .metricId = mid,
+          .startIndex = oldsz - start,
+        });
+        buf.resize(oldsz + FMT_PACKED_SZ_Max(pvs.size()));
+        size_t sz = fmt_packed_count_write(&buf[oldsz], pvs.size());
+        uint32_t prevId = 0;
+        for(const auto& pv: pvs)
+          sz += fmt_packed_entry_write(&buf[oldsz + sz], &prevId, pv.profIndex, pv.value);
+        buf.resize(oldsz + sz);
+      }
+
+      // Construct the metric_id/idx pairs for this context, in bytes
+      fmt_cctdb_ctxInfo_t ci;
+      ci.valueBlock.nValues = allpvs;
+      ci.valueBlock.pValues = start;
+      ci.valueBlock.nMetrics = idxs.size();
+      ci.valueBlock.isPacked = true;
+      buf.resize(align(buf.size(), 4));
+      ci.valueBlock.pMetricIndices = buf.size();
+      buf.resize(buf.size() + idxs.size() * FMT_CCTDB_SZ_MIdx);
+      char* cur = &buf[ci.valueBlock.pMetricIndices];
+      for(const auto& idx: idxs) {
+        fmt_cctdb_mIdx_write(cur, &idx);
+        cur += FMT_CCTDB_SZ_MIdx;
+      }
+      packedInfos.emplace_back(ctx_id, ci);
+      continue;
+    }
+
+    // Allocate enough space in buf for all the bits we want.
     assert(align(ctxOffsets[ctx_id], 4) == ctxOffsets[ctx_id]
            && "Final layout is not sufficiently aligned!");
     const auto newsz = allpvs * FMT_CCTDB_SZ_PVal + valuebufs.size() * FMT_CCTDB_SZ_MIdx;
@@ -529,8 +630,15 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
     buf.reserve(buf.size() + newsz);
 
     // Concatenate the prof_idx/value pairs, in bytes form, in metric order
-    for(const auto& [mid, pvbuf]: valuebufs)
-      buf.insert(buf.end(), pvbuf.begin(), pvbuf.end());
+    for(const auto& [mid, pvs]: valuebufs) {
+      auto oldsz = buf.size();
+      buf.resize(oldsz + pvs.size() * FMT_CCTDB_SZ_PVal);
+      char* cur = &buf[oldsz];
+      for(const auto& pv: pvs) {
+        fmt_cctdb_pVal_write(cur, &pv);
+        cur += FMT_CCTDB_SZ_PVal;
+      }
+    }
 
     // Construct the metric_id/idx pairs for this context, in bytes
     {
@@ -545,7 +653,7 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
         };
         fmt_cctdb_mIdx_write(cur, &idx);
         cur += FMT_CCTDB_SZ_MIdx;
-        pvs += pvbuf.size() / FMT_CCTDB_SZ_PVal;
+        pvs += pvbuf.size();
       }
       assert(pvs == allpvs);
     }
@@ -553,8 +661,32 @@ static void writeContexts(uint32_t firstCtx, uint32_t lastCtx,
 
   // Write out the whole blob of data where it belongs in the file
   if(buf.empty()) return;
-  auto cmfi = cmf.open(true, true);
-  cmfi.writeat(ctxOffsets[firstCtxId], buf.size(), buf.data());
+  if(!packed) {
+    cmfio.writeat(ctxOffsets[firstCtxId], std::move(buf));
+    return;
+  }
+
+  // Packed data goes wherever there is space, after which the Context Infos
+  // can be completed. Contexts without data keep their empty Context Infos.
+  const auto offset = packed->allocate(buf.size());
+  cmfio.writeat(offset, std::move(buf));
+  const auto lastCtxId = packedInfos.back().first;
+  std::vector<char> infobuf((lastCtxId - firstCtxId + 1) * FMT_CCTDB_SZ_CtxInfo);
+  for(uint32_t id = firstCtxId; id <= lastCtxId; id++) {
+    fmt_cctdb_ctxInfo_t ci;
+    ci.valueBlock.nValues = 0;
+    ci.valueBlock.pValues = offset;
+    ci.valueBlock.nMetrics = 0;
+    ci.valueBlock.isPacked = true;
+    ci.valueBlock.pMetricIndices = offset;
+    fmt_cctdb_ctxInfo_write(&infobuf[(id - firstCtxId) * FMT_CCTDB_SZ_CtxInfo], &ci);
+  }
+  for(auto& [id, ci]: packedInfos) {
+    ci.valueBlock.pValues += offset;
+    ci.valueBlock.pMetricIndices += offset;
+    fmt_cctdb_ctxInfo_write(&infobuf[(id - firstCtxId) * FMT_CCTDB_SZ_CtxInfo], &ci);
+  }
+  cmfio.writeat(packed->pCtxs + firstCtxId * FMT_CCTDB_SZ_CtxInfo, std::move(infobuf));
 }
 
 void SparseDB::write() {
@@ -647,25 +779,24 @@ void SparseDB::write() {
   // Synchronize cct.db across the ranks
   cmf->synchronize();
 
+  // Map the final profile.db, the transpose below reads directly from it
+  const auto pmfi = pmf->open(false, true);
+
   // Read and parse the Profile Info section of the final profile.db
   std::deque<ProfileIndexData> profiles;
   {
-    auto fi = pmf->open(false, false);
     fmt_profiledb_profInfoSHdr_t piSHdr;
-    {
-      char buf[FMT_PROFILEDB_SZ_ProfInfoSHdr];
-      fi.readat(pProfileInfos, sizeof buf, buf);
-      fmt_profiledb_profInfoSHdr_read(&piSHdr, buf);
-    }
+    fmt_profiledb_profInfoSHdr_read(&piSHdr,
+        pmfi.view(pProfileInfos, FMT_PROFILEDB_SZ_ProfInfoSHdr));
 
-    // Read the whole section in
-    std::vector<char> buf(piSHdr.nProfiles * FMT_PROFILEDB_SZ_ProfInfo);
-    fi.readat(piSHdr.pProfiles, buf.size(), buf.data());
+    // View the whole section in-place
+    const char* buf = pmfi.view(piSHdr.pProfiles,
+                                piSHdr.nProfiles * FMT_PROFILEDB_SZ_ProfInfo);
 
     // Load the data we need from the profile.db, in parallel
     profiles = std::deque<ProfileIndexData>(piSHdr.nProfiles);
     std::atomic<size_t> next(0);
-    forProfilesParse.fill(profiles.size(), [this, &buf, &profiles, &next](size_t i){
+    forProfilesParse.fill(profiles.size(), [&pmfi, buf, &profiles, &next](size_t i){
       fmt_profiledb_profInfo_t pi;
       fmt_profiledb_profInfo_read(&pi, &buf[i * FMT_PROFILEDB_SZ_ProfInfo]);
       if(pi.isSummary)
@@ -673,7 +804,8 @@ void SparseDB::write() {
       profiles[next.fetch_add(1, std::memory_order_relaxed)] = {
         .offset = pi.valueBlock.pValues,
         .index = (uint32_t)i,
-        .ctxPairs = readProfileCtxPairs(*pmf, pi),
+        .packed = pi.isPacked,
+        .ctxPairs = readProfileCtxPairs(pmfi, pi),
       };
     });
     forProfilesParse.contributeUntilComplete();
@@ -687,28 +819,21 @@ void SparseDB::write() {
       std::vector<char> mvalsBuf;
       std::vector<char> cidxsBuf;
       cidxsBuf.reserve(contexts.size() * FMT_PROFILEDB_SZ_CIdx);
+      uint64_t nValues = 0;
 
-      // Helper functions to insert ctx_id/idx pairs and metric/value pairs
+      // Helper function to insert ctx_id/idx pairs
       const auto addCIdx = [&](const fmt_profiledb_cIdx_t idx) {
         auto oldsz = cidxsBuf.size();
         cidxsBuf.resize(oldsz + FMT_PROFILEDB_SZ_CIdx, 0);
         fmt_profiledb_cIdx_write(&cidxsBuf[oldsz], &idx);
       };
-      const auto addMVal = [&](const fmt_profiledb_mVal_t val) {
-        auto oldsz = mvalsBuf.size();
-        mvalsBuf.resize(oldsz + FMT_PROFILEDB_SZ_MVal, 0);
-        fmt_profiledb_mVal_write(&mvalsBuf[oldsz], &val);
-      };
 
       // Now stitch together each Context's results
+      std::vector<fmt_profiledb_mVal_t> mvals;
       for(const Context& c: contexts) {
         const auto& stats = c.data().statistics();
-        if(stats.size() > 0) {
-          addCIdx({
-            .ctxId = c.userdata[src.identifier()],
-            .startIndex = mvalsBuf.size() / FMT_PROFILEDB_SZ_MVal,
-          });
-        }
+        if(stats.size() == 0) continue;
+        mvals.clear();
 
         auto iter = stats.citerate();
         std::vector<std::reference_wrapper<const
@@ -727,7 +852,7 @@ void SparseDB::write() {
             auto vvv = vv.get(sp);
             for(MetricScope ms: m.scopes()) {
               if(auto v = vvv.get(ms)) {
-                addMVal({
+                mvals.push_back({
                   .metricId = (uint16_t)id.getFor(sp, ms),
                   .value = *v,
                 });
@@ -735,13 +860,20 @@ void SparseDB::write() {
             }
           }
         }
+
+        addCIdx({
+          .ctxId = c.userdata[src.identifier()],
+          .startIndex = appendMVals(mvalsBuf, mvals, packValues),
+        });
+        nValues += mvals.size();
       }
 
       // Build prof_info
       fmt_profiledb_profInfo_t summary_info;
       summary_info.isSummary = true;
+      summary_info.isPacked = packValues;
       summary_info.pIdTuple = 0;
-      summary_info.valueBlock.nValues = mvalsBuf.size() / FMT_PROFILEDB_SZ_MVal;
+      summary_info.valueBlock.nValues = nValues;
       summary_info.valueBlock.nCtxs = cidxsBuf.size() / FMT_PROFILEDB_SZ_CIdx;
 
       // Write the summary profile out and make sure it makes it to disk
@@ -785,19 +917,23 @@ void SparseDB::write() {
         const auto i = c.userdata[src.identifier()];
 
         // write context info for all the never-exist contexts before context i
-        while(ctxid < i){
+        // When packed, all contexts start empty and are filled in later.
+        while(ctxid < i || (packValues && ctxid == i)){
           fmt_cctdb_ctxInfo_t ci;
           ci.valueBlock.nMetrics = 0;
           ci.valueBlock.nValues = 0;
-          ci.valueBlock.pValues = ctxOffsets[ctxid];
+          ci.valueBlock.pValues = packValues ? ctxStart : ctxOffsets[ctxid];
           ci.valueBlock.pMetricIndices = ci.valueBlock.pValues;
+          ci.valueBlock.isPacked = packValues;
           fmt_cctdb_ctxInfo_write(cur, &ci);
           cur += FMT_CCTDB_SZ_CtxInfo;
           ctxid++;
         }
+        if(packValues) continue;
 
         // write context info for context i
         fmt_cctdb_ctxInfo_t cii;
+        cii.valueBlock.isPacked = false;
         cii.valueBlock.nMetrics = c.userdata[ud].nMetrics;
         cii.valueBlock.nValues = (ctxOffsets[i+1] - ctxOffsets[i] - cii.valueBlock.nMetrics * FMT_CCTDB_SZ_MIdx) / FMT_CCTDB_SZ_PVal;
         cii.valueBlock.pValues = ctxOffsets[i];
@@ -810,22 +946,66 @@ void SparseDB::write() {
     }
   }
 
-  // Transpose and copy context data until we're done
+  // Packed context data is allocated dynamically after the Context Info
+  // section, once the empty Context Infos above are in place.
+  mpi::SharedAccumulator ctxDataPos(mpi::Tag::SparseDB_3);
+  std::mutex ctxDataPosLock;
+  std::optional<PackedContextLayout> packedLayout;
+  if(packValues) {
+    ctxDataPos.initialize(ctxStart);
+    packedLayout = PackedContextLayout{
+      .pCtxs = ci_sHdr.pCtxs,
+      .allocate = [&](uint64_t size) -> uint64_t {
+        std::unique_lock<std::mutex> l(ctxDataPosLock);
+        return ctxDataPos.fetch_add(align(size, 4));
+      },
+    };
+    mpi::barrier();
+  }
+
+  // Locate the blob of data we need from each profile for a range of
+  // contexts, in parallel, and start fetching it from the filesystem in the
+  // background. The range is processed later by the loop below.
+  auto pmfio = pmf->async(2);
+  const auto loadRange = [&](uint32_t idx) {
+    std::deque<ProfileMetricData> metricData;
+    if(idx >= ctxRanges.size() - 1) return metricData;
+    auto firstCtx = ctxRanges[idx];
+    auto lastCtx = ctxRanges[idx + 1];
+    if(firstCtx >= lastCtx) return metricData;
+
+    metricData.resize(profiles.size());
+    forProfilesLoad.fill(metricData.size(),
+      [&pmfi, &metricData, firstCtx, lastCtx, &profiles](size_t i){
+        const auto& p = profiles[i];
+        metricData[i] = {firstCtx, lastCtx, pmfi, p.offset, p.index, p.packed,
+                         p.ctxPairs};
+      });
+    forProfilesLoad.contributeUntilEmpty();
+    for(size_t i = 0; i < profiles.size(); i++) {
+      const auto& md = metricData[i];
+      if(md.first == md.last) continue;
+      pmfio.prefetch(profiles[i].offset + md.first->second,
+                     md.last->second - md.first->second);
+    }
+    return metricData;
+  };
+
+  // Transpose and copy context data until we're done. Output is written
+  // asynchronously, and the next range is fetched while this one is handled.
+  cmfio = cmf->async(src.teamSize());
   uint32_t idx = mpi::World::rank() > 0 ? mpi::World::rank() - 1  // Pre-allocation
                                         : ctxRangeCounter.fetch_add(1);
+  auto metricData = loadRange(idx);
   while(idx < ctxRanges.size() - 1) {
-    // Process the next range of contexts allocated to us
+    // Fetch the next available workitem from the group, and start loading it
+    const uint32_t nextIdx = ctxRangeCounter.fetch_add(1);
+    auto nextMetricData = loadRange(nextIdx);
+
+    // Process the range of contexts allocated to us
     auto firstCtx = ctxRanges[idx];
     auto lastCtx = ctxRanges[idx + 1];
     if(firstCtx < lastCtx) {
-      // Read the blob of data we need from each profile, in parallel
-      std::deque<ProfileMetricData> metricData(profiles.size());
-      forProfilesLoad.fill(metricData.size(),
-        [this, &metricData, firstCtx, lastCtx, &profiles](size_t i){
-          const auto& p = profiles[i];
-          metricData[i] = {firstCtx, lastCtx, *pmf, p.offset, p.index, p.ctxPairs};
-        });
-      forProfilesLoad.contributeUntilEmpty();
 
       // Divide up this ctx group into ranges suitable for distributing to threads.
       std::vector<std::pair<uint32_t, uint32_t>> ctxRanges;
@@ -854,25 +1034,31 @@ void SparseDB::write() {
 
       // Handle the individual ctx copies
       forEachContextRange.fill(std::move(ctxRanges),
-        [this, &metricData, &ctxOffsets](const auto& range){
-          writeContexts(range.first, range.second, *cmf, metricData, ctxOffsets);
+        [this, &metricData, &ctxOffsets, &packedLayout](const auto& range){
+          writeContexts(range.first, range.second, cmfio, metricData, ctxOffsets,
+                        packedLayout ? &*packedLayout : nullptr);
         });
       forEachContextRange.contributeUntilEmpty();
     }
 
-    // Fetch the next available workitem from the group
-    idx = ctxRangeCounter.fetch_add(1);
+    idx = nextIdx;
+    metricData = std::move(nextMetricData);
   }
 
   // Notify our helper threads that the workshares are complete now
   forProfilesLoad.complete();
   forEachContextRange.complete();
 
+  // Make sure all our writes have landed before the footer goes in
+  cmfio = util::File::Async();
+
   // The last rank is in charge of writing the final footer, AFTER all other
   // writes have completed. If the footer isn't there, the file isn't complete.
   mpi::barrier();
   if(mpi::World::rank() + 1 == mpi::World::size()) {
-    cmf->open(true, false).writeat(ctxOffsets.back(),
+    cmf->open(true, false).writeat(packedLayout
+                                   ? packedLayout->allocate(sizeof fmt_cctdb_footer)
+                                   : ctxOffsets.back(),
                                    sizeof fmt_cctdb_footer, fmt_cctdb_footer);
   }
 }
@@ -22,7 +22,7 @@ namespace hpctoolkit::sinks {
 
 class SparseDB : public hpctoolkit::ProfileSink {
 public:
-  SparseDB(hpctoolkit::stdshim::filesystem::path);
+  SparseDB(hpctoolkit::stdshim::filesystem::path, bool packValues);
   ~SparseDB() = default;
 
   void write() override;
@@ -49,6 +49,9 @@ public:
   void notifyThreadFinal(std::shared_ptr<const hpctoolkit::PerThreadTemporary>) override;
 
 private:
+  // If true, value arrays are written in the packed encoding (see packed.h)
+  bool packValues;
+
   struct udContext {
     std::atomic<uint64_t> nValues = 0;
     uint16_t nMetrics = 0;
@@ -99,7 +102,8 @@ private:
     void write(const std::vector<char>& mvBlob, uint64_t& mvOffset,
                const std::vector<char>& ciBlob, uint64_t& ciOffset);
 
-    // Flush the buffers and write everything out to the file.
+    // Flush the buffers and write everything out to the file. Waits for all
+    // the writes to complete before returning.
     // MT: Internally Synchronized
     void flush();
 
@@ -108,6 +112,9 @@ private:
     mpi::SharedAccumulator pos;
     // File everything gets written to in the end
     util::optional_ref<util::File> file;
+    // Asynchronous writes to the file, so full Buffers are written out in the
+    // background while new data fills the next Buffer
+    util::File::Async io;
 
     // Lock for the top-level internal state
     std::mutex toplock;
@@ -125,9 +132,9 @@ private:
       // Offsets to update once this Buffer is flushed
       std::vector<std::reference_wrapper<uint64_t>> toUpdate;
 
-      // Flush this Buffer's data to the given File.
+      // Queue this Buffer's data to be written at the given offset.
       // MT: Externally Synchronized (holding lowlock)
-      void flush(util::File& file, uint64_t offset);
+      void flush(util::File::Async& io, uint64_t offset);
     };
 
     // Buffers to rotate between for parallelism
@@ -137,6 +144,8 @@ private:
   // Paths and Files
   std::optional<hpctoolkit::util::File> pmf;
   std::optional<hpctoolkit::util::File> cmf;
+  // Asynchronous writes to the cct.db, issued during the transpose
+  hpctoolkit::util::File::Async cmfio;
 
   // All the contexts we know about, sorted by identifier.
   // Filled during the Contexts wavefront
@@ -4,6 +4,8 @@
 
 // -*-Mode: C++;-*-
 
+#include "util/vgannotations.hpp"
+
 #include "source.hpp"
 
 #include "util/log.hpp"
@@ -23,8 +25,29 @@ std::unique_ptr<ProfileSource> ProfileSource::create_for(const stdshim::filesyst
   return nullptr;
 }
 
+std::vector<std::pair<std::unique_ptr<ProfileSource>, stdshim::filesystem::path>>
+ProfileSource::create_all_for(const stdshim::filesystem::path& p, const stdshim::filesystem::path& meas) {
+  std::vector<std::pair<std::unique_ptr<ProfileSource>, stdshim::filesystem::path>> r;
+  // Containers hold one profile per section, each is its own Source.
+  if(auto sections = sources::Hpcrun4::containerSections(p)) {
+    for(auto& sp: *sections) {
+      if(auto s = create_for(sp, meas)) r.emplace_back(std::move(s), std::move(sp));
+    }
+    return r;
+  }
+  if(auto s = create_for(p, meas)) r.emplace_back(std::move(s), p);
+  return r;
+}
+
 bool ProfileSource::valid() const noexcept { return true; }
 
+std::uintmax_t ProfileSource::sizeHint() const noexcept { return 0; }
+
+util::WorkshareResult ProfileSource::help() {
+  // Unless specified otherwise, Sources are single-threaded
+  return {false, true};
+}
+
 void ProfileSource::bindPipeline(ProfilePipeline::Source&& se) noexcept {
   sink = std::move(se);
 }
@@ -10,6 +10,7 @@
 #include "pipeline.hpp"
 
 #include "util/locked_unordered.hpp"
+#include "util/parallel_work.hpp"
 #include "util/ref_wrappers.hpp"
 
 namespace hpctoolkit {
@@ -28,6 +29,14 @@ public:
   // MT: Internally Synchronized
   static std::unique_ptr<ProfileSource> create_for(const stdshim::filesystem::path&, const stdshim::filesystem::path&);
 
+  /// Instantiates Sources for every profile stored in the given file. Most
+  /// files hold a single profile, but hpcrun can aggregate the profiles of
+  /// a process into one container. Each Source is paired with the path to
+  /// pass to create_for to instantiate it again.
+  // MT: Internally Synchronized
+  static std::vector<std::pair<std::unique_ptr<ProfileSource>, stdshim::filesystem::path>>
+  create_all_for(const stdshim::filesystem::path&, const stdshim::filesystem::path&);
+
   /// Most format errors from a Source can be handled within the Source itself,
   /// but if errors happen during construction callers (create_for) will want to
   /// know. This gives a path for that information.
@@ -38,6 +47,11 @@ public:
   // MT: Externally Synchronized
   void bindPipeline(ProfilePipeline::Source&& se) noexcept;
 
+  /// Estimate the amount of work needed to read this Source, in bytes of input.
+  /// Used to schedule larger Sources first. Returns 0 if unknown.
+  // MT: Safe (const)
+  virtual std::uintmax_t sizeHint() const noexcept;
+
   /// Query what Classes this Source can actually provide to the Pipeline.
   // MT: Safe (const)
   virtual DataClass provides() const noexcept = 0;
@@ -48,6 +62,12 @@ public:
   // MT: Externally Synchronized
   virtual void read(const DataClass&) = 0;
 
+  /// Try to assist another thread that is currently in a read(). Returns the
+  /// amount this call contributed to the overall workshare.
+  /// Unless this is overridden, Sources are assumed to be single-threaded.
+  // MT: Internally Synchronized
+  virtual util::WorkshareResult help();
+
   /// In many cases there are dependencies between data reads, due to the nature
   /// of the conversion. This call allows a Source to adjust its request input
   /// based on the dependencies it requires. Note that tracking of previously
@@ -4,6 +4,8 @@
 
 // -*-Mode: C++;-*-
 
+#include "../util/vgannotations.hpp"
+
 #include "hpcrun4.hpp"
 
 #include "../util/log.hpp"
@@ -12,6 +14,10 @@
 
 namespace fs = hpctoolkit::stdshim::filesystem;
 
+// Number of metric values decoded as a single chunk, for profiles large enough
+// to be worth decoding on multiple threads.
+static constexpr uint64_t metricsChunkSize = 1 << 18;
+
 // TODO: Remove and change this once new-cupti is finalized
 #define HPCRUN_GPU_ROOT_NODE 65533
 #define HPCRUN_GPU_RANGE_NODE 65532
@@ -39,14 +45,55 @@ template<class F>
 scope_exit<std::decay_t<F>> make_scope_exit(F&& f) {
   return scope_exit<F>(std::forward<F>(f));
 }
+
+// Profiles in a container are named <container>#<offset of the section>,
+// see Hpcrun4::containerSections.
+std::pair<fs::path, std::optional<uint64_t>> splitSection(const fs::path& p) {
+  const auto fn = p.filename().string();
+  const auto pos = fn.rfind('#');
+  if(pos == std::string::npos || pos + 1 == fn.size() || fn.size() - pos > 20
+     || fn.find_first_not_of("0123456789", pos + 1) != std::string::npos)
+    return {p, std::nullopt};
+  return {p.parent_path() / fn.substr(0, pos), std::stoull(fn.substr(pos + 1))};
+}
 }
 
 Hpcrun4::Hpcrun4(const stdshim::filesystem::path& fn, const stdshim::filesystem::path& meas)
+  : Hpcrun4(splitSection(fn).first, splitSection(fn).second, meas, nullptr) {}
+
+Hpcrun4::Hpcrun4(const stdshim::filesystem::path& fn, std::optional<uint64_t> secOffset,
+                 const stdshim::filesystem::path& meas,
+                 std::shared_ptr<const std::vector<char>> img)
   : ProfileSource(), fileValid(true), attrsValid(true), tattrsValid(true),
-    thread(nullptr), path(fn), measDirPath(fs::weakly_canonical(meas)), tracepath(fn) {
+    thread(nullptr), path(fn), measDirPath(fs::weakly_canonical(meas)),
+    image(std::move(img)), tracepath(fn) {
   tracepath.replace_extension(".hpctrace");
-  // Try to open up the file. Errors handled inside somewhere.
-  file = hpcrun_sparse_open(path.c_str(), 0, 0);
+  // If the profile is part of a container, find its extent and trace
+  if(secOffset) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if(!f) {
+      fileValid = false;
+      return;
+    }
+    hpcrun_fmt_container_section_t sec;
+    bool ok = std::fseek(f, *secOffset, SEEK_SET) == 0
+              && hpcrun_fmt_container_section_fread(&sec, f, std::malloc) == HPCFMT_OK;
+    std::fclose(f);
+    if(!ok) {
+      fileValid = false;
+      return;
+    }
+    section = section_t{*secOffset, sec.start, sec.end};
+    if(sec.trace_name[0] != '\0') tracepath.replace_filename(sec.trace_name);
+    else tracepath.clear();
+    hpcrun_fmt_container_section_free(&sec, std::free);
+  }
+
+  // Try to open up the file. Errors handled inside somewhere. A retained
+  // image only ever holds the profile itself.
+  file = image ? hpcrun_sparse_open_image(image->data(), image->size(), 0, 0)
+         : section ? hpcrun_sparse_open(path.c_str(), section->start, section->end)
+         : hpcrun_sparse_open(path.c_str(), 0, 0);
   if(file == nullptr) {
     fileValid = false;
     return;
@@ -124,7 +171,7 @@ Hpcrun4::Hpcrun4(const stdshim::filesystem::path& fn, const stdshim::filesystem:
 
   // Also check for a corresponding tracefile. If anything goes wrong, we'll
   // just skip it.
-  if(!setupTrace(traceDisorder)) tracepath.clear();
+  if(!tracepath.empty() && !setupTrace(traceDisorder)) tracepath.clear();
 }
 
 bool Hpcrun4::valid() const noexcept { return fileValid; }
@@ -140,6 +187,85 @@ Hpcrun4::~Hpcrun4() {
   if(fileValid) hpcrun_sparse_close(file);
 }
 
+bool Hpcrun4::retainImage() {
+  if(!fileValid) return false;
+  if(image) return true;  // Already done
+
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if(!f) return false;
+  scope_exit finally([&]{ std::fclose(f); });
+  long start = 0;
+  long size;
+  if(section) {
+    start = section->start;
+    size = section->end - section->start;
+  } else {
+    if(std::fseek(f, 0, SEEK_END) != 0) return false;
+    size = std::ftell(f);
+  }
+  if(size < 0 || std::fseek(f, start, SEEK_SET) != 0) return false;
+
+  auto img = std::make_shared<std::vector<char>>(size);
+  if(std::fread(img->data(), 1, img->size(), f) != img->size()) return false;
+  if(hpcrun_sparse_use_image(file, img->data(), img->size()) != SF_SUCCEED)
+    return false;
+  image = std::move(img);
+  return true;
+}
+
+std::unique_ptr<ProfileSource> Hpcrun4::replicate() const {
+  std::unique_ptr<ProfileSource> r;
+  r.reset(new Hpcrun4(path, section ? std::optional(section->offset) : std::nullopt,
+                      measDirPath, image));
+  if(r->valid()) return r;
+  return nullptr;
+}
+
+std::uintmax_t Hpcrun4::imageSize() const noexcept {
+  if(section) return section->end - section->start;
+  std::error_code ec;
+  auto size = fs::file_size(path, ec);
+  return ec ? 0 : size;
+}
+
+std::uintmax_t Hpcrun4::sizeHint() const noexcept {
+  auto size = imageSize();
+  if(!tracepath.empty()) {
+    std::error_code ec;
+    auto tsize = fs::file_size(tracepath, ec);
+    if(!ec && tsize > (std::uintmax_t)trace_off) size += tsize - trace_off;
+  }
+  return size;
+}
+
+std::optional<std::vector<fs::path>> Hpcrun4::containerSections(const fs::path& p) {
+  std::FILE* f = std::fopen(p.c_str(), "rb");
+  if(!f) return std::nullopt;
+  scope_exit finally([&]{ std::fclose(f); });
+  if(hpcrun_fmt_container_hdr_fread(f) != HPCFMT_OK) return std::nullopt;
+
+  std::error_code ec;
+  const auto size = fs::file_size(p, ec);
+  if(ec) return std::nullopt;
+
+  std::vector<fs::path> sections;
+  while(true) {
+    const long offset = std::ftell(f);
+    hpcrun_fmt_container_section_t sec;
+    int ret = hpcrun_fmt_container_section_fread(&sec, f, std::malloc);
+    if(ret == HPCFMT_EOF) break;
+    if(ret != HPCFMT_OK || sec.end > size) {
+      if(ret == HPCFMT_OK) hpcrun_fmt_container_section_free(&sec, std::free);
+      util::log::warning{} << p.string() << " is truncated, only the first "
+                           << sections.size() << " profiles will be read";
+      break;
+    }
+    hpcrun_fmt_container_section_free(&sec, std::free);
+    sections.emplace_back(p.string() + "#" + std::to_string(offset));
+  }
+  return sections;
+}
+
 DataClass Hpcrun4::provides() const noexcept {
   using namespace literals::data;
   Class ret = attributes + references + contexts + DataClass::metrics + threads;
@@ -172,9 +298,29 @@ bool Hpcrun4::setupTrace(unsigned int traceDisorder) noexcept {
     return false;
   }
   callTrace = HPCTRACE_HDR_FLAGS_GET_BIT(thdr.flags, HPCTRACE_HDR_FLAGS_CALL_TRACE_BIT_POS);
+  trace_packed = HPCTRACE_HDR_FLAGS_GET_BIT(thdr.flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS);
   // The file is now placed right at the start of the data.
   trace_off = std::ftell(file);
 
+  if(trace_packed) {
+    // Count the number of timepoints by walking the block headers.
+    std::uint64_t count = 0;
+    while(1) {
+      uint32_t nSamples, nBytes;
+      uint64_t baseTime;
+      int err = hpctrace_fmt_packed_blockhdr_fread(&nSamples, &nBytes, &baseTime, file);
+      if(err == HPCFMT_EOF) break;
+      if(err != HPCFMT_OK || std::fseek(file, nBytes, SEEK_CUR) != 0) {
+        std::fclose(file);
+        return false;
+      }
+      count += nSamples;
+    }
+    tattrs.ctxTimepointStats(count, traceDisorder);
+    std::fclose(file);
+    return true;
+  }
+
   // Count the number of timepoints in the file, and save it for later.
   std::fseek(file, 0, SEEK_END);
   auto trace_end = std::ftell(file);
@@ -197,6 +343,73 @@ void Hpcrun4::read(const DataClass& needed) {
   }
 }
 
+util::WorkshareResult Hpcrun4::help() {
+  return metricsWork.contributeWhileAble();
+}
+
+bool Hpcrun4::readMetricBlocks(uint32_t begin, uint32_t end) {
+  // Values for the Thread's Contexts are buffered and added in bulk, so
+  // concurrent chunks don't contend on the Thread's table for every value.
+  ThreadAccumulators::Batch batch;
+  for(uint32_t block = begin; block < end; block++) {
+    // Don't bother continuing if another chunk already failed
+    if(metricsFailed.load(std::memory_order_relaxed)) return false;
+
+    const hpcrun_metricVal_t* vals;
+    const uint16_t* mids;
+    std::size_t nvals;
+    int cid = hpcrun_sparse_block_entries(file, block, &vals, &mids, &nvals);
+    if(cid < 0) {
+      util::log::info{} << "Error while reading sparse metric values";
+      return false;
+    }
+    if(nvals == 0) continue;
+    assert(sink.limit().hasContexts());
+    auto node_it = nodes.find(cid);
+    if(node_it == nodes.end()) {
+      util::log::info{} << "Encountered metric value for invalid cct node id: " << cid;
+      return false;
+    }
+    std::optional<ProfilePipeline::Source::AccumulatorsRef> raccum;
+    std::optional<ProfilePipeline::Source::AccumulatorsRef> faccum;
+    for(std::size_t i = 0; i < nvals; i++) {
+      const auto& x = metrics.at(mids[i]);
+      double v = (x.isInt ? (double)vals[i].i : vals[i].r) * x.factor;
+      if(x.isRelation) {
+        if(!raccum) {
+          if(auto* p_x = std::get_if<singleCtx_t>(&node_it->second)) {
+            raccum = sink.accumulateTo(*thread, p_x->rel);
+          } else if(auto* p_x = std::get_if<refRange_t>(&node_it->second)) {
+            raccum = sink.accumulateTo(p_x->first.second, p_x->second, p_x->first.first.rel);
+          } else {
+            util::log::info{} << "Encountered metric value for cct node of invalid type: " << cid;
+            return false;
+          }
+          raccum->batchInto(batch);
+        }
+        raccum->add(x.metric, v);
+      } else {
+        if(!faccum) {
+          if(auto* p_x = std::get_if<singleCtx_t>(&node_it->second)) {
+            faccum = sink.accumulateTo(*thread, p_x->full);
+          } else if(auto* p_x = std::get_if<reconstructedCtx_t>(&node_it->second)) {
+            faccum = sink.accumulateTo(*thread, p_x->ctx);
+          } else if(auto* p_x = std::get_if<outlinedRangeSample_t>(&node_it->second)) {
+            faccum = sink.accumulateTo(p_x->first.first, p_x->first.second, p_x->second);
+          } else {
+            util::log::info{} << "Encountered metric value for cct node of invalid type: " << cid;
+            return false;
+          }
+          faccum->batchInto(batch);
+        }
+        faccum->add(x.metric, v);
+      }
+    }
+    if(batch.size() >= metricsChunkSize) batch.flush();
+  }
+  return true;
+}
+
 bool Hpcrun4::realread(const DataClass& needed) try {
   // If attributes or threads are requested, we emit 'em.
   if(needed.hasAttributes() && attrsValid) {
@@ -538,51 +751,35 @@ bool Hpcrun4::realread(const DataClass& needed) try {
     }
   }
   if(needed.hasMetrics()) {
-    int cid;
-    while((cid = hpcrun_sparse_next_block(file)) > 0) {
-      hpcrun_metricVal_t val;
-      int mid = hpcrun_sparse_next_entry(file, &val);
-      if(mid == 0) continue;
-      assert(sink.limit().hasContexts());
-      auto node_it = nodes.find(cid);
-      if(node_it == nodes.end()) {
-        util::log::info{} << "Encountered metric value for invalid cct node id: " << cid;
-        return false;
+    uint32_t nblocks;
+    uint64_t nvals;
+    if(hpcrun_sparse_load_blocks(file, &nblocks, &nvals) != SF_SUCCEED) {
+      util::log::info{} << "Error while reading sparse metric values";
+      return false;
+    }
+    if(nvals < 2 * metricsChunkSize) {
+      if(!readMetricBlocks(0, nblocks)) return false;
+    } else {
+      // Split the blocks into chunks with about metricsChunkSize values each,
+      // and decode them alongside any other threads that come to help.
+      metricsChunks.push_back(0);
+      for(uint64_t v = metricsChunkSize; v < nvals; v += metricsChunkSize) {
+        uint32_t b = hpcrun_sparse_block_at(file, v);
+        if(b > metricsChunks.back()) metricsChunks.push_back(b);
       }
-      std::optional<ProfilePipeline::Source::AccumulatorsRef> raccum;
-      std::optional<ProfilePipeline::Source::AccumulatorsRef> faccum;
-      while(mid > 0) {
-        const auto& x = metrics.at(mid);
-        double v = (x.isInt ? (double)val.i : val.r) * x.factor;
-        if(x.isRelation) {
-          if(!raccum) {
-            if(auto* p_x = std::get_if<singleCtx_t>(&node_it->second)) {
-              raccum = sink.accumulateTo(*thread, p_x->rel);
-            } else if(auto* p_x = std::get_if<refRange_t>(&node_it->second)) {
-              raccum = sink.accumulateTo(p_x->first.second, p_x->second, p_x->first.first.rel);
-            } else {
-              util::log::info{} << "Encountered metric value for cct node of invalid type: " << cid;
-              return false;
-            }
-          }
-          raccum->add(x.metric, v);
-        } else {
-          if(!faccum) {
-            if(auto* p_x = std::get_if<singleCtx_t>(&node_it->second)) {
-              faccum = sink.accumulateTo(*thread, p_x->full);
-            } else if(auto* p_x = std::get_if<reconstructedCtx_t>(&node_it->second)) {
-              faccum = sink.accumulateTo(*thread, p_x->ctx);
-            } else if(auto* p_x = std::get_if<outlinedRangeSample_t>(&node_it->second)) {
-              faccum = sink.accumulateTo(p_x->first.first, p_x->first.second, p_x->second);
-            } else {
-              util::log::info{} << "Encountered metric value for cct node of invalid type: " << cid;
-              return false;
-            }
-          }
-          faccum->add(x.metric, v);
+      if(metricsChunks.back() < nblocks) metricsChunks.push_back(nblocks);
+      metricsWork.fill(metricsChunks.size() - 1, [this](std::size_t i){
+        bool ok = false;
+        try {
+          ok = readMetricBlocks(metricsChunks[i], metricsChunks[i+1]);
+        } catch(std::exception& e) {
+          util::log::info{} << "Exception caught while reading metric values\n"
+                               "  what(): " << e.what();
         }
-        mid = hpcrun_sparse_next_entry(file, &val);
-      }
+        if(!ok) metricsFailed.store(true, std::memory_order_relaxed);
+      });
+      metricsWork.contributeUntilComplete();
+      if(metricsFailed.load(std::memory_order_relaxed)) return false;
     }
   }
 
@@ -595,8 +792,14 @@ bool Hpcrun4::realread(const DataClass& needed) try {
     std::FILE* f = std::fopen(tracepath.c_str(), "rb");
     std::fseek(f, trace_off, SEEK_SET);
     hpctrace_fmt_datum_t tpoint;
+    std::unique_ptr<hpctrace_fmt_packed_t> packed;
+    if(trace_packed) {
+      packed = std::make_unique<hpctrace_fmt_packed_t>();
+      hpctrace_fmt_packed_init(packed.get());
+    }
     while(1) {
-      int err = hpctrace_fmt_datum_fread(&tpoint, 0, f);
+      int err = packed ? hpctrace_fmt_packed_datum_fread(&tpoint, 0, packed.get(), f)
+                       : hpctrace_fmt_datum_fread(&tpoint, 0, f);
       if(err == HPCFMT_EOF) break;
       else if(err != HPCFMT_OK) {
         util::log::info{} << "Error reading trace datum from "
@@ -613,6 +816,7 @@ bool Hpcrun4::realread(const DataClass& needed) try {
           case ProfilePipeline::Source::TimepointStatus::rewindStart:
             // Put the cursor back at the beginning
             std::fseek(f, trace_off, SEEK_SET);
+            if(packed) hpctrace_fmt_packed_init(packed.get());
             break;
           }
         }
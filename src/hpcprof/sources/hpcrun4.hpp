@@ -13,7 +13,10 @@
 #include "../util/locked_unordered.hpp"
 #include "../util/ref_wrappers.hpp"
 
+#include <atomic>
 #include <memory>
+#include <optional>
+#include <vector>
 #include "../stdshim/filesystem.hpp"
 
 // Forward declaration of a structure.
@@ -39,9 +42,38 @@ public:
   /// See `ProfileSource::read(...)`.
   void read(const DataClass&) override;
 
+  /// Help decode the metric values of a large profile, while another thread
+  /// is reading them. See `ProfileSource::help()`.
+  util::WorkshareResult help() override;
+
   DataClass provides() const noexcept override;
   DataClass finalizeRequest(const DataClass&) const noexcept override;
 
+  /// Read the entire measurement profile into memory, all later reads from
+  /// this Source (and any replicas of it) will be served from the image
+  /// without touching the filesystem. Returns false if the read failed.
+  // MT: Externally Synchronized
+  bool retainImage();
+
+  /// Create a fresh Source reading the same measurement profile. If an image
+  /// has been retained (see retainImage), the replica will share it.
+  // MT: Externally Synchronized
+  std::unique_ptr<ProfileSource> replicate() const;
+
+  /// Size of the image retainImage would read, or 0 if unknown.
+  // MT: Safe (const)
+  std::uintmax_t imageSize() const noexcept;
+
+  /// Size of the profile and its tracefile, see `ProfileSource::sizeHint()`.
+  std::uintmax_t sizeHint() const noexcept override;
+
+  /// Enumerate the profiles in an hpcrun container file (see hpcrun-fmt.h),
+  /// returning for each a path that can be passed to create_for. Returns
+  /// std::nullopt if the file is not a container.
+  // MT: Internally Synchronized
+  static std::optional<std::vector<stdshim::filesystem::path>>
+  containerSections(const stdshim::filesystem::path&);
+
 private:
   bool realread(const DataClass&);
 
@@ -62,6 +94,18 @@ private:
   stdshim::filesystem::path path;
   stdshim::filesystem::path measDirPath;
 
+  // In-memory image of the file, if one has been retained. Shared with replicas.
+  std::shared_ptr<const std::vector<char>> image;
+
+  // Location of the profile within a container, or std::nullopt if the
+  // profile is the whole file.
+  struct section_t {
+    uint64_t offset;  ///< Offset of the section header
+    uint64_t start;  ///< First byte of the profile
+    uint64_t end;  ///< One past the last byte of the profile
+  };
+  std::optional<section_t> section;
+
   struct metric_t {
     metric_t(Metric& metric) : metric(metric) {};
     Metric& metric;
@@ -79,6 +123,14 @@ private:
   // ID to Module mapping.
   std::unordered_map<unsigned int, Module&> modules;
 
+  // Metric values of large profiles are decoded in chunks of blocks, which
+  // other threads can pick up via help(). Chunk i is the blocks
+  // [metricsChunks[i], metricsChunks[i+1]).
+  util::ParallelFor metricsWork;
+  std::vector<uint32_t> metricsChunks;
+  std::atomic<bool> metricsFailed = false;
+  bool readMetricBlocks(uint32_t, uint32_t);
+
   // Recursive functions for parsing formulas into Expressions
   std::optional<std::tuple<Expression::Kind, int, bool, unsigned int>>
     peekFormulaOperator(std::istream&) const;
@@ -127,14 +179,18 @@ private:
   // Flag for whether we've warned about top-level context demotion
   bool warned_top_demotion = false;
 
-  // Path to the tracefile, and offset of the actual data blob.
+  // Path to the tracefile, offset of the actual data blob, and whether the
+  // trace records are packed.
   stdshim::filesystem::path tracepath;
   long trace_off;
+  bool trace_packed;
   bool trace_sort;
 
   // We're all friends here.
   friend std::unique_ptr<ProfileSource> ProfileSource::create_for(const stdshim::filesystem::path&, const stdshim::filesystem::path&);
   Hpcrun4(const stdshim::filesystem::path&, const stdshim::filesystem::path&);
+  Hpcrun4(const stdshim::filesystem::path&, std::optional<uint64_t>,
+          const stdshim::filesystem::path&, std::shared_ptr<const std::vector<char>>);
 };
 
 }
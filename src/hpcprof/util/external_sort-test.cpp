@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "external_sort.hpp"
+#include "streaming_sort.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace hpctoolkit::util;
+
+namespace {
+
+std::vector<std::uint32_t> shuffled(std::size_t n) {
+  std::vector<std::uint32_t> values(n);
+  for (std::size_t i = 0; i < n; i++)
+    values[i] = i;
+  std::shuffle(values.begin(), values.end(), std::mt19937(42));
+  return values;
+}
+
+// Drain the buffer, checking the chunk sizes along the way
+template <class T, class Cmp>
+std::vector<T> drained(external_sort_buffer<T, Cmp>& buf, std::size_t chunk) {
+  std::vector<T> out;
+  buf.drain(
+      [&](const std::vector<T>& tps) {
+        EXPECT_LE(tps.size(), chunk);
+        EXPECT_FALSE(tps.empty());
+        out.insert(out.end(), tps.begin(), tps.end());
+      },
+      chunk);
+  EXPECT_TRUE(buf.empty());
+  return out;
+}
+
+}  // namespace
+
+TEST(ExternalSortTest, InMemory) {
+  external_sort_buffer<std::uint32_t> buf(1 << 20);
+  for (auto v : shuffled(10000))
+    buf.push(v);
+  EXPECT_EQ(buf.size(), 10000u);
+  EXPECT_EQ(buf.runs(), 0u);
+  auto out = drained(buf, 4096);
+  ASSERT_EQ(out.size(), 10000u);
+  for (std::size_t i = 0; i < out.size(); i++)
+    ASSERT_EQ(out[i], i);
+}
+
+TEST(ExternalSortTest, SinglePassMerge) {
+  // The smallest budget holds 1024 elements, which can merge 15 runs at once
+  external_sort_buffer<std::uint32_t> buf(0);
+  for (auto v : shuffled(10 * 1024 + 7))
+    buf.push(v);
+  EXPECT_EQ(buf.runs(), 10u);
+  auto out = drained(buf, 1000);
+  ASSERT_EQ(out.size(), 10 * 1024 + 7u);
+  for (std::size_t i = 0; i < out.size(); i++)
+    ASSERT_EQ(out[i], i);
+}
+
+TEST(ExternalSortTest, MultiPassMerge) {
+  // 300 runs take two passes to merge down to 15 or fewer
+  external_sort_buffer<std::uint32_t> buf(0);
+  for (auto v : shuffled(300 * 1024))
+    buf.push(v);
+  EXPECT_EQ(buf.runs(), 299u);
+  auto out = drained(buf, 4096);
+  ASSERT_EQ(out.size(), 300 * 1024u);
+  for (std::size_t i = 0; i < out.size(); i++)
+    ASSERT_EQ(out[i], i);
+}
+
+TEST(ExternalSortTest, Duplicates) {
+  // Pairs ordered only by their first element, as timepoints are
+  using Tp = std::pair<std::uint32_t, std::uint32_t>;
+  external_sort_buffer<Tp, compare_only_first<Tp>> buf(0);
+  std::mt19937 rng(7);
+  std::vector<std::size_t> counts(100, 0);
+  for (std::size_t i = 0; i < 40000; i++) {
+    const std::uint32_t k = rng() % counts.size();
+    counts[k]++;
+    buf.push({k, (std::uint32_t)i});
+  }
+  auto out = drained(buf, 4096);
+  ASSERT_EQ(out.size(), 40000u);
+  std::vector<std::size_t> seen(counts.size(), 0);
+  for (std::size_t i = 0; i < out.size(); i++) {
+    if (i > 0) {
+      ASSERT_LE(out[i - 1].first, out[i].first);
+    }
+    seen[out[i].first]++;
+  }
+  EXPECT_EQ(seen, counts);
+}
+
+TEST(ExternalSortTest, Reuse) {
+  // A drained buffer can be filled again, including after a move
+  external_sort_buffer<std::uint32_t, std::greater<std::uint32_t>> buf(0);
+  for (int round = 0; round < 2; round++) {
+    for (auto v : shuffled(20 * 1024))
+      buf.push(v);
+    external_sort_buffer<std::uint32_t, std::greater<std::uint32_t>> moved(std::move(buf));
+    EXPECT_TRUE(buf.empty());
+    auto out = drained(moved, 4096);
+    ASSERT_EQ(out.size(), 20 * 1024u);
+    for (std::size_t i = 0; i < out.size(); i++)
+      ASSERT_EQ(out[i], out.size() - 1 - i);
+    buf = std::move(moved);
+  }
+}
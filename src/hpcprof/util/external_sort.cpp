@@ -0,0 +1,55 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*-
+
+#include "external_sort.hpp"
+
+#include "log.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+using namespace hpctoolkit::util;
+
+std::FILE* detail::open_spill_file() {
+  const char* dir = std::getenv("TMPDIR");
+  std::string path = (dir != nullptr && dir[0] != '\0' ? dir : "/tmp");
+  path += "/hpcprof-sort.XXXXXX";
+  int fd = mkstemp(path.data());
+  if(fd < 0) {
+    char buf[1024];
+    log::fatal{} << "Unable to create temporary file for sorting in "
+                 << path.substr(0, path.rfind('/')) << ": "
+                 << strerror_r(errno, buf, sizeof buf);
+  }
+  // Unlink right away so the file is cleaned up however we exit
+  unlink(path.c_str());
+  std::FILE* f = fdopen(fd, "w+b");
+  if(f == nullptr) {
+    char buf[1024];
+    log::fatal{} << "Unable to open temporary file for sorting: "
+                 << strerror_r(errno, buf, sizeof buf);
+  }
+  return f;
+}
+
+void detail::spill_write(std::FILE* f, long offset, const void* data, std::size_t size) {
+  if(std::fseek(f, offset, SEEK_SET) != 0 || std::fwrite(data, 1, size, f) < size) {
+    char buf[1024];
+    log::fatal{} << "Error while spilling to temporary file: "
+                 << strerror_r(errno, buf, sizeof buf);
+  }
+}
+
+void detail::spill_read(std::FILE* f, long offset, void* data, std::size_t size) {
+  if(std::fseek(f, offset, SEEK_SET) != 0 || std::fread(data, 1, size, f) < size) {
+    char buf[1024];
+    log::fatal{} << "Error while reading from temporary file: "
+                 << strerror_r(errno, buf, sizeof buf);
+  }
+}
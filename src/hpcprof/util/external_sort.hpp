@@ -0,0 +1,265 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*-
+
+#ifndef HPCTOOLKIT_PROFILE_UTIL_EXTERNAL_SORT_H
+#define HPCTOOLKIT_PROFILE_UTIL_EXTERNAL_SORT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hpctoolkit::util {
+
+namespace detail {
+/// Open an anonymous read-write temporary file for spilling data, in $TMPDIR
+/// if set. The file is removed from the filesystem once closed. Never fails,
+/// if no file can be created this is a fatal error.
+std::FILE* open_spill_file();
+
+/// Write or read a block of bytes at the given offset of a spill file. Any
+/// I/O error is fatal.
+void spill_write(std::FILE*, long offset, const void*, std::size_t);
+void spill_read(std::FILE*, long offset, void*, std::size_t);
+}
+
+/// Container for sorting an unbounded number of elements in bounded memory.
+///
+/// Elements are collected in memory up to a budget. When the budget is hit the
+/// collected elements are sorted and spilled to a temporary file as a "run."
+/// Draining the container k-way merges the runs back in sorted order, reading
+/// each run through a buffer sized to keep the total within the budget. If
+/// there are too many runs for each to get a reasonable buffer, they are first
+/// merged into fewer, longer runs in as many passes as needed.
+///
+/// Elements are spilled as raw bytes and never outlive the process, so any
+/// trivially copyable T will do, including ones holding pointers.
+template<class T, class Cmp = std::less<T>>
+class external_sort_buffer {
+  static_assert(std::is_trivially_copy_constructible_v<T>
+                && std::is_trivially_destructible_v<T>,
+                "external_sort_buffer can only spill trivially copyable elements!");
+
+  // Reverse of Cmp, to make a min-heap from the STL heap algorithms
+  struct RevCmp {
+    const Cmp& cmp;
+    const std::vector<std::optional<T>>& heads;
+    bool operator()(std::size_t a, std::size_t b) const {
+      return cmp(*heads[b], *heads[a]);
+    }
+  };
+
+  // A run in the spill file, described by its offset and number of elements
+  struct Run {
+    long offset;
+    std::size_t count;
+  };
+
+  // Smallest buffer (in elements) a run is read through during a merge
+  static constexpr std::size_t minRunBuffer = 64;
+
+  Cmp m_cmp;
+  std::size_t m_capacity;  // Maximum number of elements kept in memory
+  std::vector<T> m_buffer;
+  std::FILE* m_file = nullptr;
+  long m_fileEnd = 0;
+  std::vector<Run> m_runs;
+  std::size_t m_size = 0;
+
+  static T load(const unsigned char* p) noexcept {
+    std::aligned_storage_t<sizeof(T), alignof(T)> s;
+    std::memcpy(&s, p, sizeof(T));
+    return *std::launder(reinterpret_cast<const T*>(&s));
+  }
+
+  // Sort the in-memory elements and write them out as a new run
+  void spill() {
+    if(m_buffer.empty()) return;
+    if(m_file == nullptr) m_file = detail::open_spill_file();
+    std::sort(m_buffer.begin(), m_buffer.end(), m_cmp);
+    const std::size_t bytes = m_buffer.size() * sizeof(T);
+    detail::spill_write(m_file, m_fileEnd, m_buffer.data(), bytes);
+    m_runs.push_back({m_fileEnd, m_buffer.size()});
+    m_fileEnd += bytes;
+    m_buffer.clear();
+  }
+
+  // K-way merge the runs [first, last), reading each through a buffer of
+  // bufElems elements, and pass the merged elements in order to `out`.
+  template<class F>
+  void merge(Run* first, Run* last, std::size_t bufElems, F&& out) {
+    const std::size_t runs = last - first;
+    std::vector<std::vector<unsigned char>> bufs(runs);
+    std::vector<std::size_t> bufPos(runs, 0);
+    std::vector<std::size_t> bufLen(runs, 0);
+    std::vector<std::optional<T>> heads(runs);
+    auto advance = [&](std::size_t r) {
+      if(bufPos[r] == bufLen[r]) {
+        Run& run = first[r];
+        if(run.count == 0) {
+          heads[r].reset();
+          return;
+        }
+        const std::size_t n = std::min(bufElems, run.count);
+        bufs[r].resize(n * sizeof(T));
+        detail::spill_read(m_file, run.offset, bufs[r].data(), n * sizeof(T));
+        run.offset += n * sizeof(T);
+        run.count -= n;
+        bufPos[r] = 0;
+        bufLen[r] = n;
+      }
+      heads[r] = load(&bufs[r][bufPos[r]++ * sizeof(T)]);
+    };
+
+    std::vector<std::size_t> heap;
+    heap.reserve(runs);
+    for(std::size_t r = 0; r < runs; r++) {
+      advance(r);
+      heap.push_back(r);
+    }
+    const RevCmp rcmp{m_cmp, heads};
+    std::make_heap(heap.begin(), heap.end(), rcmp);
+
+    while(!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), rcmp);
+      const std::size_t r = heap.back();
+      out(*heads[r]);
+      advance(r);
+      if(heads[r]) std::push_heap(heap.begin(), heap.end(), rcmp);
+      else heap.pop_back();
+    }
+  }
+
+public:
+  /// Construct an empty buffer that keeps (roughly) at most `budget` bytes of
+  /// elements in memory at once.
+  explicit external_sort_buffer(std::size_t budget = 0, Cmp cmp = Cmp())
+    : m_cmp(std::move(cmp)),
+      m_capacity(std::max<std::size_t>(budget / sizeof(T), 1024)) {};
+
+  ~external_sort_buffer() {
+    if(m_file != nullptr) std::fclose(m_file);
+  }
+
+  external_sort_buffer(external_sort_buffer&& o)
+    : m_cmp(std::move(o.m_cmp)), m_capacity(o.m_capacity),
+      m_buffer(std::move(o.m_buffer)), m_file(std::exchange(o.m_file, nullptr)),
+      m_fileEnd(std::exchange(o.m_fileEnd, 0)), m_runs(std::move(o.m_runs)),
+      m_size(std::exchange(o.m_size, 0)) {};
+  external_sort_buffer& operator=(external_sort_buffer&& o) {
+    if(m_file != nullptr) std::fclose(m_file);
+    m_cmp = std::move(o.m_cmp);
+    m_capacity = o.m_capacity;
+    m_buffer = std::move(o.m_buffer);
+    m_file = std::exchange(o.m_file, nullptr);
+    m_fileEnd = std::exchange(o.m_fileEnd, 0);
+    m_runs = std::move(o.m_runs);
+    m_size = std::exchange(o.m_size, 0);
+    return *this;
+  }
+  external_sort_buffer(const external_sort_buffer&) = delete;
+  external_sort_buffer& operator=(const external_sort_buffer&) = delete;
+
+  /// Check whether this buffer holds any elements.
+  bool empty() const noexcept { return m_size == 0; }
+
+  /// Get the number of elements held by this buffer.
+  std::size_t size() const noexcept { return m_size; }
+
+  /// Get the number of runs that have been spilled to disk.
+  std::size_t runs() const noexcept { return m_runs.size(); }
+
+  /// Add a new element to the buffer.
+  void push(T value) {
+    if(m_buffer.size() >= m_capacity) spill();
+    m_buffer.push_back(std::move(value));
+    m_size++;
+  }
+
+  /// Remove all elements from the buffer. Space in the spill file is reused.
+  void clear() noexcept {
+    m_buffer.clear();
+    m_runs.clear();
+    m_fileEnd = 0;
+    m_size = 0;
+  }
+
+  /// Remove all the elements from the buffer in sorted order, passing them to
+  /// `f` as `const std::vector<T>&` chunks of at most `chunk` elements.
+  template<class F>
+  void drain(F&& f, std::size_t chunk = 4096) {
+    if(m_runs.empty()) {
+      // Everything fit in memory, no need to touch the disk
+      std::sort(m_buffer.begin(), m_buffer.end(), m_cmp);
+      for(std::size_t i = 0; i < m_buffer.size(); i += chunk) {
+        const std::size_t end = std::min(i + chunk, m_buffer.size());
+        if(i == 0 && end == m_buffer.size()) f(std::as_const(m_buffer));
+        else f(std::vector<T>(m_buffer.begin() + i, m_buffer.begin() + end));
+      }
+      clear();
+      return;
+    }
+
+    spill();
+    m_buffer.shrink_to_fit();
+
+    // Every run in a merge gets an equal share of the budget as its read
+    // buffer. Too many runs would make those buffers uselessly small, so merge
+    // groups of them into longer runs until few enough are left. Each pass
+    // writes its output to the other half of the spill file, so it never
+    // overwrites a run before reading it.
+    const std::size_t fanIn = std::max<std::size_t>(m_capacity / minRunBuffer, 3) - 1;
+    bool upper = false;
+    while(m_runs.size() > fanIn) {
+      const std::size_t bufElems = m_capacity / (fanIn + 1);
+      upper = !upper;
+      long dst = upper ? m_fileEnd : 0;
+      std::vector<T> wbuf;
+      wbuf.reserve(bufElems);
+      std::vector<Run> merged;
+      for(std::size_t i = 0; i < m_runs.size(); i += fanIn) {
+        Run run{dst, 0};
+        auto write = [&]{
+          const std::size_t bytes = wbuf.size() * sizeof(T);
+          detail::spill_write(m_file, dst, wbuf.data(), bytes);
+          dst += bytes;
+          run.count += wbuf.size();
+          wbuf.clear();
+        };
+        const std::size_t end = std::min(i + fanIn, m_runs.size());
+        merge(m_runs.data() + i, m_runs.data() + end, bufElems, [&](const T& v){
+          wbuf.push_back(v);
+          if(wbuf.size() >= bufElems) write();
+        });
+        if(!wbuf.empty()) write();
+        merged.push_back(run);
+      }
+      m_runs = std::move(merged);
+    }
+
+    std::vector<T> out;
+    out.reserve(chunk);
+    merge(m_runs.data(), m_runs.data() + m_runs.size(),
+          m_capacity / (m_runs.size() + 1), [&](const T& v){
+      out.push_back(v);
+      if(out.size() >= chunk) {
+        f(std::as_const(out));
+        out.clear();
+      }
+    });
+    if(!out.empty()) f(std::as_const(out));
+    clear();
+  }
+};
+
+}
+
+#endif  // HPCTOOLKIT_PROFILE_UTIL_EXTERNAL_SORT_H
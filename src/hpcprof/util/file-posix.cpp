@@ -11,10 +11,19 @@
 #include "log.hpp"
 #include "../mpi/bcast.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <fcntl.h>
+#include <mutex>
+#include <thread>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 namespace hpctoolkit::util::detail {
 struct FileImpl {
@@ -25,14 +34,113 @@ struct FileImpl {
   int fd = -1;
 };
 struct FileInstanceImpl {
-  FileInstanceImpl(int fd) : fd(fd) {};
+  FileInstanceImpl(int fd, bool mapped) : fd(fd), mapped(mapped) {};
+  ~FileInstanceImpl() {
+    for(const auto& [addr, size]: maps) munmap(addr, size);
+  }
   int fd;
+  bool mapped;
+
+  // Mappings of the file, the last covers the largest extent. Older mappings
+  // are kept alive since views into them may still be in use.
+  std::mutex maps_lock;
+  std::vector<std::pair<void*, std::size_t>> maps;
+
+  // Map the whole file as it currently stands, if it has grown past the
+  // current mapping. Returns the base of the latest mapping.
+  // MT: Externally Synchronized (maps_lock)
+  const char* remap(std::uint_fast64_t needed) {
+    if(!maps.empty() && maps.back().second >= needed)
+      return (const char*)maps.back().first;
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      char buf[1024];
+      util::log::fatal{} << "Error during stat: " << strerror_r(errno, buf, sizeof buf);
+    }
+    if((std::uint_fast64_t)st.st_size < needed) {
+      util::log::fatal{} << "Error during map: EOF at " << st.st_size
+                         << " bytes (of " << needed << " byte view)";
+    }
+    if(st.st_size == 0) return nullptr;
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED) {
+      char buf[1024];
+      util::log::fatal{} << "Error during map: " << strerror_r(errno, buf, sizeof buf);
+    }
+    maps.emplace_back(addr, st.st_size);
+    return (const char*)addr;
+  }
+};
+struct FileAsyncImpl {
+  FileAsyncImpl(int fd, unsigned int depth);
+  ~FileAsyncImpl();
+
+  // Queue an operation, blocking while the queue is full if `bounded`
+  void push(std::function<void()> op, bool bounded);
+  // Wait for all queued operations to complete
+  void wait();
+
+  int fd;
+  unsigned int depth;
+
+  std::mutex lock;
+  // Signalled when new operations are queued (or on shutdown)
+  std::condition_variable cv_queued;
+  // Signalled when operations complete
+  std::condition_variable cv_done;
+  std::deque<std::function<void()>> queue;
+  // Number of bounded operations queued or in flight
+  unsigned int inflight = 0;
+  // Number of operations (of any kind) queued or in flight
+  std::size_t pending = 0;
+  bool stopping = false;
+  std::vector<std::thread> workers;
 };
 }
 
 using namespace hpctoolkit;
 using namespace hpctoolkit::util;
 
+// Read a block of bytes in full with pread, retrying short reads
+static void preadall(int fd, std::uint_fast64_t offset, std::size_t size, char* buf) {
+  const auto orig_size = size;
+  while(size > 0) {
+    auto cnt = pread(fd, buf, size, offset);
+    if(cnt < 0) {
+      char buf[1024];
+      util::log::fatal{} << "Error during read: " << strerror_r(errno, buf, sizeof buf);
+    } else if(cnt == 0) {
+      util::log::fatal{} << "Error during read: EOF after " << (orig_size - size)
+                        << " bytes (of " << orig_size << " byte read)";
+    }
+
+    // Adjust the arguments for the next time attempt
+    offset += cnt;
+    size -= cnt;
+    buf += cnt;
+  }
+}
+
+// Write a block of bytes in full with pwrite, retrying short writes
+static void pwriteall(int fd, std::uint_fast64_t offset, std::size_t size, const char* buf) {
+  const auto orig_size = size;
+  while(size > 0) {
+    auto cnt = pwrite(fd, buf, size, offset);
+    if(cnt < 0) {
+      char buf[1024];
+      util::log::fatal{} << "Error during write: " << strerror_r(errno, buf, sizeof buf);
+    } else if(cnt == 0) {
+      util::log::fatal{} << "Error during write: EOF after " << (orig_size - size)
+                        << " bytes (of " << orig_size << " byte write)";
+    }
+
+    // Adjust the arguments for the next time attempt
+    offset += cnt;
+    size -= cnt;
+    buf += cnt;
+  }
+}
+
 File::File(stdshim::filesystem::path path, bool create) noexcept
   : impl(std::make_unique<detail::FileImpl>(std::move(path), create)) {}
 File::~File() {
@@ -93,51 +201,139 @@ void File::remove() noexcept {
 
 File::Instance::Instance() = default;
 File::Instance::Instance(const File& file, bool writable, bool mapped) noexcept
-  : impl(std::make_unique<detail::FileInstanceImpl>(file.impl->fd)) {
+  : impl(std::make_unique<detail::FileInstanceImpl>(file.impl->fd, mapped)) {
   assert(impl && "Attempt to call File::open after ::remove!");
   assert(impl->fd != -1 && "Attempt to call File::open before ::synchronize!");
+  if(mapped && !writable) {
+    // Read-only mapped Instances are usually opened to view an existing file,
+    // so map everything up front
+    std::unique_lock<std::mutex> l(impl->maps_lock);
+    impl->remap(0);
+  }
 }
 File::Instance::~Instance() = default;
 
 File::Instance::Instance(File::Instance&&) = default;
 File::Instance& File::Instance::operator=(File::Instance&&) = default;
 
+const char* File::Instance::view(std::uint_fast64_t offset, std::size_t size) const noexcept {
+  assert(impl && "Attempt to call view on an empty File::Instance!");
+  assert(impl->mapped && "Attempt to call view on an unmapped File::Instance!");
+  std::unique_lock<std::mutex> l(impl->maps_lock);
+  const char* base = impl->remap(offset + size);
+  return base != nullptr ? base + offset : nullptr;
+}
+
 void File::Instance::readat(std::uint_fast64_t offset, std::size_t size, char* buf) noexcept {
   assert(impl && "Attempt to call readat on an empty File::Instance!");
-  const auto orig_size = size;
-  while(size > 0) {
-    auto cnt = pread(impl->fd, buf, size, offset);
-    if(cnt < 0) {
-      char buf[1024];
-      util::log::fatal{} << "Error during read: " << strerror_r(errno, buf, sizeof buf);
-    } else if(cnt == 0) {
-      util::log::fatal{} << "Error during read: EOF after " << (orig_size - size)
-                        << " bytes (of " << orig_size << " byte read)";
-    }
-
-    // Adjust the arguments for the next time attempt
-    offset += cnt;
-    size -= cnt;
-    buf += cnt;
+  if(impl->mapped && size > 0) {
+    std::memcpy(buf, view(offset, size), size);
+    return;
   }
+  preadall(impl->fd, offset, size, buf);
 }
 
 void File::Instance::writeat(std::uint_fast64_t offset, std::size_t size, const char* buf) noexcept {
   assert(impl && "Attempt to call writeat on an empty File::Instance!");
-  const auto orig_size = size;
-  while(size > 0) {
-    auto cnt = pwrite(impl->fd, buf, size, offset);
-    if(cnt < 0) {
-      char buf[1024];
-      util::log::fatal{} << "Error during write: " << strerror_r(errno, buf, sizeof buf);
-    } else if(cnt == 0) {
-      util::log::fatal{} << "Error during write: EOF after " << (orig_size - size)
-                        << " bytes (of " << orig_size << " byte write)";
-    }
+  pwriteall(impl->fd, offset, size, buf);
+}
 
-    // Adjust the arguments for the next time attempt
-    offset += cnt;
-    size -= cnt;
-    buf += cnt;
+detail::FileAsyncImpl::FileAsyncImpl(int fd, unsigned int depth)
+  : fd(fd), depth(std::max(depth, 1U)) {
+  workers.reserve(this->depth);
+  for(unsigned int i = 0; i < this->depth; i++) {
+    workers.emplace_back([this]{
+      std::unique_lock<std::mutex> l(lock);
+      while(true) {
+        cv_queued.wait(l, [&]{ return stopping || !queue.empty(); });
+        if(queue.empty()) return;  // stopping
+        auto op = std::move(queue.front());
+        queue.pop_front();
+        l.unlock();
+        op();
+        l.lock();
+        pending--;
+        cv_done.notify_all();
+      }
+    });
+  }
+}
+
+detail::FileAsyncImpl::~FileAsyncImpl() {
+  wait();
+  {
+    std::unique_lock<std::mutex> l(lock);
+    stopping = true;
+  }
+  cv_queued.notify_all();
+  for(auto& t: workers) t.join();
+}
+
+void detail::FileAsyncImpl::push(std::function<void()> op, bool bounded) {
+  std::unique_lock<std::mutex> l(lock);
+  if(bounded) {
+    cv_done.wait(l, [&]{ return inflight < depth; });
+    inflight++;
+    queue.emplace_back([this, op = std::move(op)]{
+      op();
+      std::unique_lock<std::mutex> l(lock);
+      inflight--;
+    });
+  } else {
+    queue.emplace_back(std::move(op));
+  }
+  pending++;
+  cv_queued.notify_one();
+}
+
+void detail::FileAsyncImpl::wait() {
+  std::unique_lock<std::mutex> l(lock);
+  cv_done.wait(l, [&]{ return pending == 0; });
+}
+
+File::Async::Async() = default;
+File::Async::Async(const File& file, unsigned int depth) noexcept
+  : impl(std::make_unique<detail::FileAsyncImpl>(file.impl->fd, depth)) {
+  assert(file.impl && "Attempt to call File::async after ::remove!");
+  assert(impl->fd != -1 && "Attempt to call File::async before ::synchronize!");
+}
+File::Async::~Async() = default;
+
+File::Async::Async(File::Async&&) = default;
+File::Async& File::Async::operator=(File::Async&&) = default;
+
+void File::Async::readat(std::uint_fast64_t offset, std::size_t size, char* buf,
+                         std::function<void()> done) noexcept {
+  assert(impl && "Attempt to call readat on an empty File::Async!");
+  impl->push([fd = impl->fd, offset, size, buf, done = std::move(done)]{
+    preadall(fd, offset, size, buf);
+    if(done) done();
+  }, true);
+}
+
+void File::Async::writeat(std::uint_fast64_t offset, std::vector<char> data,
+                          std::function<void()> done) noexcept {
+  assert(impl && "Attempt to call writeat on an empty File::Async!");
+  if(data.empty()) {
+    if(done) done();
+    return;
   }
+  impl->push([fd = impl->fd, offset, data = std::move(data), done = std::move(done)]{
+    pwriteall(fd, offset, data.size(), data.data());
+    if(done) done();
+  }, true);
+}
+
+void File::Async::prefetch(std::uint_fast64_t offset, std::size_t size) noexcept {
+  assert(impl && "Attempt to call prefetch on an empty File::Async!");
+  if(size == 0) return;
+  impl->push([fd = impl->fd, offset, size]{
+    // This is only a hint, errors here are not a problem
+    posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+  }, false);
+}
+
+void File::Async::wait() noexcept {
+  assert(impl && "Attempt to call wait on an empty File::Async!");
+  impl->wait();
 }
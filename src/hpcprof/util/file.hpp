@@ -11,18 +11,21 @@
 #include <functional>
 #include <ios>
 #include <memory>
+#include <vector>
 
 namespace hpctoolkit::util {
 
 namespace detail {
 struct FileImpl;
 struct FileInstanceImpl;
+struct FileAsyncImpl;
 }
 
 /// This represents a file available for access on the filesystem.
 class File final {
 public:
   class Instance;
+  class Async;
 
   /// Create a File for the given path. May delay the creation of the file until
   /// synchronize().
@@ -61,6 +64,14 @@ public:
     return Instance(*this, writable, mapped);
   }
 
+  /// Open the File for asynchronous access. At most `depth` operations will
+  /// be in flight at once, serviced by as many background threads.
+  /// Only valid after synchronize() has been called for this File.
+  // MT: Internally Synchronized
+  Async async(unsigned int depth) const noexcept {
+    return Async(*this, depth);
+  }
+
   /// Instance of the opened file, which can be used for file access.
   // MT: Externally Synchronized
   class Instance final {
@@ -88,6 +99,13 @@ public:
       return writeat(offset, data.size(), data.data());
     }
 
+    /// Get a read-only view of a block of bytes at the given file offset,
+    /// without copying. Only valid for mapped Instances. The returned pointer
+    /// remains valid for the lifetime of this Instance.
+    /// Throws a fatal error if the block extends past the end of the file.
+    // MT: Internally Synchronized
+    const char* view(std::uint_fast64_t offset, std::size_t size) const noexcept;
+
   private:
     friend class File;
     Instance(const File&, bool, bool) noexcept;
@@ -95,6 +113,51 @@ public:
     std::unique_ptr<detail::FileInstanceImpl> impl;
   };
 
+  /// Queue of asynchronous operations on an opened File. Operations are issued
+  /// in the order they are queued, but may complete in any order. Queueing
+  /// blocks while the queue is full, to bound the memory held by in-flight
+  /// operations.
+  // MT: Internally Synchronized
+  class Async final {
+  public:
+    /// Constructs an empty Async.
+    Async();
+    /// Waits for all queued operations to complete before returning.
+    ~Async();
+
+    Async(const Async&) = delete;
+    Async& operator=(const Async&) = delete;
+    Async(Async&&);
+    Async& operator=(Async&&);
+
+    /// Queue a read of a block of bytes from the given file offset into the
+    /// given buffer, which must remain valid until `done` is called.
+    /// `done` is called from a background thread after the read completes.
+    /// Throws a fatal error on I/O errors.
+    void readat(std::uint_fast64_t offset, std::size_t size, char* data,
+                std::function<void()> done = {}) noexcept;
+
+    /// Queue a write of the given bytes at the given offset. The Async takes
+    /// ownership of the buffer, which is freed after the write completes.
+    /// `done` is called from a background thread after the write completes.
+    /// Throws a fatal error on I/O errors.
+    void writeat(std::uint_fast64_t offset, std::vector<char> data,
+                 std::function<void()> done = {}) noexcept;
+
+    /// Queue a hint that a block of bytes will soon be read, to allow the
+    /// filesystem to start fetching it early. Never blocks.
+    void prefetch(std::uint_fast64_t offset, std::size_t size) noexcept;
+
+    /// Wait for all operations queued so far to complete.
+    void wait() noexcept;
+
+  private:
+    friend class File;
+    Async(const File&, unsigned int) noexcept;
+
+    std::unique_ptr<detail::FileAsyncImpl> impl;
+  };
+
 private:
   std::unique_ptr<detail::FileImpl> impl;
 };
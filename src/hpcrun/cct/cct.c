@@ -41,7 +41,6 @@
 #include "../memory/hpcrun-malloc.h"
 #include "../metrics.h"
 #include "../messages/messages.h"
-#include "../../common/lean/splay-macros.h"
 #include "../../common/lean/hpcrun-fmt.h"
 #include "../../common/lean/hpcrun-fmt.h"
 #include "../../common/lean/spinlock.h"
@@ -69,6 +68,9 @@ struct cct_node_t {
   // ---------------------------------------------------------
   int32_t persistent_id;
 
+  // number of children linked under this node
+  uint32_t num_children;
+
  // bundle abstract address components into a data type
   cct_addr_t addr;
 
@@ -81,6 +83,9 @@ struct cct_node_t {
   // If false, we don't write it out in hpcrun file
   bool display;
 
+  // 1-based position of this node in its parent's sibling tree
+  uint32_t sibling_pos;
+
   // ---------------------------------------------------------
   // tree structure
   // ---------------------------------------------------------
@@ -90,15 +95,33 @@ struct cct_node_t {
   struct cct_node_t* parent;
   struct cct_node_t* children;
 
-  // left and right pointers for splay tree of siblings
+  // hash index over the children, only present for wide nodes
+  struct cct_child_index_t* child_index;
+
+  // left and right pointers for the sibling tree. Siblings are linked in
+  // insertion order as a complete binary tree (heap layout), so the
+  // sibling at position p has children at 2p and 2p+1.
   struct cct_node_t* left;
   struct cct_node_t* right;
 
-  // Splay sibling to return to after processing this node. In other words, the previous node
-  // pushed onto the stack during a DFS of the splay tree.
+  // Sibling to return to after processing this node. In other words, the previous node
+  // pushed onto the stack during a DFS of the sibling tree.
   struct cct_node_t* previous;
 };
 
+//
+// Children of a node with more than CCT_CHILD_INDEX_THRESHOLD children are
+// also entered in an open-addressing hash table (linear probing) keyed on
+// the child's address. Smaller child sets are just scanned.
+//
+#define CCT_CHILD_INDEX_THRESHOLD 8
+#define CCT_CHILD_INDEX_MIN_LOG2 5
+
+typedef struct cct_child_index_t {
+  uint32_t log2_capacity;
+  cct_node_t* slots[];
+} cct_child_index_t;
+
 typedef cct_node_t* (*cct_op_merge_t)(cct_node_t* cct, cct_op_arg_t arg, size_t level);
 
 //
@@ -140,6 +163,9 @@ cct_node_create(cct_addr_t* addr, bool unwound, cct_node_t* parent)
 
   node->parent = parent;
   node->children = NULL;
+  node->child_index = NULL;
+  node->num_children = 0;
+  node->sibling_pos = 0;
   node->left = NULL;
   node->right = NULL;
   node->previous = NULL;
@@ -152,36 +178,182 @@ cct_node_create(cct_addr_t* addr, bool unwound, cct_node_t* parent)
 }
 
 //
-// ******* SPLAY TREE section ********
-// [ Thanks to Mark Krentel ]
+// ******* CHILD SET section ********
 //
 
 //
-// local comparison macros
+// return the link (parent->children, or some sibling's left/right field)
+// that holds the sibling at heap position pos
 //
-// NOTE: argument asymmetry due to
-//     type of key value passed in = cct_addr_t*, BUT
-//     type of key in splay tree   = cct_addr_t
+static cct_node_t**
+cct_sibling_link(cct_node_t* parent, uint32_t pos)
+{
+  cct_node_t** link = &(parent->children);
+  int shift = 31 - __builtin_clz(pos);
+  while (shift-- > 0) {
+    cct_node_t* sib = *link;
+    link = ((pos >> shift) & 1) ? &(sib->right) : &(sib->left);
+  }
+  return link;
+}
+
+static inline uint32_t
+cct_child_index_hash(const cct_addr_t* addr, uint32_t log2_capacity)
+{
+  uint64_t key = (uint64_t) addr->ip_norm.lm_ip
+    ^ ((uint64_t) addr->ip_norm.lm_id << 48);
+  return (uint32_t) ((key * 0x9E3779B97F4A7C15ull) >> (64 - log2_capacity));
+}
+
+static void
+cct_child_index_put(cct_child_index_t* index, cct_node_t* child)
+{
+  uint32_t mask = (1u << index->log2_capacity) - 1;
+  uint32_t i = cct_child_index_hash(&(child->addr), index->log2_capacity);
+  while (index->slots[i] != NULL) i = (i + 1) & mask;
+  index->slots[i] = child;
+}
+
+static cct_node_t*
+cct_child_index_get(const cct_child_index_t* index, cct_addr_t* addr)
+{
+  uint32_t mask = (1u << index->log2_capacity) - 1;
+  uint32_t i = cct_child_index_hash(addr, index->log2_capacity);
+  for (cct_node_t* n; (n = index->slots[i]) != NULL; i = (i + 1) & mask) {
+    if (cct_addr_eq(addr, &(n->addr))) return n;
+  }
+  return NULL;
+}
+
 //
+// remove a child from the index, shifting later entries of its probe
+// sequence back so that no tombstones are needed
+//
+static void
+cct_child_index_remove(cct_child_index_t* index, cct_node_t* child)
+{
+  uint32_t mask = (1u << index->log2_capacity) - 1;
+  uint32_t i = cct_child_index_hash(&(child->addr), index->log2_capacity);
+  while (index->slots[i] != child) {
+    if (index->slots[i] == NULL) return;
+    i = (i + 1) & mask;
+  }
+  index->slots[i] = NULL;
+
+  for (uint32_t j = (i + 1) & mask; index->slots[j] != NULL; j = (j + 1) & mask) {
+    uint32_t home = cct_child_index_hash(&(index->slots[j]->addr), index->log2_capacity);
+    // move slot j into the hole at i unless its home lies cyclically in (i, j]
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      index->slots[i] = index->slots[j];
+      index->slots[j] = NULL;
+      i = j;
+    }
+  }
+}
 
-#define l_lt(a, b) cct_addr_lt(a, &(b))
-#define l_gt(a, b) cct_addr_gt(a, &(b))
+static void
+cct_child_index_fill(cct_child_index_t* index, cct_node_t* sib)
+{
+  if (! sib) return;
+  cct_child_index_put(index, sib);
+  cct_child_index_fill(index, sib->left);
+  cct_child_index_fill(index, sib->right);
+}
+
+//
+// (re)build the child index of a node with the given capacity. The old
+// index, if any, is simply dropped: hpcrun memory is not returned.
+//
+static void
+cct_child_index_rebuild(cct_node_t* node, uint32_t log2_capacity)
+{
+  size_t sz = sizeof(cct_child_index_t) + (sizeof(cct_node_t*) << log2_capacity);
+  cct_child_index_t* index = ENABLED(FREEABLE)
+    ? hpcrun_malloc_freeable(sz) : hpcrun_malloc(sz);
+
+  memset(index, 0, sz);
+  index->log2_capacity = log2_capacity;
+  cct_child_index_fill(index, node->children);
+  node->child_index = index;
+}
 
 static cct_node_t*
-splay(cct_node_t* cct, cct_addr_t* addr)
+cct_child_scan(cct_node_t* sib, cct_addr_t* addr)
 {
-  GENERAL_SPLAY_TREE(cct_node_t, cct, addr, addr, addr, left, right, l_lt, l_gt);
-  return cct;
+  if (! sib) return NULL;
+  if (cct_addr_eq(addr, &(sib->addr))) return sib;
+  cct_node_t* found = cct_child_scan(sib->left, addr);
+  return found ? found : cct_child_scan(sib->right, addr);
 }
 
-#undef l_lt
-#undef l_gt
+//
+// look up addr in the set of a node's children. Does not modify the tree.
+//
+static cct_node_t*
+cct_child_find(cct_node_t* node, cct_addr_t* addr)
+{
+  if (node->child_index) {
+    return cct_child_index_get(node->child_index, addr);
+  }
+  return cct_child_scan(node->children, addr);
+}
+
+//
+// add child (and the subtree below it) as the last of node's children.
+// The address of child is ASSUMED not to be in node's child set already.
+//
+static void
+cct_child_link(cct_node_t* node, cct_node_t* child)
+{
+  uint32_t pos = ++(node->num_children);
+
+  child->parent = node;
+  child->left = NULL;
+  child->right = NULL;
+  child->sibling_pos = pos;
+  *cct_sibling_link(node, pos) = child;
+
+  cct_child_index_t* index = node->child_index;
+  if (index && pos * 2 <= (1u << index->log2_capacity)) {
+    cct_child_index_put(index, child);
+  }
+  else if (index) {
+    cct_child_index_rebuild(node, index->log2_capacity + 1);
+  }
+  else if (pos > CCT_CHILD_INDEX_THRESHOLD) {
+    cct_child_index_rebuild(node, CCT_CHILD_INDEX_MIN_LOG2);
+  }
+}
+
+//
+// remove child from node's child set, moving the last sibling into its
+// position to keep the sibling tree complete
+//
+static void
+cct_child_unlink(cct_node_t* node, cct_node_t* child)
+{
+  cct_node_t** last_link = cct_sibling_link(node, node->num_children--);
+  cct_node_t* last = *last_link;
+  *last_link = NULL;
+
+  if (last != child) {
+    last->left = child->left;
+    last->right = child->right;
+    last->sibling_pos = child->sibling_pos;
+    *cct_sibling_link(node, child->sibling_pos) = last;
+  }
+  if (node->child_index) {
+    cct_child_index_remove(node->child_index, child);
+  }
+  child->left = NULL;
+  child->right = NULL;
+}
 
 //
 // helper for walking functions
 //
 
-// Prepare the given splay tree for a postorder depth-first walk, returning the first node to visit.
+// Prepare the given sibling tree for a postorder depth-first walk, returning the first node to visit.
 //
 // NOTE: Do not use directly, use the higher-level `spack_walk_*` iteration functions instead.
 //
@@ -590,37 +762,13 @@ hpcrun_cct_insert_addr(cct_node_t* node, cct_addr_t* frm, bool unwound)
   if ( ! node)
     return NULL;
 
-  cct_node_t* found    = splay(node->children, frm);
-    //
-    // !! SPECIAL CASE for cct splay !!
-    // !! The splay tree (represented by the root) is the data structure for the set
-    // !! of children of the parent. Consequently, when the splay operation changes the root,
-    // !! the parent's children pointer must point to the NEW root node
-    // !! NOT the old (pre-splay) root node
-    //
-
-  node->children = found;
-
-  if (found && cct_addr_eq(frm, &(found->addr))){
+  cct_node_t* found = cct_child_find(node, frm);
+  if (found) {
     return found;
   }
   //  cct_node_t* new = cct_node_create(frm->as_info, frm->ip_norm, frm->lip, node);
   cct_node_t* new = cct_node_create(frm, unwound, node);
-
-  node->children = new;
-  if (! found){
-    return new;
-  }
-  if (cct_addr_lt(frm, &(found->addr))){
-    new->left = found->left;
-    new->right = found;
-    found->left = NULL;
-  }
-  else { // addr > addr of found
-    new->left = found;
-    new->right = found->right;
-    found->right = NULL;
-  }
+  cct_child_link(node, new);
   return new;
 }
 
@@ -638,20 +786,11 @@ hpcrun_cct_delete_addr(cct_node_t* node, cct_addr_t* frm)
 {
   if(!node) return NULL;
 
-  cct_node_t* found = splay(node->children, frm);
-
-  node->children = found;
-
-  if(!found || !cct_addr_eq(frm, &(found->addr)))
+  cct_node_t* found = cct_child_find(node, frm);
+  if(!found)
     return NULL;
 
-  if(node->children->left == NULL) {
-    node->children = node->children->right;
-    return found;
-  }
-  node->children->left = splay(node->children->left, frm);
-  node->children->left->right = node->children->right;
-  node->children = node->children->left;
+  cct_child_unlink(node, found);
   return found;
 }
 
@@ -704,26 +843,8 @@ hpcrun_cct_terminate_path(cct_node_t* node)
 cct_node_t*
 hpcrun_cct_insert_node(cct_node_t* target, cct_node_t* src)
 {
-  src->parent = target;
-
-  cct_node_t* found = splay(target->children, &(src->addr));
-  target->children = src;
-  if (! found) {
-    return src;
-  }
-
   // NOTE: Assume equality cannot happen
-
-  if (cct_addr_lt(&(src->addr), &(found->addr))){
-    src->left = found->left;
-    src->right = found;
-    found->left = NULL;
-  }
-  else { // addr > addr of found
-    src->left = found;
-    src->right = found->right;
-    found->right = NULL;
-  }
+  cct_child_link(target, src);
   return src;
 }
 
@@ -769,7 +890,7 @@ void hpcrun_cct_walk_child_1st_w_level(cct_node_t* cct, cct_op_t op, cct_op_arg_
   cct_node_t* cur = cct;
   do {
     // At this point, cur has not been walked yet. If it has children, init a walk through its
-    // children splay tree and start iterating through them first.
+    // children sibling tree and start iterating through them first.
     if (cur->children != NULL) {
       cur = splay_walk_init(cur->children);
       ++level;
@@ -814,7 +935,7 @@ void hpcrun_cct_walk_node_1st_w_level(cct_node_t* cct, cct_op_t op, cct_op_arg_t
     op(cur, arg, level);
 
     // At this point, cur has not been walked yet. If it has children, init a walk through its
-    // children splay tree and traverse the first child before continuing.
+    // children sibling tree and traverse the first child before continuing.
     if(cur->children != NULL) {
       cur = splay_walk_init(cur->children);
       level++;
@@ -843,7 +964,7 @@ void hpcrun_cct_walk_node_1st_w_level(cct_node_t* cct, cct_op_t op, cct_op_arg_t
 
 // Iterate over the children of a cct node
 void hpcrun_walk_children(cct_node_t* cct, cct_op_t fn, cct_op_arg_t arg) {
-  // A cct node's children are stored in a splay tree, just iterate over them.
+  // A cct node's children are stored in a sibling tree, just iterate over them.
   for (cct_node_t* node = splay_walk_init(cct); node != NULL; node = splay_walk_next(node)) {
     fn(node, arg, 0);
   }
@@ -1008,21 +1129,7 @@ hpcrun_cct_find_addr(cct_node_t* cct, cct_addr_t* addr)
   if ( ! cct)
     return NULL;
 
-  cct_node_t* found    = splay(cct->children, addr);
-    //
-    // !! SPECIAL CASE for cct splay !!
-    // !! The splay tree (represented by the root) is the data structure for the set
-    // !! of children of the parent. Consequently, when the splay operation changes the root,
-    // !! the parent's children pointer must point to the NEW root node
-    // !! NOT the old (pre-splay) root node
-    //
-
-  cct->children = found;
-
-  if (found && cct_addr_eq(addr, &(found->addr))){
-    return found;
-  }
-  return NULL;
+  return cct_child_find(cct, addr);
 }
 
 //
@@ -1103,10 +1210,14 @@ hpcrun_cct_merge(cct_node_t* cct_a, cct_node_t* cct_b,
   if (! cct_a->children){
       // FIXME: vi3 bug because cct_b->children has the same addr as cct_a
     cct_a->children = cct_b->children;
-    // whole cct->children splay tree is used as kids of cct_a,
+    cct_a->child_index = cct_b->child_index;
+    cct_a->num_children = cct_b->num_children;
+    // whole cct->children sibling tree is used as kids of cct_a,
     // enough to disconnect children from cct_b (that's why hpcrun_walk_children is called)
     hpcrun_walk_children(cct_b, attach_to_a, (cct_op_arg_t) cct_a);
     cct_b->children = NULL;
+    cct_b->child_index = NULL;
+    cct_b->num_children = 0;
   }
   else {
     mjarg_t local = (mjarg_t) {.targ = cct_a, .fn = merge, .arg = arg};
@@ -1150,8 +1261,7 @@ merge_or_join(cct_node_t* n, cct_op_arg_t a, size_t l)
 }
 
 //
-// Differs from the main accessor by setting the splay cache as a side
-// effect
+// Same as the main accessor, kept as the lookup half of the merge helpers
 //
 static cct_node_t*
 cct_child_find_cache(cct_node_t* cct, cct_addr_t* addr)
@@ -1161,7 +1271,7 @@ cct_child_find_cache(cct_node_t* cct, cct_addr_t* addr)
 
 //
 // This procedure assumes that cct_child_find_cache has been
-// called, and that no other intervening splay operations have been called
+// called, and that src's address is not among target's children
 //
 static void
 cct_disjoint_union_cached(cct_node_t* target, cct_node_t* src)
@@ -1172,33 +1282,7 @@ cct_disjoint_union_cached(cct_node_t* target, cct_node_t* src)
     return;
   }
 
-  cct_addr_t* addr = hpcrun_cct_addr(src);
-  cct_node_t* found    = splay(target->children, addr);  // FIXME: vi3: is it possible that splay returns something which address is not equal to addre
-    //
-    // !! SPECIAL CASE for cct splay !!
-    // !! The splay tree (represented by the root) is the data structure for the set
-    // !! of children of the parent. Consequently, when the splay operation changes the root,
-    // !! the parent's children pointer must point to the NEW root node
-    // !! NOT the old (pre-splay) root node
-    //
-  if (!found) {
-    target->children = src;
-    src->parent = target;
-    return;
-  }
-
-  if (cct_addr_lt(addr, &(found->addr))){
-    src->left = found->left;
-    src->right = found;
-    found->left = NULL;
-  }
-  else { // addr > addr of found
-    src->left = found;
-    src->right = found->right;
-    found->right = NULL;
-  }
-  target->children = src;
-  src->parent = target;
+  cct_child_link(target, src);
 }
 
 
@@ -1206,6 +1290,8 @@ cct_disjoint_union_cached(cct_node_t* target, cct_node_t* src)
 void
 cct_remove_my_subtree(cct_node_t* cct){
   cct->children = NULL;
+  cct->child_index = NULL;
+  cct->num_children = 0;
 //  printf("CHILDREN: %p\tLEFT: %p\tRIGHT: %p\n", cct->children, cct->left, cct->right);
 }
 
@@ -1279,6 +1365,11 @@ hpcrun_cct_set_children(cct_node_t* cct, cct_node_t* children)
   if(!cct)
     return;
   cct->children = children;
+  cct->child_index = NULL;
+  cct->num_children = children ? 1 : 0;
+  if(children) {
+    children->sibling_pos = 1;
+  }
 }
 
 void
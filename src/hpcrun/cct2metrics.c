@@ -17,20 +17,27 @@
 #include "cct/cct.h"
 #include "cct2metrics.h"
 #include "thread_data.h"
-#include "../common/lean/splay-macros.h"
 
 
 //
-// ***** The splay tree node *****
+// ***** The hash table *****
 //
-struct cct2metrics_t {
+// The map is an open-addressing hash table (linear probing) keyed on the
+// cct node. The header is allocated once per thread, so a map pointer stays
+// valid while the slot array behind it grows. Entries are never removed;
+// moving the metrics off a node just clears its kind_metrics.
+//
+#define CCT2METRICS_MIN_LOG2 8
+
+typedef struct cct2metrics_entry_t {
   cct_node_id_t node;
   metric_data_list_t* kind_metrics;
-  //
-  // left and right pointers for splay tree of siblings
-  //
-  struct cct2metrics_t* right;
-  struct cct2metrics_t* left;
+} cct2metrics_entry_t;
+
+struct cct2metrics_t {
+  uint32_t log2_capacity;
+  uint32_t count;
+  cct2metrics_entry_t* slots;
 };
 
 
@@ -62,52 +69,93 @@ hpcrun_cct2metrics_init(cct2metrics_t** map)
 }
 //
 // ******* Internal operations: **********
-// mapping implemented as a splay tree
+// mapping implemented as a hash table
 //
 
-void
-help_splay_tree_dump(cct2metrics_t* tree, int indent)
+static inline uint32_t
+cct2metrics_hash(cct_node_id_t node, uint32_t log2_capacity)
 {
-  if (! tree) return;
-
-  help_splay_tree_dump(tree->right, indent+2);
-
-  char buf[300];
-  for (int i=0; i<indent; i++) buf[i] = ' ';
-  buf[indent] = '\0';
-  snprintf(buf+indent, sizeof(buf)-(indent+1), "%p", tree->node);
-  TMSG(CCT2METRICS, "%s", buf);
-
-  help_splay_tree_dump(tree->left, indent+2);
+  uint64_t key = (uint64_t) (uintptr_t) node;
+  return (uint32_t) ((key * 0x9E3779B97F4A7C15ull) >> (64 - log2_capacity));
 }
 
-void
-splay_tree_dump(cct2metrics_t* map)
+static cct2metrics_entry_t*
+cct2metrics_slots_new(uint32_t log2_capacity)
 {
-  TMSG(CCT2METRICS, "Splay tree %p appears below", map);
-  help_splay_tree_dump(map, 0);
+  size_t sz = sizeof(cct2metrics_entry_t) << log2_capacity;
+  cct2metrics_entry_t* slots = hpcrun_malloc(sz);
+  memset(slots, 0, sz);
+  return slots;
 }
 
+//
+// return the slot holding node, or the empty slot where it belongs
+//
+static cct2metrics_entry_t*
+cct2metrics_probe(cct2metrics_t* map, cct_node_id_t node)
+{
+  uint32_t mask = (1u << map->log2_capacity) - 1;
+  uint32_t i = cct2metrics_hash(node, map->log2_capacity);
+  while (map->slots[i].node != NULL && map->slots[i].node != node) {
+    i = (i + 1) & mask;
+  }
+  return &(map->slots[i]);
+}
 
-static cct2metrics_t*
-splay(cct2metrics_t* map, cct_node_id_t node)
+//
+// double the slot array. The old array is hpcrun memory and is simply
+// dropped; the geometric growth bounds the waste by the final table size.
+//
+static void
+cct2metrics_grow(cct2metrics_t* map)
 {
-  TMSG(CCT2METRICS, "splay map = %p, node = %p", map, node);
-  REGULAR_SPLAY_TREE(cct2metrics_t, map, node, node, left, right);
-  TMSG(CCT2METRICS, "new map = %p, top node = %p", map, map->node);
-  return map;
+  cct2metrics_entry_t* old = map->slots;
+  uint32_t old_capacity = 1u << map->log2_capacity;
+
+  map->log2_capacity++;
+  map->slots = cct2metrics_slots_new(map->log2_capacity);
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old[i].node != NULL) {
+      *cct2metrics_probe(map, old[i].node) = old[i];
+    }
+  }
+  TMSG(CCT2METRICS, "map %p grown to %u slots", map, 1u << map->log2_capacity);
 }
 
 static cct2metrics_t*
-cct2metrics_new(cct_node_id_t node, metric_data_list_t* kind_metrics)
+cct2metrics_new(void)
 {
   cct2metrics_t* rv = hpcrun_malloc(sizeof(cct2metrics_t));
-  rv->node = node;
-  rv->kind_metrics = kind_metrics;
-  rv->left = rv->right = NULL;
-  TMSG(CCT2METRICS, "Node: %p, Metrics: %p", rv->node, rv->kind_metrics);
+  rv->log2_capacity = CCT2METRICS_MIN_LOG2;
+  rv->count = 0;
+  rv->slots = cct2metrics_slots_new(rv->log2_capacity);
+  TMSG(CCT2METRICS, "New map: %p", rv);
   return rv;
 }
+
+static void
+cct2metrics_put(cct2metrics_t* map, cct_node_id_t node, metric_data_list_t* kind_metrics)
+{
+  cct2metrics_entry_t* entry = cct2metrics_probe(map, node);
+  if (entry->node == node) {
+    if (entry->kind_metrics != NULL) {
+      EMSG("CCT2METRICS map assoc invariant violated");
+      return;
+    }
+    entry->kind_metrics = kind_metrics;
+    return;
+  }
+
+  entry->node = node;
+  entry->kind_metrics = kind_metrics;
+  TMSG(CCT2METRICS, "Node: %p, Metrics: %p", node, kind_metrics);
+
+  // keep the load factor at or below 1/2
+  if (++(map->count) * 2 > (1u << map->log2_capacity)) {
+    cct2metrics_grow(map);
+  }
+}
+
 // ******** Interface operations **********
 //
 // for a given cct node, return the metric set
@@ -141,19 +189,10 @@ hpcrun_get_metric_data_list_specific(cct2metrics_t **map, cct_node_id_t cct_id)
   TMSG(CCT2METRICS, "GET_METRIC_SET for %p, using map %p", cct_id, current_map);
   if (! current_map) return NULL;
 
-  current_map = splay(current_map, cct_id);
-
-  if (map)
-    *map = current_map;
-  else
-    THREAD_LOCAL_MAP() = current_map;
-
-
-  TMSG(CCT2METRICS, " -- After Splay map = %p", cct_id, current_map);
-
-  if (current_map->node == cct_id) {
-    TMSG(CCT2METRICS, " -- found %p, returning metrics", current_map->node);
-    return current_map->kind_metrics;
+  cct2metrics_entry_t* entry = cct2metrics_probe(current_map, cct_id);
+  if (entry->node == cct_id) {
+    TMSG(CCT2METRICS, " -- found %p, returning metrics", cct_id);
+    return entry->kind_metrics;
   }
   TMSG(CCT2METRICS, " -- cct_id NOT, found. Return NULL");
   return NULL;
@@ -176,17 +215,12 @@ hpcrun_move_metric_data_list_specific(cct2metrics_t **map, cct_node_id_t dest, c
   TMSG(CCT2METRICS, "GET_METRIC_SET for %p, using map %p", source, current_map);
   if (! current_map) return NULL;
 
-  if (map)
-    *map = current_map;
-  else
-    THREAD_LOCAL_MAP() = current_map;
-  TMSG(CCT2METRICS, " -- After Splay map = %p", source, current_map);
-
-  if (current_map->node == source) {
-    TMSG(CCT2METRICS, " -- found %p, returning metrics", current_map->node);
-    metric_data_list_t *metric_data_list = current_map->kind_metrics;
-    current_map->kind_metrics = NULL;
-    cct2metrics_assoc(dest, metric_data_list);
+  cct2metrics_entry_t* entry = cct2metrics_probe(current_map, source);
+  if (entry->node == source && entry->kind_metrics != NULL) {
+    TMSG(CCT2METRICS, " -- found %p, returning metrics", source);
+    metric_data_list_t *metric_data_list = entry->kind_metrics;
+    entry->kind_metrics = NULL;
+    cct2metrics_put(current_map, dest, metric_data_list);
     return metric_data_list;
   }
   TMSG(CCT2METRICS, " -- cct_id NOT, found. Return NULL");
@@ -208,35 +242,10 @@ cct2metrics_assoc(cct_node_id_t node, metric_data_list_t* kind_metrics)
   cct2metrics_t* map = THREAD_LOCAL_MAP();
   TMSG(CCT2METRICS, "CCT2METRICS_ASSOC for %p, using map %p", node, map);
   if (! map) {
-    map = cct2metrics_new(node, kind_metrics);
-    TMSG(CCT2METRICS, " -- new map created: %p", map);
-  }
-  else {
-    cct2metrics_t* new = cct2metrics_new(node, kind_metrics);
-    map = splay(map, node);
-    TMSG(CCT2METRICS, " -- map after splay = %p,"
-         " node sought = %p, mapnode = %p", map, node, map->node);
-    if (map->node == node) {
-      EMSG("CCT2METRICS map assoc invariant violated");
-    }
-    else {
-      if (map->node < node) {
-        TMSG(CCT2METRICS, " -- less-than insert %p < %p", map->node, node);
-        new->left = map;
-        new->right = map->right;
-        map->right = NULL;
-      }
-      else {
-        TMSG(CCT2METRICS, " -- greater-than insert %p > %p", map->node, node);
-        new->left = map->left;
-        new->right = map;
-        map->left = NULL;
-      }
-      map = new;
-      TMSG(CCT2METRICS, " -- new map after insertion %p.(%p, %p)", map->node, map->left, map->right);
-    }
+    map = cct2metrics_new();
+    THREAD_LOCAL_MAP() = map;
   }
-  THREAD_LOCAL_MAP() = map;
-  TMSG(CCT2METRICS, "METRICS_ASSOC final, THREAD_LOCAL_MAP = %p", THREAD_LOCAL_MAP());
-  if (ENABLED(CCT2METRICS)) splay_tree_dump(THREAD_LOCAL_MAP());
+  cct2metrics_put(map, node, kind_metrics);
+  TMSG(CCT2METRICS, "METRICS_ASSOC final, THREAD_LOCAL_MAP = %p, %u entries",
+       map, map->count);
 }
@@ -45,8 +45,13 @@ typedef struct core_profile_trace_data_t {
   // IO support
   // ----------------------------------------
   FILE* hpcrun_file;
+  // in-memory profile when aggregating into a container, see write_data.c
+  char* hpcrun_image;
+  size_t hpcrun_image_size;
   void* trace_buffer;
   hpcio_outbuf_t *trace_outbuf;
+  // current block of a packed trace, NULL if the trace is not packed
+  struct hpctrace_fmt_packed_t *trace_packed;
 
 } core_profile_trace_data_t;
 
@@ -12,6 +12,8 @@
 // Names for option environment variables
 const char* HPCRUN_OUT_PATH        = "HPCRUN_OUT_PATH";
 const char* HPCRUN_TRACE           = "HPCRUN_TRACE";
+const char* HPCRUN_TRACE_PACKED    = "HPCRUN_TRACE_PACKED";
+const char* HPCRUN_TRACE_ASYNC     = "HPCRUN_TRACE_ASYNC";
 
 const char* PAPI_EVENT_LIST        = "PAPI_EVENT_LIST";
 
@@ -21,6 +23,10 @@ const char* HPCRUN_LOW_MEMSIZE     = "HPCRUN_LOW_MEMSIZE";
 
 const char* HPCRUN_ABORT_LIBC      = "HPCRUN_ABORT_LIBC";
 
+const char* HPCRUN_FNBOUNDS_CACHE  = "HPCRUN_FNBOUNDS_CACHE";
+
+const char* HPCRUN_AGGREGATE_PROFILES = "HPCRUN_AGGREGATE_PROFILES";
+
 //
 // Returns: true if 'name' is in the environment and set to a true
 // (non-zero) value.
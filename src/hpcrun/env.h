@@ -13,6 +13,8 @@
 extern const char* HPCRUN_OUT_PATH;
 
 extern const char* HPCRUN_TRACE;
+extern const char* HPCRUN_TRACE_PACKED;
+extern const char* HPCRUN_TRACE_ASYNC;
 
 extern const char* HPCRUN_EVENT_LIST;
 extern const char* HPCRUN_MEMSIZE;
@@ -20,6 +22,10 @@ extern const char* HPCRUN_LOW_MEMSIZE;
 
 extern const char* HPCRUN_ABORT_LIBC;
 
+extern const char* HPCRUN_FNBOUNDS_CACHE;
+
+extern const char* HPCRUN_AGGREGATE_PROFILES;
+
 bool hpcrun_get_env_bool(const char *);
 
 bool hpcrun_get_env_int(const char *, int *);
@@ -90,6 +90,7 @@
 #include "loadmap.h"
 #include "sample_prob.h"
 
+#include "../common/lean/hpcrun-fmt.h"
 #include "../common/lean/spinlock.h"
 #include "../common/lean/vdso.h"
 #include "../common/lean/crypto-hash.h" // Calculate a hash for vdso
@@ -103,6 +104,12 @@
 // directory/progname-rank-thread-hostid-pid-gen.suffix
 #define FILENAME_TEMPLATE  "%s/%s-%06u-%03d-" HOSTID_FORMAT "-%u-%d.%s"
 
+// directory/progname-rank-hostid-pid-gen.suffix, for per-process files
+#define CONTAINER_TEMPLATE  "%s/%s-%06u-" HOSTID_FORMAT "-%u-%d.%s"
+
+// Pseudo-thread for files shared by all threads of the process
+#define FILES_PROCESS  (-1)
+
 #define FILES_RANDOM_GEN  4
 #define FILES_MAX_GEN     11
 
@@ -143,6 +150,11 @@ static int log_done = 0;
 static int log_rename_done = 0;
 static int log_rename_ret = 0;
 
+// The profile container of this process, if profiles are aggregated, and
+// the offset where the next section will be written.
+static int container_fd = -1;
+static uint64_t container_end = 0;
+
 static int vdso_written = 0; // for coordination across fork
 
 char vdso_hash_str[CRYPTO_HASH_STRING_LENGTH];
@@ -168,6 +180,12 @@ hpcrun_files_init(void)
     log_done = 0;
     log_rename_done = 0;
     log_rename_ret = 0;
+    // the container belongs to the parent
+    if (container_fd >= 0) {
+      close(container_fd);
+    }
+    container_fd = -1;
+    container_end = 0;
   }
 }
 
@@ -230,8 +248,13 @@ hpcrun_open_file(int rank, int thread, const char *suffix, int flags)
   id = (flags & FILES_EARLY) ? &earlyid : &lateid;
   for (;;) {
     errno = 0;
-    ret = snprintf(name, PATH_MAX, FILENAME_TEMPLATE, output_directory,
-                   executable_name, rank, thread, id->host, mypid, id->gen, suffix);
+    if (thread == FILES_PROCESS) {
+      ret = snprintf(name, PATH_MAX, CONTAINER_TEMPLATE, output_directory,
+                     executable_name, rank, id->host, mypid, id->gen, suffix);
+    } else {
+      ret = snprintf(name, PATH_MAX, FILENAME_TEMPLATE, output_directory,
+                     executable_name, rank, thread, id->host, mypid, id->gen, suffix);
+    }
     if (ret > PATH_MAX) {
       fd = -1;
       errno = ENAMETOOLONG;
@@ -470,6 +493,83 @@ hpcrun_open_profile_file(int rank, int thread)
 }
 
 
+// Write all of buf at offset off of fd.
+// Returns: 0 on success, else -1 on failure.
+static int
+hpcrun_files_pwrite(int fd, const char *buf, size_t len, off_t off)
+{
+  while (len > 0) {
+    ssize_t ret = pwrite(fd, buf, len, off);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    buf += ret;
+    len -= ret;
+    off += ret;
+  }
+  return 0;
+}
+
+
+// Append the complete profile image of one thread as a new section of
+// the process's profile container, creating the container on first use.
+// Space is reserved under the files lock and written outside of it, the
+// section header last so that readers never see a partial image.
+//
+// Returns: 0 on success, else -1 on failure.
+int
+hpcrun_append_profile_section(int rank, int thread, bool traced,
+                              const char *image, size_t size)
+{
+  char trace_path[PATH_MAX + 1];
+  const char *trace_name = "";
+  int fd, ret;
+  uint64_t off;
+
+  spinlock_lock(&files_lock);
+  hpcrun_files_init();
+  hpcrun_rename_log_file_early(rank);
+  if (container_fd < 0) {
+    container_fd = hpcrun_open_file(rank, FILES_PROCESS, HPCRUN_ProfileFnmSfx, FILES_LATE);
+    container_end = HPCRUN_CONTAINER_MagicLen;
+    if (hpcrun_files_pwrite(container_fd, HPCRUN_CONTAINER_Magic,
+                            HPCRUN_CONTAINER_MagicLen, 0) != 0) {
+      EMSG("hpctoolkit: unable to write profile container header: %s", strerror(errno));
+    }
+  }
+
+  // The thread's trace file is renamed to the late id after this
+  if (traced) {
+    ret = snprintf(trace_path, PATH_MAX, FILENAME_TEMPLATE, output_directory,
+                   executable_name, rank, thread, lateid.host, mypid, lateid.gen,
+                   HPCRUN_TraceFnmSfx);
+    if (ret <= PATH_MAX) {
+      trace_name = strrchr(trace_path, '/') + 1;
+    }
+  }
+
+  size_t hdr_size = hpcrun_fmt_container_section_hdr_size(trace_name);
+  fd = container_fd;
+  off = container_end;
+  container_end += hdr_size + size;
+  spinlock_unlock(&files_lock);
+
+  char hdr[hdr_size];
+  hpcrun_fmt_container_section_hdr_swrite(size, trace_name, hdr);
+  ret = hpcrun_files_pwrite(fd, image, size, off + hdr_size);
+  if (ret == 0) {
+    ret = hpcrun_files_pwrite(fd, hdr, hdr_size, off);
+  }
+  if (ret != 0) {
+    EMSG("hpctoolkit: unable to write profile of thread %d to container: %s",
+         thread, strerror(errno));
+  }
+
+  return ret;
+}
+
+
 // Note: we use the log file as the lock for the file names, so we
 // need to rename the log file as the first late action.  Since this
 // is out of sequence, we save the return value and return it when the
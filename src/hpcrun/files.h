@@ -7,6 +7,9 @@
 #ifndef files_h
 #define files_h
 
+#include <stdbool.h>
+#include <stddef.h>
+
 
 //*****************************************************************************
 // forward declarations
@@ -23,6 +26,8 @@ const char *hpcrun_files_output_directory();
 int hpcrun_open_log_file(void);
 int hpcrun_open_trace_file(int thread);
 int hpcrun_open_profile_file(int rank, int thread);
+int hpcrun_append_profile_section(int rank, int thread, bool traced,
+                                  const char *image, size_t size);
 int hpcrun_rename_log_file(int rank);
 int hpcrun_rename_trace_file(int rank, int thread);
 
@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "fnbounds_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+class FnboundsCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char tmpl[] = "/tmp/fnbounds-cache-test.XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    root = tmpl;
+    dir = root + "/cache";
+  }
+  void TearDown() override {
+    std::system(("rm -rf '" + root + "'").c_str());
+  }
+
+  std::string root;
+  std::string dir;
+};
+
+}  // namespace
+
+TEST_F(FnboundsCacheTest, Miss) {
+  FnboundsResponse resp = {};
+  EXPECT_FALSE(fnbounds_cache_load(dir.c_str(), "0123abcd", &resp));
+  EXPECT_EQ(resp.entries, nullptr);
+}
+
+TEST_F(FnboundsCacheTest, RoundTrip) {
+  void* table[] = {(void*)0x1000, (void*)0x1040, (void*)0x10c0, (void*)0x2000};
+  FnboundsResponse in = {};
+  in.entries = table;
+  in.num_entries = 4;
+  in.max_entries = 4;
+  in.is_relocatable = true;
+  in.reference_offset = 0x400;
+  ASSERT_TRUE(fnbounds_cache_store(dir.c_str(), "0123abcd", &in));
+
+  FnboundsResponse out = {};
+  ASSERT_TRUE(fnbounds_cache_load(dir.c_str(), "0123abcd", &out));
+  ASSERT_EQ(out.num_entries, 4u);
+  EXPECT_EQ(out.max_entries, 0u);
+  EXPECT_TRUE(out.is_relocatable);
+  EXPECT_EQ(out.reference_offset, 0x400u);
+  for (size_t i = 0; i < 4; i++) EXPECT_EQ(out.entries[i], table[i]);
+
+  // Different contents never share an entry
+  EXPECT_FALSE(fnbounds_cache_load(dir.c_str(), "4567cdef", &out));
+
+  // No temporary files are left behind
+  EXPECT_NE(access((dir + "/0123abcd.fnb").c_str(), R_OK), -1);
+  std::string tmp = dir + "/0123abcd.fnb." + std::to_string(getpid()) + ".tmp";
+  EXPECT_EQ(access(tmp.c_str(), F_OK), -1);
+}
+
+TEST_F(FnboundsCacheTest, Corrupt) {
+  void* table[] = {(void*)0x1000, (void*)0x2000};
+  FnboundsResponse in = {};
+  in.entries = table;
+  in.num_entries = 2;
+  ASSERT_TRUE(fnbounds_cache_store(dir.c_str(), "0123abcd", &in));
+
+  // Truncate the table, the entry must be rejected
+  std::string path = dir + "/0123abcd.fnb";
+  ASSERT_EQ(truncate(path.c_str(), 40), 0);
+  FnboundsResponse out = {};
+  EXPECT_FALSE(fnbounds_cache_load(dir.c_str(), "0123abcd", &out));
+
+  // Garbage in place of the header is also rejected
+  FILE* f = std::fopen(path.c_str(), "wb");
+  ASSERT_NE(f, nullptr);
+  std::fputs("this is not a function bounds table, not at all", f);
+  std::fclose(f);
+  EXPECT_FALSE(fnbounds_cache_load(dir.c_str(), "0123abcd", &out));
+}
@@ -0,0 +1,199 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+//=====================================================================
+// File: fnbounds_cache.c
+//
+//     on-disk cache of function bounds tables. each cache file holds a
+//     small header followed by the sorted table of function addresses,
+//     in the native layout so it can be mapped and used directly.
+//
+//=====================================================================
+
+
+//*********************************************************************
+// system includes
+//*********************************************************************
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+//*********************************************************************
+// local includes
+//*********************************************************************
+
+#include "fnbounds_cache.h"
+
+
+//*********************************************************************
+// local types
+//*********************************************************************
+
+// bump the version whenever the layout or the contents of the table
+// (i.e. the way fnb_get_funclist computes it) changes
+#define FNBOUNDS_CACHE_MAGIC "HPCFNB01"
+
+typedef struct fnbounds_cache_header_t {
+  char magic[8];
+  uint64_t entry_size;
+  uint64_t num_entries;
+  uint64_t reference_offset;
+  uint64_t is_relocatable;
+} fnbounds_cache_header_t;
+
+
+//*********************************************************************
+// private operations
+//*********************************************************************
+
+static bool
+cache_path(char *path, const char *dir, const char *hash, const char *suffix)
+{
+  int len = snprintf(path, PATH_MAX, "%s/%s.fnb%s", dir, hash, suffix);
+  return len > 0 && len < PATH_MAX;
+}
+
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+//*********************************************************************
+// interface operations
+//*********************************************************************
+
+bool
+fnbounds_cache_load(const char *dir, const char *hash, FnboundsResponse *resp)
+{
+  char path[PATH_MAX];
+  if (!cache_path(path, dir, hash, "")) return false;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(fnbounds_cache_header_t)) {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  const fnbounds_cache_header_t *hdr = data;
+  if (memcmp(hdr->magic, FNBOUNDS_CACHE_MAGIC, sizeof hdr->magic) != 0
+      || hdr->entry_size != sizeof(void*)
+      || hdr->num_entries > (st.st_size - sizeof *hdr) / sizeof(void*)
+      || st.st_size != (off_t) (sizeof *hdr + hdr->num_entries * sizeof(void*))) {
+    munmap(data, st.st_size);
+    return false;
+  }
+
+  resp->entries = (void**) (hdr + 1);
+  resp->num_entries = hdr->num_entries;
+  resp->max_entries = 0;
+  resp->is_relocatable = hdr->is_relocatable != 0;
+  resp->reference_offset = hdr->reference_offset;
+  return true;
+}
+
+
+bool
+fnbounds_cache_store(const char *dir, const char *hash,
+                     const FnboundsResponse *resp)
+{
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX];
+  char suffix[32];
+  snprintf(suffix, sizeof suffix, ".%ld.tmp", (long) getpid());
+  if (!cache_path(path, dir, hash, "")
+      || !cache_path(tmp_path, dir, hash, suffix)) {
+    return false;
+  }
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+
+  fnbounds_cache_header_t hdr;
+  memset(&hdr, 0, sizeof hdr);
+  memcpy(hdr.magic, FNBOUNDS_CACHE_MAGIC, sizeof hdr.magic);
+  hdr.entry_size = sizeof(void*);
+  hdr.num_entries = resp->num_entries;
+  hdr.reference_offset = resp->reference_offset;
+  hdr.is_relocatable = resp->is_relocatable;
+
+  bool ok = write_all(fd, &hdr, sizeof hdr)
+    && write_all(fd, resp->entries, resp->num_entries * sizeof(void*));
+  ok = (close(fd) == 0) && ok;
+
+  // if another process got there first, its table is just as good
+  if (ok) ok = (rename(tmp_path, path) == 0);
+  if (!ok) unlink(tmp_path);
+  return ok;
+}
+
+
+bool
+fnbounds_cache_stat_key(char *key, size_t len, const struct stat *st)
+{
+  int n = snprintf(key, len, "st-%lx-%lx-%lx-%lx.%09ld",
+                   (unsigned long) st->st_dev, (unsigned long) st->st_ino,
+                   (unsigned long) st->st_size,
+                   (unsigned long) st->st_mtim.tv_sec, (long) st->st_mtim.tv_nsec);
+  return n > 0 && (size_t) n < len;
+}
+
+
+bool
+fnbounds_cache_alias(const char *dir, const char *hash, const char *key)
+{
+  char target[PATH_MAX];
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX];
+  char suffix[32];
+  snprintf(suffix, sizeof suffix, ".%ld.tmp", (long) getpid());
+  int len = snprintf(target, sizeof target, "%s.fnb", hash);
+  if (len <= 0 || len >= (int) sizeof target
+      || !cache_path(path, dir, key, "")
+      || !cache_path(tmp_path, dir, key, suffix)) {
+    return false;
+  }
+
+  // the link is relative, so the cache directory can be moved
+  if (symlink(target, tmp_path) != 0) return false;
+  if (rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+//=====================================================================
+// File: fnbounds_cache.h
+//
+//     on-disk cache of function bounds tables, keyed by a hash of the
+//     contents of the binary they were computed from. processes that
+//     load the same binary can share a single scan of its symbols.
+//
+//=====================================================================
+
+#ifndef _FNBOUNDS_FNBOUNDS_CACHE_H_
+#define _FNBOUNDS_FNBOUNDS_CACHE_H_
+
+#include "fnbounds.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//---------------------------------------------------------------------
+// function fnbounds_cache_load:
+//
+//     look up the table for the binary with content hash 'hash' in the
+//     cache directory 'dir'. on a hit, fill 'resp' with a table mapped
+//     read-only from the cache file and return true. the mapping is
+//     never released, and resp->max_entries is set to 0 to mark that
+//     the table cannot be grown.
+//---------------------------------------------------------------------
+bool
+fnbounds_cache_load(const char *dir, const char *hash, FnboundsResponse *resp);
+
+//---------------------------------------------------------------------
+// function fnbounds_cache_store:
+//
+//     record the (sorted) table in 'resp' for the binary with content
+//     hash 'hash' in the cache directory 'dir', creating it if needed.
+//     the table is written to a temporary file and renamed into place,
+//     so concurrent readers only ever see complete tables.
+//
+//     return true on success
+//---------------------------------------------------------------------
+bool
+fnbounds_cache_store(const char *dir, const char *hash,
+                     const FnboundsResponse *resp);
+
+//---------------------------------------------------------------------
+// function fnbounds_cache_stat_key:
+//
+//     format a key identifying the binary by its (device, inode, size,
+//     modification time) into 'key', to find its table without hashing
+//     its contents. returns false if 'key' is too small.
+//---------------------------------------------------------------------
+bool
+fnbounds_cache_stat_key(char *key, size_t len, const struct stat *st);
+
+//---------------------------------------------------------------------
+// function fnbounds_cache_alias:
+//
+//     make the table for content hash 'hash' in the cache directory
+//     'dir' also available under 'key', so fnbounds_cache_load(dir,
+//     key, ...) finds it. the alias is a symbolic link, created under
+//     a temporary name and renamed into place.
+//
+//     return true on success
+//---------------------------------------------------------------------
+bool
+fnbounds_cache_alias(const char *dir, const char *hash, const char *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _FNBOUNDS_FNBOUNDS_CACHE_H_
@@ -36,6 +36,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/param.h> // for PATH_MAX
+#include <sys/stat.h>  // stat
 #include <sys/types.h>
 #include <unistd.h>    // getpid
 
@@ -52,10 +53,12 @@
 
 #include "fnbounds_interface.h"
 #include "fnbounds.h"
+#include "fnbounds_cache.h"
 
 #include "../main.h"
 #include "../hpcrun_stats.h"
 #include "../disabled.h"
+#include "../env.h"
 #include "../files.h"
 #include "../loadmap.h"
 #include "../epoch.h"
@@ -68,6 +71,7 @@
 #include "../../common/lean/spinlock.h"
 #include "../../common/lean/vdso.h"
 #include "../../common/lean/crypto-hash.h"
+#include "../../common/lean/elf-hash.h"
 
 
 
@@ -232,6 +236,67 @@ fnbounds_fetch_executable_table(void)
 // is already locked (mostly).
 //*********************************************************************
 
+// fetch the function list for a binary, from the fnbounds cache if one
+// is configured and it already holds the table for this binary's
+// contents. otherwise scan the binary and populate the cache.
+static FnboundsResponse
+fnbounds_get_funclist(const char* pathname)
+{
+  const char* cache_dir = getenv(HPCRUN_FNBOUNDS_CACHE);
+
+  // virtual files like [vdso] have no contents on disk to hash
+  if (cache_dir == NULL || cache_dir[0] == '\0' || pathname[0] == '[') {
+    return fnb_get_funclist(pathname);
+  }
+
+  // hashing reads the whole binary, so first look for the table under
+  // the binary's identity on disk, which only costs a stat
+  FnboundsResponse fnbres;
+  struct stat st;
+  char key[128];
+  bool have_key = stat(pathname, &st) == 0
+    && fnbounds_cache_stat_key(key, sizeof key, &st);
+  if (have_key && fnbounds_cache_load(cache_dir, key, &fnbres)) {
+    TMSG(FNBOUNDS, "cache hit for %s (%s)", pathname, key);
+    return fnbres;
+  }
+
+  char* hash = elf_hash(pathname);
+  if (hash == NULL) {
+    return fnb_get_funclist(pathname);
+  }
+
+  bool cached = fnbounds_cache_load(cache_dir, hash, &fnbres);
+  if (cached) {
+    TMSG(FNBOUNDS, "cache hit for %s (%s)", pathname, hash);
+  } else {
+    fnbres = fnb_get_funclist(pathname);
+    cached = fnbres.entries != NULL
+      && fnbounds_cache_store(cache_dir, hash, &fnbres);
+    if (fnbres.entries != NULL && !cached) {
+      TMSG(FNBOUNDS, "unable to cache function bounds for %s in %s: %s",
+           pathname, cache_dir, strerror(errno));
+    }
+  }
+
+  // the binary may have changed between the stat and the hash, in which
+  // case the key no longer describes what was hashed
+  struct stat st2;
+  if (cached && have_key && stat(pathname, &st2) == 0
+      && st2.st_dev == st.st_dev && st2.st_ino == st.st_ino
+      && st2.st_size == st.st_size
+      && st2.st_mtim.tv_sec == st.st_mtim.tv_sec
+      && st2.st_mtim.tv_nsec == st.st_mtim.tv_nsec
+      && !fnbounds_cache_alias(cache_dir, hash, key)) {
+    TMSG(FNBOUNDS, "unable to alias function bounds for %s in %s: %s",
+         pathname, cache_dir, strerror(errno));
+  }
+
+  free(hash);
+  return fnbres;
+}
+
+
 static dso_info_t*
 fnbounds_compute(const char* incoming_filename, void* start, void* end)
 {
@@ -275,7 +340,7 @@ fnbounds_compute(const char* incoming_filename, void* start, void* end)
     pathname_for_query = filename;
   }
 
-  FnboundsResponse fnbres = fnb_get_funclist(pathname_for_query);
+  FnboundsResponse fnbres = fnbounds_get_funclist(pathname_for_query);
   if (fnbres.entries == NULL) {
     return hpcrun_dso_make(filename, NULL, start, end);
   }
@@ -45,6 +45,7 @@
 #include "gpu-trace-api.h"
 #include "gpu-trace-item.h"
 #include "gpu-trace-channel.h"
+#include "gpu-trace-reorder.h"
 #include "gpu-trace-channel-set.h"
 #include "gpu-trace-demultiplexer.h"
 #include "gpu-context-id-map.h"
@@ -178,7 +179,10 @@ gpu_trace_stream_acquire
 
   gpu_compute_profile_name(tag, &td->core_profile_trace_data);
 
+  // records are reordered within a window before they reach the trace file,
+  // this is only a hint for hpcprof in case they arrive later than that
   td->core_profile_trace_data.trace_expected_disorder = 30;
+  td->gpu_trace_reorder = gpu_trace_reorder_new();
 
   return td;
 }
@@ -208,6 +212,20 @@ gpu_trace_cct_insert_context
 }
 
 
+static void
+gpu_trace_stream_emit
+(
+ cct_node_t *leaf,
+ uint64_t time,
+ void *arg
+)
+{
+  thread_data_t *td = arg;
+  hpcrun_trace_append_stream(&td->core_profile_trace_data, leaf, 0,
+                           td->prev_dLCA, time);
+}
+
+
 static void
 gpu_trace_stream_append
 (
@@ -216,8 +234,19 @@ gpu_trace_stream_append
  uint64_t time
 )
 {
-  hpcrun_trace_append_stream(&td->core_profile_trace_data, leaf, 0,
-                           td->prev_dLCA, time);
+  // hold records back briefly so the trace file is written in time order
+  gpu_trace_reorder_push(td->gpu_trace_reorder, leaf, time,
+                         gpu_trace_stream_emit, td);
+}
+
+
+static void
+gpu_trace_stream_flush
+(
+ thread_data_t* td
+)
+{
+  gpu_trace_reorder_flush(td->gpu_trace_reorder, gpu_trace_stream_emit, td);
 }
 
 static uint64_t
@@ -263,6 +292,7 @@ gpu_trace_channel_release
 )
 {
   thread_data_t *td = gpu_trace_channel_get_thread_data(channel);
+  gpu_trace_stream_flush(td);
   hpcrun_write_profile_data(&td->core_profile_trace_data);
   hpcrun_trace_close(&td->core_profile_trace_data);
 
@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+//******************************************************************************
+// local includes
+//******************************************************************************
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+
+#include "../../memory/hpcrun-malloc.h"
+
+#include "gpu-trace-reorder.h"
+
+
+
+//******************************************************************************
+// type declarations
+//******************************************************************************
+
+typedef struct reorder_entry_t {
+  uint64_t time;
+  uint64_t seqno;
+  cct_node_t *leaf;
+} reorder_entry_t;
+
+
+// min-heap of pending records, ordered by (time, seqno)
+typedef struct gpu_trace_reorder_t {
+  uint64_t next_seqno;
+  unsigned int size;
+  reorder_entry_t heap[GPU_TRACE_REORDER_WINDOW];
+} gpu_trace_reorder_t;
+
+
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+static bool
+entry_less
+(
+ const reorder_entry_t *a,
+ const reorder_entry_t *b
+)
+{
+  return a->time < b->time || (a->time == b->time && a->seqno < b->seqno);
+}
+
+
+static void
+heap_swap
+(
+ gpu_trace_reorder_t *window,
+ unsigned int i,
+ unsigned int j
+)
+{
+  reorder_entry_t tmp = window->heap[i];
+  window->heap[i] = window->heap[j];
+  window->heap[j] = tmp;
+}
+
+
+static void
+heap_insert
+(
+ gpu_trace_reorder_t *window,
+ reorder_entry_t entry
+)
+{
+  unsigned int i = window->size++;
+  window->heap[i] = entry;
+  while (i > 0) {
+    unsigned int parent = (i - 1) / 2;
+    if (!entry_less(&window->heap[i], &window->heap[parent])) break;
+    heap_swap(window, i, parent);
+    i = parent;
+  }
+}
+
+
+static reorder_entry_t
+heap_pop
+(
+ gpu_trace_reorder_t *window
+)
+{
+  reorder_entry_t top = window->heap[0];
+  window->heap[0] = window->heap[--window->size];
+
+  unsigned int i = 0;
+  for (;;) {
+    unsigned int least = i;
+    unsigned int left = 2 * i + 1;
+    unsigned int right = left + 1;
+    if (left < window->size && entry_less(&window->heap[left], &window->heap[least]))
+      least = left;
+    if (right < window->size && entry_less(&window->heap[right], &window->heap[least]))
+      least = right;
+    if (least == i) break;
+    heap_swap(window, i, least);
+    i = least;
+  }
+
+  return top;
+}
+
+
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+gpu_trace_reorder_t *
+gpu_trace_reorder_new
+(
+ void
+)
+{
+  gpu_trace_reorder_t *window = hpcrun_malloc_safe(sizeof(gpu_trace_reorder_t));
+
+  window->next_seqno = 0;
+  window->size = 0;
+
+  return window;
+}
+
+
+void
+gpu_trace_reorder_push
+(
+ gpu_trace_reorder_t *window,
+ cct_node_t *leaf,
+ uint64_t time,
+ gpu_trace_reorder_emit_fn_t emit_fn,
+ void *arg
+)
+{
+  if (window->size == GPU_TRACE_REORDER_WINDOW) {
+    reorder_entry_t oldest = heap_pop(window);
+    emit_fn(oldest.leaf, oldest.time, arg);
+  }
+
+  reorder_entry_t entry = {
+    .time = time,
+    .seqno = window->next_seqno++,
+    .leaf = leaf
+  };
+  heap_insert(window, entry);
+}
+
+
+void
+gpu_trace_reorder_flush
+(
+ gpu_trace_reorder_t *window,
+ gpu_trace_reorder_emit_fn_t emit_fn,
+ void *arg
+)
+{
+  while (window->size > 0) {
+    reorder_entry_t oldest = heap_pop(window);
+    emit_fn(oldest.leaf, oldest.time, arg);
+  }
+}
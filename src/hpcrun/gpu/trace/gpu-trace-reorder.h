@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*- // technically C99
+
+#ifndef gpu_trace_reorder_h
+#define gpu_trace_reorder_h
+
+
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <stdint.h>
+
+
+
+//******************************************************************************
+// macros
+//******************************************************************************
+
+// number of trace records held back per stream to restore timestamp order
+#define GPU_TRACE_REORDER_WINDOW 64
+
+
+
+//******************************************************************************
+// forward type declarations
+//******************************************************************************
+
+typedef struct cct_node_t cct_node_t;
+
+
+
+//******************************************************************************
+// type declarations
+//******************************************************************************
+
+typedef struct gpu_trace_reorder_t gpu_trace_reorder_t;
+
+typedef void (*gpu_trace_reorder_emit_fn_t)
+(
+ cct_node_t *leaf,
+ uint64_t time,
+ void *arg
+);
+
+
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+/**
+ * Creates a new, empty reorder window for a GPU stream's trace records
+ * @return the newly created window
+*/
+gpu_trace_reorder_t *
+gpu_trace_reorder_new
+(
+ void
+);
+
+
+/**
+ * \brief Adds a trace record to \p window . If the window is full, the record
+ * with the earliest timestamp is first passed to \p emit_fn along with \p arg .
+ * Records with equal timestamps are emitted in the order they were added.
+*/
+void
+gpu_trace_reorder_push
+(
+ gpu_trace_reorder_t *window,
+ cct_node_t *leaf,
+ uint64_t time,
+ gpu_trace_reorder_emit_fn_t emit_fn,
+ void *arg
+);
+
+
+/**
+ * \brief Passes all records held in \p window to \p emit_fn in timestamp
+ * order, leaving the window empty.
+*/
+void
+gpu_trace_reorder_flush
+(
+ gpu_trace_reorder_t *window,
+ gpu_trace_reorder_emit_fn_t emit_fn,
+ void *arg
+);
+
+
+#endif
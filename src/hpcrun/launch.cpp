@@ -115,6 +115,12 @@ R"==(
                                            elements are added, any statistical properties of the CPU
                                            traces are disturbed.
 
+  --trace-packed       Write traces in a packed encoding that stores the
+                       difference between successive timestamps and elides
+                       repeated call paths. Packed traces are several times
+                       smaller, but can only be read by this version of
+                       HPCToolkit or later.
+
   --omp-serial-only    When profiling using the OMPT interface for OpenMP,
                        suppress all samples not in serial code.
 
@@ -122,6 +128,12 @@ R"==(
                        Delay starting sampling until the application calls
                        hpctoolkit_sampling_start().
 
+  --fnbounds-cache <dir>
+                       Cache the function bounds computed for each binary in
+                       <dir>, keyed by the binary's contents. Later processes
+                       loading the same binary reuse the cached bounds instead
+                       of scanning its symbol tables again.
+
   -f <frac>, -fp <frac>, --process-fraction <frac>
                        Measure only a fraction <frac> of the execution's
                        processes.  For each process, enable measurement
@@ -135,6 +147,10 @@ R"==(
                        0 : do not merge non-overlapped threads
                        1 : merge non-overlapped threads (default)
 
+  --aggregate-profiles Write the profiles of all threads of a process into
+                       a single .hpcrun container file instead of one file
+                       per thread. Trace files are still written per thread.
+
   -o <outpath>, --output <outpath>
                        Directory for output data.
                        {hpctoolkit-<command>-measurements[-<jobid>]}
@@ -417,6 +433,8 @@ int main(int argc, char* argv[]) {
         return 1;
       }
       env["HPCRUN_TRACE"] = "2";
+    } else if (strmatch(arg, {"--trace-packed"})) {
+      env["HPCRUN_TRACE_PACKED"] = "1";
     } else if (strmatch(arg, {"-js", "--jobs-symtab"})) {
       // Deprecated
       popvalue();
@@ -426,6 +444,8 @@ int main(int argc, char* argv[]) {
       env["HPCRUN_LOCAL_RANKS"] = popvalue();
     } else if (strmatch(arg, {"--rocprofiler-path"})) {
       rocm_envs_rocprofiler_path = popvalue();
+    } else if (strmatch(arg, {"--fnbounds-cache"})) {
+      env["HPCRUN_FNBOUNDS_CACHE"] = popvalue();
     } else if (strmatch(arg, {"--disable-gprof"})) {
       preload_list.emplace_back(HPCRUN_PRELOAD_GPROF_SO);
     } else if (strmatch(arg, {"--omp-serial-only"})) {
@@ -446,6 +466,8 @@ int main(int argc, char* argv[]) {
       env["HPCRUN_RETAIN_RECURSION"] = "1";
     } else if (strmatch(arg, {"-m", "--merge-threads"})) {
       env["HPCRUN_MERGE_THREADS"] = popvalue();
+    } else if (strmatch(arg, {"--aggregate-profiles"})) {
+      env["HPCRUN_AGGREGATE_PROFILES"] = "1";
     } else if (strmatch(arg, {"-lm", "--low-memsize"})) {
       env["HPCRUN_LOW_MEMSIZE"] = popvalue();
     } else if (strmatch(arg, {"-ms", "--memsize"})) {
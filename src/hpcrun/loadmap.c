@@ -7,6 +7,8 @@
 #define _GNU_SOURCE
 
 #include <libgen.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <sys/time.h>
 
 #include "cct/cct.h"
@@ -37,6 +39,54 @@ static spinlock_t loadmap_lock = SPINLOCK_UNLOCKED;
 
 static loadmap_notify_t *notification_recipients = NULL;
 
+
+/* sorted index over the address ranges of the mapped load modules.
+   lookups may run in a signal handler, so the index is never modified
+   in place: it is rebuilt copy-on-write whenever a load module is
+   mapped or unmapped, and published with a single atomic store. */
+typedef struct loadmap_index_entry_t {
+  void* start_addr;
+  void* end_addr;
+  load_module_t* lm;
+} loadmap_index_entry_t;
+
+typedef struct loadmap_index_t {
+  struct loadmap_index_t* next; // only used on the retired and free lists
+  size_t capacity;
+  size_t size;
+  bool overlapping; // some ranges overlap, so a binary search is not valid
+  loadmap_index_entry_t entries[];
+} loadmap_index_t;
+
+static _Atomic(loadmap_index_t*) s_index = NULL;
+
+/* hazard slots protecting the snapshots in use by lookups. each thread
+   publishes the snapshot it is searching in a record of its own, so a
+   lookup only writes to a cache line no other thread writes. a signal
+   handler may interrupt a lookup on the same thread, so the slots of a
+   record are used as a small stack. records are never freed, but are
+   reused once their thread exits. */
+#define LOADMAP_HAZARD_DEPTH 4
+#define LOADMAP_HAZARD_ALIGN 64
+
+typedef struct loadmap_hazard_t {
+  _Atomic(loadmap_index_t*) slots[LOADMAP_HAZARD_DEPTH];
+  atomic_int depth; // only modified by the owning thread
+  atomic_bool in_use;
+  struct loadmap_hazard_t* next;
+} loadmap_hazard_t;
+
+static _Atomic(loadmap_hazard_t*) s_hazards = NULL;
+static __thread loadmap_hazard_t* s_hazard_self = NULL;
+
+// snapshots that have been replaced, but may still be in use by a lookup
+static loadmap_index_t* s_index_retired = NULL;
+
+// snapshots that are known to be unused and can be refilled
+static loadmap_index_t* s_index_free = NULL;
+
+static spinlock_t index_lock = SPINLOCK_UNLOCKED;
+
 static void hpcrun_loadModule_flags_init(load_module_t *lm);
 
 void
@@ -255,14 +305,149 @@ hpcrun_loadmap_print(hpcrun_loadmap_t* loadmap)
 
 //***************************************************************************
 
-load_module_t*
-hpcrun_loadmap_findByAddr(void* begin, void* end)
+static int
+hpcrun_loadmap_index_compare(const void* a, const void* b)
 {
-  // don't waste effort on an obviously invalid address
-  if (begin == 0) return NULL;
+  const loadmap_index_entry_t* x = a;
+  const loadmap_index_entry_t* y = b;
+  if (x->start_addr < y->start_addr) return -1;
+  if (x->start_addr > y->start_addr) return 1;
+  return 0;
+}
 
-  TMSG(LOADMAP, "find by address %p -- %p", begin, end);
 
+static loadmap_hazard_t*
+hpcrun_loadmap_hazard_self()
+{
+  if (s_hazard_self) return s_hazard_self;
+
+  // reuse the record of a thread that has exited, if there is one
+  for (loadmap_hazard_t* h = atomic_load(&s_hazards); h; h = h->next) {
+    bool free = false;
+    if (!atomic_load_explicit(&h->in_use, memory_order_relaxed)
+        && atomic_compare_exchange_strong(&h->in_use, &free, true)) {
+      s_hazard_self = h;
+      return h;
+    }
+  }
+
+  // otherwise allocate a new one, on a cache line of its own
+  char* mem = hpcrun_malloc_safe(sizeof(loadmap_hazard_t) + LOADMAP_HAZARD_ALIGN);
+  if (mem == NULL) return NULL;
+  loadmap_hazard_t* h = (loadmap_hazard_t*)
+    (((uintptr_t) mem + LOADMAP_HAZARD_ALIGN - 1) & ~(uintptr_t)(LOADMAP_HAZARD_ALIGN - 1));
+  for (int i = 0; i < LOADMAP_HAZARD_DEPTH; i++) {
+    atomic_init(&h->slots[i], NULL);
+  }
+  atomic_init(&h->depth, 0);
+  atomic_init(&h->in_use, true);
+  h->next = atomic_load(&s_hazards);
+  while (!atomic_compare_exchange_weak(&s_hazards, &h->next, h));
+
+  s_hazard_self = h;
+  return h;
+}
+
+
+void
+hpcrun_loadmap_thread_fini()
+{
+  if (s_hazard_self) {
+    atomic_store(&s_hazard_self->in_use, false);
+    s_hazard_self = NULL;
+  }
+}
+
+
+static bool
+hpcrun_loadmap_index_in_use(loadmap_index_t* idx)
+{
+  for (loadmap_hazard_t* h = atomic_load(&s_hazards); h; h = h->next) {
+    for (int i = 0; i < LOADMAP_HAZARD_DEPTH; i++) {
+      if (atomic_load(&h->slots[i]) == idx) return true;
+    }
+  }
+  return false;
+}
+
+
+static void
+hpcrun_loadmap_index_rebuild()
+{
+  spinlock_lock(&index_lock);
+
+  // Retired snapshots can be recycled once no hazard slot refers to them,
+  // since any lookup that starts later will only see the current snapshot.
+  for (loadmap_index_t** p = &s_index_retired; *p; ) {
+    loadmap_index_t* x = *p;
+    if (hpcrun_loadmap_index_in_use(x)) {
+      p = &x->next;
+    } else {
+      *p = x->next;
+      x->next = s_index_free;
+      s_index_free = x;
+    }
+  }
+
+  size_t count = 0;
+  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+    if (x->dso_info) count++;
+  }
+
+  // Refill a free snapshot if one is large enough, otherwise allocate a new
+  // one with room to grow
+  loadmap_index_t* idx = NULL;
+  for (loadmap_index_t** p = &s_index_free; *p; p = &(*p)->next) {
+    if ((*p)->capacity >= count) {
+      idx = *p;
+      *p = idx->next;
+      break;
+    }
+  }
+  if (idx == NULL) {
+    size_t capacity = (count < 16) ? 32 : 2 * count;
+    idx = (loadmap_index_t*) hpcrun_malloc(sizeof(loadmap_index_t)
+                                 + capacity * sizeof(loadmap_index_entry_t));
+    idx->capacity = capacity;
+  }
+
+  idx->next = NULL;
+  idx->size = 0;
+  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+    if (x->dso_info) {
+      loadmap_index_entry_t* e = &idx->entries[idx->size++];
+      e->start_addr = x->dso_info->start_addr;
+      e->end_addr = x->dso_info->end_addr;
+      e->lm = x;
+    }
+  }
+  qsort(idx->entries, idx->size, sizeof(loadmap_index_entry_t),
+        hpcrun_loadmap_index_compare);
+
+  idx->overlapping = false;
+  for (size_t i = 1; i < idx->size; i++) {
+    if (idx->entries[i].start_addr < idx->entries[i-1].end_addr) {
+      idx->overlapping = true;
+      break;
+    }
+  }
+
+  loadmap_index_t* old = atomic_exchange(&s_index, idx);
+  if (old) {
+    old->next = s_index_retired;
+    s_index_retired = old;
+  }
+
+  TMSG(LOADMAP, "rebuilt address index: %ld modules%s", (long) idx->size,
+       idx->overlapping ? " (overlapping)" : "");
+
+  spinlock_unlock(&index_lock);
+}
+
+
+static load_module_t*
+hpcrun_loadmap_findByAddr_list(void* begin, void* end)
+{
   for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
     TMSG(LOADMAP, "\tload module %s", x->name);
     if (x->dso_info) {
@@ -275,12 +460,79 @@ hpcrun_loadmap_findByAddr(void* begin, void* end)
                                   x->dso_info->start_to_ref_dist) : -1)
            );
       if (x->dso_info->start_addr <= begin && end <= x->dso_info->end_addr) {
-        TMSG(LOADMAP, "       --->%s", x->name);
-        hpcrun_loadModule_flags_set(x, LOADMAP_ENTRY_ANALYZE);
         return x;
       }
     }
   }
+  return NULL;
+}
+
+
+static load_module_t*
+hpcrun_loadmap_findByAddr_index(loadmap_index_t* idx, void* begin, void* end)
+{
+  // find the last entry starting at or before begin
+  size_t lo = 0;
+  size_t hi = idx->size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (idx->entries[mid].start_addr <= begin) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0) return NULL;
+
+  loadmap_index_entry_t* e = &idx->entries[lo - 1];
+  TMSG(LOADMAP, "\tload module %s [%lx, %lx)", e->lm->name,
+       (uintptr_t) e->start_addr, (uintptr_t) e->end_addr);
+  return (end <= e->end_addr) ? e->lm : NULL;
+}
+
+
+load_module_t*
+hpcrun_loadmap_findByAddr(void* begin, void* end)
+{
+  // don't waste effort on an obviously invalid address
+  if (begin == 0) return NULL;
+
+  TMSG(LOADMAP, "find by address %p -- %p", begin, end);
+
+  load_module_t* x = NULL;
+  loadmap_hazard_t* h = hpcrun_loadmap_hazard_self();
+  int depth = h ? atomic_load_explicit(&h->depth, memory_order_relaxed)
+                : LOADMAP_HAZARD_DEPTH;
+  if (depth < LOADMAP_HAZARD_DEPTH) {
+    // claim a slot before anything can interrupt us and use it too
+    atomic_store_explicit(&h->depth, depth + 1, memory_order_relaxed);
+    atomic_signal_fence(memory_order_seq_cst);
+
+    // publish the snapshot, and check it is still current so that a
+    // rebuild is guaranteed to see it in the slot
+    loadmap_index_t* idx;
+    do {
+      idx = atomic_load(&s_index);
+      atomic_store(&h->slots[depth], idx);
+    } while (idx != atomic_load(&s_index));
+
+    if (idx && !idx->overlapping) {
+      x = hpcrun_loadmap_findByAddr_index(idx, begin, end);
+    } else if (idx) {
+      // overlapping ranges are resolved by list order, as they always were
+      x = hpcrun_loadmap_findByAddr_list(begin, end);
+    }
+
+    atomic_store_explicit(&h->slots[depth], NULL, memory_order_release);
+    atomic_signal_fence(memory_order_seq_cst);
+    atomic_store_explicit(&h->depth, depth, memory_order_relaxed);
+  } else if (atomic_load(&s_index)) {
+    // no slot to protect a snapshot with, so walk the list instead
+    x = hpcrun_loadmap_findByAddr_list(begin, end);
+  }
+
+  if (x) {
+    TMSG(LOADMAP, "       --->%s", x->name);
+    hpcrun_loadModule_flags_set(x, LOADMAP_ENTRY_ANALYZE);
+    return x;
+  }
   TMSG(LOADMAP, "       --->(NOT FOUND)");
   return NULL;
 }
@@ -432,6 +684,8 @@ hpcrun_loadmap_map(dso_info_t* dso)
 
   }
 
+  hpcrun_loadmap_index_rebuild();
+
   hpcrun_loadmap_notify_map(lm);
 
   TMSG(LOADMAP, "hpcrun_loadmap_map: '%s' size=%d %s",
@@ -454,6 +708,7 @@ hpcrun_loadmap_unmap(load_module_t* lm)
   hpcrun_loadmap_notify_unmap(lm);
 
   lm->dso_info = NULL;
+  hpcrun_loadmap_index_rebuild();
 
   // Set dl_phdr_info structure to uninitialized state
   lm->phdr_info.dlpi_phdr = NULL;
@@ -177,6 +177,12 @@ load_module_t*
 hpcrun_loadmap_findByAddr(void* begin, void* end);
 
 
+// hpcrun_loadmap_thread_fini: Release the calling thread's state for
+//   hpcrun_loadmap_findByAddr, so it can be reused by other threads.
+void
+hpcrun_loadmap_thread_fini();
+
+
 // hpcrun_loadmap_findByName: Find a load module by name.
 load_module_t*
 hpcrun_loadmap_findByName(const char* name);
@@ -727,6 +727,7 @@ hpcrun_fini_internal()
 
     // write all threads' profile data and close trace file
     hpcrun_threadMgr_data_fini(td);
+    hpcrun_trace_fini();
 
     auditor_exports()->mainlib_disconnect();
     fnbounds_fini();
@@ -814,6 +815,8 @@ hpcrun_thread_fini(epoch_t *epoch)
 {
   TMSG(FINI,"thread fini");
 
+  hpcrun_loadmap_thread_fini();
+
   // take no action if this thread is suppressed
   if (!hpcrun_thread_suppress_sample) {
     TMSG(FINI,"thread finit stops sampling");
@@ -98,6 +98,10 @@ leakinfo_t leakinfo_NULL = { .magic = 0, .context = NULL, .bytes = 0 };
 #define HPCRUN_MEMLEAK_PROB  "HPCRUN_MEMLEAK_PROB"
 #define DEFAULT_PROB  0.1
 
+// Number of shards of the footer splay tree, must be a power of 2
+#define MEMLEAK_TREE_SHARDS_LOG2  6
+#define MEMLEAK_TREE_SHARDS  (1 << MEMLEAK_TREE_SHARDS_LOG2)
+
 
 /******************************************************************************
  * private data
@@ -108,8 +112,18 @@ static int leak_detection_init = 0;    // default is uninitialized
 static int use_memleak_prob = 0;
 static float memleak_prob = 0.0;
 
-static struct leakinfo_s *memleak_tree_root = NULL;
-static spinlock_t memtree_lock = SPINLOCK_UNLOCKED;
+// Leakinfo structs in footers are kept in splay trees keyed by the
+// application's pointer. Blocks are spread over a number of trees, each
+// with its own lock and cache line, so that threads allocating and
+// freeing different blocks rarely contend on the same lock.
+typedef struct memleak_shard_s {
+  struct leakinfo_s *root;
+  spinlock_t lock;
+} __attribute__((aligned(64))) memleak_shard_t;
+
+static memleak_shard_t memleak_tree_shards[MEMLEAK_TREE_SHARDS] = {
+  [0 ... MEMLEAK_TREE_SHARDS - 1] = { .root = NULL, .lock = SPINLOCK_UNLOCKED }
+};
 
 static int leakinfo_size = sizeof(struct leakinfo_s);
 static long memleak_pagesize = MEMLEAK_DEFAULT_PAGESIZE;
@@ -139,33 +153,45 @@ splay(struct leakinfo_s *root, void *key)
 }
 
 
+// Returns the shard for a block. Blocks are at least 8-byte aligned and
+// nearby blocks tend to come from the same thread, so mix all the bits
+// (Fibonacci hashing) rather than taking the low ones.
+static inline memleak_shard_t *
+memleak_shard(void *memblock)
+{
+  uint64_t h = (uint64_t)(uintptr_t) memblock * 0x9E3779B97F4A7C15ULL;
+  return &memleak_tree_shards[h >> (64 - MEMLEAK_TREE_SHARDS_LOG2)];
+}
+
+
 static void
 splay_insert(struct leakinfo_s *node)
 {
   void *memblock = node->memblock;
+  memleak_shard_t *shard = memleak_shard(memblock);
 
   node->left = node->right = NULL;
 
-  spinlock_lock(&memtree_lock);
-  if (memleak_tree_root != NULL) {
-    memleak_tree_root = splay(memleak_tree_root, memblock);
-
-    if (memblock < memleak_tree_root->memblock) {
-      node->left = memleak_tree_root->left;
-      node->right = memleak_tree_root;
-      memleak_tree_root->left = NULL;
-    } else if (memblock > memleak_tree_root->memblock) {
-      node->left = memleak_tree_root;
-      node->right = memleak_tree_root->right;
-      memleak_tree_root->right = NULL;
+  spinlock_lock(&shard->lock);
+  if (shard->root != NULL) {
+    shard->root = splay(shard->root, memblock);
+
+    if (memblock < shard->root->memblock) {
+      node->left = shard->root->left;
+      node->right = shard->root;
+      shard->root->left = NULL;
+    } else if (memblock > shard->root->memblock) {
+      node->left = shard->root;
+      node->right = shard->root->right;
+      shard->root->right = NULL;
     } else {
       TMSG(MEMLEAK, "memleak splay tree: unable to insert %p (already present)",
            node->memblock);
       hpcrun_terminate();
     }
   }
-  memleak_tree_root = node;
-  spinlock_unlock(&memtree_lock);
+  shard->root = node;
+  spinlock_unlock(&shard->lock);
 }
 
 
@@ -173,34 +199,35 @@ static struct leakinfo_s *
 splay_delete(void *memblock)
 {
   struct leakinfo_s *result = NULL;
+  memleak_shard_t *shard = memleak_shard(memblock);
 
-  spinlock_lock(&memtree_lock);
-  if (memleak_tree_root == NULL) {
-    spinlock_unlock(&memtree_lock);
+  spinlock_lock(&shard->lock);
+  if (shard->root == NULL) {
+    spinlock_unlock(&shard->lock);
     TMSG(MEMLEAK, "memleak splay tree empty: unable to delete %p", memblock);
     return NULL;
   }
 
-  memleak_tree_root = splay(memleak_tree_root, memblock);
+  shard->root = splay(shard->root, memblock);
 
-  if (memblock != memleak_tree_root->memblock) {
-    spinlock_unlock(&memtree_lock);
+  if (memblock != shard->root->memblock) {
+    spinlock_unlock(&shard->lock);
     TMSG(MEMLEAK, "memleak splay tree: %p not in tree", memblock);
     return NULL;
   }
 
-  result = memleak_tree_root;
+  result = shard->root;
 
-  if (memleak_tree_root->left == NULL) {
-    memleak_tree_root = memleak_tree_root->right;
-    spinlock_unlock(&memtree_lock);
+  if (shard->root->left == NULL) {
+    shard->root = shard->root->right;
+    spinlock_unlock(&shard->lock);
     return result;
   }
 
-  memleak_tree_root->left = splay(memleak_tree_root->left, memblock);
-  memleak_tree_root->left->right = memleak_tree_root->right;
-  memleak_tree_root =  memleak_tree_root->left;
-  spinlock_unlock(&memtree_lock);
+  shard->root->left = splay(shard->root->left, memblock);
+  shard->root->left->right = shard->root->right;
+  shard->root = shard->root->left;
+  spinlock_unlock(&shard->lock);
   return result;
 }
 
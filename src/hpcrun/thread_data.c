@@ -288,8 +288,11 @@ core_profile_trace_data_init
   // IO support
   // ----------------------------------------
   cptd->hpcrun_file  = NULL;
+  cptd->hpcrun_image = NULL;
+  cptd->hpcrun_image_size = 0;
   cptd->trace_buffer = NULL;
   cptd->trace_outbuf = NULL;
+  cptd->trace_packed = NULL;
 
   // ----------------------------------------
   // ???
@@ -451,6 +454,7 @@ hpcrun_thread_data_init
   // gpu trace line support
   // ----------------------------------------
   td->gpu_trace_prev_time = 0;
+  td->gpu_trace_reorder = NULL;
 
   // ----------------------------------------
   // blame-shifting
@@ -250,6 +250,7 @@ typedef struct thread_data_t {
   bool application_thread_0;
 
   uint64_t gpu_trace_prev_time;
+  struct gpu_trace_reorder_t *gpu_trace_reorder;
 
   uint64_t ga_idleness_count;
 
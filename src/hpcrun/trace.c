@@ -68,6 +68,7 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
 
 static int tracing = 0;
 static int trace_flags = 0;
+static bool trace_packed = false;
 
 //*********************************************************************
 // interface operations
@@ -87,7 +88,30 @@ hpcrun_trace_init()
   if (tracing > 1) {
       hpcrun_set_trace_metric(HPCRUN_CPU_KERNEL_LAUNCH_TRACE_FLAG);
   }
-  TMSG(TRACE, "Tracing is %s (%d)", (tracing ? "ON" : "OFF"), tracing);
+  trace_packed = hpcrun_get_env_bool(HPCRUN_TRACE_PACKED);
+  TMSG(TRACE, "Tracing is %s (%d)%s", (tracing ? "ON" : "OFF"), tracing,
+       (trace_packed ? ", packed" : ""));
+
+  // Full trace buffers are written out by a background I/O thread, so
+  // sampling threads don't stall in write(). Enabled unless
+  // HPCRUN_TRACE_ASYNC=0.
+  int async = 1;
+  hpcrun_get_env_int(HPCRUN_TRACE_ASYNC, &async);
+  if (tracing && async) {
+    monitor_disable_new_threads();
+    if (hpcio_outbuf_async_start() != HPCFMT_OK) {
+      EMSG("unable to start trace I/O thread, writing traces synchronously");
+    }
+    monitor_enable_new_threads();
+  }
+}
+
+
+void
+hpcrun_trace_fini()
+{
+  // Called once every trace has been closed
+  hpcio_outbuf_async_stop();
 }
 
 void
@@ -114,7 +138,8 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd, hpcrun_trace_type_t type)
     cptd->trace_buffer = hpcrun_malloc(HPCRUN_TraceBufferSz);
 
     ret = hpcio_outbuf_attach(&cptd->trace_outbuf, fd, cptd->trace_buffer,
-                              HPCRUN_TraceBufferSz, HPCIO_OUTBUF_UNLOCKED, hpcrun_malloc);
+                              HPCRUN_TraceBufferSz,
+                              HPCIO_OUTBUF_UNLOCKED | HPCIO_OUTBUF_ASYNC, hpcrun_malloc);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "open");
 
     hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
@@ -131,6 +156,12 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd, hpcrun_trace_type_t type)
     HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, false);
 #endif
 
+    if (trace_packed) {
+      cptd->trace_packed = hpcrun_malloc(sizeof(hpctrace_fmt_packed_t));
+      hpctrace_fmt_packed_init(cptd->trace_packed);
+      HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS, true);
+    }
+
     switch(type) {
     case HPCRUN_SAMPLE_TRACE:
       HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_CALL_TRACE_BIT_POS, 0);
@@ -215,6 +246,10 @@ hpcrun_trace_close(core_profile_trace_data_t * cptd)
   if (tracing && hpcrun_sample_prob_active()) {
 
     TMSG(TRACE, "Trace active close code");
+    if (cptd->trace_packed != NULL
+        && hpctrace_fmt_packed_flush(cptd->trace_packed, cptd->trace_outbuf) != HPCFMT_OK) {
+      EMSG("unable to flush last block of packed trace file");
+    }
     int ret = hpcio_outbuf_close(&cptd->trace_outbuf);
     if (ret != HPCFMT_OK) {
       EMSG("unable to flush and close trace file");
@@ -276,7 +311,13 @@ hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int
     HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, false);
 #endif
 
-    int ret = hpctrace_fmt_datum_outbuf(&trace_datum, flags, cptd->trace_outbuf);
+    int ret;
+    if (cptd->trace_packed != NULL) {
+      ret = hpctrace_fmt_packed_datum_outbuf(&trace_datum, flags,
+                                             cptd->trace_packed, cptd->trace_outbuf);
+    } else {
+      ret = hpctrace_fmt_datum_outbuf(&trace_datum, flags, cptd->trace_outbuf);
+    }
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "append");
 }
 
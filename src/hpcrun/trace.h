@@ -26,6 +26,7 @@ typedef enum hpcrun_trace_type {
 void trace_other_close(void *thread_data);
 
 void hpcrun_trace_init();
+void hpcrun_trace_fini();
 void hpcrun_trace_open(core_profile_trace_data_t * cptd, hpcrun_trace_type_t type);
 void hpcrun_trace_append(core_profile_trace_data_t *cptd, cct_node_t* node, unsigned int metric_id, uint32_t dLCA, uint64_t sampling_period);
 void hpcrun_trace_append_with_time(core_profile_trace_data_t *st, unsigned int call_path_id, unsigned int metric_id, uint64_t nanotime);
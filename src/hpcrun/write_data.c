@@ -21,6 +21,7 @@
 
 #include "fname_max.h"
 #include "unwind/common/backtrace.h"
+#include "env.h"
 #include "files.h"
 #include "epoch.h"
 #include "rank.h"
@@ -113,8 +114,15 @@ lazy_open_data_file(core_profile_trace_data_t *cptd)
     rank = 0;
   }
 
-  int fd = hpcrun_open_profile_file(rank, cptd->id);
-  fs = fdopen(fd, "w");
+  // When aggregating, the profile is built in memory and appended to the
+  // process's container as a whole once complete, see
+  // hpcrun_write_profile_data.
+  if (hpcrun_sample_prob_active() && hpcrun_get_env_bool(HPCRUN_AGGREGATE_PROFILES)) {
+    fs = open_memstream(&cptd->hpcrun_image, &cptd->hpcrun_image_size);
+  } else {
+    int fd = hpcrun_open_profile_file(rank, cptd->id);
+    fs = fdopen(fd, "w");
+  }
   if (fs == NULL)
   {
     EEMSG("HPCToolkit: %s: unable to open profile file", __func__);
@@ -424,6 +432,17 @@ int hpcrun_write_profile_data(core_profile_trace_data_t *cptd)
 
   TMSG(DATA_WRITE, "closing file");
   hpcio_fclose(fs);
+
+  if (cptd->hpcrun_image) {
+    TMSG(DATA_WRITE, "appending profile to container");
+    int rank = hpcrun_get_rank();
+    hpcrun_append_profile_section(rank < 0 ? 0 : rank, cptd->id,
+                                  cptd->trace_outbuf != NULL,
+                                  cptd->hpcrun_image, cptd->hpcrun_image_size);
+    free(cptd->hpcrun_image);
+    cptd->hpcrun_image = NULL;
+    cptd->hpcrun_image_size = 0;
+  }
   TMSG(DATA_WRITE, "Done!");
 
   return HPCRUN_OK;
@@ -163,6 +163,9 @@ Options: Override structure recovery defaults
                        Loop nesting structure is only useful with
                        instruction-level measurements collected using PC
                        sampling or instrumentation. {no}
+  --index <yes/no>     Also write a binary index of each hpcstruct file,
+                       named <file>.idx, which hpcprof loads much faster
+                       than the XML. {no}
 
 
 Options: Specify output file when analyzing a single binary
@@ -209,6 +212,7 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
   {  0 ,  "gpucfg",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB,  NULL,  NULL },
   {  1 ,  "gpu",          CLP::ARG_REQ,  CLP::DUPOPT_CLOB,  NULL,  NULL },
   {  1 ,  "cpu",          CLP::ARG_REQ,  CLP::DUPOPT_CLOB,  NULL,  NULL },
+  {  0 ,  "index",        CLP::ARG_REQ,  CLP::DUPOPT_CLOB,  NULL,  NULL },
   { 'I', "include",       CLP::ARG_REQ,  CLP::DUPOPT_CAT,  ":",
      NULL },
   { 'R', "replace-path",  CLP::ARG_REQ,  CLP::DUPOPT_CAT,  CLP_SEPARATOR,
@@ -270,6 +274,7 @@ Args::Ctor()
   show_gaps = false;
   nocache = false;
   compute_gpu_cfg = false;
+  write_index = false;
   meas_dir = "";
   is_from_makefile = false;
   cache_stat = CACHE_DISABLED;
@@ -431,6 +436,14 @@ Args::parse(int argc, const char* const argv[])
       compute_gpu_cfg = yes;
     }
 
+    if (parser.isOpt("index")) {
+      const string & arg = parser.getOptArg("index");
+      bool yes = strcasecmp("yes", arg.c_str()) == 0;
+      bool no = strcasecmp("no", arg.c_str()) == 0;
+      if (!yes && !no) ARG_ERROR("index argument must be 'yes' or 'no'.");
+      write_index = yes;
+    }
+
     if (parser.isOpt("gpu")) {
       const string & arg = parser.getOptArg("gpu");
       bool yes = strcasecmp("yes", arg.c_str()) == 0;
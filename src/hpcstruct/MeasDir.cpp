@@ -6,7 +6,9 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <dirent.h>
+#include <fcntl.h>
 
 #include <iostream>
 using std::cerr;
@@ -15,10 +17,12 @@ using std::endl;
 #include <dlfcn.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <streambuf>
 #include <new>
+#include <unordered_set>
 #include <vector>
 
 #include <string.h>
@@ -41,265 +45,167 @@ using namespace std;
 
 // Function prototypes
 static void create_structs_directory ( string &structs_dir);
-static void open_makefile ( string &makefile_name, fstream &makefile);
 static void verify_measurements_directory(string &measurements_dir);
 
-// Contents of Makefile to be generated for the directory
-// editorconfig-checker-disable
-static const char* analysis_makefile = R"EOF(
-#*******************************************************************************
-# a helper template makefile used by hpcstruct at runtime
-#
-# if hpcstruct is passed the name of a measurements directory that contains
-# a gpubins subdirectory, this makefile will be used to orchestrate parallel
-# analysis of all gpubins within the subdirectory.
-#
-# to simplify things at execution time, this makefile will be incorporated
-# into hpcstruct as a string and written to a temporary file if it is needed.
-# this avoids the need for hpcstruct to know how to find a copy of this
-# makefile at runtime in an hpctoolkit installation.
-#*******************************************************************************
-
-#-------------------------------------------------------------------------------
-# set up subdirectory paths
-#-------------------------------------------------------------------------------
-GPUBIN_DIR  = $(MEAS_DIR)/gpubins
-STRUCTS_DIR = $(MEAS_DIR)/structs
-
-
-#*******************************************************************************
-# calculate the alternate kind of GPU CFG analysis
-#*******************************************************************************
-ifeq ($(GPUBIN_CFG),yes)
-GPUBIN_CFG_ALT = no
-else
-GPUBIN_CFG_ALT = yes
-endif
-
-
-#*******************************************************************************
-# use a measurement cache, if available
-#*******************************************************************************
-ifneq ($(CACHE)x,x)
-CACHE_ARGS = -c $(CACHE)
-else
-CACHE_ARGS = --nocache
-endif
-
-
-#-------------------------------------------------------------------------------
-# create $(MEAS_DIR)/all.lm: a list of all load modules involved in the execution
-#-------------------------------------------------------------------------------
-$(MEAS_DIR)/all.lm:
-	@echo INFO: identifying load modules that need binary analysis
-	@echo
-	$(PROFLM) $(MEAS_DIR) > $(MEAS_DIR)/all.lm
-
-
-#*******************************************************************************
-# enable analysis of GPU binaries
-#*******************************************************************************
-ifeq ($(GPU_ANALYZE),1)
-GPUBIN_USED_DIR  = $(MEAS_DIR)/gpubins-used
-
-#-------------------------------------------------------------------------------
-# create gpubins-used directory containing links to all GPU binaries used
-#-------------------------------------------------------------------------------
-$(GPUBIN_USED_DIR): $(MEAS_DIR)/all.lm
-	-@mkdir $(GPUBIN_USED_DIR) >&- 2>&-
-	-@cd $(GPUBIN_USED_DIR) >&- 2>&-; for i in `cat $(MEAS_DIR)/all.lm | grep gpubin`; do ln -s $(MEAS_DIR)/$$i; done >&- 2>&-
-
-#-------------------------------------------------------------------------------
-# $(GB): gpubin files
-#-------------------------------------------------------------------------------
-GB := $(wildcard $(GPUBIN_USED_DIR)/*)
-
-#-------------------------------------------------------------------------------
-# $(GS): hpcstruct files for gpubins
-#-------------------------------------------------------------------------------
-GS := $(patsubst $(GPUBIN_USED_DIR)/%,$(STRUCTS_DIR)/%-gpucfg-$(GPUBIN_CFG).hpcstruct,$(GB))
-
-#-------------------------------------------------------------------------------
-# $(GW): warning files that may be generated during structure analysis of gpubins
-#-------------------------------------------------------------------------------
-GW := $(patsubst %.hpcstruct,%.warnings,$(GS))
-
-endif
-
-#*******************************************************************************
-#*******************************************************************************
-
-
-#*******************************************************************************
-# enable analysis of CPU binaries
-#*******************************************************************************
-ifeq ($(CPU_ANALYZE),1)
-CPUBIN_DIR  = $(MEAS_DIR)/cpubins
-
-#-------------------------------------------------------------------------------
-# create cpubins directory containing links to all CPU binaries
-#-------------------------------------------------------------------------------
-$(CPUBIN_DIR): $(MEAS_DIR)/all.lm
-	-@mkdir $(CPUBIN_DIR) >&- 2>&-
-	-@cd $(CPUBIN_DIR) >&- 2>&-; for i in `cat $(MEAS_DIR)/all.lm | grep ^/`; do ln -s $$i; done >&- 2>&-
-	-@cd $(CPUBIN_DIR) >&- 2>&-; for i in `cat $(MEAS_DIR)/all.lm | grep -v gpubin | grep -v ^/`; do ln -s $(MEAS_DIR)/$$i; done >&- 2>&-
-
-#-------------------------------------------------------------------------------
-# $(CB): cpubin files
-#-------------------------------------------------------------------------------
-CB := $(wildcard $(CPUBIN_DIR)/*)
-
-#-------------------------------------------------------------------------------
-# $(CS): hpcstruct files for cpubins
-#-------------------------------------------------------------------------------
-CS := $(patsubst $(CPUBIN_DIR)/%,$(STRUCTS_DIR)/%.hpcstruct,$(CB))
-
-#-------------------------------------------------------------------------------
-# $(CW): warning files that may be generated during structure analysis of cpubins
-#-------------------------------------------------------------------------------
-CW := $(patsubst %.hpcstruct,%.warnings,$(CS))
-
-endif
-#-------------------------------------------------------------------------------
-# execute the sequence of commands for each target in a single shell
-#-------------------------------------------------------------------------------
-.ONESHELL:
-.SILENT:
-
-.DEFAULT_GOAL := all
-
-#-------------------------------------------------------------------------------
-# rule for analyzing a cpu binary
-# 1. analyze a cpu binary file in $(CPUBIN)
-# 2. produce a hpcstruct file in $(STRUCTS_DIR)
-# 3. leave a warnings file in $(STRUCTS_DIR) if trouble arises
-# 4. announce when analysis of a cpu binary begins and ends
-#-------------------------------------------------------------------------------
-$(STRUCTS_DIR)/%.hpcstruct: $(CPUBIN_DIR)/%
-	@cpubin_name=`basename -s x $<`
-	@input_name=`cat $(MEAS_DIR)/all.lm | grep "/$$cpubin_name$$"`
-	struct_name=$@
-	warn_name=$(STRUCTS_DIR)/$$cpubin_name.warnings
-	# @echo  DEBUG cpubin = $$cpu_bin_name
-	nbytes=`du -b -L $< | tail -1 | awk '{ print $$1 }'`
-	meas_dir=$(MEAS_DIR)
-	# echo DEBUG meas_dir = $$meas_dir
-
-	if test $$nbytes -gt $(CPAR_SIZE) ; then
-		# inform the user the analysis is starting
-		PARSTAT=concurrent
-		if test $(THREADS) -gt 1 ; then
-			echo  \ begin parallel analysis of CPU binary $$cpubin_name \(size = $$nbytes, threads = $(THREADS)\)
-			PARSTAT=parallel
-		else
-			echo \ begin concurrent analysis of CPU binary $$cpubin_name \(size = $$nbytes, threads = 1\)
-		fi
-
-		#  invoke hpcstruct on the CPU binary in the measurements directory
-		$(STRUCT) $(CACHE_ARGS) -j $(THREADS) -o $$struct_name -M $$meas_dir $$input_name > $$warn_name 2>&1 || { err=$$?; egrep 'ERROR|WARNING' $$warn_name >&2; }
-		# echo DEBUG: hpcstruct for analysis of CPU binary $$cpubin_name returned
-
-		# See if there is anything to worry about in the warnings file
-		#  suppress any ADVICE, INFO, DEBUG, and CACHESTAT lines and any blank lines;
-		#  it's an error if anything remains
-		#
-		errs=`sed 's/^$//INFO/g;' $$warn_name |grep -v DEBUG | grep -v CACHESTAT | grep -v INFO | grep -v ADVICE | wc -l`
-
-		# echo DEBUG errs = XX $$errs XX
-		if [ $${errs} -eq 1 ] ; then
-			echo WARNING: incomplete analysis of $$cpubin_name';' see $$warn_name for details
-		fi
-
-		# extract the status relative to the cache
-		CACHE_STAT=`grep CACHESTAT $$warn_name | sed 's/CACHESTAT// ' `
-		# echo DEBUG CACHE_STAT = XX $$CACHE_STAT XX
-		echo \ \ \ end  $$PARSTAT analysis of CPU binary $$cpubin_name $$CACHE_STAT
-
-	fi
-
-#-------------------------------------------------------------------------------
-# rule  for analyzing a gpubin
-# 1. analyze a gpubin file in $(GPUBIN_DIR)
-# 2. produce a hpcstruct file in $(STRUCTS_DIR)
-# 3. leave a warnings file in $(STRUCTS_DIR) if trouble arises
-# 4. announce when analysis of a gpubin begins and ends
-#-------------------------------------------------------------------------------
-$(STRUCTS_DIR)/%-gpucfg-$(GPUBIN_CFG).hpcstruct: $(GPUBIN_DIR)/%
-	@gpubin_name=`basename -s x $<`
-	@input_name=`cat $(MEAS_DIR)/all.lm | grep "/$$gpubin_name$$"`
-	struct_name=$@
-	rm -f $(STRUCTS_DIR)/$$gpubin_name-gpucfg-$(GPUBIN_CFG_ALT).hpcstruct
-	rm -f $(STRUCTS_DIR)/$$gpubin_name-gpucfg-$(GPUBIN_CFG_ALT).warnings
-	warn_name=$(STRUCTS_DIR)/$$gpubin_name-gpucfg-$(GPUBIN_CFG).warnings
-	nbytes=`du -b -L $< | tail -1 | awk '{ print $$1 }'`
-	meas_dir=$(MEAS_DIR)
-	# echo DEBUG meas_dir = $$meas_dir
-
-	if test $$nbytes -gt $(GPAR_SIZE) ; then
-		# tell user we're starting
-		PARSTAT=concurrent
-		if test $(THREADS) -gt 1 ; then
-			PARSTAT=parallel
-			echo \ begin parallel [gpucfg=$(GPUBIN_CFG)] analysis of GPU binary $$gpubin_name \(size = $$nbytes, threads = $(THREADS)\)
-		else
-			echo \ begin concurrent [gpucfg=$(GPUBIN_CFG)] analysis of GPU binary $$gpubin_name \(size = $$nbytes, threads = 1\)
-		fi
-
-		# invoke hpcstruct to process the gpu binary
-		$(STRUCT) $(CACHE_ARGS) -j $(THREADS) --gpucfg $(GPUBIN_CFG) -o $$struct_name -M $$meas_dir $$input_name > $$warn_name 2>&1 || { err=$$?; egrep 'ERROR|WARNING' $$warn_name >&2; }
-		# echo debug: hpcstruct for analysis of GPU binary $$gpubin_name returned
-
-		# See if there is anything to worry about in the warnings file
-		#  suppress any ADVICE, INFO, DEBUG, and CACHESTAT lines and any blank lines;
-		#  it's an error if anything remains
-		#
-		errs=`sed 's/^$//INFO/g;' $$warn_name |grep -v DEBUG | grep -v CACHESTAT | grep -v INFO | grep -v ADVICE | wc -l`
-		# echo DEBUG errs = XX $$errs XX
-
-		if [ $${errs} -eq 1 ] ; then
-			echo WARNING: incomplete analysis of $$gpubin_name';' see $$warn_name for details
-		fi
-
-		# extract the status relative to the cache
-		CACHE_STAT=`grep CACHESTAT $$warn_name  | sed 's/CACHESTAT// ' `
-		# echo DEBUG CACHE_STAT = XX $$CACHE_STAT XX
-
-		echo \ \ \ end  $$PARSTAT [gpucfg=$(GPUBIN_CFG)] analysis of GPU binary $$gpubin_name $$CACHE_STAT
-	fi
-
-#-------------------------------------------------------------------------------
-# analyze files to create structure files
-#-------------------------------------------------------------------------------
-DOMAKE=1
-
-ifeq ($(DOMAKE),1)
-all: $(CPUBIN_DIR) $(GPUBIN_USED_DIR)
-	$(MAKE) -j $(LJOBS) THREADS=$(LTHREADS) GPAR_SIZE=$(PAR_SIZE) CPAR_SIZE=$(PAR_SIZE) analyze
-	$(MAKE) -j $(SJOBS) THREADS=$(STHREADS) GPAR_SIZE=0 CPAR_SIZE=0 analyze
-endif
-
-analyze: $(GS) $(CS)
-
-#-------------------------------------------------------------------------------
-# remove all generated files
-#-------------------------------------------------------------------------------
-clean:
-	@echo removing all hpcstruct files in $(STRUCTS_DIR)
-	@rm -f $(GS)
-	@rm -f $(CS)
-	@echo removing all links to CPU binaries in $(CPUBIN_DIR)
-	@rm -rf $(CPUBIN_DIR)
-	@rm -rf $(MEAS_DIR)/all.lm
-	@echo removing all warnings files in $(STRUCTS_DIR)
-	@rm -f $(CW)
-	@rm -f $(GW)
-)EOF";
-// editorconfig-checker-enable
+namespace {
+
+// One binary to be analyzed by a child hpcstruct
+struct AnalysisJob {
+  string input_name;    // load module name as listed in all.lm
+  string binary_path;   // path to the binary itself
+  string binary_name;   // basename of the binary, used in messages
+  string struct_path;   // hpcstruct file to produce
+  string warn_path;     // captured stdout/stderr of the child
+  bool gpu;
+  off_t size;
+  bool cached;          // the cache already holds a structure file for it
+  unsigned int threads;
+  pid_t pid;
+};
 
+}
+
+static string
+path_basename(const string &path)
+{
+  size_t pos = path.rfind('/');
+  return pos == string::npos ? path : path.substr(pos + 1);
+}
+
+// Launch a child process running argv[0] in directory cwd, with stdout and
+// stderr sent to the file out_path. Returns the pid, or -1 on failure.
+static pid_t
+spawn_child
+(
+  const vector<string> &argv,
+  const string &cwd,
+  const string &out_path
+)
+{
+  vector<char*> cargv;
+  for (const auto &a : argv) cargv.push_back(const_cast<char*>(a.c_str()));
+  cargv.push_back(NULL);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // Child. Only async-signal-safe calls from here on.
+    int fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0
+        || chdir(cwd.c_str()) != 0) {
+      _exit(125);
+    }
+    close(fd);
+    execv(cargv[0], cargv.data());
+    _exit(127);
+  }
+  return pid;
+}
 
+// List the load modules of a measurements directory into all.lm using
+// hpcproflm, and return them
+static vector<string>
+identify_load_modules
+(
+  const string &hpcproflm_path,
+  const string &measurements_dir,
+  const string &structs_dir
+)
+{
+  cout << "INFO: identifying load modules that need binary analysis\n" << endl;
+
+  string lm_path = measurements_dir + "/all.lm";
+  pid_t pid = spawn_child({hpcproflm_path, measurements_dir}, structs_dir, lm_path);
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0
+      || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    DIAG_EMsg("Unable to identify the load modules of measurements directory "
+              << measurements_dir << "; see " << lm_path);
+    exit(1);
+  }
+
+  vector<string> modules;
+  std::ifstream lm(lm_path);
+  for (string line; std::getline(lm, line); ) {
+    if (!line.empty()) modules.push_back(line);
+  }
+  return modules;
+}
+
+// Check whether the structure cache already holds an entry for a binary,
+// the same way the child hpcstruct will look for it
+static bool
+cache_has_entry
+(
+  const string &cache_path,
+  const AnalysisJob &job,
+  bool gpucfg
+)
+{
+  char *hash = hpcstruct_cache_hash(job.binary_path.c_str());
+  string entry = cache_path + "/FLAT/" + hash
+                 + ((job.gpu && gpucfg) ? "/hpcstruct+gpucfg" : "/hpcstruct");
+  free(hash);
+  return access(entry.c_str(), R_OK) == 0;
+}
+
+// Report the outcome of a child hpcstruct, as recorded in its warnings file
+static void
+finish_job
+(
+  const AnalysisJob &job,
+  int status,
+  const string &gpucfg
+)
+{
+  bool failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  unsigned int errs = 0;
+  string cache_stat;
+
+  std::ifstream warn(job.warn_path);
+  for (string line; std::getline(warn, line); ) {
+    size_t pos = line.find("CACHESTAT");
+    if (pos != string::npos) {
+      pos = line.find_first_not_of(' ', pos + strlen("CACHESTAT"));
+      cache_stat = (pos == string::npos) ? "" : line.substr(pos);
+      continue;
+    }
+    // anything other than ADVICE, INFO and DEBUG lines is worth a warning
+    if (line.empty() || line.find("DEBUG") != string::npos
+        || line.find("INFO") != string::npos
+        || line.find("ADVICE") != string::npos) {
+      continue;
+    }
+    errs++;
+    if (failed && (line.find("ERROR") != string::npos
+                   || line.find("WARNING") != string::npos)) {
+      cerr << line << endl;
+    }
+  }
+
+  if (errs > 0) {
+    cout << "WARNING: incomplete analysis of " << job.binary_name
+         << "; see " << job.warn_path << " for details" << endl;
+  }
+
+  cout << "   end  " << (job.threads > 1 ? "parallel" : "concurrent");
+  if (job.gpu) {
+    cout << " [gpucfg=" << gpucfg << "] analysis of GPU binary ";
+  } else {
+    cout << " analysis of CPU binary ";
+  }
+  cout << job.binary_name << " " << cache_stat << endl;
+}
+
+
+//
+// For a measurements directory, launch hpcstruct to analyze the CPU and GPU
+// binaries associated with the measurements.
 //
-// For a measurements directory, write a Makefile and launch hpcstruct
-// to analyze CPU and GPU binaries associated with the measurements
+// Binaries are scheduled longest-first onto a pool of `jobs` threads: each
+// large binary gets a parallel analysis with `pthreads` threads, small ones
+// get `small_threads`, and binaries already in the structure cache only
+// need one. Whenever a child finishes, the largest pending binary that
+// fits in the freed threads is started next.
 //
 
 
@@ -336,17 +242,9 @@ doMeasurementsDir
     hpcstruct_path = path != NULL && path[0] != '\0' ? path : HPCTOOLKIT_INSTALL_PREFIX "/bin/hpcstruct";
   }
 
-  //
-  // Write Makefile and launch analysis.
-  //
   string structs_dir = measurements_dir + "/structs";
   create_structs_directory(structs_dir);
 
-  string makefile_name = structs_dir + "/Makefile";
-
-  fstream makefile;
-  open_makefile(makefile_name, makefile);
-
   // Figure out how many threads and jobs are to be used
   unsigned int pthreads;
   unsigned int jobs;
@@ -389,38 +287,10 @@ doMeasurementsDir
   }
 
   string gpucfg = args.compute_gpu_cfg ? "yes" : "no";
+  string gpucfg_alt = args.compute_gpu_cfg ? "no" : "yes";
 
   // two threads per small binary unless concurrency is 1
-  int small_jobs = (jobs >= 2) ? jobs / 2 : jobs;
-  int small_threads = (jobs == 1) ? 1 : 2;
-
-  // Write the header with definitions to the makefile
-  makefile << "MEAS_DIR =  "    << measurements_dir << "\n"
-           << "GPUBIN_CFG = "   << gpucfg << "\n"
-           << "CPU_ANALYZE = "  << args.analyze_cpu_binaries << "\n"
-           << "GPU_ANALYZE = "  << args.analyze_gpu_binaries << "\n"
-           << "PAR_SIZE = "     << args.parallel_analysis_threshold << "\n"
-           << "JOBS = "         << jobs << "\n"
-           << "SJOBS = "        << small_jobs << "\n"
-           << "STHREADS = "     << small_threads << "\n"
-           << "LJOBS = "        << jobs/pthreads << "\n"
-           << "LTHREADS = "     << pthreads << "\n"
-           << "PROFLM = "       << hpcproflm_path << "\n"
-           << "STRUCT= "        << hpcstruct_path << "\n";
-
-  if (!cache_path.empty()) {
-    makefile << "CACHE= "       << cache_path << "\n";
-  } else {
-    makefile << "CACHE= " << "\n";
-  }
-
-  makefile << analysis_makefile << endl;
-
-  makefile.close();
-
-  // Construct the make command to invoke it
-  string make_cmd = string("make -C ") + structs_dir + " -k --silent "
-      + " --no-print-directory all";
+  unsigned int small_threads = (jobs == 1) ? 1 : 2;
 
   // Describe the parallelism and concurrency used
   cout << "INFO: Using a pool of " << jobs << " threads to analyze binaries in a measurement directory" << endl;
@@ -429,11 +299,133 @@ doMeasurementsDir
   cout << "INFO: Analyzing each small binary using " << small_threads <<
     " thread" << ((small_threads > 1) ? "s" : "") <<  "\n" << endl;
 
-  // Run the make command
   //
-  if (system(make_cmd.c_str()) != 0) {
-    DIAG_EMsg("Running make to generate hpcstruct files for measurement directory failed.");
-    exit(1);
+  // Collect the binaries that need analysis. Like make, skip any whose
+  // structure file is newer than the binary.
+  //
+  vector<AnalysisJob> pending;
+  std::unordered_set<string> seen;
+  for (const string &lm : identify_load_modules(hpcproflm_path, measurements_dir, structs_dir)) {
+    AnalysisJob job;
+    job.input_name = lm;
+    job.gpu = lm.find("gpubin") != string::npos;
+    if (job.gpu ? !args.analyze_gpu_binaries : !args.analyze_cpu_binaries) continue;
+
+    job.binary_path = (lm[0] == '/') ? lm : measurements_dir + "/" + lm;
+    job.binary_name = path_basename(lm);
+    string stem = structs_dir + "/" + job.binary_name;
+    if (job.gpu) {
+      unlink((stem + "-gpucfg-" + gpucfg_alt + ".hpcstruct").c_str());
+      unlink((stem + "-gpucfg-" + gpucfg_alt + ".warnings").c_str());
+      stem += "-gpucfg-" + gpucfg;
+    }
+    job.struct_path = stem + ".hpcstruct";
+    job.warn_path = stem + ".warnings";
+    if (!seen.insert(job.struct_path).second) continue;
+
+    struct stat bin_sb, struct_sb;
+    if (stat(job.binary_path.c_str(), &bin_sb) != 0) {
+      cerr << "WARNING: unable to access binary " << job.binary_path
+           << ": " << strerror(errno) << endl;
+      continue;
+    }
+    if (stat(job.struct_path.c_str(), &struct_sb) == 0
+        && struct_sb.st_mtime >= bin_sb.st_mtime) {
+      continue;
+    }
+
+    job.size = bin_sb.st_size;
+    job.cached = false;
+    job.pid = -1;
+    pending.push_back(std::move(job));
+  }
+
+  // Hashing reads every binary, so check the cache in parallel
+  if (!cache_path.empty()) {
+    #pragma omp parallel for schedule(dynamic) num_threads(jobs)
+    for (size_t i = 0; i < pending.size(); i++) {
+      pending[i].cached = cache_has_entry(cache_path, pending[i], args.compute_gpu_cfg);
+    }
+  }
+
+  for (auto &job : pending) {
+    if (job.cached) job.threads = 1;
+    else if (job.size > args.parallel_analysis_threshold) job.threads = pthreads;
+    else job.threads = small_threads;
+    job.threads = std::min(job.threads, jobs);
+  }
+
+  // Longest job first: uncached binaries by decreasing size, then cache hits
+  std::stable_sort(pending.begin(), pending.end(),
+    [](const AnalysisJob &a, const AnalysisJob &b) {
+      if (a.cached != b.cached) return !a.cached;
+      return a.size > b.size;
+    });
+
+  vector<AnalysisJob> running;
+  unsigned int idle = jobs;
+  while (!pending.empty() || !running.empty()) {
+    // Start the largest pending binaries that fit in the idle threads
+    for (auto it = pending.begin(); it != pending.end() && idle > 0; ) {
+      if (it->threads > idle) {
+        ++it;
+        continue;
+      }
+      AnalysisJob &job = *it;
+
+      cout << " begin " << (job.threads > 1 ? "parallel" : "concurrent");
+      if (job.gpu) {
+        cout << " [gpucfg=" << gpucfg << "] analysis of GPU binary ";
+      } else {
+        cout << " analysis of CPU binary ";
+      }
+      cout << job.binary_name << " (size = " << job.size
+           << ", threads = " << job.threads << ")" << endl;
+
+      vector<string> argv = {hpcstruct_path};
+      if (cache_path.empty()) {
+        argv.push_back("--nocache");
+      } else {
+        argv.insert(argv.end(), {"-c", cache_path});
+      }
+      argv.insert(argv.end(), {"-j", std::to_string(job.threads),
+                               "--index", args.write_index ? "yes" : "no"});
+      if (job.gpu) {
+        argv.insert(argv.end(), {"--gpucfg", gpucfg});
+      }
+      argv.insert(argv.end(), {"-o", job.struct_path, "-M", measurements_dir,
+                               job.input_name});
+
+      job.pid = spawn_child(argv, structs_dir, job.warn_path);
+      if (job.pid < 0) {
+        DIAG_EMsg("Unable to launch hpcstruct for " << job.binary_path
+                  << ": " << strerror(errno));
+        it = pending.erase(it);
+        continue;
+      }
+      idle -= job.threads;
+      running.push_back(std::move(job));
+      it = pending.erase(it);
+    }
+
+    if (running.empty()) break;
+
+    // Wait for any analysis to finish
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      DIAG_EMsg("Waiting for hpcstruct children failed: " << strerror(errno));
+      exit(1);
+    }
+    for (auto it = running.begin(); it != running.end(); ++it) {
+      if (it->pid == pid) {
+        finish_job(*it, status, gpucfg);
+        idle += it->threads;
+        running.erase(it);
+        break;
+      }
+    }
   }
 
   // Write a blank line
@@ -500,19 +492,3 @@ create_structs_directory
     exit(1);
   }
 }
-
-// Open the Makefile to create it.
-static void
-open_makefile
-(
-  string &makefile_name,
-  fstream &makefile
-)
-{
-  makefile.open(makefile_name, fstream::out | fstream::trunc);
-
-  if (! makefile.is_open()) {
-    DIAG_EMsg("Unable to write file: " << makefile_name);
-    exit(1);
-  }
-}
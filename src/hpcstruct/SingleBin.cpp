@@ -29,6 +29,7 @@ using std::endl;
 
 #include "hpcstruct.hpp"
 #include "Struct.hpp"
+#include "Struct-Index.hpp"
 #include "../common/lean/gpu-binary-naming.h"
 #include "../common/lean/hpcio.h"
 #include "../common/realpath.h"
@@ -89,6 +90,19 @@ static void replace_lmname(std::string& line, const std::string& newname) {
   line.replace(first, last-first, newname);
 }
 
+// Check whether the load module name in a structure file is already
+// newname, in which case the file can be used without rewriting it.
+static bool lmname_current(const std::string& path, const std::string& newname) {
+  std::ifstream infs(path);
+  for(std::string line; std::getline(infs, line); ) {
+    if(line.find("<LM") == std::string::npos) continue;
+    std::string replaced = line;
+    replace_lmname(replaced, newname);
+    return replaced == line;
+  }
+  return false;
+}
+
 void
 doSingleBinary
 (
@@ -151,6 +165,7 @@ doSingleBinary
   string cache_path_directory;
   string cache_flat_entry;
   string cache_directory;
+  int cache_lock = -1;
 
   // Make sure the file is readable
   if ( access(args.full_filenm.c_str(), R_OK) != 0 ) {
@@ -178,6 +193,9 @@ doSingleBinary
       // Compute a hash of the binary
       char *hash = hpcstruct_cache_hash(args.full_filenm.c_str());
 
+      // Wait for any other hpcstruct working on this binary to finish
+      cache_lock = hpcstruct_cache_lock(cache_directory.c_str(), hash, true);
+
       //  If it's a gpu binary and the user requested the cfg, set a suffix
       string suffix = "";
       if (gpu_binary && args.compute_gpu_cfg) {
@@ -262,18 +280,27 @@ doSingleBinary
       error = n;
     }
   }
+  hpcstruct.close(error);
+  gaps.close(error);
 
   // If we're pulling from the cache, ensure the module path in the new file is correct
   if(!error) {
     auto cache = hpcstruct.cached();
-    if(!cache.empty()) {
-      std::ifstream infs(cache);
-      std::ofstream outfs(hpcstruct_path);
-
-      // Slurp, adjust and output lines one at a time
-      for(std::string line; std::getline(infs, line); ) {
-        replace_lmname(line, args.in_filenm);
-        outfs << line << "\n";
+    if(!cache.empty() && !hpcstruct_path.empty()) {
+      if(lmname_current(cache, args.in_filenm)) {
+        hpcstruct_cache_retrieve(hpcstruct_path.c_str(), cache.c_str());
+      } else {
+        std::ifstream infs(cache);
+        std::ofstream outfs(hpcstruct_path);
+
+        // Slurp, adjust and output lines one at a time
+        for(std::string line; std::getline(infs, line); ) {
+          replace_lmname(line, args.in_filenm);
+          outfs << line << "\n";
+        }
+        if (args.cache_stat == CACHE_ENTRY_COPIED) {
+          args.cache_stat = CACHE_ENTRY_COPIED_RENAME;
+        }
       }
     }
   }
@@ -281,6 +308,17 @@ doSingleBinary
   hpcstruct.finalize(error);
   gaps.finalize(error);
 
+  hpcstruct_cache_unlock(cache_lock);
+  if (args.cache_stat == CACHE_ENTRY_ADDED || args.cache_stat == CACHE_ENTRY_REPLACED) {
+    hpcstruct_cache_evict(cache_directory.c_str());
+  }
+
+  // Index the final hpcstruct file, if requested
+  if (!error && args.write_index && !hpcstruct_path.empty()) {
+    BAnal::Struct::makeStructIndex(hpcstruct_path,
+                                   hpcstruct_path + BAnal::Struct::IndexSuffix);
+  }
+
   // Set cache usage status string
   const char * cache_stat_str;
   switch( args.cache_stat ) {
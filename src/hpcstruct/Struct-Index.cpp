@@ -0,0 +1,379 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*-
+
+// This file converts a finished hpcstruct file into its binary index. The
+// tables are built with the same nesting rules hpcprof's StructFile finalizer
+// applies to the XML, so loading either gives the same results.
+
+//***************************************************************************
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
+#include <xercesc/sax2/Attributes.hpp>
+#include <xercesc/util/XMLString.hpp>
+
+#include "../common/lean/formats/structidx.h"
+#include "../common/diagnostics.h"
+
+#include "Struct-Index.hpp"
+
+using namespace std;
+using namespace xercesc;
+
+// NOTE: Xerces is initialized by the static XercesState in Structure-Cache.cpp
+
+namespace {
+
+string xmlstr(const XMLCh* const str) {
+  if(str == nullptr) return "";
+  char* n = XMLString::transcode(str);
+  if(n == nullptr) return "";
+  string r(n);
+  XMLString::release(&n);
+  return r;
+}
+
+struct XMLStr {
+  XMLStr(const string& s) : str(XMLString::transcode(s.c_str())) {};
+  ~XMLStr() { XMLString::release(&str); }
+  operator const XMLCh*() const { return str; }
+  XMLCh* str;
+};
+
+constexpr uint64_t NoString = UINT64_MAX;
+
+// Address range, ordered the same way as hpcprof's util::interval: ranges that
+// overlap compare equivalent, so the first one inserted wins.
+struct Range {
+  uint64_t begin;
+  uint64_t end;
+  bool operator<(const Range& o) const {
+    return o.begin >= end && begin < o.begin;
+  }
+};
+
+struct Module {
+  string path;
+  bool hasCalls = false;
+  // String references are offsets in the string table, NoString if absent
+  vector<fmt_structidx_function_t> funcs;
+  vector<fmt_structidx_scope_t> scopes;
+  map<Range, pair<uint32_t, uint32_t>> leaves;
+  vector<fmt_structidx_call_t> calls;
+};
+
+// Everything collected from the hpcstruct file, before layout
+struct Index {
+  vector<Module> modules;
+  string strings;
+  unordered_map<string, uint64_t> stringIds;
+
+  uint64_t str(const string& s) {
+    auto [it, first] = stringIds.try_emplace(s, strings.size());
+    if(first) {
+      strings += s;
+      strings.push_back('\0');
+    }
+    return it->second;
+  }
+};
+
+vector<Range> parseVs(const string& vs) {
+  // General format: {[0xstart-0xend) ...}
+  if(vs.size() < 2 || vs.at(0) != '{')
+    throw invalid_argument("Bad VMA description: bad start");
+  vector<Range> vals;
+  const char* c = vs.data() + 1;
+  while(*c != '}') {
+    char* cx;
+    if(isspace(*c)) { c++; continue; }
+    if(*c != '[') throw invalid_argument("Bad VMA description: bad segment opening");
+    c++;
+    uint64_t lo = strtoull(c, &cx, 16);
+    c = cx;
+    if(*c != '-') throw invalid_argument("Bad VMA description: bad segment middle");
+    c++;
+    uint64_t hi = strtoull(c, &cx, 16);
+    c = cx;
+    if(*c != ')') throw invalid_argument("Bad VMA description: bad segment closing");
+    c++;
+    vals.push_back({lo, hi});
+  }
+  return vals;
+}
+
+class IndexBuilder : public DefaultHandler {
+public:
+  IndexBuilder(Index& idx) : idx(idx) {}
+
+  void startElement(const XMLCh* const, const XMLCh* const localname,
+                    const XMLCh* const, const Attributes& attrs) override {
+    string ename = xmlstr(localname);
+    auto attr = [&](const char* n) { return xmlstr(attrs.getValue(XMLStr(n))); };
+
+    if(ename == "HPCToolkitStructure") return;
+    if(ename == "LM") {
+      if(mod != nullptr) throw logic_error("Nested <LM> tags");
+      mod = &idx.modules.emplace_back();
+      mod->path = attr("n");
+      mod->hasCalls = attr("has-calls") == "1";
+      entries.clear();
+      stack = {};
+      stack.emplace();
+      return;
+    }
+    if(mod == nullptr) throw logic_error("<" + ename + "> tag outside of an <LM>");
+
+    const Ctx top = stack.top();
+    if(ename == "F") {  // File
+      auto file = attr("n");
+      if(file.empty()) throw logic_error("Bad <F> tag seen");
+      auto& next = stack.emplace(top, 'F');
+      next.file = idx.str(file);
+    } else if(ename == "P") {  // Procedure
+      if(top.func >= 0) throw logic_error("<P> tags cannot be nested!");
+      auto is = parseVs(attr("v"));
+      if(is.size() != 1) throw invalid_argument("VMA on <P> should only have one range!");
+      if(is[0].end != is[0].begin+1) throw invalid_argument("VMA on <P> should represent a single byte!");
+      if(!entries.insert(is[0].begin).second)
+        throw logic_error("<P> tags must have unique function entries!");
+      fmt_structidx_function_t fn = {};
+      fn.pName = idx.str(attr("n"));
+      fn.entry = is[0].begin;
+      fn.hasEntry = true;
+      fn.pFile = top.file;
+      fn.line = top.file != NoString ? stoul(attr("l")) : 0;
+      uint32_t fidx = mod->funcs.size();
+      mod->funcs.push_back(fn);
+      auto& next = stack.emplace(top, 'P');
+      next.node = pushScope(fmt_structidx_scope_function, fmt_structidx_relation_enclosure,
+                            top.node, fidx, 0, NoString, 0);
+      next.func = fidx;
+    } else if(ename == "L") {  // Loop
+      auto fpath = attr("f");
+      if(fpath.empty() && top.file == NoString)
+        throw logic_error("<L> tag without an implicit f= attribute!");
+      uint64_t file = fpath.empty() ? top.file : idx.str(fpath);
+      auto& next = stack.emplace(top, 'L');
+      next.node = pushScope(fmt_structidx_scope_loop, fmt_structidx_relation_enclosure,
+                            top.node, 0, parseVs(attr("v")).at(0).begin, file,
+                            stoul(attr("l")));
+      next.file = file;
+    } else if(ename == "S" || ename == "C") {  // Statement
+      if(top.file == NoString) throw logic_error("<S> tag without an implicit f= attribute!");
+      if(top.func < 0) throw logic_error("<S> tag without an enclosing <P>!");
+      uint32_t leaf = pushScope(fmt_structidx_scope_line, fmt_structidx_relation_enclosure,
+                                top.node, 0, 0, top.file, stoul(attr("l")));
+      auto is = parseVs(attr("v"));
+      for(const auto& i: is)
+        mod->leaves.try_emplace(i, leaf - 1, top.func);
+      if(ename == "C") {  // Call: <S> with an additional call edge
+        if(is.size() != 1) throw invalid_argument("VMA on <C> tag should only have one range!");
+        auto callee = attr("t");
+        if(!callee.empty()) {
+          fmt_structidx_call_t call = {};
+          call.callee = stoull(callee, nullptr, 16);
+          call.callerInst = is[0].begin;
+          call.caller = top.func;
+          mod->calls.push_back(call);
+        }
+      }
+      // Statements are leaves, they are not pushed onto the stack
+    } else if(ename == "A") {
+      if(top.tag != 'A') {  // First A, gives the caller line
+        auto& next = stack.emplace(top, 'A');
+        auto fpath = attr("f");
+        if(!fpath.empty()) next.file = idx.str(fpath);
+        next.a_line = stoul(attr("l"));
+      } else {  // Double A, inlined function
+        if(top.file == NoString) throw logic_error("Double-<A> without an implicit f= attribute!");
+        auto fpath = attr("f");
+        uint64_t file = fpath.empty() ? top.file : idx.str(fpath);
+        fmt_structidx_function_t fn = {};
+        fn.pName = idx.str(attr("n"));
+        fn.hasEntry = false;
+        fn.pFile = file;
+        fn.line = stoul(attr("l"));
+        uint32_t fidx = mod->funcs.size();
+        mod->funcs.push_back(fn);
+        auto& next = stack.emplace(top, 'B');
+        next.file = file;
+        uint32_t call = pushScope(fmt_structidx_scope_line, fmt_structidx_relation_inlined_call,
+                                  top.node, 0, 0, top.file, top.a_line);
+        next.node = pushScope(fmt_structidx_scope_function, fmt_structidx_relation_enclosure,
+                              call, fidx, 0, NoString, 0);
+      }
+    } else throw logic_error("Unknown tag " + ename);
+  }
+
+  void endElement(const XMLCh* const, const XMLCh* const localname,
+                  const XMLCh* const) override {
+    string ename = xmlstr(localname);
+    if(ename == "HPCToolkitStructure" || ename == "S" || ename == "C") return;
+    if(ename == "LM") {
+      mod = nullptr;
+      return;
+    }
+    stack.pop();
+  }
+
+  void fatalError(const SAXParseException& e) override { throw e; }
+
+private:
+  struct Ctx {
+    char tag = 'R';
+    uint64_t file = NoString;
+    int64_t func = -1;  // Index of the enclosing <P> Function
+    uint32_t node = 0;  // Index+1 of the innermost Scope
+    uint32_t a_line = 0;
+    Ctx() = default;
+    Ctx(const Ctx& o, char t) : Ctx(o) { tag = t; }
+  };
+
+  // Add a new Scope to the current Module, returns its index+1
+  uint32_t pushScope(uint8_t kind, uint8_t relation, uint32_t parent,
+                     uint32_t func, uint64_t addr, uint64_t file, uint32_t line) {
+    fmt_structidx_scope_t sc = {};
+    sc.kind = kind;
+    sc.relation = relation;
+    sc.parent = parent;
+    sc.function = func;
+    sc.addr = addr;
+    sc.pFile = file;
+    sc.line = line;
+    mod->scopes.push_back(sc);
+    return mod->scopes.size();
+  }
+
+  Index& idx;
+  Module* mod = nullptr;
+  std::stack<Ctx> stack;
+  unordered_set<uint64_t> entries;
+};
+
+// Lay out and write the collected Index to the given stream
+void writeIndex(ostream& os, Index& idx) {
+  for(auto& m: idx.modules) (void)idx.str(m.path);
+
+  // Layout: header, Module table, per-Module tables, then the string table
+  uint64_t cursor = FMT_STRUCTIDX_SZ_FHdr;
+  uint64_t pModules = cursor;
+  cursor += idx.modules.size() * FMT_STRUCTIDX_SZ_Module;
+  vector<fmt_structidx_module_t> mods;
+  for(const auto& m: idx.modules) {
+    fmt_structidx_module_t sm = {};
+    sm.nFunctions = m.funcs.size();
+    sm.nScopes = m.scopes.size();
+    sm.nLeaves = m.leaves.size();
+    sm.nCalls = m.calls.size();
+    sm.hasCalls = m.hasCalls;
+    cursor = (cursor + 7) & ~7;
+    sm.pFunctions = cursor;
+    cursor += sm.nFunctions * FMT_STRUCTIDX_SZ_Function;
+    sm.pScopes = cursor;
+    cursor += sm.nScopes * FMT_STRUCTIDX_SZ_Scope;
+    sm.pLeaves = cursor;
+    cursor += sm.nLeaves * FMT_STRUCTIDX_SZ_Leaf;
+    sm.pCalls = cursor;
+    cursor += sm.nCalls * FMT_STRUCTIDX_SZ_Call;
+    mods.push_back(sm);
+  }
+  const uint64_t pStrings = cursor;
+  auto strp = [&](uint64_t s) { return s == NoString ? 0 : pStrings + s; };
+
+  vector<char> buf(FMT_STRUCTIDX_SZ_FHdr, 0);
+  fmt_structidx_fHdr_t hdr = {};
+  hdr.pModules = pModules;
+  hdr.nModules = mods.size();
+  fmt_structidx_fHdr_write(buf.data(), &hdr);
+  for(size_t i = 0; i < mods.size(); i++) {
+    mods[i].pPath = strp(idx.str(idx.modules[i].path));
+    char d[FMT_STRUCTIDX_SZ_Module];
+    fmt_structidx_module_write(d, &mods[i]);
+    buf.insert(buf.end(), d, d + sizeof d);
+  }
+  for(size_t i = 0; i < mods.size(); i++) {
+    const auto& m = idx.modules[i];
+    buf.resize(mods[i].pFunctions, 0);
+    for(auto fn: m.funcs) {
+      char d[FMT_STRUCTIDX_SZ_Function];
+      fn.pName = strp(fn.pName);
+      fn.pFile = strp(fn.pFile);
+      fmt_structidx_function_write(d, &fn);
+      buf.insert(buf.end(), d, d + sizeof d);
+    }
+    for(auto sc: m.scopes) {
+      char d[FMT_STRUCTIDX_SZ_Scope];
+      sc.pFile = strp(sc.pFile);
+      fmt_structidx_scope_write(d, &sc);
+      buf.insert(buf.end(), d, d + sizeof d);
+    }
+    for(const auto& [range, leaf]: m.leaves) {
+      char d[FMT_STRUCTIDX_SZ_Leaf];
+      fmt_structidx_leaf_t lf = {range.begin, range.end, leaf.first, leaf.second};
+      fmt_structidx_leaf_write(d, &lf);
+      buf.insert(buf.end(), d, d + sizeof d);
+    }
+    for(const auto& call: m.calls) {
+      char d[FMT_STRUCTIDX_SZ_Call];
+      fmt_structidx_call_write(d, &call);
+      buf.insert(buf.end(), d, d + sizeof d);
+    }
+  }
+  buf.insert(buf.end(), idx.strings.begin(), idx.strings.end());
+  buf.insert(buf.end(), fmt_structidx_footer, fmt_structidx_footer + sizeof fmt_structidx_footer);
+  os.write(buf.data(), buf.size());
+}
+
+}  // namespace
+
+bool
+BAnal::Struct::makeStructIndex(const string& structPath, const string& indexPath)
+{
+  Index idx;
+  try {
+    unique_ptr<SAX2XMLReader> parser(XMLReaderFactory::createXMLReader());
+    if(!parser) return false;
+    IndexBuilder handler(idx);
+    parser->setContentHandler(&handler);
+    parser->setErrorHandler(&handler);
+    parser->parse(XMLStr(structPath));
+  } catch(std::exception& e) {
+    DIAG_EMsg("Unable to index structure file " << structPath << ": " << e.what());
+    return false;
+  } catch(SAXException& e) {
+    DIAG_EMsg("Unable to index structure file " << structPath << ": " << xmlstr(e.getMessage()));
+    return false;
+  }
+
+  // Write to a temporary and rename, so hpcprof never sees a partial index
+  string tmpPath = indexPath + "." + to_string(getpid()) + ".tmp";
+  ofstream os(tmpPath, ios::binary | ios::trunc);
+  if(os) writeIndex(os, idx);
+  os.close();
+  if(!os || rename(tmpPath.c_str(), indexPath.c_str()) != 0) {
+    DIAG_EMsg("Unable to write structure index " << indexPath);
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,32 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// -*-Mode: C++;-*-
+
+// This file defines the API for generating the binary index of an hpcstruct
+// file (*.hpcstruct.idx), see common/lean/formats/structidx.h. hpcprof loads
+// the index with mmap in place of parsing the XML.
+
+//***************************************************************************
+
+#ifndef BAnal_Struct_Index_hpp
+#define BAnal_Struct_Index_hpp
+
+#include <string>
+
+namespace BAnal {
+namespace Struct {
+
+// Suffix appended to the hpcstruct file name to name its index
+constexpr const char* IndexSuffix = ".idx";
+
+// Read the (complete) hpcstruct file structPath and write its index to
+// indexPath. Returns false and writes nothing if the conversion fails.
+bool
+makeStructIndex(const std::string& structPath, const std::string& indexPath);
+
+} // namespace Struct
+} // namespace BAnal
+
+#endif
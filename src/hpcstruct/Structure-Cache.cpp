@@ -20,14 +20,21 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <ftw.h>
+#include <linux/fs.h>
 #include <linux/limits.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
 #include <fstream>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <xercesc/sax2/SAX2XMLReader.hpp>
 #include <xercesc/sax2/DefaultHandler.hpp>
@@ -57,6 +64,9 @@ using namespace xercesc;
 
 #define STRUCT_CACHE_ENV "HPCTOOLKIT_HPCSTRUCT_CACHE"
 
+// environment variable bounding the total size of the structure cache
+#define STRUCT_CACHE_LIMIT_ENV "HPCTOOLKIT_HPCSTRUCT_CACHE_LIMIT"
+
 
 
 //***************************************************************************
@@ -83,6 +93,7 @@ typedef enum { PATH_READABLE, PATH_WRITEABLE, PATH_DIR_READABLE, PATH_DIR_WRITEA
 static  ckpath_ret_t ck_path ( const char *path, const char *caller );
 static  ckpath_ret_t mk_dirpath ( const char *path, const char *errortype, bool msg );
 static bool check_cache_file (char *path);
+static int lock_path ( const std::string &path, bool wait );
 
 // return value
 //   1: success
@@ -314,6 +325,130 @@ check_cache_file (char *path)
   return StructureFileCheckVersion(path);
 }
 
+static bool
+empty_string
+(
+ const char *s
+)
+{
+  return s == 0 || *s == 0;
+}
+
+
+static int
+remove_tree_entry(const char *path, const struct stat *, int, struct FTW *)
+{
+  return remove(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+//  Remove a file-system tree, like "rm -rf"
+static void
+remove_tree
+(
+ const std::string &path
+)
+{
+  nftw(path.c_str(), remove_tree_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+//  Take an exclusive advisory lock on the file at path, creating it if
+//  needed. Returns the locked file descriptor, or -1 if the lock is busy
+//  (when not waiting) or cannot be taken.
+static int
+lock_path
+(
+ const std::string &path,
+ bool wait
+)
+{
+  for (;;) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+
+    if (flock(fd, wait ? LOCK_EX : (LOCK_EX | LOCK_NB)) != 0) {
+      close(fd);
+      return -1;
+    }
+
+    // The lock file may have been unlinked by eviction while we waited;
+    // only a lock on the file currently at path counts.
+    struct stat fd_sb, path_sb;
+    if (fstat(fd, &fd_sb) == 0 && stat(path.c_str(), &path_sb) == 0
+        && fd_sb.st_dev == path_sb.st_dev && fd_sb.st_ino == path_sb.st_ino) {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+//  Parse the cache size limit, in bytes with an optional K, M, G or T
+//  suffix. Returns 0 if no limit is set.
+static unsigned long long
+cache_size_limit()
+{
+  const char *str = getenv(STRUCT_CACHE_LIMIT_ENV);
+  if (empty_string(str)) return 0;
+
+  char *end;
+  unsigned long long limit = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'T': case 't': limit <<= 10; // fallthrough
+  case 'G': case 'g': limit <<= 10; // fallthrough
+  case 'M': case 'm': limit <<= 10; // fallthrough
+  case 'K': case 'k': limit <<= 10; break;
+  case '\0': break;
+  default:
+    std::cerr << "WARNING: ignoring malformed " STRUCT_CACHE_LIMIT_ENV " value "
+              << str << std::endl;
+    return 0;
+  }
+  return limit;
+}
+
+namespace {
+// An entry directory in CACHE/PATH: the files cached for one binary
+struct CacheEntry {
+  std::string dir;
+  unsigned long long bytes;
+  struct timespec used;
+};
+}
+
+//  Collect the entry directories under a CACHE/PATH subtree, i.e. the
+//  directories that directly contain files
+static void
+scan_cache_entries
+(
+ const std::string &dir,
+ std::vector<CacheEntry> &entries
+)
+{
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) return;
+
+  unsigned long long bytes = 0;
+  bool has_files = false;
+  for (struct dirent *ent; (ent = readdir(d)) != NULL; ) {
+    if ((strcmp(ent->d_name, ".") == 0) || (strcmp(ent->d_name, "..") == 0)) continue;
+
+    std::string path = dir + "/" + ent->d_name;
+    struct stat sb;
+    if (lstat(path.c_str(), &sb) != 0) continue;
+    if (S_ISDIR(sb.st_mode)) {
+      scan_cache_entries(path, entries);
+    } else if (S_ISREG(sb.st_mode)) {
+      bytes += (unsigned long long) sb.st_blocks * 512;
+      has_files = true;
+    }
+  }
+  closedir(d);
+
+  struct stat sb;
+  if (has_files && stat(dir.c_str(), &sb) == 0) {
+    entries.push_back({dir, bytes, sb.st_mtim});
+  }
+}
+
 //  clean up cache entry being replaced
 
 static int
@@ -331,11 +466,16 @@ hpcstruct_cache_cleanup
   char* oldhash = hpcstruct_cache_needs_cleanup(path, hash);
 
   if (oldhash != NULL) {
-    // indicates the name of the replaced entry
+    // indicates the name of the replaced entry. Leave it alone if another
+    // hpcstruct is using it right now; eviction will get to it later.
+    int lock = hpcstruct_cache_lock(cachedir, oldhash, false);
+    if (lock < 0) {
+      free(oldhash);
+      return 0;
+    }
+
     // First, try to remove the directory
-    std::string command("rm -rf ");
-    command += path;
-    system(command.c_str());
+    remove_tree(path);
 
     // check to see that it worked
     ckpath_ret_t ret = ck_path ( path.c_str(), "cache_cleanup" );
@@ -351,9 +491,7 @@ hpcstruct_cache_cleanup
     string fpath =  hpcstruct_cache_flat_entry(cachedir, oldhash );
 
     // Remove that entry
-    command = "rm -f " + fpath;
-
-    system(command.c_str());
+    unlink(fpath.c_str());
 
     // check to see that it worked
     ret = ck_path ( fpath.c_str(), "cache_cleanup -- FLAT" );
@@ -361,22 +499,15 @@ hpcstruct_cache_cleanup
       std::cerr << "ERROR: cache_cleanup FLAT of " << fpath.c_str() << " failed" << std::endl;
       exit(1);
     }
+
+    hpcstruct_cache_unlock(lock);
+    free(oldhash);
   }
 
   return 0;
 }
 
 
-static bool
-empty_string
-(
- const char *s
-)
-{
-  return s == 0 || *s == 0;
-}
-
-
 
 //***************************************************************************
 // interface operations
@@ -531,6 +662,153 @@ hpcstruct_cache_entry
 }
 
 
+// Take the advisory lock serializing work on the cache entries for a hash.
+//  Concurrent hpcstruct processes analyzing the same binary wait here for
+//  the first one to publish its result, rather than duplicating the work.
+//  Returns the lock, or -1 if it could not be taken.
+int
+hpcstruct_cache_lock
+(
+ const char *cache_dir,
+ const char *hash,
+ bool wait
+)
+{
+  if (empty_string(hash)) return -1;
+
+  hpctoolkit::stdshim::filesystem::path path = cache_dir;
+  path /= "LOCK";
+  if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) return -1;
+
+  path /= hash;
+  return lock_path(path.string(), wait);
+}
+
+
+void
+hpcstruct_cache_unlock
+(
+ int lock
+)
+{
+  if (lock >= 0) close(lock);
+}
+
+
+// Atomically publish a completed file as a cache entry, so readers never
+//  see a partially written structure file
+void
+hpcstruct_cache_publish
+(
+ const char *tmp_path,
+ const char *entry
+)
+{
+  if (rename(tmp_path, entry) != 0) {
+    std::cerr << "WARNING: unable to add " << entry << " to the structure cache: "
+              << strerror(errno) << std::endl;
+    unlink(tmp_path);
+  }
+}
+
+
+// Copy a cache entry to dst. The copy shares storage with the cache entry
+//  (a reflink) when the file system supports it, and replaces dst atomically.
+void
+hpcstruct_cache_retrieve
+(
+ const char *dst,
+ const char *entry
+)
+{
+  std::string tmp = std::string(dst) + ".tmp." + std::to_string(getpid());
+
+  bool cloned = false;
+#ifdef FICLONE
+  int src_fd = open(entry, O_RDONLY | O_CLOEXEC);
+  if (src_fd >= 0) {
+    int dst_fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dst_fd >= 0) {
+      cloned = ioctl(dst_fd, FICLONE, src_fd) == 0;
+      close(dst_fd);
+    }
+    close(src_fd);
+  }
+#endif
+  if (!cloned) {
+    FileUtil::copy(tmp, entry);
+  }
+
+  if (rename(tmp.c_str(), dst) != 0) {
+    unlink(tmp.c_str());
+    DIAG_Throw("Unable to write '" << dst << "' (" << strerror(errno) << ")");
+  }
+}
+
+
+// Record a use of the cache entry directory holding file entry, for eviction
+void
+hpcstruct_cache_touch
+(
+ const char *entry
+)
+{
+  std::string dir(entry);
+  size_t pos = dir.rfind('/');
+  if (pos == std::string::npos) return;
+  dir.erase(pos);
+
+  // the FLAT entry is a symbolic link to the PATH entry; update the target
+  utimensat(AT_FDCWD, dir.c_str(), NULL, 0);
+}
+
+
+// Evict least-recently used entries until the cache fits within the limit
+//  given by STRUCT_CACHE_LIMIT_ENV. Entries in use by other hpcstruct
+//  processes are skipped.
+void
+hpcstruct_cache_evict
+(
+ const char *cache_dir
+)
+{
+  unsigned long long limit = cache_size_limit();
+  if (limit == 0) return;
+
+  std::vector<CacheEntry> entries;
+  scan_cache_entries(std::string(cache_dir) + "/PATH", entries);
+
+  unsigned long long total = 0;
+  for (const auto &e : entries) total += e.bytes;
+  if (total <= limit) return;
+
+  std::sort(entries.begin(), entries.end(),
+    [](const CacheEntry &a, const CacheEntry &b) {
+      if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+      return a.used.tv_nsec < b.used.tv_nsec;
+    });
+
+  for (const auto &e : entries) {
+    if (total <= limit) break;
+
+    std::string hash = e.dir.substr(e.dir.rfind('/') + 1);
+    int lock = hpcstruct_cache_lock(cache_dir, hash.c_str(), false);
+    if (lock < 0) continue;
+
+    remove_tree(e.dir);
+    total -= e.bytes;
+
+    // drop the FLAT link if it pointed at the evicted entry
+    std::string flat = std::string(cache_dir) + "/FLAT/" + hash;
+    struct stat sb;
+    if (stat(flat.c_str(), &sb) != 0) unlink(flat.c_str());
+
+    unlink((std::string(cache_dir) + "/LOCK/" + hash).c_str());
+    hpcstruct_cache_unlock(lock);
+  }
+}
+
+
 // Routine to examine arguments, and set up the cache directory
 // Returns the absolute path to the top-level cache directory
 //  Returns NULL if no cache directory was specified
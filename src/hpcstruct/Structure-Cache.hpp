@@ -128,4 +128,50 @@ hpcstruct_cache_writable
  const char *cache_dir
 );
 
+
+int
+hpcstruct_cache_lock
+(
+ const char *cache_dir,
+ const char *hash, // hash for elf file
+ bool wait
+);
+
+
+void
+hpcstruct_cache_unlock
+(
+ int lock
+);
+
+
+void
+hpcstruct_cache_publish
+(
+ const char *tmp_path,
+ const char *entry
+);
+
+
+void
+hpcstruct_cache_retrieve
+(
+ const char *dst,
+ const char *entry
+);
+
+
+void
+hpcstruct_cache_touch
+(
+ const char *entry
+);
+
+
+void
+hpcstruct_cache_evict
+(
+ const char *cache_dir
+);
+
 #endif
@@ -35,7 +35,8 @@ public:
   //
   //    The fourth parameter, result, is the name of the output structure file
   //
-  //    When the cache is used, the output stream points to the cache'd structure file
+  //    When the cache is used, the output stream points to a temporary file beside the
+  //    cache'd structure file, which close() renames into place once complete.
   //    When it is not used, the output stream points to the actual output file.
   //
   void init(const char *cache_path_directory, const char *cache_flat_directory, const char *kind,
@@ -54,7 +55,10 @@ public:
   //
   void open() {
     if (!stream_name.empty()) {
-      stream = IOUtil::OpenOStream(stream_name.c_str());
+      if (use_cache) {
+        tmp_name = stream_name + ".tmp." + std::to_string(getpid());
+      }
+      stream = IOUtil::OpenOStream(tmp_name.empty() ? stream_name.c_str() : tmp_name.c_str());
       buffer = new char[HPCIO_RWBufferSz];
       stream->rdbuf()->pubsetbuf(buffer, HPCIO_RWBufferSz);
     }
@@ -67,6 +71,8 @@ public:
       if (use_cache && (hpcstruct_cache_find(flat_name.c_str()) ||
                         hpcstruct_cache_find(stream_name.c_str()))) {
         is_cached = true;
+        hpcstruct_cache_touch(hpcstruct_cache_find(flat_name.c_str())
+                              ? flat_name.c_str() : stream_name.c_str());
         if ( ( global_args->cache_stat != CACHE_DISABLED) && ( global_args->cache_stat != CACHE_NOT_NAMED) ) {
           global_args->cache_stat = CACHE_ENTRY_COPIED;
         }
@@ -101,19 +107,35 @@ public:
     return {};
   }
 
-  // finalize closes the output stream
-  void finalize(int error) {
+  // close closes the output stream, and publishes the new cache entry if
+  // the stream was written successfully
+  void close(int error) {
     if (stream) IOUtil::CloseStream(stream);
     if (buffer) delete[] buffer;
+    stream = 0;
+    buffer = 0;
+    if (!tmp_name.empty()) {
+      if (error) {
+        unlink(tmp_name.c_str());
+      } else {
+        hpcstruct_cache_publish(tmp_name.c_str(), stream_name.c_str());
+      }
+      tmp_name.clear();
+    }
+  };
+
+  // finalize closes the output stream and produces the output file
+  void finalize(int error) {
+    close(error);
     if (!name.empty()) {
       if (error) {
         unlink(name.c_str());
       } else {
         if (use_cache) {
           if (hpcstruct_cache_find(flat_name.c_str())) {
-            FileUtil::copy(name, flat_name);
+            hpcstruct_cache_retrieve(name.c_str(), flat_name.c_str());
           } else {
-            FileUtil::copy(name, stream_name);
+            hpcstruct_cache_retrieve(name.c_str(), stream_name.c_str());
           }
         }
       }
@@ -127,6 +149,7 @@ private:
   std::ostream *stream;
   std::string name;
   std::string stream_name;
+  std::string tmp_name;
   std::string flat_name;
   char *buffer;
   bool use_cache;
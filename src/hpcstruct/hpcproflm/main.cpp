@@ -85,14 +85,16 @@ getLoadModuleName(loadmap_entry_t* x)
 }
 
 
+// read the footer of the profile occupying [start, end) of the file
 static bool
-readFooter(FILE* fs, hpcrun_fmt_footer_t &footer)
+readFooter(FILE* fs, size_t start, size_t end, hpcrun_fmt_footer_t &footer)
 {
-  fseek(fs, 0, SEEK_END);
-  size_t footer_position = ftell(fs) - SF_footer_SIZE;
-  fseek(fs, footer_position, SEEK_SET);
+  if (end < start + SF_footer_SIZE) return false;
+  fseek(fs, end - SF_footer_SIZE, SEEK_SET);
 
-  return hpcrun_fmt_footer_fread(&footer, fs) == HPCFMT_OK;
+  if (hpcrun_fmt_footer_fread(&footer, fs) != HPCFMT_OK) return false;
+  hpcrun_sparse_footer_update_w_start(&footer, start);
+  return true;
 }
 
 
@@ -127,9 +129,21 @@ processProfile(const fs::path &path, std::unordered_set<std::string> &loadModule
    FILE* fs = hpcio_fopen_r(fnm);
    if (fs) {
     hpcrun_fmt_footer_t footer;
-    bool status = readFooter(fs, footer);
-    if (status) {
-      status = readLoadmap(fs, footer, loadModules);
+    bool status = true;
+    if (hpcrun_fmt_container_hdr_fread(fs) == HPCFMT_OK) {
+      // a container holds the profiles of all threads of a process
+      hpcrun_fmt_container_section_t section;
+      while (status && hpcrun_fmt_container_section_fread(&section, fs, malloc) == HPCFMT_OK) {
+        long next = ftell(fs);
+        status = readFooter(fs, section.start, section.end, footer)
+                 && readLoadmap(fs, footer, loadModules);
+        hpcrun_fmt_container_section_free(&section, free);
+        fseek(fs, next, SEEK_SET);
+      }
+    } else {
+      fseek(fs, 0, SEEK_END);
+      status = readFooter(fs, 0, ftell(fs), footer)
+               && readLoadmap(fs, footer, loadModules);
     }
     DIAG_WMsgIf(status == false, "unable to extract loadmap from profile " << filename);
     fclose(fs);
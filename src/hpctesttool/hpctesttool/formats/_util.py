@@ -82,6 +82,49 @@ class VersionedStructure:
         return self.unpack(version, read_nbytes(file, self.size(version), offset))
 
 
+def _read_varint(buf, pos: int):
+    out, shift = 0, 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        out |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return out, pos
+
+
+def read_packed_array(file, offset: int) -> typing.List[typing.Tuple[int, float]]:
+    """Read a packed array of id-value pairs from the file starting at offset. See the
+    "Packed value arrays" section of FORMATS.md for the encoding.
+    """
+    with preserve_filepos(file):
+        file.seek(offset)
+        count, pos = _read_varint(file.read(10), 0)
+        file.seek(offset + pos)
+        buf = file.read(count * 13)
+
+    out = []
+    pos, prev_id = 0, 0
+    try:
+        for _ in range(count):
+            hdr, pos = _read_varint(buf, pos)
+            delta = hdr >> 2
+            prev_id += -((delta >> 1) + 1) if delta & 1 else delta >> 1
+            tag = hdr & 0x3
+            if tag == 0:
+                value = 0.0
+            elif tag in (1, 2):
+                mag, pos = _read_varint(buf, pos)
+                value = float(mag) if tag == 1 else -float(mag)
+            else:
+                (value,) = struct.unpack_from("<d", buf, pos)
+                pos += 8
+            out.append((prev_id, value))
+    except (IndexError, struct.error) as e:
+        raise OSError("EOF reached before end of packed array!") from e
+    return out
+
+
 def read_ntstring(file, offset):
     """Read a null-terminated string from the file starting at offset, or the current stream
     position if None.
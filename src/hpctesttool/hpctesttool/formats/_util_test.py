@@ -6,7 +6,7 @@ import io
 
 import pytest
 
-from ._util import VersionedStructure, read_ntstring
+from ._util import VersionedStructure, read_ntstring, read_packed_array
 
 
 def test_versionedstructure():
@@ -31,3 +31,22 @@ def test_read_ntstring():
     src = io.BytesIO(b"FooBar\0")
     assert read_ntstring(src, offset=0) == "FooBar"
     assert read_ntstring(src, offset=3) == "Bar"
+
+
+def test_read_packed_array():
+    # Count of 4, then (2, 0.0), (5, 300.0), (4, -1.0) and (4, 0.5) as a raw f64
+    src = io.BytesIO(
+        b"\xff\x04"
+        + b"\x10"
+        + b"\x19\xac\x02"
+        + b"\x06\x01"
+        + b"\x03\x00\x00\x00\x00\x00\x00\xe0\x3f"
+    )
+    assert read_packed_array(src, offset=1) == [
+        (2, 0.0),
+        (5, 300.0),
+        (4, -1.0),
+        (4, 0.5),
+    ]
+    with pytest.raises(OSError, match=r"EOF reached before end of packed array"):
+        read_packed_array(io.BytesIO(b"\x02\x10"), offset=0)
@@ -854,7 +854,7 @@ class StrictDiff(DiffStrategy):
         self._isomorphic_update(a.traces, b.traces)
 
     @_key.register
-    @check_fields("prof_index", "line")
+    @check_fields("prof_index", "line", "levels")
     def _(self, o: v4.tracedb.ContextTrace, *, side_a: bool):
         if isinstance(self.a, v4.Database):
             assert isinstance(self.b, v4.Database)
@@ -864,7 +864,7 @@ class StrictDiff(DiffStrategy):
         return (self._key_m(o.prof_index, side_a=side_a, key=key),)
 
     @_update.register
-    @check_fields("prof_index", "line")
+    @check_fields("prof_index", "line", "levels")
     def _(self, a: v4.tracedb.ContextTrace, b: v4.tracedb.ContextTrace):
         assert self._key_a(a) == self._key_b(b)
         if isinstance(self.a, v4.Database):
@@ -877,6 +877,8 @@ class StrictDiff(DiffStrategy):
         else:
             self.altered[a] = b
         self._sequential_update(a.line, b.line)
+        for la, lb in itertools.zip_longest(a.levels, b.levels, fillvalue=[]):
+            self._sequential_update(la, lb)
 
     @_update.register
     @check_fields("timestamp", "ctx_id")
@@ -5,7 +5,7 @@
 import dataclasses
 import typing
 
-from .._util import VersionedStructure
+from .._util import VersionedStructure, read_packed_array
 from ..base import DatabaseFile, StructureBase, _CommentedMap, yaml_object
 
 if typing.TYPE_CHECKING:
@@ -31,7 +31,7 @@ class ContextDB(DatabaseFile):
     """The cct.db file format."""
 
     major_version = 4
-    max_minor_version = 0
+    max_minor_version = 1
     format_code = b"ctxt"
     footer_code = b"__ctx.db"
 
@@ -107,6 +107,8 @@ class PerContext(StructureBase):
         valueBlock_pValues=(0, 0x08, "Q"),
         valueBlock_nMetrics=(0, 0x10, "H"),
         valueBlock_pMetricIndices=(0, 0x18, "Q"),
+        # Added in v4.1
+        valueBlock_flags=(1, 0x12, "B"),
     )
 
     __value = VersionedStructure(
@@ -147,14 +149,6 @@ class PerContext(StructureBase):
     @classmethod
     def from_file(cls, version: int, file, offset: int):
         data = cls.__struct.unpack_file(version, file, offset)
-        values = [
-            cls.__value.unpack_file(0, file, o)
-            for o in scaled_range(
-                data["valueBlock_pValues"],
-                data["valueBlock_nValues"],
-                cls.__value.size(0),
-            )
-        ]
         met_indices = [
             cls.__met_idx.unpack_file(0, file, o)
             for o in scaled_range(
@@ -163,6 +157,27 @@ class PerContext(StructureBase):
                 cls.__met_idx.size(0),
             )
         ]
+        if data.get("valueBlock_flags", 0) & 0x1:
+            # startIndex is the byte offset of each metric's packed array
+            return cls(
+                values={
+                    idx["metricId"]: dict(
+                        read_packed_array(
+                            file, data["valueBlock_pValues"] + idx["startIndex"]
+                        )
+                    )
+                    for idx in met_indices
+                }
+            )
+
+        values = [
+            cls.__value.unpack_file(0, file, o)
+            for o in scaled_range(
+                data["valueBlock_pValues"],
+                data["valueBlock_nValues"],
+                cls.__value.size(0),
+            )
+        ]
         return cls(
             values={
                 idx["metricId"]: {
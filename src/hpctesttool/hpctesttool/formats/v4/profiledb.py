@@ -6,7 +6,7 @@ import dataclasses
 import functools
 import typing
 
-from .._util import VersionedStructure
+from .._util import VersionedStructure, read_packed_array
 from ..base import (
     BitFlags,
     DatabaseFile,
@@ -40,7 +40,7 @@ class ProfileDB(DatabaseFile):
     """The profile.db file format."""
 
     major_version = 4
-    max_minor_version = 0
+    max_minor_version = 1
     format_code = b"prof"
     footer_code = b"_prof.db"
 
@@ -112,6 +112,8 @@ class Profile(StructureBase):
     class Flags(BitFlags):
         # Added in v4.0
         is_summary = EnumEntry(0, min_version=0)
+        # Added in v4.1
+        is_packed = EnumEntry(1, min_version=1)
 
     id_tuple: typing.Optional["IdentifierTuple"]
     flags: Flags
@@ -160,14 +162,7 @@ class Profile(StructureBase):
     @classmethod
     def from_file(cls, version: int, file, offset: int):
         data = cls.__struct.unpack_file(version, file, offset)
-        values = [
-            cls.__value.unpack_file(0, file, o)
-            for o in scaled_range(
-                data["valueBlock_pValues"],
-                data["valueBlock_nValues"],
-                cls.__value.size(0),
-            )
-        ]
+        flags = cls.Flags.versioned_decode(version, data["flags"])
         ctx_indices = [
             cls.__ctx_idx.unpack_file(0, file, o)
             for o in scaled_range(
@@ -176,17 +171,29 @@ class Profile(StructureBase):
                 cls.__ctx_idx.size(0),
             )
         ]
-        return cls(
-            id_tuple=(
-                IdentifierTuple.from_file(version, file, data["pIdTuple"])
-                if data["pIdTuple"] != 0
-                else None
-            ),
-            flags=cls.Flags.versioned_decode(version, data["flags"]),
-            values={
+        if cls.Flags.is_packed in flags:
+            # startIndex is the byte offset of each context's packed array
+            values = {
+                idx["ctxId"]: dict(
+                    read_packed_array(
+                        file, data["valueBlock_pValues"] + idx["startIndex"]
+                    )
+                )
+                for idx in ctx_indices
+            }
+        else:
+            raw_values = [
+                cls.__value.unpack_file(0, file, o)
+                for o in scaled_range(
+                    data["valueBlock_pValues"],
+                    data["valueBlock_nValues"],
+                    cls.__value.size(0),
+                )
+            ]
+            values = {
                 idx["ctxId"]: {
                     val["metricId"]: val["value"]
-                    for val in values[
+                    for val in raw_values[
                         idx["startIndex"] : (
                             ctx_indices[i + 1]["startIndex"]
                             if i + 1 < len(ctx_indices)
@@ -195,7 +202,15 @@ class Profile(StructureBase):
                     ]
                 }
                 for i, idx in enumerate(ctx_indices)
-            },
+            }
+        return cls(
+            id_tuple=(
+                IdentifierTuple.from_file(version, file, data["pIdTuple"])
+                if data["pIdTuple"] != 0
+                else None
+            ),
+            flags=flags,
+            values=values,
         )
 
     @classmethod
@@ -18,6 +18,8 @@ __all__ = [
     "ContextTraceHeadersSection",
     "ContextTrace",
     "ContextTraceElement",
+    # v4.1
+    "ContextTraceLevelsSection",
 ]
 
 
@@ -27,7 +29,7 @@ class TraceDB(DatabaseFile):
     """The trace.db file format."""
 
     major_version = 4
-    max_minor_version = 0
+    max_minor_version = 1
     format_code = b"trce"
     footer_code = b"trace.db"
 
@@ -36,6 +38,8 @@ class TraceDB(DatabaseFile):
     __struct = DatabaseFile._header_struct(
         # Added in v4.0
         CtxTraces=(0,),
+        # Added in v4.1
+        CtxTraceLevels=(1,),
     )
 
     def _with(self, meta: "MetaDB", profile: "ProfileDB"):
@@ -45,11 +49,16 @@ class TraceDB(DatabaseFile):
     def from_file(cls, file):
         minor = cls._parse_header(file)
         sections = cls.__struct.unpack_file(minor, file, 0)
-        return cls(
-            ctx_traces=ContextTraceHeadersSection.from_file(
-                minor, file, sections["pCtxTraces"]
-            ),
+        ctx_traces = ContextTraceHeadersSection.from_file(
+            minor, file, sections["pCtxTraces"]
         )
+        if sections.get("szCtxTraceLevels", 0) > 0:
+            levels = ContextTraceLevelsSection.from_file(
+                minor, file, sections["pCtxTraceLevels"]
+            )
+            for trace, trace_levels in zip(ctx_traces.traces, levels):
+                trace.levels = trace_levels
+        return cls(ctx_traces=ctx_traces)
 
 
 @yaml_object(yaml_tag="!trace.db/v4/ContextTraceHeaders")
@@ -99,6 +108,10 @@ class ContextTrace(StructureBase):
 
     prof_index: int
     line: typing.List["ContextTraceElement"]
+    # Added in v4.1, summary levels of the line from finest to coarsest
+    levels: typing.List[typing.List["ContextTraceElement"]] = dataclasses.field(
+        default_factory=list
+    )
 
     __struct = VersionedStructure(
         "<",
@@ -131,6 +144,7 @@ class ContextTrace(StructureBase):
 
     def __setstate__(self, state):
         self.__dict__.update(state)
+        self.__dict__.setdefault("levels", [])
         for e in self.line:
             e._with_first(self.line[0].timestamp)
 
@@ -139,6 +153,9 @@ class ContextTrace(StructureBase):
             self._profile = profile.profile_map[self.prof_index]
         for e in self.line:
             e._with(meta)
+        for level in self.levels:
+            for e in level:
+                e._with(meta)
 
     @classmethod
     def from_file(cls, version, file, offset):
@@ -153,6 +170,57 @@ class ContextTrace(StructureBase):
         )
 
 
+class ContextTraceLevelsSection:
+    """trace.db Context Trace Levels section. Only used while reading, the levels are
+    stored in the ContextTrace they belong to."""
+
+    __struct = VersionedStructure(
+        "<",
+        # Added in v4.1
+        pTraces=(1, 0x00, "Q"),
+        nTraces=(1, 0x08, "L"),
+        szTrace=(1, 0x0C, "B"),
+        log2Fanout=(1, 0x0D, "B"),
+    )
+    __levels = VersionedStructure(
+        "<",
+        # Added in v4.1
+        pLevels=(1, 0x00, "Q"),
+        nLevels=(1, 0x08, "B"),
+    )
+    __level = VersionedStructure(
+        # Fixed structure
+        "<",
+        pStart=(-1, 0x00, "Q"),
+        pEnd=(-1, 0x08, "Q"),
+    )
+
+    @classmethod
+    def from_file(cls, version: int, file, offset: int):
+        """Read the summary levels for each trace, in the order of the traces."""
+        data = cls.__struct.unpack_file(version, file, offset)
+        result = []
+        for i in range(data["nTraces"]):
+            ctl = cls.__levels.unpack_file(
+                version, file, data["pTraces"] + data["szTrace"] * i
+            )
+            levels = []
+            for j in range(ctl["nLevels"]):
+                tl = cls.__level.unpack_file(
+                    0, file, ctl["pLevels"] + cls.__level.size(0) * j
+                )
+                levels.append(
+                    [
+                        ContextTraceElement.from_file(file, o)
+                        for o in range(
+                            tl["pStart"], tl["pEnd"], ContextTraceElement.size
+                        )
+                    ]
+                )
+            result.append(levels)
+        return result
+
+
 @yaml_object(yaml_tag="!trace.db/v4/ContextTraceElement")
 @dataclasses.dataclass(eq=False)
 class ContextTraceElement(StructureBase):
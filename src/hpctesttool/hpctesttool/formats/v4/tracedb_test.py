@@ -3,6 +3,8 @@
 # SPDX-License-Identifier: BSD-3-Clause
 
 import dataclasses
+import io
+import struct
 
 from .._test_util import assert_good_traversal, dump_to_string, testdatadir, yaml
 from .tracedb import TraceDB
@@ -20,6 +22,29 @@ def test_small_v4_0(yaml):
     assert dataclasses.asdict(got) == dataclasses.asdict(expected)
 
 
+def test_levels_v4_1():
+    # One trace of 2 elements with a single summary level of 1 element
+    f = bytearray(0x100)
+    f[0x00:0x10] = b"HPCTOOLKITtrce\x04\x01"
+    struct.pack_into("<QQQQ", f, 0x10, 0x38, 0x30, 0x20, 0x68)
+    struct.pack_into("<QLB", f, 0x30, 0x50, 1, 0x18)
+    struct.pack_into("<QQ", f, 0x40, 42, 48)
+    struct.pack_into("<LxxxxQQ", f, 0x50, 1, 0x88, 0xA0)
+    struct.pack_into("<QLBB", f, 0x68, 0x78, 1, 0x10, 2)
+    struct.pack_into("<QB", f, 0x78, 0xA0, 1)
+    struct.pack_into("<QLQL", f, 0x88, 42, 1, 48, 2)
+    struct.pack_into("<QQ", f, 0xA0, 0xB0, 0xBC)
+    struct.pack_into("<QL", f, 0xB0, 42, 2)
+    f[-8:] = b"trace.db"
+
+    got = TraceDB.from_file(io.BytesIO(bytes(f)))
+    (trace,) = got.ctx_traces.traces
+    assert [(e.timestamp, e.ctx_id) for e in trace.line] == [(42, 1), (48, 2)]
+    assert [[(e.timestamp, e.ctx_id) for e in lv] for lv in trace.levels] == [
+        [(42, 2)]
+    ]
+
+
 def test_yaml_rt(yaml):
     orig = yaml.load(
         """
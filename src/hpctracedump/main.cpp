@@ -63,11 +63,17 @@ main(int argc, char **argv)
     exit(-1);
   }
 
-  // read and dump trace records until EOF
-  while ( !feof(infs) ) {
+  bool packed = HPCTRACE_HDR_FLAGS_GET_BIT(hdr.flags, HPCTRACE_HDR_FLAGS_PACKED_BIT_POS);
+  hpctrace_fmt_packed_t* pstate = new hpctrace_fmt_packed_t;
+  hpctrace_fmt_packed_init(pstate);
+
+  // read and dump trace records until EOF (packed records may still be
+  // buffered once the end of the file has been reached)
+  while ( pstate->nSamples > 0 || !feof(infs) ) {
     hpctrace_fmt_datum_t datum;
 
-    ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
+    ret = packed ? hpctrace_fmt_packed_datum_fread(&datum, hdr.flags, pstate, infs)
+                 : hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
 
     if (ret == HPCFMT_EOF) {
       break;
@@ -82,6 +88,7 @@ main(int argc, char **argv)
 
   hpcio_fclose(infs);
 
+  delete pstate;
   delete[] infsBuf;
 
   return 0;
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: Contributors to the HPCToolkit Project
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Microbenchmark for the memleak allocation tracking: every thread
+// repeatedly allocates and frees a window of aligned blocks (which are
+// always tracked out-of-line) and the mean time per malloc/free pair is
+// reported.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WINDOW 64
+
+static long iterations = 200000;
+
+static void* worker(void* arg) {
+  void* blocks[WINDOW] = {NULL};
+  for (long i = 0; i < iterations; i++) {
+    int slot = i % WINDOW;
+    free(blocks[slot]);
+    if (posix_memalign(&blocks[slot], 64, 16 + (i % 256)) != 0)
+      abort();
+  }
+  for (int slot = 0; slot < WINDOW; slot++)
+    free(blocks[slot]);
+  return arg;
+}
+
+int main(int argc, char* argv[]) {
+  int nthreads = argc > 1 ? atoi(argv[1]) : 4;
+  if (argc > 2)
+    iterations = atol(argv[2]);
+  if (nthreads < 1)
+    nthreads = 1;
+
+  pthread_t* threads = malloc(nthreads * sizeof *threads);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < nthreads; i++)
+    pthread_create(&threads[i], NULL, worker, NULL);
+  for (int i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  free(threads);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%d threads: %.1f ns per malloc/free pair\n", nthreads,
+         ns / ((double)nthreads * iterations));
+  return 0;
+}